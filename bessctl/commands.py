@@ -1000,12 +1000,9 @@ def command_module(cli, module, cmd, arg_type, args):
     if args is None:
         args = {}
 
-    cli.bess.pause_all()
-    try:
-        ret = cli.bess.run_module_command(module, cmd, arg_type, args)
-        cli.fout.write('response: %s\n' % repr(ret))
-    finally:
-        cli.bess.resume_all()
+    # bessd holds running workers for commands that are not thread safe
+    ret = cli.bess.run_module_command(module, cmd, arg_type, args)
+    cli.fout.write('response: %s\n' % repr(ret))
 
 
 @cmd('command gatehook GATEHOOK MODULE DIRECTION GATE GATEHOOK_CMD ARG_TYPE [CMD_ARGS...]',
@@ -1014,13 +1011,10 @@ def command_gatehook(cli, name, module, direction, gate, cmd, arg_type, args):
     if args is None:
         args = {}
 
-    cli.bess.pause_all()
-    try:
-        ret = cli.bess.run_gatehook_command(name, module, direction, gate, cmd,
-                                            arg_type, args)
-        cli.fout.write('response: %s\n' % repr(ret))
-    finally:
-        cli.bess.resume_all()
+    # bessd holds running workers for commands that are not thread safe
+    ret = cli.bess.run_gatehook_command(name, module, direction, gate, cmd,
+                                        arg_type, args)
+    cli.fout.write('response: %s\n' % repr(ret))
 
 
 # Please do not rely on this API. This API may be replaced with `command port PORT`
@@ -1055,17 +1049,19 @@ def delete_module(cli, module):
         cli.bess.resume_all()
 
 
-@cmd('delete connection MODULE ogate [OGATE]',
+@cmd('delete connection MODULE ogate [OGATE] [PAUSE_WORKERS]',
      'Delete a connection between two modules')
-def delete_connection(cli, module, ogate):
+def delete_connection(cli, module, ogate, pause_workers='pause'):
     if ogate is None:
         ogate = 0
 
-    cli.bess.pause_all()
+    if pause_workers != 'no_pause':
+        cli.bess.pause_all()
     try:
         cli.bess.disconnect_modules(module, ogate)
     finally:
-        cli.bess.resume_all()
+        if pause_workers != 'no_pause':
+            cli.bess.resume_all()
 
 
 def _show_worker_header(cli):
@@ -1234,10 +1230,27 @@ def _build_tcs_tree(tcs):
                     c_.HasField("priority")):
                 nodes[c_.name]["show_list"].append(
                     "priority: %d" % c_.priority)
+            elif (nodes[tc.parent]["policy"] == "deadline" and
+                    c_.HasField("deadline_ns")):
+                nodes[c_.name]["show_list"].append(
+                    "deadline: %.3f us" % (c_.deadline_ns / 1e3))
 
         if c_.policy == "rate_limit":
             nodes[c_.name]["show_list"].append(_limit_to_str(c_.limit))
-            nodes[c_.name]["show_list"].append(_burst_to_str(c_.max_burst))
+            if c_.pacing_gap_ns:
+                nodes[c_.name]["show_list"].append(
+                    'pacing: %.3f us' % (c_.pacing_gap_ns / 1e3))
+            else:
+                nodes[c_.name]["show_list"].append(
+                    _burst_to_str(c_.max_burst))
+
+        if c_.policy == "leaf":
+            if c_.run_budget_cycles:
+                nodes[c_.name]["show_list"].append(
+                    'budget: %d cycles' % c_.run_budget_cycles)
+            if c_.run_budget_packets:
+                nodes[c_.name]["show_list"].append(
+                    'budget: %d packets' % c_.run_budget_packets)
 
     return root
 
@@ -1541,6 +1554,16 @@ def _show_module(cli, module_name):
                  ', '.join("%s::%s" % (h.class_name, h.hook_name)
                            for h in gate.gatehooks)))
     cli.fout.write('    Deadends: %-12d\n' % (info.deadends,))
+    for reason, cnt in sorted(info.drops.reasons.items()):
+        cli.fout.write('      %-12s %d\n' % (reason, cnt))
+    if info.alloc_failures:
+        cli.fout.write('    Allocation failures: %d\n' % (info.alloc_failures,))
+
+    if info.HasField('profile'):
+        p = info.profile
+        cli.fout.write('    Profile: calls %-11d packets in %-12d '
+                       'out %-12d cycles %d\n' %
+                       (p.cnt, p.pkts_in, p.pkts_out, p.cycles))
 
     if hasattr(info, 'dump'):
         dump_str = pprint.pformat(info.dump, width=74)
@@ -1566,6 +1589,49 @@ def show_module_list(cli, module_names):
         _show_module(cli, module_name)
 
 
+@cmd('show drops', 'Show packet drops of all modules by reason')
+def show_drops(cli):
+    modules = cli.bess.get_drop_stats().modules
+
+    if not modules:
+        cli.fout.write('No packet has been dropped.\n')
+        return
+
+    for module in modules:
+        cli.fout.write('  %s\n' % module.name)
+        for reason, cnt in sorted(module.drops.reasons.items()):
+            per_worker = ', '.join(
+                'W%d %d' % (w.wid, w.reasons[reason])
+                for w in module.worker_drops if reason in w.reasons)
+            cli.fout.write('    %-12s %-12d (%s)\n' % (reason, cnt, per_worker))
+
+
+@cmd('show profile', 'Show the per-module profile of the pipeline')
+def show_profile(cli):
+    profile = cli.bess.get_pipeline_profile()
+
+    if not profile.frames:
+        raise cli.CommandError('No module has been profiled. '
+                               'Run "profile enable" first.')
+
+    if not profile.enabled:
+        cli.fout.write('  (profiling is currently disabled)\n')
+
+    cli.fout.write('  %-40s %10s %12s %12s %10s %6s\n' %
+                   ('Stack', 'calls', 'pkts_in', 'pkts_out',
+                    'cycles/pkt', 'cycle%'))
+
+    for frame in sorted(profile.frames, key=lambda f: -f.profile.cycles):
+        p = frame.profile
+        pkts = max(p.pkts_in, p.pkts_out)
+        cycles_per_pkt = p.cycles / pkts if pkts else 0.0
+        share = 100.0 * p.cycles / profile.total_cycles \
+            if profile.total_cycles else 0.0
+        cli.fout.write('  %-40s %10d %12d %12d %10.1f %6.2f\n' %
+                       (frame.stack, p.cnt, p.pkts_in, p.pkts_out,
+                        cycles_per_pkt, share))
+
+
 def _show_mclass(cli, cls_name, detail):
     info = cli.bess.get_mclass_info(cls_name)
     cli.fout.write('%-16s %s\n' % (info.name, info.help))
@@ -2071,6 +2137,59 @@ def track_reset(cli, module_name, direction, gate):
                               'EmptyArg', {})
 
 
+@cmd('profile ENABLE_DISABLE',
+     'Count calls, packets, and CPU cycles of every module')
+def profile_modules(cli, flag):
+    cli.bess.configure_module_profiling(flag == 'enable')
+
+
+@cmd('profile reset', 'Reset the per-module profiles')
+def profile_reset(cli):
+    enabled = cli.bess.get_pipeline_profile().enabled
+    cli.bess.configure_module_profiling(enabled, reset=True)
+
+
+def _show_partition(cli, proposal):
+    for i, stage in enumerate(proposal.stages):
+        wid = 'any' if stage.wid < 0 else stage.wid
+        cli.fout.write('  Stage %d (worker %s): %.1f cycles/pkt\n' %
+                       (i, wid, stage.cycles_per_pkt))
+        cli.fout.write('    %s\n' % ', '.join(stage.modules))
+
+    for cut in proposal.cuts:
+        cli.fout.write('  Queue at %s:%d (worker %d)\n' %
+                       (cut.name, cut.ogate, cut.wid))
+
+    cli.fout.write('  Throughput: %.3f Mpps -> %.3f Mpps (estimated)\n' %
+                   (proposal.current_pps / 1e6, proposal.expected_pps / 1e6))
+
+
+@cmd('show partition MODULE WORKER_ID...',
+     'Show a split of the pipeline of a task module across workers')
+def show_partition(cli, module_name, worker_ids):
+    _show_partition(cli, cli.bess.propose_pipeline_partition(module_name,
+                                                             worker_ids))
+
+
+def _apply_partition(cli, cuts):
+    response = cli.bess.apply_pipeline_partition(cuts)
+    cli.fout.write('  Added %s\n' % ', '.join(response.queues))
+
+
+@cmd('partition MODULE WORKER_ID...',
+     'Split the pipeline of a task module across workers with Queues')
+def partition_pipeline(cli, module_name, worker_ids):
+    proposal = cli.bess.propose_pipeline_partition(module_name, worker_ids)
+    _show_partition(cli, proposal)
+
+    if not proposal.cuts:
+        cli.fout.write('No change is needed.\n')
+        return
+
+    warn(cli, 'The pipeline will be rewired with %d Queue modules.' %
+         len(proposal.cuts), _apply_partition, proposal.cuts)
+
+
 @cmd('interactive', 'Switch to interactive mode')
 def interactive(cli):
     if cli.interactive:
@@ -2108,9 +2227,27 @@ def show_system_packets(cli, socket):
         cli.fout.write('\tmp_available_count: {}\n'.format(
             dump.mp_available_count))
         cli.fout.write('\tmp_in_use_count: {}\n'.format(dump.mp_in_use_count))
+        cli.fout.write('\tmp_peak_in_use_count: {}\n'.format(
+            dump.mp_peak_in_use_count))
+        cli.fout.write('\tgrow_count: {} ({} failed)\n'.format(
+            dump.grow_count, dump.grow_failures))
         cli.fout.write('\tring_count: {}\n'.format(dump.ring_count))
         cli.fout.write('\tring_free_count: {}\n'.format(dump.ring_free_count))
         cli.fout.write('\tring_bytes: {}\n'.format(dump.ring_bytes))
+        cli.fout.write('\tworker_cache_size: {}\n'.format(
+            dump.worker_cache_size))
+        if not dump.worker_cache_size:
+            continue
+        cli.fout.write('\tworker_cache_count: {}\n'.format(
+            dump.worker_cache_count))
+        cli.fout.write('\tworker_cache_allocs: {}\n'.format(
+            dump.worker_cache_allocs))
+        cli.fout.write('\tworker_cache_frees: {} ({} remote)\n'.format(
+            dump.worker_cache_frees, dump.worker_cache_remote_frees))
+        cli.fout.write('\tworker_cache_refills: {}\n'.format(
+            dump.worker_cache_refills))
+        cli.fout.write('\tworker_cache_flushes: {}\n'.format(
+            dump.worker_cache_flushes))
 
 
 @cmd('http [HOST] [PORT_NUMBER]', 'Run an HTTP server')
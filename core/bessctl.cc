@@ -31,6 +31,7 @@
 
 #include "bessctl.h"
 
+#include <queue>
 #include <thread>
 
 #include <gflags/gflags.h>
@@ -311,6 +312,115 @@ static int collect_metadata(Module* m, GetModuleInfoResponse* response) {
   return 0;
 }
 
+// Sums up the per-worker profiles of the module into 'sum', and also adds those
+// of the workers that ran it to 'per_worker' unless it is null. Returns false
+// if the module has never been profiled.
+static bool collect_profile(
+    const Module* m, bess::pb::ModuleProfile* sum,
+    google::protobuf::RepeatedPtrField<bess::pb::ModuleProfile>* per_worker) {
+  const ::ModuleProfile* profile = m->profile();
+  if (!profile) {
+    return false;
+  }
+
+  // Workers keep counting. Each counter is consistent, but not as a whole.
+  sum->set_wid(-1);
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    const ::ModuleProfile& p = profile[wid];
+    uint64_t cnt = p.cnt;
+    if (!cnt) {
+      continue;
+    }
+
+    uint64_t pkts_in = p.pkts_in;
+    uint64_t pkts_out = p.pkts_out;
+    uint64_t cycles = p.cycles;
+
+    sum->set_cnt(sum->cnt() + cnt);
+    sum->set_pkts_in(sum->pkts_in() + pkts_in);
+    sum->set_pkts_out(sum->pkts_out() + pkts_out);
+    sum->set_cycles(sum->cycles() + cycles);
+
+    if (per_worker) {
+      bess::pb::ModuleProfile* w = per_worker->Add();
+      w->set_wid(wid);
+      w->set_cnt(cnt);
+      w->set_pkts_in(pkts_in);
+      w->set_pkts_out(pkts_out);
+      w->set_cycles(cycles);
+    }
+  }
+
+  return true;
+}
+
+// Fills in the drops of a module by reason, only those matching 'reason'
+// unless it is empty. Returns false if no such packet has been dropped.
+static bool collect_drops(
+    const Module* m, const std::string& reason, bess::pb::ModuleDrops* sum,
+    google::protobuf::RepeatedPtrField<bess::pb::ModuleDrops>* per_worker) {
+  bool found = false;
+
+  sum->set_wid(-1);
+  auto* sum_reasons = sum->mutable_reasons();
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    const DropCounts& counts = m->drops(wid);
+    bess::pb::ModuleDrops* w = nullptr;
+
+    for (size_t i = 0; i < counts.size(); i++) {
+      // Workers keep counting, so each counter is read only once.
+      uint64_t cnt = counts[i];
+      const char* name = DropReasonName(static_cast<DropReason>(i));
+      if (!cnt || (!reason.empty() && reason != name)) {
+        continue;
+      }
+
+      found = true;
+      (*sum_reasons)[name] += cnt;
+      if (per_worker) {
+        if (!w) {
+          w = per_worker->Add();
+          w->set_wid(wid);
+        }
+        (*w->mutable_reasons())[name] = cnt;
+      }
+    }
+  }
+
+  return found;
+}
+
+// Returns the shortest path from a task module to each reachable module, as
+// ';'-separated module names.
+static std::map<const Module*, std::string> collect_stacks() {
+  std::map<const Module*, std::string> stacks;
+  std::queue<const Module*> q;
+
+  for (const auto& it : ModuleGraph::GetAllModules()) {
+    if (it.second->is_task()) {
+      stacks.emplace(it.second, it.second->name());
+      q.push(it.second);
+    }
+  }
+
+  while (!q.empty()) {
+    const Module* m = q.front();
+    q.pop();
+
+    for (const bess::OGate* ogate : m->ogates()) {
+      if (!ogate) {
+        continue;
+      }
+      const Module* next = ogate->next();
+      if (stacks.emplace(next, stacks[m] + ";" + next->name()).second) {
+        q.push(next);
+      }
+    }
+  }
+
+  return stacks;
+}
+
 static ::Port* create_port(const std::string& name, const PortBuilder& driver,
                            queue_t num_inc_q, queue_t num_out_q,
                            size_t size_inc_q, size_t size_out_q,
@@ -418,6 +528,7 @@ static void collect_tc(const bess::TrafficClass* c, int wid,
     status->mutable_class_()->mutable_limit()->insert({resource, limit});
     status->mutable_class_()->mutable_max_burst()->insert(
         {resource, max_burst});
+    status->mutable_class_()->set_pacing_gap_ns(rl->pacing_gap_ns());
   } else if (c->policy() == bess::POLICY_LEAF) {
     const bess::LeafTrafficClass* leaf =
         static_cast<const bess::LeafTrafficClass*>(c);
@@ -430,6 +541,9 @@ static void collect_tc(const bess::TrafficClass* c, int wid,
     CHECK(it != module->tasks().end());
     uint64_t task_id = it - module->tasks().begin();
     status->mutable_class_()->set_leaf_module_taskid(task_id);
+    status->mutable_class_()->set_run_budget_cycles(leaf->run_budget_cycles());
+    status->mutable_class_()->set_run_budget_packets(
+        leaf->run_budget_packets());
   }
 }
 
@@ -551,10 +665,84 @@ class BESSControlImpl final : public BESSControl::Service {
       status->set_core(workers[wid]->core());
       status->set_num_tcs(workers[wid]->scheduler()->NumTcs());
       status->set_silent_drops(workers[wid]->silent_drops());
+
+      const bess::sched_stats& stats = workers[wid]->scheduler()->stats();
+      status->set_idle_sleeps(stats.cnt_sleep);
+      status->set_idle_sleep_ns(tsc_to_ns(stats.cycles_sleep));
+      if (stats.cnt_timer_wakeup) {
+        status->set_wakeup_jitter_avg_ns(
+            tsc_to_ns(stats.cycles_wakeup_jitter.value() /
+                      stats.cnt_timer_wakeup.value()));
+      }
+      status->set_wakeup_jitter_max_ns(
+          tsc_to_ns(stats.max_cycles_wakeup_jitter));
     }
     return Status::OK;
   }
 
+  Status GetWorkerStats(ServerContext*, const GetWorkerStatsRequest* request,
+                        GetWorkerStatsResponse* response) override {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    std::vector<int> wids;
+    for (int64_t wid : request->wids()) {
+      if (wid < 0 || wid >= Worker::kMaxWorkers) {
+        return return_with_error(response, EINVAL, "Invalid worker id");
+      }
+      if (!is_worker_active(wid)) {
+        return return_with_error(response, ENOENT, "Worker %d is not active",
+                                 static_cast<int>(wid));
+      }
+      wids.push_back(wid);
+    }
+
+    if (wids.empty()) {
+      for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+        if (is_worker_active(wid)) {
+          wids.push_back(wid);
+        }
+      }
+    }
+
+    // Workers keep running. The counters are individually consistent, but not
+    // necessarily as a whole.
+    response->set_timestamp(get_epoch_time());
+    response->set_tsc_hz(tsc_hz);
+
+    for (int wid : wids) {
+      const bess::sched_stats& stats = workers[wid]->scheduler()->stats();
+      GetWorkerStatsResponse_WorkerStats* s = response->add_stats();
+
+      uint64_t cycles = stats.usage[bess::RESOURCE_CYCLE];
+      uint64_t packets = stats.usage[bess::RESOURCE_PACKET];
+      uint64_t idle_cycles = stats.cycles_idle;
+
+      s->set_wid(wid);
+      s->set_count(stats.usage[bess::RESOURCE_COUNT]);
+      s->set_cycles(cycles);
+      s->set_packets(packets);
+      s->set_bits(stats.usage[bess::RESOURCE_BIT]);
+      s->set_idle_count(stats.cnt_idle);
+      s->set_idle_cycles(idle_cycles);
+
+      if (cycles + idle_cycles) {
+        double total = cycles + idle_cycles;
+        s->set_busy_ratio(cycles / total);
+        s->set_idle_ratio(idle_cycles / total);
+      }
+      if (cycles) {
+        s->set_packets_per_cycle(static_cast<double>(packets) / cycles);
+      }
+
+      for (int i = 0; i < bess::sched_stats::kNumRunLengthBuckets; i++) {
+        s->add_run_length_hist(stats.run_length_hist[i]);
+      }
+      s->set_budget_rerun_count(stats.cnt_budget_rerun);
+    }
+
+    return Status::OK;
+  }
+
   Status AddWorker(ServerContext*, const AddWorkerRequest* request,
                    EmptyResponse* response) override {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
@@ -577,7 +765,23 @@ class BESSControlImpl final : public BESSControl::Service {
                                scheduler.c_str());
     }
 
-    launch_worker(wid, core, scheduler);
+    bess::SchedulerOpts opts;
+    opts.idle_sleep = request->idle_sleep();
+    if (request->idle_max_sleep_us()) {
+      opts.idle_max_sleep_us = request->idle_max_sleep_us();
+    }
+    if (request->idle_wakeup_margin_us()) {
+      opts.idle_wakeup_margin_us = request->idle_wakeup_margin_us();
+    }
+    opts.wakeup_timing_wheel = request->wakeup_timing_wheel();
+    opts.work_stealing = request->work_stealing();
+    if (opts.idle_wakeup_margin_us >= opts.idle_max_sleep_us) {
+      return return_with_error(
+          response, EINVAL,
+          "idle_wakeup_margin_us must be smaller than idle_max_sleep_us");
+    }
+
+    launch_worker(wid, core, scheduler, opts);
     return Status::OK;
   }
 
@@ -607,6 +811,13 @@ class BESSControlImpl final : public BESSControl::Service {
       }
     }
 
+    // Work stealing peers keep pointers to each other's scheduler. Let them
+    // forget this one.
+    std::unique_ptr<WorkerPauser> wp;
+    if (worker->scheduler()->opts().work_stealing) {
+      wp.reset(new WorkerPauser());
+    }
+
     destroy_worker(wid);
     return Status::OK;
   }
@@ -641,7 +852,8 @@ class BESSControlImpl final : public BESSControl::Service {
       bess::TrafficClass* c = tc_pair.second;
       int wid = c->WorkerId();
       if (wid_filter == Worker::kAnyWorker || wid_filter == wid) {
-        // WRR and Priority TCs associate share/priority to each child
+        // WRR, Priority and Deadline TCs associate share/priority/deadline to
+        // each child
         if (c->policy() == bess::POLICY_WEIGHTED_FAIR) {
           const auto* wrr_parent =
               static_cast<const bess::WeightedFairTrafficClass*>(c);
@@ -658,6 +870,14 @@ class BESSControlImpl final : public BESSControl::Service {
             collect_tc(child_data.c_, wid, status);
             status->mutable_class_()->set_priority(child_data.priority_);
           }
+        } else if (c->policy() == bess::POLICY_DEADLINE) {
+          const auto* deadline_parent =
+              static_cast<const bess::DeadlineTrafficClass*>(c);
+          for (const auto& child_data : deadline_parent->children()) {
+            auto* status = response->add_classes_status();
+            collect_tc(child_data.first, wid, status);
+            status->mutable_class_()->set_deadline_ns(child_data.second);
+          }
         } else {
           for (const auto* child : c->Children()) {
             auto* status = response->add_classes_status();
@@ -774,6 +994,10 @@ class BESSControlImpl final : public BESSControl::Service {
       c = reinterpret_cast<bess::TrafficClass*>(
           TrafficClassBuilder::CreateTrafficClass<bess::RoundRobinTrafficClass>(
               tc_name));
+    } else if (policy == bess::TrafficPolicyName[bess::POLICY_DEADLINE]) {
+      c = reinterpret_cast<bess::TrafficClass*>(
+          TrafficClassBuilder::CreateTrafficClass<bess::DeadlineTrafficClass>(
+              tc_name));
     } else if (policy == bess::TrafficPolicyName[bess::POLICY_RATE_LIMIT]) {
       uint64_t limit = 0;
       uint64_t max_burst = 0;
@@ -791,7 +1015,8 @@ class BESSControlImpl final : public BESSControl::Service {
       }
       c = reinterpret_cast<bess::TrafficClass*>(
           TrafficClassBuilder::CreateTrafficClass<bess::RateLimitTrafficClass>(
-              tc_name, bess::ResourceMap.at(resource), limit, max_burst));
+              tc_name, bess::ResourceMap.at(resource), limit, max_burst,
+              request->class_().pacing_gap_ns()));
     } else if (policy == bess::TrafficPolicyName[bess::POLICY_LEAF]) {
       return return_with_error(response, EINVAL,
                                "Cannot create leaf TC. Use "
@@ -834,6 +1059,10 @@ class BESSControlImpl final : public BESSControl::Service {
       if (max_bursts.find(resource) != max_bursts.end()) {
         tc->set_max_burst(max_bursts.at(resource));
       }
+      if (request->class_().pacing_case() ==
+          bess::pb::TrafficClass::kPacingGapNs) {
+        tc->set_pacing_gap_ns(request->class_().pacing_gap_ns());
+      }
     } else if (c->policy() == bess::POLICY_WEIGHTED_FAIR) {
       bess::WeightedFairTrafficClass* tc =
           reinterpret_cast<bess::WeightedFairTrafficClass*>(c);
@@ -842,10 +1071,14 @@ class BESSControlImpl final : public BESSControl::Service {
         return return_with_error(response, EINVAL, "Invalid resource");
       }
       tc->set_resource(bess::ResourceMap.at(resource));
+    } else if (c->policy() == bess::POLICY_LEAF) {
+      bess::LeafTrafficClass* tc = static_cast<bess::LeafTrafficClass*>(c);
+      tc->set_run_budget(request->class_().run_budget_cycles(),
+                         request->class_().run_budget_packets());
     } else {
       return return_with_error(response, EINVAL,
-                               "Only 'rate_limit' and"
-                               " 'weighted_fair' can be updated");
+                               "Only 'rate_limit', 'weighted_fair' and"
+                               " 'leaf' can be updated");
     }
 
     return Status::OK;
@@ -911,6 +1144,24 @@ class BESSControlImpl final : public BESSControl::Service {
     response->set_cycles(c->stats().usage[bess::RESOURCE_CYCLE]);
     response->set_packets(c->stats().usage[bess::RESOURCE_PACKET]);
     response->set_bits(c->stats().usage[bess::RESOURCE_BIT]);
+    response->set_deadline_missed(c->stats().cnt_deadline_missed);
+
+    if (c->policy() == bess::POLICY_LEAF) {
+      auto leaf = static_cast<bess::LeafTrafficClass*>(c);
+      response->set_stolen_count(leaf->cnt_stolen());
+      response->set_stolen_cycles(leaf->cycles_stolen());
+      response->set_stolen_packets(leaf->packets_stolen());
+    } else if (c->policy() == bess::POLICY_RATE_LIMIT) {
+      auto rl = static_cast<bess::RateLimitTrafficClass*>(c);
+      const struct bess::pacing_stats& ps = rl->pacing_stats();
+      if (ps.cnt_gaps) {
+        response->set_pacing_gap_count(ps.cnt_gaps);
+        response->set_pacing_gap_avg_ns(tsc_to_ns(ps.gap_cycles) /
+                                        static_cast<double>(ps.cnt_gaps));
+        response->set_pacing_gap_min_ns(tsc_to_ns(ps.gap_cycles_min));
+        response->set_pacing_gap_max_ns(tsc_to_ns(ps.gap_cycles_max));
+      }
+    }
 
     return Status::OK;
   }
@@ -1305,6 +1556,44 @@ class BESSControlImpl final : public BESSControl::Service {
     collect_ogates(m, response);
     collect_metadata(m, response);
     response->set_deadends(m->deadends());
+    response->set_alloc_failures(m->alloc_failures());
+    if (m->profile()) {
+      collect_profile(m, response->mutable_profile(),
+                      response->mutable_worker_profiles());
+    }
+    collect_drops(m, "", response->mutable_drops(),
+                  response->mutable_worker_drops());
+
+    return Status::OK;
+  }
+
+  Status GetDropStats(ServerContext*, const GetDropStatsRequest* request,
+                      GetDropStatsResponse* response) override {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    const std::string& reason = request->reason();
+    if (!reason.empty()) {
+      bool valid = false;
+      for (size_t i = 0; i < static_cast<size_t>(DropReason::kNumReasons);
+           i++) {
+        valid |= (reason == DropReasonName(static_cast<DropReason>(i)));
+      }
+      if (!valid) {
+        return return_with_error(response, EINVAL, "Unknown drop reason '%s'",
+                                 reason.c_str());
+      }
+    }
+
+    for (const auto& pair : ModuleGraph::GetAllModules()) {
+      const Module* m = pair.second;
+      GetDropStatsResponse_Module module;
+
+      if (collect_drops(m, reason, module.mutable_drops(),
+                        module.mutable_worker_drops())) {
+        module.set_name(m->name());
+        response->add_modules()->Swap(&module);
+      }
+    }
 
     return Status::OK;
   }
@@ -1352,6 +1641,13 @@ class BESSControlImpl final : public BESSControl::Service {
     if (is_any_worker_running()) {
       ModuleGraph::PropagateActiveWorker();
       if (m1->num_active_workers() || m2->num_active_workers()) {
+        // Rewire under running workers if possible
+        ret = ModuleGraph::ConnectModulesHitless(m1, ogate, m2, igate,
+                                                 request->skip_default_hooks());
+        if (ret != -EAGAIN) {
+          goto done;
+        }
+
         WorkerPauser wp;  // Only pause when absolutely required
         ret = ModuleGraph::ConnectModules(m1, ogate, m2, igate,
                                           request->skip_default_hooks());
@@ -1373,7 +1669,6 @@ class BESSControlImpl final : public BESSControl::Service {
                            EmptyResponse* response) override {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
 
-    WorkerPauser wp;
     const char* m_name;
     gate_idx_t ogate;
 
@@ -1392,7 +1687,12 @@ class BESSControlImpl final : public BESSControl::Service {
     }
     Module* m = it->second;
 
-    ret = ModuleGraph::DisconnectModule(m, ogate);
+    // Rewire under running workers if possible
+    ret = ModuleGraph::DisconnectModuleHitless(m, ogate);
+    if (ret == -EAGAIN) {
+      WorkerPauser wp;
+      ret = ModuleGraph::DisconnectModule(m, ogate);
+    }
     if (ret < 0)
       return return_with_error(response, -ret, "Disconnection %s:%d failed",
                                m_name, ogate);
@@ -1400,6 +1700,142 @@ class BESSControlImpl final : public BESSControl::Service {
     return Status::OK;
   }
 
+  Status ConfigureModuleProfiling(
+      ServerContext*, const ConfigureModuleProfilingRequest* request,
+      EmptyResponse*) override {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    ModuleGraph::SetProfiling(request->enable(), request->reset());
+    return Status::OK;
+  }
+
+  Status GetPipelineProfile(ServerContext*, const EmptyRequest*,
+                            GetPipelineProfileResponse* response) override {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    std::map<const Module*, std::string> stacks = collect_stacks();
+    uint64_t total_cycles = 0;
+
+    response->set_enabled(Module::profiling_enabled());
+    response->set_timestamp(get_epoch_time());
+    response->set_tsc_hz(tsc_hz);
+
+    for (const auto& it : ModuleGraph::GetAllModules()) {
+      const Module* m = it.second;
+      bess::pb::ModuleProfile profile;
+
+      if (!collect_profile(m, &profile, nullptr)) {
+        continue;
+      }
+
+      GetPipelineProfileResponse_Frame* frame = response->add_frames();
+      const auto& stack = stacks.find(m);
+      frame->set_stack(stack != stacks.end() ? stack->second : m->name());
+      frame->set_name(m->name());
+      frame->set_mclass(m->module_builder()->class_name());
+      *frame->mutable_profile() = profile;
+      total_cycles += profile.cycles();
+    }
+
+    response->set_total_cycles(total_cycles);
+    return Status::OK;
+  }
+
+  Status ProposePipelinePartition(
+      ServerContext*, const ProposePipelinePartitionRequest* request,
+      ProposePipelinePartitionResponse* response) override {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    const auto& it = ModuleGraph::GetAllModules().find(request->task());
+    if (it == ModuleGraph::GetAllModules().end()) {
+      return return_with_error(response, ENOENT, "No module '%s' found",
+                               request->task().c_str());
+    }
+
+    std::vector<int> wids;
+    for (int64_t wid : request->wids()) {
+      if (wid < 0 || wid >= Worker::kMaxWorkers || !is_worker_active(wid)) {
+        return return_with_error(response, EINVAL, "worker:%d does not exist",
+                                 static_cast<int>(wid));
+      }
+      wids.push_back(wid);
+    }
+
+    PipelinePartition partition;
+    int ret = ModuleGraph::ProposePartition(it->second, wids, &partition);
+    if (ret == -ENODATA) {
+      return return_with_error(response, ENODATA,
+                               "Pipeline of '%s' has not been profiled",
+                               request->task().c_str());
+    } else if (ret < 0) {
+      return return_with_error(response, -ret, "'%s' is not a task module",
+                               request->task().c_str());
+    }
+
+    double max_cycles = 0.0;
+    for (const auto& stage : partition.stages) {
+      ProposePipelinePartitionResponse_Stage* s = response->add_stages();
+      s->set_wid(stage.wid);
+      for (const Module* m : stage.modules) {
+        s->add_modules(m->name());
+      }
+      s->set_cycles_per_pkt(stage.cycles_per_pkt);
+      max_cycles = std::max(max_cycles, stage.cycles_per_pkt);
+    }
+
+    for (const auto& cut : partition.cuts) {
+      PipelineCut* c = response->add_cuts();
+      c->set_name(cut.module->name());
+      c->set_ogate(cut.ogate_idx);
+      c->set_wid(cut.wid);
+    }
+
+    if (partition.cycles_per_pkt > 0.0) {
+      response->set_current_pps(tsc_hz / partition.cycles_per_pkt);
+    }
+    if (max_cycles > 0.0) {
+      response->set_expected_pps(tsc_hz / max_cycles);
+    }
+
+    return Status::OK;
+  }
+
+  Status ApplyPipelinePartition(
+      ServerContext*, const ApplyPipelinePartitionRequest* request,
+      ApplyPipelinePartitionResponse* response) override {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    std::vector<PipelinePartition::Cut> cuts;
+    for (const auto& cut : request->cuts()) {
+      const auto& it = ModuleGraph::GetAllModules().find(cut.name());
+      if (it == ModuleGraph::GetAllModules().end()) {
+        return return_with_error(response, ENOENT, "No module '%s' found",
+                                 cut.name().c_str());
+      }
+      int wid = cut.wid();
+      if (wid != Worker::kAnyWorker &&
+          (wid < 0 || wid >= Worker::kMaxWorkers || !is_worker_active(wid))) {
+        return return_with_error(response, EINVAL, "worker:%d does not exist",
+                                 wid);
+      }
+      cuts.push_back({it->second, static_cast<gate_idx_t>(cut.ogate()), wid});
+    }
+
+    WorkerPauser wp;
+
+    std::vector<std::string> queues;
+    int ret = ModuleGraph::ApplyPartition(cuts, &queues);
+    for (const auto& name : queues) {
+      response->add_queues(name);
+    }
+    if (ret < 0) {
+      return return_with_error(response, -ret,
+                               "Partitioning failed, pipeline left unchanged");
+    }
+
+    return Status::OK;
+  }
+
   Status DumpMempool(ServerContext*, const DumpMempoolRequest* request,
                      DumpMempoolResponse* response) override {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
@@ -1434,6 +1870,19 @@ class BESSControlImpl final : public BESSControl::Service {
       dump->set_ring_count(ring_count);
       dump->set_ring_free_count(ring_free_count);
       dump->set_ring_bytes(rte_ring_get_memsize(ring_count + ring_free_count));
+
+      bess::PacketPool::CacheStats stats = pool->GetCacheStats();
+      dump->set_worker_cache_size(pool->worker_cache_size());
+      dump->set_worker_cache_count(stats.count);
+      dump->set_worker_cache_allocs(stats.allocs);
+      dump->set_worker_cache_frees(stats.frees);
+      dump->set_worker_cache_remote_frees(stats.remote_frees);
+      dump->set_worker_cache_refills(stats.refills);
+      dump->set_worker_cache_flushes(stats.flushes);
+
+      dump->set_mp_peak_in_use_count(pool->PeakInUse());
+      dump->set_grow_count(pool->grow_count());
+      dump->set_grow_failures(pool->grow_failures());
     }
     return Status::OK;
   }
@@ -1852,6 +2301,15 @@ class BESSControlImpl final : public BESSControl::Service {
         fail = !static_cast<bess::RateLimitTrafficClass*>(parent)->AddChild(
             c.get());
         break;
+      case bess::POLICY_DEADLINE:
+        if (class_.arg_case() != bess::pb::TrafficClass::kDeadlineNs ||
+            class_.deadline_ns() <= 0) {
+          return return_with_error(response, EINVAL,
+                                   "No positive deadline_ns specified");
+        }
+        fail = !static_cast<bess::DeadlineTrafficClass*>(parent)->AddChild(
+            c.get(), class_.deadline_ns());
+        break;
       default:
         return return_with_error(response, EPERM,
                                  "Parent tc doesn't support children");
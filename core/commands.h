@@ -62,7 +62,8 @@ struct GenericCommand {
   cmd_func_t func;
 
   // If set to THREAD_SAFE, workers don't need to be paused in order to run
-  // this command.
+  // this command. Otherwise, running workers are held between task runs while
+  // it runs (see WorkerHolder), and the resume hooks run before they go on.
   ThreadSafety mt_safe;
 };
 
@@ -0,0 +1,506 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "af_packet.h"
+
+#include <arpa/inet.h>
+#include <linux/ethtool.h>
+#include <linux/if_ether.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <rte_common.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "../utils/copy.h"
+#include "../utils/ether.h"
+#include "../worker.h"
+
+// Linux 4.20+. Older kernels reject it, and outgoing packets are skipped
+// in RecvPackets() anyway.
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+namespace {
+
+const uint32_t kDefaultBlockSize = 1 << 18;  // 256KB
+const uint32_t kDefaultNumBlocks = 64;
+const uint32_t kDefaultBlockTimeoutMs = 1;
+
+// Only used by the kernel to check the RX ring geometry
+const uint32_t kRxFrameSize = 2048;
+
+// Where packet data starts in a TX frame
+const uint32_t kTxDataOffset = TPACKET_ALIGN(sizeof(tpacket3_hdr));
+
+const uint32_t kTxFrameSize = TPACKET_ALIGN(kTxDataOffset + SNBUF_DATA);
+const uint32_t kTxFramesPerBlock = 16;
+
+const struct {
+  const char *name;
+  int mode;
+} kFanoutModes[] = {
+    {"hash", PACKET_FANOUT_HASH},     {"lb", PACKET_FANOUT_LB},
+    {"cpu", PACKET_FANOUT_CPU},       {"rollover", PACKET_FANOUT_ROLLOVER},
+    {"random", PACKET_FANOUT_RND},    {"qm", PACKET_FANOUT_QM},
+};
+
+// Runs a SIOC* ioctl on the device. Returns 0 or -errno.
+int DevIoctl(const std::string &ifname, unsigned long request, ifreq *ifr) {
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -errno;
+  }
+
+  snprintf(ifr->ifr_name, IFNAMSIZ, "%s", ifname.c_str());
+  int ret = ioctl(fd, request, ifr) < 0 ? -errno : 0;
+  close(fd);
+  return ret;
+}
+
+}  // namespace
+
+CommandResponse AfPacketPort::Init(const bess::pb::AfPacketPortArg &arg) {
+  size_t num_rxq = num_queues[PACKET_DIR_INC];
+  size_t num_txq = num_queues[PACKET_DIR_OUT];
+  uint32_t block_size = arg.block_size() ?: kDefaultBlockSize;
+  uint32_t num_blocks = arg.num_blocks() ?: kDefaultNumBlocks;
+  uint32_t timeout_ms = arg.block_timeout_ms() ?: kDefaultBlockTimeoutMs;
+
+  if (arg.ifname().empty()) {
+    return CommandFailure(EINVAL, "'ifname' must be given");
+  }
+
+  if (block_size % getpagesize() || block_size < kRxFrameSize) {
+    return CommandFailure(EINVAL, "'block_size' must be a multiple of %d",
+                          getpagesize());
+  }
+
+  int fanout_mode = -1;
+  std::string mode_name = arg.fanout_mode();
+  if (mode_name.empty()) {
+    mode_name = "hash";
+  }
+  for (const auto &m : kFanoutModes) {
+    if (mode_name == m.name) {
+      fanout_mode = m.mode;
+    }
+  }
+  if (fanout_mode < 0) {
+    return CommandFailure(EINVAL, "Unknown fanout mode '%s'",
+                          mode_name.c_str());
+  }
+
+  if (arg.fanout_group() > 0xffff) {
+    return CommandFailure(EINVAL, "'fanout_group' must be less than 65536");
+  }
+
+  ifname_ = arg.ifname();
+  ifindex_ = if_nametoindex(ifname_.c_str());
+  if (ifindex_ == 0) {
+    return CommandFailure(ENODEV, "Cannot find interface %s", ifname_.c_str());
+  }
+
+  ifreq ifr = {};
+  int ret = DevIoctl(ifname_, SIOCGIFMTU, &ifr);
+  if (ret < 0) {
+    return CommandFailure(-ret, "SIOCGIFMTU failed");
+  }
+  conf_.mtu = ifr.ifr_mtu;
+
+  ret = DevIoctl(ifname_, SIOCGIFHWADDR, &ifr);
+  if (ret < 0) {
+    return CommandFailure(-ret, "SIOCGIFHWADDR failed");
+  }
+  bess::utils::Copy(conf_.mac_addr.bytes, ifr.ifr_hwaddr.sa_data,
+                    bess::utils::Ethernet::Address::kSize);
+
+  qdisc_bypass_ = arg.qdisc_bypass();
+
+  // Multiple RX queues share the packets of the interface through a fanout
+  // group. A group of our own is picked by the kernel, unless one is given
+  // (e.g., shared with other processes).
+  bool has_group =
+      arg.fanout_case() == bess::pb::AfPacketPortArg::kFanoutGroup;
+  bool fanout = num_rxq > 1 || has_group;
+  uint32_t fanout_group = arg.fanout_group();
+  // The kernel may pick any ID, 0 included, so 0 cannot tell it apart.
+  bool fanout_joined = false;
+
+  rxqs_.resize(num_rxq);
+  for (RxQueue &q : rxqs_) {
+    tpacket_req3 req = {};
+    req.tp_block_size = block_size;
+    req.tp_block_nr = num_blocks;
+    req.tp_frame_size = kRxFrameSize;
+    req.tp_frame_nr = (block_size / kRxFrameSize) * num_blocks;
+    req.tp_retire_blk_tov = timeout_ms;
+
+    CommandResponse err = OpenRing(&q, htons(ETH_P_ALL), PACKET_RX_RING, req);
+    if (err.has_error()) {
+      DeInit();
+      return err;
+    }
+
+    int one = 1;
+    setsockopt(q.fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+
+    if (!fanout) {
+      continue;
+    }
+
+    int type_flags = fanout_mode;
+    if (!fanout_joined && !has_group) {
+      type_flags |= PACKET_FANOUT_FLAG_UNIQUEID;
+    }
+
+    int val = fanout_group | (type_flags << 16);
+    socklen_t len = sizeof(val);
+    if (setsockopt(q.fd, SOL_PACKET, PACKET_FANOUT, &val, sizeof(val)) < 0 ||
+        getsockopt(q.fd, SOL_PACKET, PACKET_FANOUT, &val, &len) < 0) {
+      DeInit();
+      return CommandFailure(errno, "Cannot join fanout group %u",
+                            fanout_group);
+    }
+    fanout_group = val & 0xffff;
+    fanout_joined = true;
+  }
+
+  txqs_.resize(num_txq);
+  for (TxQueue &q : txqs_) {
+    tpacket_req3 req = {};
+    req.tp_block_size = RTE_ALIGN_CEIL(kTxFrameSize * kTxFramesPerBlock,
+                                       static_cast<uint32_t>(getpagesize()));
+    req.tp_frame_size = kTxFrameSize;
+    req.tp_block_nr = (queue_size[PACKET_DIR_OUT] + kTxFramesPerBlock - 1) /
+                      kTxFramesPerBlock;
+    q.frames_per_block = req.tp_block_size / kTxFrameSize;
+    req.tp_frame_nr = q.frames_per_block * req.tp_block_nr;
+
+    q.frame_size = kTxFrameSize;
+    q.num_frames = req.tp_frame_nr;
+
+    CommandResponse err = OpenRing(&q, 0, PACKET_TX_RING, req);
+    if (err.has_error()) {
+      DeInit();
+      return err;
+    }
+  }
+
+  if (fanout) {
+    LOG(INFO) << name() << ": " << num_rxq << " RX queues in fanout group "
+              << fanout_group << " (" << mode_name << ")";
+  }
+
+  return CommandSuccess();
+}
+
+CommandResponse AfPacketPort::OpenRing(Ring *r, uint16_t protocol,
+                                       int ring_type, const tpacket_req3 &req) {
+  const char *ring_name = (ring_type == PACKET_RX_RING) ? "RX" : "TX";
+
+  // Nothing is received before bind(), so that the ring only ever holds
+  // packets of the interface.
+  r->fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+  if (r->fd < 0) {
+    return CommandFailure(errno, "socket(AF_PACKET) failed");
+  }
+
+  int version = TPACKET_V3;
+  if (setsockopt(r->fd, SOL_PACKET, PACKET_VERSION, &version,
+                 sizeof(version)) < 0) {
+    return CommandFailure(errno, "TPACKET_V3 is not supported");
+  }
+
+  if (ring_type == PACKET_TX_RING) {
+    // Let the kernel skip malformed frames, rather than stop at them
+    int one = 1;
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one)) < 0 ||
+        (qdisc_bypass_ && setsockopt(r->fd, SOL_PACKET, PACKET_QDISC_BYPASS,
+                                     &one, sizeof(one)) < 0)) {
+      return CommandFailure(errno, "Cannot set up TX socket");
+    }
+  }
+
+  if (setsockopt(r->fd, SOL_PACKET, ring_type, &req, sizeof(req)) < 0) {
+    return CommandFailure(errno, "Cannot set up %s ring (Linux 4.11+ needed)",
+                          ring_name);
+  }
+
+  r->block_size = req.tp_block_size;
+  r->num_blocks = req.tp_block_nr;
+  r->map_size = static_cast<size_t>(req.tp_block_size) * req.tp_block_nr;
+
+  void *map = mmap(nullptr, r->map_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, 0);
+  if (map == MAP_FAILED) {
+    return CommandFailure(errno, "Cannot mmap() %s ring", ring_name);
+  }
+  r->map = static_cast<char *>(map);
+
+  sockaddr_ll sll = {};
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = protocol;
+  sll.sll_ifindex = ifindex_;
+
+  if (bind(r->fd, reinterpret_cast<sockaddr *>(&sll), sizeof(sll)) < 0) {
+    return CommandFailure(errno, "Cannot bind to %s", ifname_.c_str());
+  }
+
+  return CommandSuccess();
+}
+
+void AfPacketPort::CloseRing(Ring *r) {
+  if (r->map) {
+    munmap(r->map, r->map_size);
+    r->map = nullptr;
+  }
+
+  if (r->fd >= 0) {
+    close(r->fd);
+    r->fd = -1;
+  }
+}
+
+void AfPacketPort::DeInit() {
+  for (RxQueue &q : rxqs_) {
+    CloseRing(&q);
+  }
+  rxqs_.clear();
+
+  for (TxQueue &q : txqs_) {
+    CloseRing(&q);
+  }
+  txqs_.clear();
+}
+
+bool AfPacketPort::CopyPacket(RxQueue *q, const tpacket3_hdr *hdr,
+                              bess::Packet *pkt) {
+  const char *base = reinterpret_cast<const char *>(hdr);
+  const sockaddr_ll *sll = reinterpret_cast<const sockaddr_ll *>(
+      base + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+
+  // Our own transmissions, on kernels without PACKET_IGNORE_OUTGOING
+  if (sll->sll_pkttype == PACKET_OUTGOING) {
+    return false;
+  }
+
+  const char *data = base + hdr->tp_mac;
+  uint32_t len = hdr->tp_snaplen;
+
+  // The kernel strips the VLAN tag of received packets. Put it back.
+  bool vlan = (hdr->tp_status & TP_STATUS_VLAN_VALID) &&
+              len >= 2 * bess::utils::Ethernet::Address::kSize;
+  uint32_t total_len = len + (vlan ? sizeof(bess::utils::Vlan) : 0);
+
+  if (unlikely(total_len > SNBUF_DATA || hdr->tp_len > len)) {
+    q->oversized++;
+    return false;
+  }
+
+  char *dst = static_cast<char *>(pkt->append(total_len));
+
+  if (likely(!vlan)) {
+    bess::utils::CopyInlined(dst, data, len);
+  } else {
+    const size_t addrs_len = 2 * bess::utils::Ethernet::Address::kSize;
+    uint16_t tag[2] = {
+        htons((hdr->tp_status & TP_STATUS_VLAN_TPID_VALID)
+                  ? hdr->hv1.tp_vlan_tpid
+                  : static_cast<uint16_t>(ETH_P_8021Q)),
+        htons(hdr->hv1.tp_vlan_tci)};
+
+    bess::utils::Copy(dst, data, addrs_len);
+    bess::utils::Copy(dst + addrs_len, tag, sizeof(tag));
+    bess::utils::CopyInlined(dst + addrs_len + sizeof(tag), data + addrs_len,
+                             len - addrs_len);
+  }
+
+  return true;
+}
+
+int AfPacketPort::RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  RxQueue &q = rxqs_[qid];
+  uint32_t first_block = q.block;
+  uint32_t done = 0;  // blocks consumed, returned to the kernel at the end
+  int recv_cnt = 0;
+
+  while (recv_cnt < cnt) {
+    if (q.left == 0) {
+      // Do not come back around to the blocks we have not returned yet
+      if (done == q.num_blocks) {
+        break;
+      }
+
+      tpacket_block_desc *desc = q.block_desc(q.block);
+      uint32_t status =
+          __atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE);
+      if (!(status & TP_STATUS_USER)) {
+        break;
+      }
+
+      q.left = desc->hdr.bh1.num_pkts;
+      q.next = reinterpret_cast<tpacket3_hdr *>(
+          reinterpret_cast<char *>(desc) + desc->hdr.bh1.offset_to_first_pkt);
+    }
+
+    int n = std::min<int>(cnt - recv_cnt, q.left);
+    if (n > 0 &&
+        !current_worker.packet_pool()->AllocBulk(pkts + recv_cnt, n)) {
+      break;
+    }
+
+    // Skipped packets leave their Packet to the next one
+    int copied = 0;
+    for (int i = 0; i < n; i++) {
+      tpacket3_hdr *hdr = q.next;
+      q.next = reinterpret_cast<tpacket3_hdr *>(
+          reinterpret_cast<char *>(hdr) + hdr->tp_next_offset);
+      copied += CopyPacket(&q, hdr, pkts[recv_cnt + copied]);
+    }
+
+    bess::Packet::Free(pkts + recv_cnt + copied, n - copied);
+    recv_cnt += copied;
+    q.left -= n;
+
+    if (q.left == 0) {
+      q.block = (q.block + 1) % q.num_blocks;
+      done++;
+    }
+  }
+
+  for (uint32_t i = 0; i < done; i++) {
+    tpacket_block_desc *desc = q.block_desc((first_block + i) % q.num_blocks);
+    __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                     __ATOMIC_RELEASE);
+  }
+
+  return recv_cnt;
+}
+
+int AfPacketPort::SendPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  TxQueue &q = txqs_[qid];
+  int sent = 0;
+
+  for (; sent < cnt; sent++) {
+    bess::Packet *pkt = pkts[sent];
+    tpacket3_hdr *hdr = q.frame(q.head);
+
+    if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) !=
+            TP_STATUS_AVAILABLE ||
+        pkt->total_len() > SNBUF_DATA) {
+      break;
+    }
+
+    char *dst = reinterpret_cast<char *>(hdr) + kTxDataOffset;
+    for (bess::Packet *seg = pkt; seg; seg = seg->next()) {
+      bess::utils::CopyInlined(dst, seg->head_data(), seg->head_len());
+      dst += seg->head_len();
+    }
+
+    hdr->tp_len = pkt->total_len();
+    hdr->tp_snaplen = pkt->total_len();
+    hdr->tp_next_offset = 0;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST,
+                     __ATOMIC_RELEASE);
+
+    if (++q.head == q.num_frames) {
+      q.head = 0;
+    }
+  }
+
+  if (sent > 0) {
+    // The kernel transmits all pending frames before returning
+    send(q.fd, nullptr, 0, MSG_DONTWAIT);
+    bess::Packet::Free(pkts, sent);
+  }
+
+  auto &stats = queue_stats[PACKET_DIR_OUT][qid];
+  stats.requested_hist[cnt]++;
+  stats.actual_hist[sent]++;
+  stats.diff_hist[cnt - sent]++;
+  return sent;
+}
+
+void AfPacketPort::CollectStats(bool reset) {
+  for (size_t i = 0; i < rxqs_.size(); i++) {
+    RxQueue &q = rxqs_[i];
+    tpacket_stats_v3 st;
+    socklen_t len = sizeof(st);
+
+    // The kernel clears its counters on every read
+    if (getsockopt(q.fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) < 0) {
+      PLOG(ERROR) << "getsockopt(PACKET_STATISTICS)";
+      continue;
+    }
+
+    if (reset) {
+      q.kernel_drops = 0;
+      q.oversized_base = q.oversized;
+      continue;
+    }
+
+    q.kernel_drops += st.tp_drops;
+    queue_stats[PACKET_DIR_INC][i].dropped =
+        q.kernel_drops + q.oversized - q.oversized_base;
+  }
+}
+
+Port::LinkStatus AfPacketPort::GetLinkStatus() {
+  LinkStatus status = {};
+  ifreq ifr = {};
+
+  if (DevIoctl(ifname_, SIOCGIFFLAGS, &ifr) == 0) {
+    status.link_up = (ifr.ifr_flags & IFF_UP) && (ifr.ifr_flags & IFF_RUNNING);
+  }
+
+  ethtool_cmd cmd = {};
+  cmd.cmd = ETHTOOL_GSET;
+  ifr.ifr_data = reinterpret_cast<char *>(&cmd);
+  if (DevIoctl(ifname_, SIOCETHTOOL, &ifr) == 0) {
+    uint32_t speed = ethtool_cmd_speed(&cmd);
+    status.speed = (speed == static_cast<uint32_t>(SPEED_UNKNOWN)) ? 0 : speed;
+    status.full_duplex = (cmd.duplex == DUPLEX_FULL);
+    status.autoneg = (cmd.autoneg == AUTONEG_ENABLE);
+  }
+
+  return status;
+}
+
+ADD_DRIVER(AfPacketPort, "af_packet_port",
+           "Linux AF_PACKET socket with TPACKET_V3 rings")
@@ -0,0 +1,128 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef BESS_DRIVERS_AF_PACKET_H_
+#define BESS_DRIVERS_AF_PACKET_H_
+
+#include <linux/if_packet.h>
+
+#include <string>
+#include <vector>
+
+#include "../port.h"
+
+// Port on a Linux network interface, through AF_PACKET sockets with
+// memory-mapped TPACKET_V3 rings (Linux 4.11+).
+//
+// Each RX queue has a socket with a ring of blocks, which the kernel fills
+// with packets and hands over as a whole, when full or after a timeout.
+// Packets are copied out of a block, and the block is returned to the kernel
+// once all of its packets are consumed. With more than one RX queue, the
+// sockets form a fanout group, among which the kernel spreads the packets.
+//
+// Each TX queue has a socket with a ring of frames. Packets are copied into
+// the frames, and the kernel is kicked once per batch.
+class AfPacketPort final : public Port {
+ public:
+  AfPacketPort() : Port(), ifindex_(), qdisc_bypass_(), rxqs_(), txqs_() {}
+
+  CommandResponse Init(const bess::pb::AfPacketPortArg &arg);
+
+  void DeInit() override;
+
+  void CollectStats(bool reset) override;
+
+  int RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+  int SendPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+
+  int GetRxQueueFd(queue_t qid) const override {
+    return qid < rxqs_.size() ? rxqs_[qid].fd : -1;
+  }
+
+  LinkStatus GetLinkStatus() override;
+
+ private:
+  // A mmap()ed ring of a socket
+  struct Ring {
+    int fd = -1;
+    char *map = nullptr;
+    size_t map_size = 0;
+    uint32_t block_size = 0;
+    uint32_t num_blocks = 0;
+  };
+
+  struct RxQueue : Ring {
+    uint32_t block = 0;  // current block
+    uint32_t left = 0;   // packets left in it, 0 if not acquired yet
+    tpacket3_hdr *next = nullptr;  // next packet in it
+
+    // Packets dropped by the kernel, accumulated by CollectStats(), and
+    // packets too large for a Packet, dropped by RecvPackets()
+    uint64_t kernel_drops = 0;
+    uint64_t oversized = 0;
+    uint64_t oversized_base = 0;  // value at the last CollectStats(true)
+
+    tpacket_block_desc *block_desc(uint32_t i) {
+      return reinterpret_cast<tpacket_block_desc *>(map + i * block_size);
+    }
+  };
+
+  struct TxQueue : Ring {
+    uint32_t frame_size = 0;
+    uint32_t frames_per_block = 0;
+    uint32_t num_frames = 0;
+    uint32_t head = 0;  // next frame to fill
+
+    tpacket3_hdr *frame(uint32_t i) {
+      return reinterpret_cast<tpacket3_hdr *>(
+          map + (i / frames_per_block) * block_size +
+          (i % frames_per_block) * frame_size);
+    }
+  };
+
+  // Opens a socket with a TPACKET_V3 ring of type 'ring_type', bound to the
+  // interface and 'protocol' (network byte order). Sockets bound with
+  // protocol 0 receive nothing.
+  CommandResponse OpenRing(Ring *r, uint16_t protocol, int ring_type,
+                           const tpacket_req3 &req);
+  void CloseRing(Ring *r);
+
+  // Copies a received packet into pkt. Returns false if it is to be skipped.
+  bool CopyPacket(RxQueue *q, const tpacket3_hdr *hdr, bess::Packet *pkt);
+
+  std::string ifname_;
+  int ifindex_;
+  bool qdisc_bypass_;
+
+  std::vector<RxQueue> rxqs_;
+  std::vector<TxQueue> txqs_;
+};
+
+#endif  // BESS_DRIVERS_AF_PACKET_H_
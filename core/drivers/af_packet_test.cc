@@ -0,0 +1,253 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "af_packet.h"
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../opts.h"
+#include "../packet_pool.h"
+#include "../worker.h"
+
+namespace {
+
+const int kQueueSize = 64;
+const uint16_t kLen = 60;
+
+// IEEE 802 local experimental EtherType, so that the frames of the test can
+// be told apart from whatever else the kernel sends on a new link.
+const uint16_t kEtherType = 0x88b5;
+
+// An AfPacketPort on one end of a veth pair, and a plain packet socket on
+// the other. The tests need CAP_NET_ADMIN and CAP_NET_RAW, and pass
+// vacuously without them.
+class AfPacketPortTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    // Packets are received into the pool of the current worker
+    FLAGS_m = 0;
+    if (!bess::PacketPool::GetDefaultPool(0)) {
+      bess::PacketPool::CreateDefaultPools(4096);
+    }
+    current_worker.SetNonWorker();
+  }
+
+  virtual void SetUp() {
+    std::string id = std::to_string(getpid());
+    ifname_ = "bpkt" + id + "a";
+    peer_ifname_ = "bpkt" + id + "b";
+
+    std::string cmd = "ip link add " + ifname_ + " type veth peer name " +
+                      peer_ifname_ + " >/dev/null 2>&1 && ip link set " +
+                      ifname_ + " up && ip link set " + peer_ifname_ + " up";
+    if (system(cmd.c_str()) != 0) {
+      std::cerr << "Cannot create a veth pair, skipping test\n";
+      return;
+    }
+    veth_ = true;
+
+    peer_fd_ = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK, htons(ETH_P_ALL));
+    if (peer_fd_ < 0) {
+      std::cerr << "Cannot open a packet socket, skipping test\n";
+      return;
+    }
+    sockaddr_ll sll = {};
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = if_nametoindex(peer_ifname_.c_str());
+    ASSERT_EQ(0, bind(peer_fd_, reinterpret_cast<sockaddr *>(&sll),
+                      sizeof(sll)));
+  }
+
+  virtual void TearDown() {
+    if (port_) {
+      port_->DeInit();
+    }
+    if (peer_fd_ >= 0) {
+      close(peer_fd_);
+    }
+    if (veth_) {
+      std::string cmd = "ip link del " + ifname_;
+      EXPECT_EQ(0, system(cmd.c_str()));
+    }
+  }
+
+  void InitPort(const bess::pb::AfPacketPortArg &arg_) {
+    bess::pb::AfPacketPortArg arg = arg_;
+    arg.set_ifname(ifname_);
+    port_.reset(new AfPacketPort());
+    port_->num_queues[PACKET_DIR_INC] = 1;
+    port_->num_queues[PACKET_DIR_OUT] = 1;
+    port_->queue_size[PACKET_DIR_INC] = kQueueSize;
+    port_->queue_size[PACKET_DIR_OUT] = kQueueSize;
+    CommandResponse err = port_->Init(arg);
+    ASSERT_FALSE(err.has_error()) << err.error().errmsg();
+  }
+
+  // Fills in a test frame of kLen bytes, with a payload from 'seed' on
+  static void MakeFrame(char *data, int seed) {
+    memset(data, 0xff, 6);
+    memset(data + 6, 0x02, 6);
+    uint16_t ether_type = htons(kEtherType);
+    memcpy(data + 12, &ether_type, sizeof(ether_type));
+    for (int i = 14; i < kLen; i++) {
+      data[i] = seed + i;
+    }
+  }
+
+  void Send(const char *frame, size_t len) {
+    ASSERT_EQ(static_cast<ssize_t>(len), send(peer_fd_, frame, len, 0))
+        << strerror(errno);
+  }
+
+  // Polls the port until it has received 'frame'. Other packets are freed.
+  bool Receive(const char *frame, size_t len) {
+    for (int i = 0; i < 1000; i++) {
+      bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+      int cnt = port_->RecvPackets(0, pkts, bess::PacketBatch::kMaxBurst);
+      bool found = false;
+      for (int j = 0; j < cnt; j++) {
+        found |= pkts[j]->total_len() == len &&
+                 memcmp(pkts[j]->head_data(), frame, len) == 0;
+      }
+      bess::Packet::Free(pkts, cnt);
+      if (found) {
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+  }
+
+  bool veth_ = false;
+  std::string ifname_;
+  std::string peer_ifname_;
+  int peer_fd_ = -1;
+  std::unique_ptr<AfPacketPort> port_;
+};
+
+#define SKIP_IF_UNAVAILABLE() \
+  do {                        \
+    if (peer_fd_ < 0) {       \
+      return;                 \
+    }                         \
+  } while (0)
+
+// Single frames only make it through once their block times out. Blocks are
+// given back to the kernel, so the ring can wrap around many times.
+TEST_F(AfPacketPortTest, Recv) {
+  SKIP_IF_UNAVAILABLE();
+
+  bess::pb::AfPacketPortArg arg;
+  arg.set_block_size(getpagesize());
+  arg.set_num_blocks(2);
+  InitPort(arg);
+
+  for (int seed = 0; seed < 16; seed++) {
+    char frame[kLen];
+    MakeFrame(frame, seed);
+    Send(frame, kLen);
+    EXPECT_TRUE(Receive(frame, kLen)) << "frame " << seed;
+  }
+}
+
+// The kernel strips the VLAN tag of received frames, which the port puts
+// back.
+TEST_F(AfPacketPortTest, RecvVlan) {
+  SKIP_IF_UNAVAILABLE();
+
+  InitPort(bess::pb::AfPacketPortArg());
+
+  char frame[kLen + 4];
+  MakeFrame(frame + 4, 1);
+  memmove(frame, frame + 4, 12);
+  const uint8_t tag[4] = {0x81, 0x00, 0x01, 0x23};
+  memcpy(frame + 12, tag, sizeof(tag));
+
+  Send(frame, sizeof(frame));
+  EXPECT_TRUE(Receive(frame, sizeof(frame)));
+}
+
+TEST_F(AfPacketPortTest, Send) {
+  SKIP_IF_UNAVAILABLE();
+
+  InitPort(bess::pb::AfPacketPortArg());
+
+  bess::Packet *pkts[4];
+  ASSERT_TRUE(current_worker.packet_pool()->AllocBulk(pkts, 4, kLen));
+  for (int i = 0; i < 4; i++) {
+    MakeFrame(pkts[i]->head_data<char *>(), i);
+  }
+  ASSERT_EQ(4, port_->SendPackets(0, pkts, 4));
+
+  int received = 0;
+  for (int i = 0; i < 1000 && received < 4; i++) {
+    char buf[2048];
+    ssize_t len;
+    while ((len = recv(peer_fd_, buf, sizeof(buf), 0)) > 0) {
+      char frame[kLen];
+      MakeFrame(frame, received);
+      if (len == kLen && memcmp(buf, frame, kLen) == 0) {
+        received++;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(4, received);
+}
+
+// An explicit group 0 is joined like any other.
+TEST_F(AfPacketPortTest, FanoutGroupZero) {
+  SKIP_IF_UNAVAILABLE();
+
+  bess::pb::AfPacketPortArg arg;
+  arg.set_fanout_group(0);
+  InitPort(arg);
+
+  char frame[kLen];
+  MakeFrame(frame, 2);
+  Send(frame, kLen);
+  EXPECT_TRUE(Receive(frame, kLen));
+}
+
+}  // namespace
@@ -0,0 +1,770 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "af_xdp.h"
+
+#ifdef XDP_UMEM_UNALIGNED_CHUNK_FLAG
+
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <rte_common.h>
+#include <rte_mbuf.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#include "../utils/copy.h"
+#include "../utils/ether.h"
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+// Linux 5.11+. Older kernels reject them, which fails Init().
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+
+namespace {
+
+// A UMEM chunk is the headroom and data area of a packet. The kernel puts
+// received frames XDP_PACKET_HEADROOM bytes into it.
+const uint32_t kChunkSize = SNBUF_HEADROOM + SNBUF_DATA;
+
+const uint32_t kMaxMtu = kChunkSize - XDP_PACKET_HEADROOM -
+                         sizeof(bess::utils::Ethernet) -
+                         sizeof(bess::utils::Vlan);
+
+// Smallest page size the kernel may map the UMEM with. Chunks within a page
+// are always DMA-contiguous.
+const uintptr_t kPageSize = 4096;
+
+const uint32_t kDefaultBusyPollBudget = 64;
+
+int Bpf(int cmd, union bpf_attr *attr) {
+  return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+// Runs a SIOCGIF* ioctl on the device. Returns 0 or -errno.
+int IfIoctl(const std::string &ifname, unsigned long request, ifreq *ifr) {
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -errno;
+  }
+
+  memset(ifr, 0, sizeof(*ifr));
+  snprintf(ifr->ifr_name, IFNAMSIZ, "%s", ifname.c_str());
+
+  int ret = ioctl(fd, request, ifr) < 0 ? -errno : 0;
+  close(fd);
+  return ret;
+}
+
+// Attaches (fd >= 0) or detaches (fd == -1) the XDP program of a device,
+// via rtnetlink. Returns 0 or -errno.
+int SetXdpProgram(int ifindex, int fd, uint32_t flags) {
+  struct {
+    nlmsghdr nh;
+    ifinfomsg ifi;
+    char attrs[64];
+  } req;
+
+  memset(&req, 0, sizeof(req));
+  req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifi));
+  req.nh.nlmsg_type = RTM_SETLINK;
+  req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+  req.ifi.ifi_family = AF_UNSPEC;
+  req.ifi.ifi_index = ifindex;
+
+  rtattr *nest = reinterpret_cast<rtattr *>(reinterpret_cast<char *>(&req) +
+                                            NLMSG_ALIGN(req.nh.nlmsg_len));
+  nest->rta_type = NLA_F_NESTED | IFLA_XDP;
+  nest->rta_len = RTA_LENGTH(0);
+
+  auto add_attr = [nest](uint16_t type, uint32_t val) {
+    rtattr *rta = reinterpret_cast<rtattr *>(reinterpret_cast<char *>(nest) +
+                                             RTA_ALIGN(nest->rta_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(sizeof(val));
+    memcpy(RTA_DATA(rta), &val, sizeof(val));
+    nest->rta_len = RTA_ALIGN(nest->rta_len) + rta->rta_len;
+  };
+
+  add_attr(IFLA_XDP_FD, fd);
+  if (flags) {
+    add_attr(IFLA_XDP_FLAGS, flags);
+  }
+  req.nh.nlmsg_len = NLMSG_ALIGN(req.nh.nlmsg_len) + nest->rta_len;
+
+  int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (sock < 0) {
+    return -errno;
+  }
+
+  int ret = 0;
+  char buf[4096];
+  ssize_t len = 0;
+
+  if (send(sock, &req, req.nh.nlmsg_len, 0) < 0 ||
+      (len = recv(sock, buf, sizeof(buf), 0)) < 0) {
+    ret = -errno;
+  } else {
+    nlmsghdr *nh = reinterpret_cast<nlmsghdr *>(buf);
+    if (NLMSG_OK(nh, len) && nh->nlmsg_type == NLMSG_ERROR) {
+      ret = static_cast<nlmsgerr *>(NLMSG_DATA(nh))->error;
+    }
+  }
+
+  close(sock);
+  return ret;
+}
+
+}  // namespace
+
+uint32_t AfXdpPort::Ring::Free(uint32_t n) {
+  uint32_t free = size - (cached_prod - cached_cons);
+  if (free < n) {
+    cached_cons = __atomic_load_n(consumer, __ATOMIC_ACQUIRE);
+    free = size - (cached_prod - cached_cons);
+  }
+  return std::min(free, n);
+}
+
+uint32_t AfXdpPort::Ring::Available(uint32_t n) {
+  uint32_t avail = cached_prod - cached_cons;
+  if (avail < n) {
+    cached_prod = __atomic_load_n(producer, __ATOMIC_ACQUIRE);
+    avail = cached_prod - cached_cons;
+  }
+  return std::min(avail, n);
+}
+
+CommandResponse AfXdpPort::Init(const bess::pb::AfXdpPortArg &arg) {
+  size_t num_rxq = num_queues[PACKET_DIR_INC];
+  size_t num_txq = num_queues[PACKET_DIR_OUT];
+  size_t rx_size = queue_size[PACKET_DIR_INC];
+  size_t tx_size = queue_size[PACKET_DIR_OUT];
+  size_t num_socks = std::max(num_rxq, num_txq);
+
+  if (arg.ifname().empty()) {
+    return CommandFailure(EINVAL, "'ifname' must be given");
+  }
+
+  if (arg.force_zero_copy() && (arg.force_copy() || arg.skb_mode())) {
+    return CommandFailure(EINVAL,
+                          "'force_zero_copy' cannot be used with "
+                          "'force_copy' or 'skb_mode'");
+  }
+
+  if (!rte_is_power_of_2(rx_size) || !rte_is_power_of_2(tx_size)) {
+    return CommandFailure(EINVAL, "Queue sizes must be powers of two");
+  }
+
+  if (num_socks == 0) {
+    return CommandFailure(EINVAL, "At least one queue is needed");
+  }
+
+  ifname_ = arg.ifname();
+  ifindex_ = if_nametoindex(ifname_.c_str());
+  if (ifindex_ == 0) {
+    return CommandFailure(ENODEV, "Cannot find interface %s", ifname_.c_str());
+  }
+
+  ifreq ifr;
+  int ret = IfIoctl(ifname_, SIOCGIFMTU, &ifr);
+  if (ret < 0) {
+    return CommandFailure(-ret, "SIOCGIFMTU failed");
+  }
+
+  if (static_cast<uint32_t>(ifr.ifr_mtu) > kMaxMtu) {
+    return CommandFailure(EINVAL, "MTU of %s (%d) is larger than %u",
+                          ifname_.c_str(), ifr.ifr_mtu, kMaxMtu);
+  }
+  conf_.mtu = ifr.ifr_mtu;
+
+  ret = IfIoctl(ifname_, SIOCGIFHWADDR, &ifr);
+  if (ret < 0) {
+    return CommandFailure(-ret, "SIOCGIFHWADDR failed");
+  }
+  bess::utils::Copy(conf_.mac_addr.bytes, ifr.ifr_hwaddr.sa_data,
+                    bess::utils::Ethernet::Address::kSize);
+
+  first_qid_ = arg.first_qid();
+  busy_poll_usecs_ = arg.busy_poll_usecs();
+  busy_poll_budget_ = arg.busy_poll_budget() ?: kDefaultBusyPollBudget;
+  xdp_flags_ = arg.skb_mode() ? XDP_FLAGS_SKB_MODE : 0;
+
+  // Enough for full rings, and as many packets again in the pipeline. In
+  // zero-copy mode about half of the packets end up unusable.
+  uint64_t num_frames = arg.num_frames();
+  if (num_frames == 0) {
+    num_frames = num_socks * 2 * (2 * rx_size + 2 * tx_size);
+    if (!arg.force_copy() && !arg.skb_mode()) {
+      num_frames *= 2;
+    }
+  }
+
+  pool_.reset(new bess::PlainPacketPool(num_frames));
+  if (pool_->Capacity() < num_frames) {
+    DeInit();
+    return CommandFailure(ENOMEM, "Cannot allocate %" PRIu64 " packets",
+                          num_frames);
+  }
+
+  socks_.resize(num_socks);
+  for (size_t i = 0; i < num_socks; i++) {
+    Socket &s = socks_[i];
+    s.fill.size = rx_size;
+    s.comp.size = tx_size;
+    s.rx.size = (i < num_rxq) ? rx_size : 0;
+    s.tx.size = (i < num_txq) ? tx_size : 0;
+  }
+
+  // Zero-copy needs both driver support and native XDP. Fall back to copy
+  // mode unless told otherwise.
+  CommandResponse err;
+  uint16_t bind_flags = XDP_USE_NEED_WAKEUP;
+
+  if (arg.force_copy() || arg.skb_mode()) {
+    err = CreateSocket(0, first_qid_, bind_flags | XDP_COPY);
+  } else {
+    err = CreateSocket(0, first_qid_, bind_flags | XDP_ZEROCOPY);
+    zero_copy_ = !err.has_error();
+    if (err.has_error() && !arg.force_zero_copy()) {
+      VLOG(1) << name() << ": zero-copy unavailable (" << err.error().errmsg()
+              << "), using copy mode";
+      CloseSocket(&socks_[0]);
+      err = CreateSocket(0, first_qid_, bind_flags | XDP_COPY);
+    }
+  }
+
+  for (size_t i = 1; i < num_socks && !err.has_error(); i++) {
+    err = CreateSocket(i, first_qid_ + i, XDP_SHARED_UMEM);
+  }
+
+  if (!err.has_error()) {
+    for (Socket &s : socks_) {
+      for (size_t j = 0; s.rx.size && j < rx_size;
+           j += bess::PacketBatch::kMaxBurst) {
+        Refill(&s);
+      }
+    }
+    err = AttachProgram();
+  }
+
+  if (err.has_error()) {
+    DeInit();
+    return err;
+  }
+
+  LOG(INFO) << name() << ": " << ifname_ << " queues " << first_qid_ << "-"
+            << first_qid_ + num_socks - 1 << " in "
+            << (zero_copy_ ? "zero-copy" : "copy") << " mode";
+
+  return CommandSuccess();
+}
+
+CommandResponse AfXdpPort::CreateSocket(size_t i, uint32_t qid,
+                                        uint16_t bind_flags) {
+  Socket &s = socks_[i];
+
+  s.fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+  if (s.fd < 0) {
+    return CommandFailure(errno, "socket(AF_XDP) failed");
+  }
+
+  if (i == 0) {
+    xdp_umem_reg reg = {};
+    reg.addr = reinterpret_cast<uintptr_t>(pool_->region());
+    reg.len = pool_->region_size();
+    reg.chunk_size = kChunkSize;
+    reg.headroom = 0;
+    reg.flags = XDP_UMEM_UNALIGNED_CHUNK_FLAG;
+
+    if (setsockopt(s.fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) {
+      return CommandFailure(errno, "Cannot register UMEM");
+    }
+  }
+
+  // Since Linux 5.10, sockets sharing the UMEM on other queues have their
+  // own fill and completion rings.
+  if (setsockopt(s.fd, SOL_XDP, XDP_UMEM_FILL_RING, &s.fill.size,
+                 sizeof(s.fill.size)) < 0 ||
+      setsockopt(s.fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &s.comp.size,
+                 sizeof(s.comp.size)) < 0) {
+    return CommandFailure(errno, "Cannot set up UMEM rings");
+  }
+
+  if ((s.rx.size && setsockopt(s.fd, SOL_XDP, XDP_RX_RING, &s.rx.size,
+                               sizeof(s.rx.size)) < 0) ||
+      (s.tx.size && setsockopt(s.fd, SOL_XDP, XDP_TX_RING, &s.tx.size,
+                               sizeof(s.tx.size)) < 0)) {
+    return CommandFailure(errno, "Cannot set up RX/TX rings");
+  }
+
+  CommandResponse err = MapRings(&s);
+  if (err.has_error()) {
+    return err;
+  }
+
+  if (busy_poll_usecs_) {
+    int one = 1;
+    int ret = setsockopt(s.fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one,
+                         sizeof(one));
+    ret = ret ?: setsockopt(s.fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_usecs_,
+                            sizeof(busy_poll_usecs_));
+    ret = ret ?: setsockopt(s.fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET,
+                            &busy_poll_budget_, sizeof(busy_poll_budget_));
+    if (ret < 0) {
+      return CommandFailure(errno, "Cannot enable busy polling");
+    }
+  }
+
+  sockaddr_xdp sxdp = {};
+  sxdp.sxdp_family = AF_XDP;
+  sxdp.sxdp_ifindex = ifindex_;
+  sxdp.sxdp_queue_id = qid;
+  sxdp.sxdp_flags = bind_flags;
+  if (bind_flags & XDP_SHARED_UMEM) {
+    sxdp.sxdp_shared_umem_fd = socks_[0].fd;
+  }
+
+  if (bind(s.fd, reinterpret_cast<sockaddr *>(&sxdp), sizeof(sxdp)) < 0) {
+    return CommandFailure(errno, "Cannot bind to queue %u of %s", qid,
+                          ifname_.c_str());
+  }
+
+  return CommandSuccess();
+}
+
+CommandResponse AfXdpPort::MapRings(Socket *s) {
+  xdp_mmap_offsets off;
+  socklen_t optlen = sizeof(off);
+
+  if (getsockopt(s->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+    return CommandFailure(errno, "getsockopt(XDP_MMAP_OFFSETS) failed");
+  }
+
+  auto map = [s](Ring *r, const xdp_ring_offset &o, size_t desc_size,
+                 off_t pgoff) {
+    if (r->size == 0) {
+      return true;
+    }
+
+    r->map_size = o.desc + r->size * desc_size;
+    void *map = mmap(nullptr, r->map_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, s->fd, pgoff);
+    if (map == MAP_FAILED) {
+      return false;
+    }
+
+    char *base = static_cast<char *>(map);
+    r->map = map;
+    r->producer = reinterpret_cast<uint32_t *>(base + o.producer);
+    r->consumer = reinterpret_cast<uint32_t *>(base + o.consumer);
+    r->flags = reinterpret_cast<uint32_t *>(base + o.flags);
+    r->descs = base + o.desc;
+    r->mask = r->size - 1;
+    r->cached_prod = *r->producer;
+    r->cached_cons = *r->consumer;
+    return true;
+  };
+
+  if (!map(&s->fill, off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) ||
+      !map(&s->comp, off.cr, sizeof(uint64_t),
+           XDP_UMEM_PGOFF_COMPLETION_RING) ||
+      !map(&s->rx, off.rx, sizeof(xdp_desc), XDP_PGOFF_RX_RING) ||
+      !map(&s->tx, off.tx, sizeof(xdp_desc), XDP_PGOFF_TX_RING)) {
+    return CommandFailure(errno, "Cannot mmap() rings");
+  }
+
+  return CommandSuccess();
+}
+
+void AfXdpPort::CloseSocket(Socket *s) {
+  for (Ring *r : {&s->fill, &s->comp, &s->rx, &s->tx}) {
+    if (r->map) {
+      munmap(r->map, r->map_size);
+      r->map = nullptr;
+    }
+  }
+
+  if (s->fd >= 0) {
+    close(s->fd);
+    s->fd = -1;
+  }
+
+  bess::Packet::Free(s->unusable.data(), s->unusable.size());
+  s->unusable.clear();
+}
+
+CommandResponse AfXdpPort::AttachProgram() {
+  union bpf_attr attr;
+
+  // Nothing to redirect for TX-only ports
+  if (num_queues[PACKET_DIR_INC] == 0) {
+    return CommandSuccess();
+  }
+
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof(uint32_t);
+  attr.value_size = sizeof(int);
+  attr.max_entries = first_qid_ + num_queues[PACKET_DIR_INC];
+
+  map_fd_ = Bpf(BPF_MAP_CREATE, &attr);
+  if (map_fd_ < 0) {
+    return CommandFailure(errno, "Cannot create XSKMAP");
+  }
+
+  // return bpf_redirect_map(&xskmap, ctx->rx_queue_index, XDP_PASS);
+  // Packets of queues without a socket go up the kernel stack.
+  struct bpf_insn insns[] = {
+      {BPF_LDX | BPF_MEM | BPF_W, 2, 1, offsetof(xdp_md, rx_queue_index), 0},
+      {BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map_fd_},
+      {0, 0, 0, 0, 0},
+      {BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS},
+      {BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map},
+      {BPF_JMP | BPF_EXIT, 0, 0, 0, 0},
+  };
+  static const char kLicense[] = "BSD";
+  char log[4096] = "";
+
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = reinterpret_cast<uintptr_t>(insns);
+  attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+  attr.license = reinterpret_cast<uintptr_t>(kLicense);
+  attr.log_buf = reinterpret_cast<uintptr_t>(log);
+  attr.log_size = sizeof(log);
+  attr.log_level = 1;
+
+  prog_fd_ = Bpf(BPF_PROG_LOAD, &attr);
+  if (prog_fd_ < 0) {
+    return CommandFailure(errno, "Cannot load XDP program: %s", log);
+  }
+
+  int ret = SetXdpProgram(ifindex_, prog_fd_,
+                          xdp_flags_ | XDP_FLAGS_UPDATE_IF_NOEXIST);
+  if (ret < 0) {
+    return CommandFailure(-ret, "Cannot attach XDP program to %s%s",
+                          ifname_.c_str(),
+                          ret == -EBUSY ? " (it already has one)" : "");
+  }
+  prog_attached_ = true;
+
+  for (size_t i = 0; i < num_queues[PACKET_DIR_INC]; i++) {
+    uint32_t key = first_qid_ + i;
+    int fd = socks_[i].fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map_fd_;
+    attr.key = reinterpret_cast<uintptr_t>(&key);
+    attr.value = reinterpret_cast<uintptr_t>(&fd);
+
+    if (Bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+      return CommandFailure(errno, "Cannot add socket of queue %u to XSKMAP",
+                            key);
+    }
+  }
+
+  return CommandSuccess();
+}
+
+void AfXdpPort::DeInit() {
+  if (prog_attached_) {
+    int ret = SetXdpProgram(ifindex_, -1, xdp_flags_);
+    LOG_IF(WARNING, ret < 0) << "Cannot detach XDP program from " << ifname_
+                             << ": " << strerror(-ret);
+    prog_attached_ = false;
+  }
+
+  if (prog_fd_ >= 0) {
+    close(prog_fd_);
+    prog_fd_ = -1;
+  }
+
+  if (map_fd_ >= 0) {
+    close(map_fd_);
+    map_fd_ = -1;
+  }
+
+  // Whatever the kernel still had is lost with the sockets. The rest of the
+  // packets may still be in the pipeline.
+  size_t lost = 0;
+  for (Socket &s : socks_) {
+    CloseSocket(&s);
+    lost += s.in_kernel;
+  }
+  socks_.clear();
+
+  if (pool_) {
+    bess::PacketPool::Retire(std::move(pool_), lost);
+  }
+}
+
+bool AfXdpPort::IsUsableFrame(bess::Packet *pkt) const {
+  uintptr_t addr = pkt->buffer<char *>() - pool_->region();
+
+  // Not of the pool (a negative offset wraps around)
+  if (addr >= pool_->region_size()) {
+    return false;
+  }
+
+  // Clones and their originals are shared with others
+  if (!pkt->is_simple() ||
+      rte_mbuf_refcnt_read(reinterpret_cast<rte_mbuf *>(pkt)) != 1) {
+    return false;
+  }
+
+  return !zero_copy_ || (addr % kPageSize) + kChunkSize <= kPageSize;
+}
+
+bess::Packet *AfXdpPort::AllocFrame(Socket *s) {
+  bess::Packet *pkt;
+
+  while ((pkt = pool_->Alloc()) && !IsUsableFrame(pkt)) {
+    s->unusable.push_back(pkt);
+  }
+  return pkt;
+}
+
+void AfXdpPort::Refill(Socket *s) {
+  bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+
+  uint32_t n = s->fill.Free(bess::PacketBatch::kMaxBurst);
+  if (n == 0) {
+    return;
+  }
+
+  // The pool is running low. Give the kernel what is left.
+  if (!pool_->AllocBulk(pkts, n)) {
+    uint32_t i = 0;
+    while (i < n && (pkts[i] = pool_->Alloc())) {
+      i++;
+    }
+    n = i;
+  }
+
+  uint32_t filled = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    if (unlikely(zero_copy_ && !IsUsableFrame(pkts[i]))) {
+      s->unusable.push_back(pkts[i]);
+      continue;
+    }
+    s->fill.desc<uint64_t>(s->fill.cached_prod + filled++) =
+        umem_addr(pkts[i]);
+  }
+  s->fill.Submit(filled);
+  s->in_kernel += filled;
+}
+
+void AfXdpPort::Complete(Socket *s) {
+  bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+  uint32_t n;
+
+  while ((n = s->comp.Available(bess::PacketBatch::kMaxBurst)) > 0) {
+    for (uint32_t i = 0; i < n; i++) {
+      pkts[i] = umem_packet(s->comp.desc<uint64_t>(s->comp.cached_cons + i));
+    }
+    s->comp.Release(n);
+    s->in_kernel -= n;
+    bess::Packet::Free(pkts, n);
+  }
+}
+
+bess::Packet *AfXdpPort::CopyToUmem(Socket *s, bess::Packet *pkt) {
+  uint32_t len = pkt->total_len();
+  if (len > SNBUF_DATA) {
+    return nullptr;
+  }
+
+  bess::Packet *frame = AllocFrame(s);
+  if (!frame) {
+    return nullptr;
+  }
+
+  char *dst = frame->head_data<char *>();
+  for (bess::Packet *seg = pkt; seg; seg = seg->next()) {
+    bess::utils::CopyInlined(dst, seg->head_data(), seg->head_len());
+    dst += seg->head_len();
+  }
+
+  frame->set_data_len(len);
+  frame->set_total_len(len);
+  return frame;
+}
+
+int AfXdpPort::RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  Socket &s = socks_[qid];
+
+  uint32_t n = s.rx.Available(cnt);
+  if (n == 0) {
+    // Let the kernel process the device queue, if it is waiting for us
+    if (busy_poll_usecs_ || s.fill.NeedsWakeup()) {
+      recvfrom(s.fd, nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+    }
+    Refill(&s);
+    return 0;
+  }
+
+  for (uint32_t i = 0; i < n; i++) {
+    const xdp_desc &desc = s.rx.desc<xdp_desc>(s.rx.cached_cons + i);
+    bess::Packet *pkt = umem_packet(desc.addr);
+
+    pkt->set_data_off(desc.addr >> XSK_UNALIGNED_BUF_OFFSET_SHIFT);
+    pkt->set_data_len(desc.len);
+    pkt->set_total_len(desc.len);
+    pkts[i] = pkt;
+  }
+  s.rx.Release(n);
+  s.in_kernel -= n;
+
+  Refill(&s);
+  return n;
+}
+
+int AfXdpPort::SendPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  Socket &s = socks_[qid];
+  bess::Packet *copied[bess::PacketBatch::kMaxBurst];
+  int num_copied = 0;
+
+  Complete(&s);
+
+  int n = s.tx.Free(cnt);
+  int sent = 0;
+
+  for (; sent < n; sent++) {
+    bess::Packet *frame = pkts[sent];
+
+    if (!IsUsableFrame(frame)) {
+      frame = CopyToUmem(&s, frame);
+      if (!frame) {
+        break;
+      }
+      copied[num_copied++] = pkts[sent];
+    }
+
+    xdp_desc &desc = s.tx.desc<xdp_desc>(s.tx.cached_prod + sent);
+    desc.addr = umem_addr(frame) | (static_cast<uint64_t>(frame->data_off())
+                                    << XSK_UNALIGNED_BUF_OFFSET_SHIFT);
+    desc.len = frame->data_len();
+    desc.options = 0;
+  }
+
+  if (sent > 0) {
+    s.tx.Submit(sent);
+    s.in_kernel += sent;
+    if (s.tx.NeedsWakeup()) {
+      sendto(s.fd, nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+    }
+  }
+
+  bess::Packet::Free(copied, num_copied);
+
+  auto &stats = queue_stats[PACKET_DIR_OUT][qid];
+  stats.requested_hist[cnt]++;
+  stats.actual_hist[sent]++;
+  stats.diff_hist[cnt - sent]++;
+  return sent;
+}
+
+void AfXdpPort::CollectStats(bool reset) {
+  uint64_t tx_invalid = 0;
+
+  for (size_t i = 0; i < socks_.size(); i++) {
+    Socket &s = socks_[i];
+    xdp_statistics st;
+    socklen_t optlen = sizeof(st);
+
+    if (getsockopt(s.fd, SOL_XDP, XDP_STATISTICS, &st, &optlen) < 0) {
+      PLOG(ERROR) << "getsockopt(XDP_STATISTICS)";
+      continue;
+    }
+
+    if (reset) {
+      s.stats_base = st;
+      continue;
+    }
+
+    if (i < num_queues[PACKET_DIR_INC]) {
+      queue_stats[PACKET_DIR_INC][i].dropped =
+          (st.rx_dropped - s.stats_base.rx_dropped) +
+          (st.rx_invalid_descs - s.stats_base.rx_invalid_descs);
+    }
+    tx_invalid += st.tx_invalid_descs - s.stats_base.tx_invalid_descs;
+  }
+
+  if (!reset) {
+    port_stats_.out.dropped = tx_invalid;
+  }
+}
+
+Port::LinkStatus AfXdpPort::GetLinkStatus() {
+  LinkStatus status = {};
+  ifreq ifr;
+
+  if (IfIoctl(ifname_, SIOCGIFFLAGS, &ifr) == 0) {
+    status.link_up = (ifr.ifr_flags & IFF_UP) && (ifr.ifr_flags & IFF_RUNNING);
+  }
+
+  // -1 if unknown, as for virtual devices
+  int speed = 0;
+  std::string duplex;
+  std::ifstream("/sys/class/net/" + ifname_ + "/speed") >> speed;
+  std::ifstream("/sys/class/net/" + ifname_ + "/duplex") >> duplex;
+
+  status.speed = std::max(speed, 0);
+  status.full_duplex = (duplex == "full");
+  return status;
+}
+
+ADD_DRIVER(AfXdpPort, "af_xdp_port", "Linux AF_XDP socket")
+
+#endif  // XDP_UMEM_UNALIGNED_CHUNK_FLAG
@@ -0,0 +1,204 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef BESS_DRIVERS_AF_XDP_H_
+#define BESS_DRIVERS_AF_XDP_H_
+
+// AF_XDP needs the UMEM features of Linux 5.4+ headers (unaligned chunks and
+// need_wakeup); the driver is left out of older builds.
+#if __has_include(<linux/if_xdp.h>)
+#include <linux/if_xdp.h>
+#endif
+
+#ifdef XDP_UMEM_UNALIGNED_CHUNK_FLAG
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../packet_pool.h"
+#include "../port.h"
+
+// Port on a Linux network interface, through AF_XDP sockets.
+//
+// An XDP program redirects the packets of the bound device queues to one
+// socket per queue. All sockets share a single UMEM, which is the memory of a
+// private PacketPool, so received packets are handed to the pipeline without
+// a copy and packets of the pool are transmitted in place. Other packets are
+// copied into the UMEM on TX.
+//
+// In zero-copy mode the NIC DMAs straight into the UMEM. Since the pool is
+// backed by 4k pages, packets whose buffer straddles a page boundary are then
+// unusable, and set aside. Zero-copy needs driver support; copy mode works on
+// any device, including veth pairs.
+//
+// Requires Linux 5.4+, and 5.10+ for more than one queue.
+class AfXdpPort final : public Port {
+ public:
+  AfXdpPort()
+      : Port(),
+        ifindex_(),
+        first_qid_(),
+        zero_copy_(),
+        busy_poll_usecs_(),
+        busy_poll_budget_(),
+        xdp_flags_(),
+        prog_attached_(),
+        map_fd_(-1),
+        prog_fd_(-1),
+        socks_() {}
+
+  CommandResponse Init(const bess::pb::AfXdpPortArg &arg);
+
+  void DeInit() override;
+
+  void CollectStats(bool reset) override;
+
+  int RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+  int SendPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+
+  int GetRxQueueFd(queue_t qid) const override {
+    return qid < socks_.size() ? socks_[qid].fd : -1;
+  }
+
+  LinkStatus GetLinkStatus() override;
+
+ private:
+  // Single-producer, single-consumer ring shared with the kernel. The cached
+  // index of the other side is refreshed only when it looks exhausted.
+  struct Ring {
+    uint32_t cached_prod;
+    uint32_t cached_cons;
+    uint32_t mask;
+    uint32_t size;
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *descs;
+    void *map;
+    size_t map_size;
+
+    // Producer side (fill and TX rings): number of free entries, up to n
+    uint32_t Free(uint32_t n);
+    // Consumer side (RX and completion rings): number of entries, up to n
+    uint32_t Available(uint32_t n);
+
+    void Submit(uint32_t n) {
+      cached_prod += n;
+      __atomic_store_n(producer, cached_prod, __ATOMIC_RELEASE);
+    }
+
+    void Release(uint32_t n) {
+      cached_cons += n;
+      __atomic_store_n(consumer, cached_cons, __ATOMIC_RELEASE);
+    }
+
+    bool NeedsWakeup() const {
+      return __atomic_load_n(flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP;
+    }
+
+    template <typename T>
+    T &desc(uint32_t idx) {
+      return static_cast<T *>(descs)[idx & mask];
+    }
+  };
+
+  struct Socket {
+    int fd = -1;
+    Ring fill = {};
+    Ring comp = {};
+    Ring rx = {};  // size 0 if the socket serves no RX queue
+    Ring tx = {};  // ditto, for TX
+    xdp_statistics stats_base = {};  // values at the last CollectStats(true)
+
+    // Packets given to the kernel through the fill and TX rings, and not yet
+    // back through the RX and completion rings
+    uint64_t in_kernel = 0;
+
+    // Packets not usable in zero-copy mode, kept out of circulation
+    std::vector<bess::Packet *> unusable;
+  };
+
+  // Creates the socket of queue i, bound to device queue qid. Socket 0
+  // registers the UMEM, which the others share.
+  CommandResponse CreateSocket(size_t i, uint32_t qid, uint16_t bind_flags);
+  CommandResponse MapRings(Socket *s);
+  void CloseSocket(Socket *s);
+
+  CommandResponse AttachProgram();
+
+  // Tops up the fill ring of the socket with packets of the pool
+  void Refill(Socket *s);
+
+  // Frees the packets of completed transmissions
+  void Complete(Socket *s);
+
+  // Returns a new packet of the pool with the data of pkt, or nullptr
+  bess::Packet *CopyToUmem(Socket *s, bess::Packet *pkt);
+
+  // Allocates a packet of the pool that can be given to the kernel
+  bess::Packet *AllocFrame(Socket *s);
+
+  // Can pkt be given to the kernel as it is?
+  bool IsUsableFrame(bess::Packet *pkt) const;
+
+  // UMEM address of the buffer of a packet of the pool, and vice versa
+  uint64_t umem_addr(bess::Packet *pkt) const {
+    return pkt->buffer<char *>() - pool_->region();
+  }
+  bess::Packet *umem_packet(uint64_t addr) const {
+    char *buf = pool_->region() + (addr & XSK_UNALIGNED_BUF_ADDR_MASK);
+    return reinterpret_cast<bess::Packet *>(buf - SNBUF_HEADROOM_OFF);
+  }
+
+  std::string ifname_;
+  int ifindex_;
+  uint32_t first_qid_;
+  bool zero_copy_;
+  uint32_t busy_poll_usecs_;
+  uint32_t busy_poll_budget_;
+  uint32_t xdp_flags_;  // XDP_FLAGS_*_MODE the program is attached with
+  bool prog_attached_;
+
+  int map_fd_;
+  int prog_fd_;
+
+  // Backs the UMEM. Packets received by the port come from, and go back to
+  // this pool, which DeInit() retires rather than destroys, since they may
+  // still be in the pipeline.
+  std::unique_ptr<bess::PlainPacketPool> pool_;
+
+  // socks_[i] serves BESS RX/TX queue i
+  std::vector<Socket> socks_;
+};
+
+#endif  // XDP_UMEM_UNALIGNED_CHUNK_FLAG
+
+#endif  // BESS_DRIVERS_AF_XDP_H_
@@ -0,0 +1,242 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "af_xdp.h"
+
+#ifdef XDP_UMEM_UNALIGNED_CHUNK_FLAG
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../opts.h"
+#include "../packet_pool.h"
+#include "../worker.h"
+
+namespace {
+
+const int kQueueSize = 64;
+const uint16_t kLen = 60;
+
+// IEEE 802 local experimental EtherType, so that the frames of the test can
+// be told apart from whatever else the kernel sends on a new link.
+const uint16_t kEtherType = 0x88b5;
+
+// An AfXdpPort on one end of a veth pair, and a packet socket on the other.
+// The tests need CAP_NET_ADMIN and AF_XDP support, and pass vacuously
+// without them.
+class AfXdpPortTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    // Packets sent by the tests come from the pool of the current worker
+    FLAGS_m = 0;
+    if (!bess::PacketPool::GetDefaultPool(0)) {
+      bess::PacketPool::CreateDefaultPools(4096);
+    }
+    current_worker.SetNonWorker();
+  }
+
+  virtual void SetUp() {
+    std::string id = std::to_string(getpid());
+    ifname_ = "bxdp" + id + "a";
+    peer_ifname_ = "bxdp" + id + "b";
+
+    std::string cmd = "ip link add " + ifname_ + " type veth peer name " +
+                      peer_ifname_ + " >/dev/null 2>&1 && ip link set " +
+                      ifname_ + " up && ip link set " + peer_ifname_ + " up";
+    if (system(cmd.c_str()) != 0) {
+      std::cerr << "Cannot create a veth pair, skipping test\n";
+      return;
+    }
+    veth_ = true;
+
+    peer_fd_ = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK, htons(ETH_P_ALL));
+    ASSERT_LE(0, peer_fd_) << strerror(errno);
+    sockaddr_ll sll = {};
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = if_nametoindex(peer_ifname_.c_str());
+    ASSERT_EQ(0, bind(peer_fd_, reinterpret_cast<sockaddr *>(&sll),
+                      sizeof(sll)));
+
+    bess::pb::AfXdpPortArg arg;
+    arg.set_ifname(ifname_);
+    arg.set_skb_mode(true);
+    port_.reset(new AfXdpPort());
+    port_->num_queues[PACKET_DIR_INC] = 1;
+    port_->num_queues[PACKET_DIR_OUT] = 1;
+    port_->queue_size[PACKET_DIR_INC] = kQueueSize;
+    port_->queue_size[PACKET_DIR_OUT] = kQueueSize;
+
+    CommandResponse err = port_->Init(arg);
+    int code = err.error().code();
+    if (code == EAFNOSUPPORT || code == EPERM || code == ENOSYS ||
+        code == EOPNOTSUPP) {
+      std::cerr << "AF_XDP unavailable, skipping test\n";
+      port_.reset();
+      return;
+    }
+    ASSERT_FALSE(err.has_error()) << err.error().errmsg();
+  }
+
+  virtual void TearDown() {
+    if (port_) {
+      port_->DeInit();
+    }
+    if (peer_fd_ >= 0) {
+      close(peer_fd_);
+    }
+    if (veth_) {
+      std::string cmd = "ip link del " + ifname_;
+      EXPECT_EQ(0, system(cmd.c_str()));
+    }
+  }
+
+  // Fills in a test frame of kLen bytes, with a payload from 'seed' on
+  static void MakeFrame(char *data, int seed) {
+    memset(data, 0xff, 12);
+    uint16_t ether_type = htons(kEtherType);
+    memcpy(data + 12, &ether_type, sizeof(ether_type));
+    for (int i = 14; i < kLen; i++) {
+      data[i] = seed + i;
+    }
+  }
+
+  static bool IsFrame(const char *data, size_t len, int seed) {
+    char expected[kLen];
+    MakeFrame(expected, seed);
+    return len == kLen && memcmp(data + 12, expected + 12, kLen - 12) == 0;
+  }
+
+  // Polls the port until it has received the test frame of 'seed'. Other
+  // frames are freed.
+  bess::Packet *Receive(int seed) {
+    for (int i = 0; i < 1000; i++) {
+      bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+      int cnt = port_->RecvPackets(0, pkts, bess::PacketBatch::kMaxBurst);
+      bess::Packet *found = nullptr;
+      for (int j = 0; j < cnt; j++) {
+        if (!found &&
+            IsFrame(pkts[j]->head_data<char *>(), pkts[j]->head_len(), seed)) {
+          found = pkts[j];
+        } else {
+          bess::Packet::Free(pkts[j]);
+        }
+      }
+      if (found) {
+        return found;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return nullptr;
+  }
+
+  bool veth_ = false;
+  std::string ifname_;
+  std::string peer_ifname_;
+  int peer_fd_ = -1;
+  std::unique_ptr<AfXdpPort> port_;
+};
+
+#define SKIP_IF_UNAVAILABLE() \
+  do {                        \
+    if (!port_) {             \
+      return;                 \
+    }                         \
+  } while (0)
+
+TEST_F(AfXdpPortTest, Recv) {
+  SKIP_IF_UNAVAILABLE();
+
+  for (int seed = 0; seed < 4; seed++) {
+    char frame[kLen];
+    MakeFrame(frame, seed);
+    ASSERT_EQ(kLen, send(peer_fd_, frame, kLen, 0)) << strerror(errno);
+
+    bess::Packet *pkt = Receive(seed);
+    ASSERT_NE(nullptr, pkt) << "frame " << seed;
+    EXPECT_EQ(kLen, pkt->total_len());
+    bess::Packet::Free(pkt);
+  }
+}
+
+TEST_F(AfXdpPortTest, Send) {
+  SKIP_IF_UNAVAILABLE();
+
+  bess::Packet *pkt = current_worker.packet_pool()->Alloc(kLen);
+  ASSERT_NE(nullptr, pkt);
+  MakeFrame(pkt->head_data<char *>(), 7);
+  ASSERT_EQ(1, port_->SendPackets(0, &pkt, 1));
+
+  bool received = false;
+  for (int i = 0; i < 1000 && !received; i++) {
+    char buf[2048];
+    ssize_t len;
+    while (!received && (len = recv(peer_fd_, buf, sizeof(buf), 0)) > 0) {
+      received = IsFrame(buf, len, 7);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_TRUE(received);
+}
+
+// Received packets stay valid after the port is gone.
+TEST_F(AfXdpPortTest, OutlivesPort) {
+  SKIP_IF_UNAVAILABLE();
+
+  char frame[kLen];
+  MakeFrame(frame, 3);
+  ASSERT_EQ(kLen, send(peer_fd_, frame, kLen, 0)) << strerror(errno);
+  bess::Packet *pkt = Receive(3);
+  ASSERT_NE(nullptr, pkt);
+
+  port_->DeInit();
+  port_.reset();
+  bess::PacketPool::ReapRetired();
+
+  EXPECT_TRUE(IsFrame(pkt->head_data<char *>(), pkt->head_len(), 3));
+  bess::Packet::Free(pkt);
+  bess::PacketPool::ReapRetired();
+}
+
+}  // namespace
+
+#endif  // XDP_UMEM_UNALIGNED_CHUNK_FLAG
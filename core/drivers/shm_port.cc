@@ -0,0 +1,919 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "shm_port.h"
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <rte_common.h>
+#include <rte_mbuf.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "../utils/copy.h"
+#include "../worker.h"
+
+// Descriptors are 64-bit on both ends, even for 32-bit apps
+#define __LLRING_USE_PHYS_ADDR__
+#include "../kmod/llring.h"
+
+namespace {
+
+inline uint64_t MakeDesc(uint32_t id, uint32_t len) {
+  return id | (static_cast<uint64_t>(len) << 32);
+}
+
+inline uint32_t DescId(uint64_t desc) {
+  return static_cast<uint32_t>(desc);
+}
+
+inline uint32_t DescLen(uint64_t desc) {
+  return desc >> 32;
+}
+
+// Fills in a UNIX socket address, abstract if path starts with '@'.
+// Returns the address length.
+socklen_t FillAddr(struct sockaddr_un *addr, const std::string &path) {
+  addr->sun_family = AF_UNIX;
+  snprintf(addr->sun_path, sizeof(addr->sun_path), "%s", path.c_str());
+
+  // This doesn't include the trailing null character.
+  socklen_t addrlen = offsetof(struct sockaddr_un, sun_path) +
+                      strlen(addr->sun_path);
+  if (addr->sun_path[0] == '@') {
+    addr->sun_path[0] = '\0';
+  }
+  return addrlen;
+}
+
+}  // namespace
+
+/*
+ * Note that all socket operations are run non-blocking, so that
+ * the only place we block is in the ppoll() system call.
+ */
+void ShmPortControlThread::Run() {
+  struct pollfd fds[2];
+  memset(fds, 0, sizeof(fds));
+  fds[0].fd = owner_->listen_fd_;  // -1 (ignored by ppoll()) on clients
+  fds[0].events = POLLIN;
+  fds[1].events = POLLIN | POLLRDHUP;
+
+  while (true) {
+    fds[1].fd = owner_->peer_fd_;
+    int res = ppoll(fds, 2, nullptr, Sigmask());
+
+    if (IsExitRequested()) {
+      return;
+    } else if (res < 0) {
+      if (errno != EINTR) {
+        PLOG(ERROR) << "ppoll()";
+      }
+      continue;
+    }
+
+    // A client may hang up and another connect at once
+    if (fds[1].revents) {
+      owner_->ServePeer(fds[1].revents);
+    }
+    if (fds[0].revents & POLLIN) {
+      owner_->AcceptClient();
+    }
+  }
+}
+
+CommandResponse ShmPort::Init(const bess::pb::ShmPortArg &arg) {
+  server_ = arg.server();
+
+  if (num_queues[PACKET_DIR_INC] + num_queues[PACKET_DIR_OUT] == 0) {
+    return CommandFailure(EINVAL, "At least one queue is needed");
+  }
+
+  CommandResponse err;
+  if (server_) {
+    for (packet_dir_t dir : {PACKET_DIR_INC, PACKET_DIR_OUT}) {
+      if (queue_size[dir] < 2 || !rte_is_power_of_2(queue_size[dir])) {
+        return CommandFailure(EINVAL, "Queue sizes must be powers of two");
+      }
+    }
+    trusted_uid_ = arg.trusted_uid();
+    err = CreateRegions(arg.num_buffers());
+    if (!err.has_error()) {
+      err = Listen(arg.path());
+    }
+  } else {
+    if (arg.path().empty()) {
+      return CommandFailure(EINVAL, "'path' must be given for clients");
+    }
+    if (arg.num_buffers()) {
+      return CommandFailure(EINVAL, "'num_buffers' is for servers only");
+    }
+    if (arg.trusted_uid()) {
+      return CommandFailure(EINVAL, "'trusted_uid' is for servers only");
+    }
+    err = Connect(arg.path());
+  }
+
+  if (!err.has_error() && !control_thread_.Start()) {
+    err = CommandFailure(errno, "unable to start control thread");
+  }
+
+  if (err.has_error()) {
+    DeInit();
+    return err;
+  }
+
+  return CommandSuccess();
+}
+
+void ShmPort::DeInit() {
+  // End thread and wait for it (no-op if never started).
+  control_thread_.Terminate();
+
+  if (listen_fd_ != kNotConnectedFd) {
+    close(listen_fd_);
+    listen_fd_ = kNotConnectedFd;
+  }
+  if (peer_fd_ != kNotConnectedFd) {
+    close(peer_fd_);
+    peer_fd_ = kNotConnectedFd;
+  }
+  if (ring_fd_ >= 0) {
+    close(ring_fd_);
+    ring_fd_ = -1;
+  }
+
+  for (std::vector<Queue> &queues : queues_) {
+    for (Queue &q : queues) {
+      for (bess::Packet *pkt : q.lent) {
+        bess::Packet::Free(pkt);
+      }
+    }
+    queues.clear();
+  }
+
+  if (region_) {
+    munmap(region_, region_size_);
+    region_ = nullptr;
+  }
+
+  // The buffer region of servers is the memory of their pool
+  if (buf_region_ && !server_) {
+    munmap(buf_region_, buf_region_size_);
+  }
+  buf_region_ = nullptr;
+
+  // Packets received by the server may still be in the pipeline. The lent
+  // ones are all back by now.
+  if (pool_) {
+    bess::PacketPool::Retire(std::move(pool_));
+  }
+}
+
+CommandResponse ShmPort::CreateRegions(uint64_t num_buffers) {
+  size_t nq = num_queues[PACKET_DIR_INC] + num_queues[PACKET_DIR_OUT];
+  size_t size = sizeof(Region) + nq * sizeof(QueueInfo);
+  uint64_t num_ids = 0;
+
+  for (packet_dir_t dir : {PACKET_DIR_INC, PACKET_DIR_OUT}) {
+    size_t slots = queue_size[dir];
+    size_t ring_bytes =
+        RTE_ALIGN_CEIL(llring_bytes_with_slots(slots), RTE_CACHE_LINE_SIZE);
+    size_t bufs_bytes =
+        RTE_ALIGN_CEIL((slots - 1) * sizeof(uint64_t), RTE_CACHE_LINE_SIZE);
+    size += num_queues[dir] * (2 * ring_bytes + bufs_bytes);
+    num_ids += num_queues[dir] * (slots - 1);
+  }
+
+  // Enough for all buffers to be lent, and as many packets again in the
+  // pipeline
+  if (num_buffers == 0) {
+    num_buffers = 2 * num_ids;
+  }
+
+  pool_.reset(new bess::PlainPacketPool(num_buffers, -1, true));
+  if (pool_->region_fd() < 0) {
+    return CommandFailure(ENOMEM,
+                          "Cannot allocate shared memory for %" PRIu64
+                          " packets",
+                          num_buffers);
+  }
+  if (pool_->Capacity() < num_buffers) {
+    return CommandFailure(ENOMEM, "Cannot allocate %" PRIu64 " packets",
+                          num_buffers);
+  }
+  buf_region_ = pool_->region();
+  buf_region_size_ = pool_->region_size();
+
+  ring_fd_ = memfd_create("bess_shm_port", MFD_CLOEXEC);
+  if (ring_fd_ < 0) {
+    return CommandFailure(errno, "memfd_create() failed");
+  }
+  if (ftruncate(ring_fd_, size) < 0) {
+    return CommandFailure(errno, "ftruncate() failed");
+  }
+
+  void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, 0);
+  if (addr == MAP_FAILED) {
+    return CommandFailure(errno, "mmap() failed");
+  }
+  region_ = static_cast<char *>(addr);
+  region_size_ = size;
+
+  Region *hdr = reinterpret_cast<Region *>(region_);
+  hdr->magic = kMagic;
+  hdr->version = kVersion;
+  hdr->buf_size = SNBUF_DATA;
+  hdr->region_size = region_size_;
+  hdr->buf_region_size = buf_region_size_;
+
+  QueueInfo *info = reinterpret_cast<QueueInfo *>(hdr + 1);
+  uint64_t off = sizeof(Region) + nq * sizeof(QueueInfo);
+
+  for (packet_dir_t dir : {PACKET_DIR_INC, PACKET_DIR_OUT}) {
+    uint32_t slots = queue_size[dir];
+    hdr->num_queues[dir] = num_queues[dir];
+    hdr->ring_slots[dir] = slots;
+
+    queues_[dir].resize(num_queues[dir]);
+    for (Queue &q : queues_[dir]) {
+      for (uint64_t &ring_off : info->ring_off) {
+        ring_off = off;
+        off += RTE_ALIGN_CEIL(llring_bytes_with_slots(slots),
+                              RTE_CACHE_LINE_SIZE);
+      }
+      info->bufs_off = off;
+      off += RTE_ALIGN_CEIL((slots - 1) * sizeof(uint64_t),
+                            RTE_CACHE_LINE_SIZE);
+
+      CHECK(SetUpQueue(&q, info++, slots));
+      q.lent.assign(q.num_bufs, nullptr);
+      ResetQueue(&q);
+    }
+  }
+
+  return CommandSuccess();
+}
+
+CommandResponse ShmPort::Listen(const std::string &path) {
+  listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    return CommandFailure(errno, "socket(AF_UNIX) failed");
+  }
+
+  std::string sock_path = path;
+  if (sock_path.empty()) {
+    sock_path = std::string(P_tmpdir) + "/bess_shm_" + name();
+  }
+
+  socklen_t addrlen = FillAddr(&addr_, sock_path);
+
+  // Non-abstract socket address? Remove existing socket file, if any.
+  if (addr_.sun_path[0] != '\0') {
+    unlink(addr_.sun_path);
+  }
+
+  if (bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr_), addrlen) <
+      0) {
+    return CommandFailure(errno, "bind(%s) failed", sock_path.c_str());
+  }
+
+  if (listen(listen_fd_, 1) < 0) {
+    return CommandFailure(errno, "listen() failed");
+  }
+
+  return CommandSuccess();
+}
+
+CommandResponse ShmPort::Connect(const std::string &path) {
+  peer_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (peer_fd_ < 0) {
+    return CommandFailure(errno, "socket(AF_UNIX) failed");
+  }
+
+  socklen_t addrlen = FillAddr(&addr_, path);
+  if (connect(peer_fd_, reinterpret_cast<struct sockaddr *>(&addr_),
+              addrlen) < 0) {
+    return CommandFailure(errno, "connect(%s) failed", path.c_str());
+  }
+
+  struct pollfd pfd = {.fd = peer_fd_, .events = POLLIN, .revents = 0};
+  int ret = poll(&pfd, 1, kHandshakeTimeoutMs);
+  if (ret <= 0) {
+    return CommandFailure(ret < 0 ? errno : ETIMEDOUT,
+                          "No handshake from the server");
+  }
+
+  Hello hello;
+  int fds[2];
+  struct iovec iov = {.iov_base = &hello, .iov_len = sizeof(hello)};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t len = recvmsg(peer_fd_, &msg, MSG_CMSG_CLOEXEC);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (len <= 0 || !cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+    // The server hangs up on clients while it is serving another one
+    return CommandFailure(len == 0 ? ECONNREFUSED : EPROTO,
+                          "The server refused the connection");
+  }
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+  CommandResponse err;
+  if (len != sizeof(hello) || hello.magic != kMagic ||
+      hello.version != kVersion || !(hello.conn_id & 1)) {
+    err = CommandFailure(EPROTO, "Invalid handshake from the server");
+  } else {
+    err = MapRegions(fds[0], fds[1]);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  // Let the server know why we are leaving, if we are
+  Ack ack = {.magic = kMagic,
+             .status = static_cast<int32_t>(err.error().code())};
+  if (send(peer_fd_, &ack, sizeof(ack), MSG_NOSIGNAL) < 0 &&
+      !err.has_error()) {
+    err = CommandFailure(errno, "send() failed");
+  }
+
+  if (!err.has_error()) {
+    conn_id_ = hello.conn_id;
+  }
+  return err;
+}
+
+CommandResponse ShmPort::MapRegions(int ring_fd, int buf_fd) {
+  struct stat st;
+  if (fstat(ring_fd, &st) < 0) {
+    return CommandFailure(errno, "fstat() failed");
+  }
+  if (static_cast<size_t>(st.st_size) < sizeof(Region)) {
+    return CommandFailure(EPROTO, "Invalid ring region");
+  }
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd, 0);
+  if (addr == MAP_FAILED) {
+    return CommandFailure(errno, "mmap() failed");
+  }
+  region_ = static_cast<char *>(addr);
+  region_size_ = st.st_size;
+
+  Region hdr;
+  memcpy(&hdr, region_, sizeof(hdr));
+  if (hdr.magic != kMagic || hdr.version != kVersion ||
+      hdr.region_size != region_size_ || hdr.buf_size != SNBUF_DATA) {
+    return CommandFailure(EPROTO, "Invalid ring region");
+  }
+
+  // Our RX queues are the TX queues of the server, and vice versa
+  if (hdr.num_queues[PACKET_DIR_INC] != num_queues[PACKET_DIR_OUT] ||
+      hdr.num_queues[PACKET_DIR_OUT] != num_queues[PACKET_DIR_INC]) {
+    return CommandFailure(EINVAL,
+                          "Queues (%d RX, %d TX) do not mirror those of the "
+                          "server (%u RX, %u TX)",
+                          num_queues[PACKET_DIR_INC],
+                          num_queues[PACKET_DIR_OUT],
+                          hdr.num_queues[PACKET_DIR_INC],
+                          hdr.num_queues[PACKET_DIR_OUT]);
+  }
+
+  if (sizeof(Region) + (num_queues[PACKET_DIR_INC] +
+                        num_queues[PACKET_DIR_OUT]) * sizeof(QueueInfo) >
+      region_size_) {
+    return CommandFailure(EPROTO, "Invalid ring region");
+  }
+
+  if (fstat(buf_fd, &st) < 0) {
+    return CommandFailure(errno, "fstat() failed");
+  }
+  if (static_cast<uint64_t>(st.st_size) < hdr.buf_region_size ||
+      hdr.buf_region_size < SNBUF_DATA) {
+    return CommandFailure(EPROTO, "Invalid buffer region");
+  }
+
+  addr = mmap(nullptr, hdr.buf_region_size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, buf_fd, 0);
+  if (addr == MAP_FAILED) {
+    return CommandFailure(errno, "mmap() failed");
+  }
+  buf_region_ = static_cast<char *>(addr);
+  buf_region_size_ = hdr.buf_region_size;
+
+  QueueInfo *info = reinterpret_cast<QueueInfo *>(region_ + sizeof(Region));
+
+  for (packet_dir_t sdir : {PACKET_DIR_INC, PACKET_DIR_OUT}) {
+    packet_dir_t dir = (sdir == PACKET_DIR_INC) ? PACKET_DIR_OUT
+                                                : PACKET_DIR_INC;
+    uint32_t slots = hdr.ring_slots[sdir];
+    if (num_queues[dir] &&
+        (slots < 2 || slots > MAX_QUEUE_SIZE || !rte_is_power_of_2(slots))) {
+      return CommandFailure(EPROTO, "Invalid ring size %u", slots);
+    }
+
+    queues_[dir].resize(num_queues[dir]);
+    for (Queue &q : queues_[dir]) {
+      if (!SetUpQueue(&q, info++, slots)) {
+        return CommandFailure(EPROTO, "Invalid ring region");
+      }
+    }
+  }
+
+  return CommandSuccess();
+}
+
+bool ShmPort::SetUpQueue(Queue *q, QueueInfo *info, uint32_t slots) {
+  size_t ring_bytes = llring_bytes_with_slots(slots);
+  size_t bufs_bytes = (slots - 1) * sizeof(uint64_t);
+
+  auto in_region = [this](uint64_t off, size_t len) {
+    return off % RTE_CACHE_LINE_SIZE == 0 && len <= region_size_ &&
+           off <= region_size_ - len;
+  };
+
+  for (int i = 0; i < 2; i++) {
+    uint64_t off = info->ring_off[i];
+    if (!in_region(off, ring_bytes)) {
+      return false;
+    }
+    q->rings[i] = reinterpret_cast<llring *>(region_ + off);
+  }
+
+  uint64_t off = info->bufs_off;
+  if (!in_region(off, bufs_bytes)) {
+    return false;
+  }
+  q->bufs = reinterpret_cast<uint64_t *>(region_ + off);
+  q->ready = &info->ready;
+  q->num_bufs = slots - 1;
+  q->conn_id = 0;
+  q->free_ids.reserve(std::max<size_t>(q->num_bufs,
+                                       bess::PacketBatch::kMaxBurst));
+  return true;
+}
+
+void ShmPort::AcceptClient() {
+  int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0) {
+    if (errno != EINTR && errno != EAGAIN) {
+      PLOG(ERROR) << "accept4()";
+    }
+    return;
+  }
+
+  if (peer_fd_ != kNotConnectedFd) {
+    LOG(WARNING) << name() << ": Ignoring additional client";
+    close(fd);
+    return;
+  }
+
+  struct ucred cred;
+  socklen_t cred_len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0) {
+    PLOG(ERROR) << "getsockopt(SO_PEERCRED)";
+    close(fd);
+    return;
+  }
+  if (!IsTrusted(cred.uid)) {
+    LOG(WARNING) << name() << ": Rejecting client of untrusted user "
+                 << cred.uid;
+    close(fd);
+    return;
+  }
+
+  // The connection ID becomes odd once the client acks
+  Hello hello = {
+      .magic = kMagic, .version = kVersion, .conn_id = conn_id_ + 1};
+  int fds[2] = {ring_fd_, pool_->region_fd()};
+
+  struct iovec iov = {.iov_base = &hello, .iov_len = sizeof(hello)};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(hello)) {
+    PLOG(ERROR) << "sendmsg()";
+    close(fd);
+    return;
+  }
+
+  peer_fd_ = fd;
+}
+
+bool ShmPort::IsTrusted(uid_t uid) const {
+  return uid == 0 || uid == geteuid() || uid == trusted_uid_;
+}
+
+void ShmPort::ServePeer(short revents) {
+  if (revents & POLLIN) {
+    Ack ack;
+    ssize_t ret = recv(peer_fd_, &ack, sizeof(ack), MSG_DONTWAIT);
+    bool acked = (conn_id_ & 1);
+
+    // Clients never hear from the server after the handshake
+    if (server_ && !acked && (ret >= 0 || errno != EAGAIN)) {
+      if (ret == sizeof(ack) && ack.magic == kMagic && ack.status == 0) {
+        conn_id_++;
+        LOG(INFO) << name() << ": Client connected";
+      } else {
+        LOG(WARNING) << name() << ": Client rejected the handshake"
+                     << (ret == sizeof(ack) ? ": " + std::string(strerror(
+                                                         ack.status))
+                                            : "");
+        Disconnect();
+        return;
+      }
+    }
+  }
+
+  if (revents & (POLLRDHUP | POLLHUP | POLLERR)) {
+    Disconnect();
+  }
+}
+
+void ShmPort::Disconnect() {
+  int fd = peer_fd_;
+  peer_fd_ = kNotConnectedFd;
+  close(fd);
+
+  // Servers reset their queues when they see the change; clients just stop
+  // using them.
+  uint64_t conn_id = conn_id_;
+  if (conn_id & 1) {
+    conn_id_ = conn_id + 1;
+    LOG(INFO) << name() << ": " << (server_ ? "Client" : "Server")
+              << " disconnected";
+  }
+}
+
+bool ShmPort::IsReady(Queue *q, packet_dir_t dir) {
+  uint64_t conn_id = conn_id_.load(std::memory_order_acquire);
+
+  if (!server_) {
+    return __atomic_load_n(q->ready, __ATOMIC_ACQUIRE) == conn_id;
+  }
+
+  if (likely(conn_id == q->conn_id)) {
+    return conn_id & 1;
+  }
+
+  ResetQueue(q);
+  q->conn_id = conn_id;
+  if (!(conn_id & 1)) {
+    return false;
+  }
+
+  if (dir == PACKET_DIR_INC) {
+    while (Refill(q) > 0) {
+    }
+  }
+  __atomic_store_n(q->ready, conn_id, __ATOMIC_RELEASE);
+  return true;
+}
+
+void ShmPort::ResetQueue(Queue *q) {
+  for (bess::Packet *&pkt : q->lent) {
+    if (pkt) {
+      bess::Packet::Free(pkt);
+      pkt = nullptr;
+    }
+  }
+
+  // IDs are handed out from 0
+  q->free_ids.clear();
+  for (uint32_t id = q->num_bufs; id-- > 0;) {
+    q->free_ids.push_back(id);
+  }
+
+  llring_init(q->rings[0], q->num_bufs + 1, 1, 1);
+  llring_init(q->rings[1], q->num_bufs + 1, 1, 1);
+}
+
+uint32_t ShmPort::Refill(Queue *q) {
+  bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+  uint64_t ids[bess::PacketBatch::kMaxBurst];
+
+  // No more IDs than ring slots, so the fill ring has room for all of them
+  uint32_t n = std::min<size_t>(q->free_ids.size(),
+                                bess::PacketBatch::kMaxBurst);
+  if (n == 0 || !pool_->AllocBulk(pkts, n)) {
+    return 0;
+  }
+
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t id = q->free_ids.back();
+    q->free_ids.pop_back();
+    q->lent[id] = pkts[i];
+    q->bufs[id] = pkts[i]->head_data<char *>() - buf_region_;
+    ids[i] = id;
+  }
+  llring_sp_enqueue_burst(q->rings[0], ids, n);
+  return n;
+}
+
+void ShmPort::Complete(Queue *q) {
+  bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+  uint64_t ids[bess::PacketBatch::kMaxBurst];
+  uint32_t budget = q->num_bufs;
+  int n;
+
+  while (budget > 0 &&
+         (n = llring_sc_dequeue_burst(
+              q->rings[1], ids,
+              std::min<uint32_t>(budget, bess::PacketBatch::kMaxBurst))) > 0) {
+    int done = 0;
+    for (int i = 0; i < n; i++) {
+      uint64_t id = ids[i];
+      if (likely(id < q->num_bufs && q->lent[id])) {
+        pkts[done++] = q->lent[id];
+        q->lent[id] = nullptr;
+        q->free_ids.push_back(id);
+      }
+    }
+    bess::Packet::Free(pkts, done);
+    budget -= n;
+  }
+}
+
+bool ShmPort::IsLendable(bess::Packet *pkt) const {
+  uintptr_t off = pkt->buffer<char *>() - buf_region_;
+
+  // Not of the pool (a negative offset wraps around)
+  if (off >= buf_region_size_) {
+    return false;
+  }
+
+  // Clones and their originals are shared with others
+  return pkt->is_simple() &&
+         rte_mbuf_refcnt_read(reinterpret_cast<rte_mbuf *>(pkt)) == 1;
+}
+
+bess::Packet *ShmPort::CopyToPool(bess::Packet *pkt) {
+  uint32_t len = pkt->total_len();
+  if (len > SNBUF_DATA) {
+    return nullptr;
+  }
+
+  bess::Packet *copy = pool_->Alloc();
+  if (!copy) {
+    return nullptr;
+  }
+
+  char *dst = copy->head_data<char *>();
+  for (bess::Packet *seg = pkt; seg; seg = seg->next()) {
+    bess::utils::CopyInlined(dst, seg->head_data(), seg->head_len());
+    dst += seg->head_len();
+  }
+
+  copy->set_data_len(len);
+  copy->set_total_len(len);
+  return copy;
+}
+
+int ShmPort::RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  return server_ ? RecvPacketsServer(qid, pkts, cnt)
+                 : RecvPacketsClient(qid, pkts, cnt);
+}
+
+int ShmPort::SendPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  int sent = server_ ? SendPacketsServer(qid, pkts, cnt)
+                     : SendPacketsClient(qid, pkts, cnt);
+
+  auto &stats = queue_stats[PACKET_DIR_OUT][qid];
+  stats.requested_hist[cnt]++;
+  stats.actual_hist[sent]++;
+  stats.diff_hist[cnt - sent]++;
+  return sent;
+}
+
+int ShmPort::RecvPacketsServer(queue_t qid, bess::Packet **pkts, int cnt) {
+  Queue &q = queues_[PACKET_DIR_INC][qid];
+  if (!IsReady(&q, PACKET_DIR_INC)) {
+    return 0;
+  }
+
+  uint64_t descs[bess::PacketBatch::kMaxBurst];
+  int n = llring_sc_dequeue_burst(q.rings[1], descs, cnt);
+  int received = 0;
+
+  // The packets were lent to the client, so they are handed over as they are
+  for (int i = 0; i < n; i++) {
+    uint32_t id = DescId(descs[i]);
+    uint32_t len = DescLen(descs[i]);
+    if (unlikely(id >= q.num_bufs || !q.lent[id] || len > SNBUF_DATA)) {
+      continue;
+    }
+
+    bess::Packet *pkt = q.lent[id];
+    q.lent[id] = nullptr;
+    q.free_ids.push_back(id);
+
+    pkt->set_data_len(len);
+    pkt->set_total_len(len);
+    pkts[received++] = pkt;
+  }
+
+  queue_stats[PACKET_DIR_INC][qid].dropped += n - received;
+
+  Refill(&q);
+  return received;
+}
+
+int ShmPort::SendPacketsServer(queue_t qid, bess::Packet **pkts, int cnt) {
+  Queue &q = queues_[PACKET_DIR_OUT][qid];
+  if (!IsReady(&q, PACKET_DIR_OUT)) {
+    return 0;
+  }
+
+  bess::Packet *copied[bess::PacketBatch::kMaxBurst];
+  int num_copied = 0;
+  uint64_t descs[bess::PacketBatch::kMaxBurst];
+
+  Complete(&q);
+
+  // No more IDs than ring slots, so the TX ring has room for all of them
+  int n = std::min<size_t>(cnt, q.free_ids.size());
+  int sent = 0;
+
+  for (; sent < n; sent++) {
+    bess::Packet *buf = pkts[sent];
+
+    if (!IsLendable(buf)) {
+      buf = CopyToPool(buf);
+      if (!buf) {
+        break;
+      }
+      copied[num_copied++] = pkts[sent];
+    }
+
+    uint32_t id = q.free_ids.back();
+    q.free_ids.pop_back();
+    q.lent[id] = buf;
+    q.bufs[id] = buf->head_data<char *>() - buf_region_;
+    descs[sent] = MakeDesc(id, buf->data_len());
+  }
+
+  if (sent > 0) {
+    llring_sp_enqueue_burst(q.rings[0], descs, sent);
+  }
+
+  bess::Packet::Free(copied, num_copied);
+  return sent;
+}
+
+int ShmPort::RecvPacketsClient(queue_t qid, bess::Packet **pkts, int cnt) {
+  Queue &q = queues_[PACKET_DIR_INC][qid];
+  if (!IsReady(&q, PACKET_DIR_INC)) {
+    return 0;
+  }
+
+  uint32_t n = std::min<uint32_t>(cnt, llring_count(q.rings[0]));
+  if (n == 0 || !current_worker.packet_pool()->AllocBulk(pkts, n)) {
+    return 0;
+  }
+
+  uint64_t descs[bess::PacketBatch::kMaxBurst];
+  n = llring_sc_dequeue_burst(q.rings[0], descs, n);
+  int received = 0;
+
+  for (uint32_t i = 0; i < n; i++) {
+    bess::Packet *pkt = pkts[i];
+    uint32_t id = DescId(descs[i]);
+    uint32_t len = DescLen(descs[i]);
+    uint64_t off = (id < q.num_bufs)
+                       ? __atomic_load_n(&q.bufs[id], __ATOMIC_RELAXED)
+                       : buf_region_size_;
+
+    // All IDs go back to the server, which ignores invalid ones
+    descs[i] = id;
+
+    if (unlikely(len > SNBUF_DATA || off > buf_region_size_ - len)) {
+      bess::Packet::Free(pkt);
+      continue;
+    }
+
+    bess::utils::CopyInlined(pkt->head_data(), buf_region_ + off, len);
+    pkt->set_data_len(len);
+    pkt->set_total_len(len);
+    pkts[received++] = pkt;
+  }
+
+  llring_sp_enqueue_burst(q.rings[1], descs, n);
+
+  queue_stats[PACKET_DIR_INC][qid].dropped += n - received;
+  return received;
+}
+
+int ShmPort::SendPacketsClient(queue_t qid, bess::Packet **pkts, int cnt) {
+  Queue &q = queues_[PACKET_DIR_OUT][qid];
+  if (!IsReady(&q, PACKET_DIR_OUT)) {
+    return 0;
+  }
+
+  uint64_t descs[bess::PacketBatch::kMaxBurst];
+
+  if (q.free_ids.size() < static_cast<size_t>(cnt)) {
+    int n = llring_sc_dequeue_burst(
+        q.rings[0], descs, bess::PacketBatch::kMaxBurst - q.free_ids.size());
+    for (int i = 0; i < n; i++) {
+      if (likely(descs[i] < q.num_bufs)) {
+        q.free_ids.push_back(descs[i]);
+      }
+    }
+  }
+
+  int sent = 0;
+  while (sent < cnt && !q.free_ids.empty()) {
+    bess::Packet *pkt = pkts[sent];
+    uint32_t len = pkt->total_len();
+    if (len > SNBUF_DATA) {
+      break;
+    }
+
+    uint32_t id = q.free_ids.back();
+    q.free_ids.pop_back();
+    uint64_t off = __atomic_load_n(&q.bufs[id], __ATOMIC_RELAXED);
+    if (unlikely(off > buf_region_size_ - SNBUF_DATA)) {
+      continue;  // a broken buffer, kept out of circulation
+    }
+
+    char *dst = buf_region_ + off;
+    for (bess::Packet *seg = pkt; seg; seg = seg->next()) {
+      bess::utils::CopyInlined(dst, seg->head_data(), seg->head_len());
+      dst += seg->head_len();
+    }
+
+    descs[sent++] = MakeDesc(id, len);
+  }
+
+  if (sent > 0) {
+    llring_sp_enqueue_burst(q.rings[1], descs, sent);
+  }
+
+  bess::Packet::Free(pkts, sent);
+  return sent;
+}
+
+Port::LinkStatus ShmPort::GetLinkStatus() {
+  return LinkStatus{
+      .speed = 0,
+      .full_duplex = true,
+      .autoneg = true,
+      .link_up = (conn_id_ & 1) != 0,
+  };
+}
+
+ADD_DRIVER(ShmPort, "shm_port", "shared memory port to another bessd or app")
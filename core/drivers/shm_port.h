@@ -0,0 +1,241 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef BESS_DRIVERS_SHM_PORT_H_
+#define BESS_DRIVERS_SHM_PORT_H_
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../packet_pool.h"
+#include "../port.h"
+#include "../utils/syscallthread.h"
+
+struct llring;
+class ShmPort;
+
+// Serves the control socket: accepts clients and watches for hangups on the
+// server, and watches for a hangup of the server on the client.
+class ShmPortControlThread final : public bess::utils::SyscallThreadPfuncs {
+ public:
+  explicit ShmPortControlThread(ShmPort *owner) : owner_(owner) {}
+  void Run() override;
+
+ private:
+  ShmPort *owner_;
+};
+
+// Port to another bessd, or to a local app, through shared memory.
+//
+// The server creates two memfds: a ring region with a pair of single-
+// producer, single-consumer llrings per queue, and the buffer region, which
+// is the memory of a private PacketPool. A client connects to the UNIX
+// socket of the server, gets both fds with SCM_RIGHTS and maps them. From
+// then on, packets are exchanged by polling the rings, with no system calls.
+//
+// Buffers are owned by the server, and identified by per-queue IDs. The
+// server lends packets of its pool to the client: empty ones on a fill ring
+// for the client to transmit into, and full ones on a TX ring. The client
+// returns them on an RX ring and a completion ring, respectively. Thus the
+// server never copies packets of its own pool; the client always copies.
+//
+// The buffer region is all of the memory of the pool, so clients can
+// write to the packet headers and metadata of the server too, and thereby
+// crash it or worse. Clients are thus trusted: the server only accepts
+// those run by root, by the user of bessd, or by a user given as trusted.
+// They are also trusted not to corrupt the ring headers, but descriptors
+// from either side are validated. The server survives clients coming and
+// going; a client whose server hangs up only goes down, and must be
+// recreated to reconnect.
+class ShmPort final : public Port {
+ public:
+  static const uint32_t kMagic = 0x42534850;  // "PHSB"
+  static const uint32_t kVersion = 1;
+
+  // First message of the server, with the ring and buffer fds attached.
+  struct Hello {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t conn_id;  // the client may use queues once they are ready
+  };
+
+  // Reply of the client. Nonzero status (an errno) rejects the server.
+  struct Ack {
+    uint32_t magic;
+    int32_t status;
+  };
+
+  // The ring region starts with a Region, followed by a QueueInfo for each
+  // INC queue of the server, then for each OUT queue. Offsets are from the
+  // start of the ring region, except for buffer offsets, which are from the
+  // start of the buffer region.
+  struct alignas(64) Region {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_queues[PACKET_DIRS];  // of the server
+    uint32_t ring_slots[PACKET_DIRS];
+    uint32_t buf_size;  // room of each buffer, from its offset
+    uint64_t region_size;
+    uint64_t buf_region_size;
+  };
+
+  // A descriptor is "id | len << 32". Ring 0 goes from the server to the
+  // client: buffer IDs of the fill ring for server INC queues, descriptors
+  // of the TX ring for OUT queues. Ring 1 goes the other way: descriptors of
+  // the RX ring, or IDs of the completion ring. A queue has ring_slots - 1
+  // IDs, so neither ring can overflow.
+  struct alignas(64) QueueInfo {
+    uint64_t ready;  // conn_id of the client the rings were reset for
+    uint64_t ring_off[2];
+    uint64_t bufs_off;  // uint64_t buffer offsets, by ID
+  };
+
+  ShmPort()
+      : Port(),
+        server_(),
+        control_thread_(this),
+        listen_fd_(kNotConnectedFd),
+        peer_fd_(kNotConnectedFd),
+        ring_fd_(-1),
+        trusted_uid_(),
+        addr_(),
+        conn_id_(),
+        region_(),
+        region_size_(),
+        buf_region_(),
+        buf_region_size_() {}
+
+  CommandResponse Init(const bess::pb::ShmPortArg &arg);
+
+  void DeInit() override;
+
+  int RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+  int SendPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+
+  LinkStatus GetLinkStatus() override;
+
+ private:
+  friend class ShmPortControlThread;
+
+  struct Queue {
+    llring *rings[2];
+    uint64_t *bufs;
+    uint64_t *ready;
+    uint32_t num_bufs;
+
+    // Server: IDs not lent to the client. Client: IDs taken from the fill
+    // ring, not used yet.
+    std::vector<uint32_t> free_ids;
+
+    // Server only: packets lent to the client, by ID, and the connection the
+    // rings were last reset for
+    std::vector<bess::Packet *> lent;
+    uint64_t conn_id;
+  };
+
+  static const int kNotConnectedFd = -1;
+  static const int kHandshakeTimeoutMs = 1000;
+
+  CommandResponse Listen(const std::string &path);
+  CommandResponse CreateRegions(uint64_t num_buffers);
+  CommandResponse Connect(const std::string &path);
+  CommandResponse MapRegions(int ring_fd, int buf_fd);
+
+  // Points q at the rings described by info, if they lie in the region
+  bool SetUpQueue(Queue *q, QueueInfo *info, uint32_t slots);
+
+  // Server only: may a client of this user map the buffer region?
+  bool IsTrusted(uid_t uid) const;
+
+  // Called by the control thread
+  void AcceptClient();
+  void ServePeer(short revents);
+  void Disconnect();
+
+  // Is the client connection that the queue serves up? On the server, this
+  // resets the queue first if the connection has changed.
+  bool IsReady(Queue *q, packet_dir_t dir);
+
+  // Server only: takes back all lent packets and empties the rings
+  void ResetQueue(Queue *q);
+
+  // Server only: lends empty packets on the fill ring. Returns their number.
+  uint32_t Refill(Queue *q);
+
+  // Server only: frees the packets of completed transmissions
+  void Complete(Queue *q);
+
+  // Server only: can pkt be lent to the client as it is?
+  bool IsLendable(bess::Packet *pkt) const;
+
+  // Server only: returns a new packet of the pool with the data of pkt
+  bess::Packet *CopyToPool(bess::Packet *pkt);
+
+  int RecvPacketsServer(queue_t qid, bess::Packet **pkts, int cnt);
+  int SendPacketsServer(queue_t qid, bess::Packet **pkts, int cnt);
+  int RecvPacketsClient(queue_t qid, bess::Packet **pkts, int cnt);
+  int SendPacketsClient(queue_t qid, bess::Packet **pkts, int cnt);
+
+  bool server_;
+
+  ShmPortControlThread control_thread_;
+
+  int listen_fd_;
+  // The connected client (on the server) or the server (on the client).
+  // Written by the control thread only, after Init().
+  volatile int peer_fd_;
+  int ring_fd_;        // server only
+  uid_t trusted_uid_;  // server only, besides root and our own user
+  struct sockaddr_un addr_;
+
+  // Odd while a client is connected, bumped on every connect and hangup.
+  // The client keeps the value it was given by the server in the Hello.
+  std::atomic<uint64_t> conn_id_;
+
+  char *region_;
+  size_t region_size_;
+  char *buf_region_;
+  size_t buf_region_size_;
+
+  // Server only: backs the buffer region. Packets received by the port come
+  // from, and go back to this pool, which DeInit() retires rather than
+  // destroys, since they may still be in the pipeline.
+  std::unique_ptr<bess::PlainPacketPool> pool_;
+
+  // Indexed by the direction of this port
+  std::vector<Queue> queues_[PACKET_DIRS];
+};
+
+#endif  // BESS_DRIVERS_SHM_PORT_H_
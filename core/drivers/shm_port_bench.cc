@@ -0,0 +1,173 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Measures the throughput of a server and a client shm port, polled by the
+// same thread, for each direction and a few packet sizes. Packets from
+// elsewhere are copied on both ends; "Loopback" has the server forward what
+// it receives, which it does without a copy.
+
+#include "shm_port.h"
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../opts.h"
+#include "../packet_pool.h"
+#include "../worker.h"
+
+namespace {
+
+const int kBurst = bess::PacketBatch::kMaxBurst;
+
+class ShmPortFixture : public benchmark::Fixture {
+ public:
+  void SetUp(benchmark::State &) override {
+    // Clients receive into packets of the pool of the current worker
+    if (!bess::PacketPool::GetDefaultPool(0)) {
+      FLAGS_m = 0;
+      bess::PacketPool::CreateDefaultPools();
+    }
+    current_worker.SetNonWorker();
+    pool_ = current_worker.packet_pool();
+
+    std::string path = "@bess_shm_port_bench_" + std::to_string(getpid());
+    bess::pb::ShmPortArg arg;
+    arg.set_path(path);
+
+    arg.set_server(true);
+    server_.reset(NewPort());
+    CommandResponse err = server_->Init(arg);
+    CHECK(!err.has_error()) << err.error().errmsg();
+
+    arg.set_server(false);
+    client_.reset(NewPort());
+    err = client_->Init(arg);
+    CHECK(!err.has_error()) << err.error().errmsg();
+
+    while (!server_->GetLinkStatus().link_up) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  void TearDown(benchmark::State &) override {
+    client_->DeInit();
+    client_.reset();
+    server_->DeInit();
+    server_.reset();
+  }
+
+ protected:
+  static ShmPort *NewPort() {
+    ShmPort *port = new ShmPort();
+    for (packet_dir_t dir : {PACKET_DIR_INC, PACKET_DIR_OUT}) {
+      port->num_queues[dir] = 1;
+      port->queue_size[dir] = 1024;
+    }
+    return port;
+  }
+
+  // Sends a batch of new packets of 'len' bytes. Returns the number sent.
+  int Send(ShmPort *port, int len) {
+    bess::Packet *pkts[kBurst];
+    CHECK(pool_->AllocBulk(pkts, kBurst, len));
+    int sent = port->SendPackets(0, pkts, kBurst);
+    bess::Packet::Free(pkts + sent, kBurst - sent);
+    return sent;
+  }
+
+  // Receives and drops a batch. Returns the number received.
+  int Drain(ShmPort *port) {
+    bess::Packet *pkts[kBurst];
+    int received = port->RecvPackets(0, pkts, kBurst);
+    bess::Packet::Free(pkts, received);
+    return received;
+  }
+
+  bess::PacketPool *pool_;
+  std::unique_ptr<ShmPort> server_;
+  std::unique_ptr<ShmPort> client_;
+};
+
+BENCHMARK_DEFINE_F(ShmPortFixture, ClientToServer)(benchmark::State &state) {
+  int len = state.range(0);
+  uint64_t pkts = 0;
+
+  for (auto _ : state) {
+    Send(client_.get(), len);
+    pkts += Drain(server_.get());
+  }
+
+  state.SetItemsProcessed(pkts);
+  state.SetBytesProcessed(pkts * len);
+}
+
+BENCHMARK_DEFINE_F(ShmPortFixture, ServerToClient)(benchmark::State &state) {
+  int len = state.range(0);
+  uint64_t pkts = 0;
+
+  for (auto _ : state) {
+    Send(server_.get(), len);
+    pkts += Drain(client_.get());
+  }
+
+  state.SetItemsProcessed(pkts);
+  state.SetBytesProcessed(pkts * len);
+}
+
+BENCHMARK_DEFINE_F(ShmPortFixture, Loopback)(benchmark::State &state) {
+  int len = state.range(0);
+  uint64_t pkts = 0;
+  bess::Packet *batch[kBurst];
+
+  for (auto _ : state) {
+    Send(client_.get(), len);
+    int received = server_->RecvPackets(0, batch, kBurst);
+    int sent = server_->SendPackets(0, batch, received);
+    bess::Packet::Free(batch + sent, received - sent);
+    pkts += Drain(client_.get());
+  }
+
+  state.SetItemsProcessed(pkts);
+  state.SetBytesProcessed(pkts * len);
+}
+
+BENCHMARK_REGISTER_F(ShmPortFixture, ClientToServer)->Arg(64)->Arg(1500);
+BENCHMARK_REGISTER_F(ShmPortFixture, ServerToClient)->Arg(64)->Arg(1500);
+BENCHMARK_REGISTER_F(ShmPortFixture, Loopback)->Arg(64)->Arg(1500);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,322 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "shm_port.h"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../opts.h"
+#include "../packet_pool.h"
+#include "../worker.h"
+
+namespace {
+
+const int kQueueSize = 64;
+
+// A server and a client in the same process, polled by the test thread.
+class ShmPortTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    // Clients receive into packets of the pool of the current worker
+    FLAGS_m = 0;
+    if (!bess::PacketPool::GetDefaultPool(0)) {
+      bess::PacketPool::CreateDefaultPools(4096);
+    }
+    current_worker.SetNonWorker();
+  }
+
+  virtual void SetUp() {
+    path_ = "@bess_shm_port_test_" + std::to_string(getpid());
+
+    bess::pb::ShmPortArg arg;
+    arg.set_path(path_);
+    arg.set_server(true);
+    server_ = NewPort(1, 1);
+    ASSERT_FALSE(server_->Init(arg).has_error());
+  }
+
+  virtual void TearDown() {
+    if (client_) {
+      client_->DeInit();
+    }
+    server_->DeInit();
+  }
+
+  std::unique_ptr<ShmPort> NewPort(queue_t num_rxq, queue_t num_txq) {
+    std::unique_ptr<ShmPort> port(new ShmPort());
+    port->num_queues[PACKET_DIR_INC] = num_rxq;
+    port->num_queues[PACKET_DIR_OUT] = num_txq;
+    port->queue_size[PACKET_DIR_INC] = kQueueSize;
+    port->queue_size[PACKET_DIR_OUT] = kQueueSize;
+    return port;
+  }
+
+  CommandResponse Connect(queue_t num_rxq = 1, queue_t num_txq = 1) {
+    bess::pb::ShmPortArg arg;
+    arg.set_path(path_);
+    client_ = NewPort(num_rxq, num_txq);
+    return client_->Init(arg);
+  }
+
+  void Disconnect() {
+    client_->DeInit();
+    client_.reset();
+  }
+
+  // Waits for the link to be up (or down) on both ends. The server sets up
+  // its queues for a client the next time they are polled.
+  bool WaitForLink(bool up) {
+    for (int i = 0; i < 1000; i++) {
+      if (server_->GetLinkStatus().link_up == up &&
+          (!client_ || client_->GetLinkStatus().link_up == up)) {
+        bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+        server_->RecvPackets(0, pkts, 0);
+        server_->SendPackets(0, pkts, 0);
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+  }
+
+  // Packets of 'len' bytes, from 'seed' on
+  void AllocPackets(bess::Packet **pkts, int cnt, uint16_t len, int seed) {
+    ASSERT_TRUE(current_worker.packet_pool()->AllocBulk(pkts, cnt, len));
+    for (int i = 0; i < cnt; i++) {
+      char *data = pkts[i]->head_data<char *>();
+      for (int j = 0; j < len; j++) {
+        data[j] = seed + i + j;
+      }
+    }
+  }
+
+  void CheckPackets(bess::Packet **pkts, int cnt, uint16_t len, int seed) {
+    for (int i = 0; i < cnt; i++) {
+      ASSERT_EQ(len, pkts[i]->total_len());
+      ASSERT_EQ(len, pkts[i]->head_len());
+      const char *data = pkts[i]->head_data<const char *>();
+      for (int j = 0; j < len; j++) {
+        ASSERT_EQ(static_cast<char>(seed + i + j), data[j]) << i << " " << j;
+      }
+    }
+  }
+
+  // Polls port until it has received cnt packets
+  int Receive(ShmPort *port, bess::Packet **pkts, int cnt) {
+    int received = 0;
+    for (int i = 0; i < 1000 && received < cnt; i++) {
+      received += port->RecvPackets(0, pkts + received, cnt - received);
+    }
+    return received;
+  }
+
+  std::string path_;
+  std::unique_ptr<ShmPort> server_;
+  std::unique_ptr<ShmPort> client_;
+};
+
+TEST_F(ShmPortTest, NotConnected) {
+  bess::Packet *pkts[4];
+  AllocPackets(pkts, 4, 60, 0);
+
+  EXPECT_FALSE(server_->GetLinkStatus().link_up);
+  EXPECT_EQ(0, server_->SendPackets(0, pkts, 4));
+  EXPECT_EQ(0, server_->RecvPackets(0, pkts, 4));
+
+  bess::Packet::Free(pkts, 4);
+}
+
+TEST_F(ShmPortTest, ClientToServer) {
+  ASSERT_FALSE(Connect().has_error());
+  ASSERT_TRUE(WaitForLink(true));
+
+  bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+  for (int round = 0; round < 10; round++) {
+    AllocPackets(pkts, 32, 100 + round, round);
+    ASSERT_EQ(32, client_->SendPackets(0, pkts, 32));
+
+    ASSERT_EQ(32, Receive(server_.get(), pkts, 32));
+    CheckPackets(pkts, 32, 100 + round, round);
+    bess::Packet::Free(pkts, 32);
+  }
+}
+
+TEST_F(ShmPortTest, ServerToClient) {
+  ASSERT_FALSE(Connect().has_error());
+  ASSERT_TRUE(WaitForLink(true));
+
+  bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+
+  // Copied into the buffers of the server
+  for (int round = 0; round < 10; round++) {
+    AllocPackets(pkts, 32, 1500, round);
+    ASSERT_EQ(32, server_->SendPackets(0, pkts, 32));
+
+    ASSERT_EQ(32, Receive(client_.get(), pkts, 32));
+    CheckPackets(pkts, 32, 1500, round);
+    bess::Packet::Free(pkts, 32);
+  }
+
+  // Packets received by the server are its own, and lent back as they are
+  for (int round = 0; round < 10; round++) {
+    AllocPackets(pkts, 16, 64, round);
+    ASSERT_EQ(16, client_->SendPackets(0, pkts, 16));
+    ASSERT_EQ(16, Receive(server_.get(), pkts, 16));
+    ASSERT_EQ(16, server_->SendPackets(0, pkts, 16));
+
+    ASSERT_EQ(16, Receive(client_.get(), pkts, 16));
+    CheckPackets(pkts, 16, 64, round);
+    bess::Packet::Free(pkts, 16);
+  }
+}
+
+TEST_F(ShmPortTest, Backpressure) {
+  ASSERT_FALSE(Connect().has_error());
+  ASSERT_TRUE(WaitForLink(true));
+
+  // The client has kQueueSize - 1 buffers to send into
+  bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+  int sent = 0;
+  for (int i = 0; i < 4; i++) {
+    AllocPackets(pkts, 32, 60, 0);
+    int n = client_->SendPackets(0, pkts, 32);
+    bess::Packet::Free(pkts + n, 32 - n);
+    sent += n;
+  }
+  EXPECT_EQ(kQueueSize - 1, sent);
+
+  // ... and gets them back once the server has received some
+  ASSERT_EQ(32, Receive(server_.get(), pkts, 32));
+  bess::Packet::Free(pkts, 32);
+
+  AllocPackets(pkts, 32, 60, 0);
+  EXPECT_EQ(32, client_->SendPackets(0, pkts, 32));
+}
+
+TEST_F(ShmPortTest, Reconnect) {
+  bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+
+  // Buffers left with a client are taken back when it leaves. Otherwise the
+  // pool of the server would run dry after a few rounds.
+  for (int round = 0; round < 10; round++) {
+    ASSERT_FALSE(Connect().has_error());
+    ASSERT_TRUE(WaitForLink(true));
+
+    AllocPackets(pkts, 32, 60, round);
+    ASSERT_EQ(32, server_->SendPackets(0, pkts, 32));
+    AllocPackets(pkts, 32, 60, round);
+    ASSERT_EQ(32, client_->SendPackets(0, pkts, 32));
+
+    ASSERT_EQ(16, Receive(server_.get(), pkts, 16));
+    CheckPackets(pkts, 16, 60, round);
+    bess::Packet::Free(pkts, 16);
+
+    Disconnect();
+    ASSERT_TRUE(WaitForLink(false));
+  }
+}
+
+TEST_F(ShmPortTest, ServerHangup) {
+  ASSERT_FALSE(Connect().has_error());
+  ASSERT_TRUE(WaitForLink(true));
+
+  server_->DeInit();
+  server_ = NewPort(1, 1);
+  for (int i = 0; i < 1000 && client_->GetLinkStatus().link_up; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_FALSE(client_->GetLinkStatus().link_up);
+
+  bess::Packet *pkts[4];
+  AllocPackets(pkts, 4, 60, 0);
+  EXPECT_EQ(0, client_->SendPackets(0, pkts, 4));
+  EXPECT_EQ(0, client_->RecvPackets(0, pkts, 4));
+  bess::Packet::Free(pkts, 4);
+}
+
+// Packets received by the server stay valid after it is gone.
+TEST_F(ShmPortTest, OutlivesServer) {
+  ASSERT_FALSE(Connect().has_error());
+  ASSERT_TRUE(WaitForLink(true));
+
+  bess::Packet *pkts[16];
+  AllocPackets(pkts, 16, 60, 5);
+  ASSERT_EQ(16, client_->SendPackets(0, pkts, 16));
+  ASSERT_EQ(16, Receive(server_.get(), pkts, 16));
+
+  Disconnect();
+  server_->DeInit();
+  server_ = NewPort(1, 1);
+  bess::PacketPool::ReapRetired();
+
+  CheckPackets(pkts, 16, 60, 5);
+  bess::Packet::Free(pkts, 16);
+  bess::PacketPool::ReapRetired();
+}
+
+TEST_F(ShmPortTest, QueueMismatch) {
+  CommandResponse err = Connect(2, 1);
+  EXPECT_EQ(EINVAL, err.error().code());
+  client_.reset();
+
+  // The server hangs up on the client, and takes the next one
+  ASSERT_TRUE(WaitForLink(false));
+  ASSERT_FALSE(Connect().has_error());
+  ASSERT_TRUE(WaitForLink(true));
+}
+
+TEST_F(ShmPortTest, NoServer) {
+  bess::pb::ShmPortArg arg;
+  arg.set_path(path_ + "_none");
+  std::unique_ptr<ShmPort> port = NewPort(1, 1);
+  EXPECT_EQ(ECONNREFUSED, port->Init(arg).error().code());
+}
+
+TEST_F(ShmPortTest, ServerOnlyArgs) {
+  bess::pb::ShmPortArg arg;
+  arg.set_path(path_);
+  arg.set_trusted_uid(1000);
+  std::unique_ptr<ShmPort> port = NewPort(1, 1);
+  EXPECT_EQ(EINVAL, port->Init(arg).error().code());
+
+  arg.set_trusted_uid(0);
+  arg.set_num_buffers(1024);
+  port = NewPort(1, 1);
+  EXPECT_EQ(EINVAL, port->Init(arg).error().code());
+}
+
+}  // namespace
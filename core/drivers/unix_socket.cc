@@ -131,6 +131,16 @@ CommandResponse UnixSocketPort::Init(const bess::pb::UnixSocketPortArg &arg) {
 
   confirm_connect_ = arg.confirm_connect();
 
+  if (arg.io_uring()) {
+#ifdef BESS_HAVE_IO_URING
+    io_uring_ = true;
+#else
+    return CommandFailure(ENOTSUP, "BESS was built without io_uring support");
+#endif
+  } else if (arg.sqpoll()) {
+    return CommandFailure(EINVAL, "'sqpoll' requires 'io_uring'");
+  }
+
   listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET, 0);
   if (listen_fd_ < 0) {
     DeInit();
@@ -169,11 +179,25 @@ CommandResponse UnixSocketPort::Init(const bess::pb::UnixSocketPortArg &arg) {
     return CommandFailure(errno, "listen() failed");
   }
 
+#ifdef BESS_HAVE_IO_URING
+  if (io_uring_) {
+    CommandResponse err = SetUpIoUring(arg.sqpoll());
+    if (err.error().code() != 0) {
+      DeInit();
+      return err;
+    }
+  }
+#endif
+
   if (!accept_thread_.Start()) {
     DeInit();
     return CommandFailure(errno, "unable to start accept thread");
   }
 
+  if (io_uring_) {
+    return CommandSuccess();
+  }
+
   for (size_t i = 0; i < bess::PacketBatch::kMaxBurst; i++) {
     recv_vector_[i] = {.msg_hdr = {.msg_name = nullptr,
                                    .msg_namelen = 0,
@@ -203,6 +227,12 @@ void UnixSocketPort::DeInit() {
     close(client_fd_);
   }
 
+#ifdef BESS_HAVE_IO_URING
+  if (io_uring_) {
+    TearDownIoUring();
+  }
+#endif
+
   for (auto *pkt : pkt_recv_vector_) {
     bess::Packet::Free(pkt);
   }
@@ -213,6 +243,12 @@ int UnixSocketPort::RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) {
 
   DCHECK_EQ(qid, 0);
 
+#ifdef BESS_HAVE_IO_URING
+  if (io_uring_) {
+    return RecvPacketsIoUring(pkts, cnt);
+  }
+#endif
+
   if (client_fd == kNotConnectedFd) {
     last_idle_ns_ = 0;
     return 0;
@@ -255,6 +291,14 @@ int UnixSocketPort::SendPackets(queue_t qid, bess::Packet **pkts, int cnt) {
 
   DCHECK_EQ(qid, 0);
 
+#ifdef BESS_HAVE_IO_URING
+  if (io_uring_) {
+    int taken = SendPacketsIoUring(pkts, cnt);
+    queue_stats[PACKET_DIR_OUT][0].dropped += cnt - taken;
+    return taken;
+  }
+#endif
+
   if (client_fd == kNotConnectedFd) {
     return 0;
   }
@@ -297,5 +341,340 @@ int UnixSocketPort::SendPackets(queue_t qid, bess::Packet **pkts, int cnt) {
   return sent;
 }
 
+#ifdef BESS_HAVE_IO_URING
+
+// user_data of requests other than receives and sends
+static const uint64_t kIoUringCancelTag = 0;
+
+// The kernel caps buffer rings at 32768 entries
+static const size_t kMaxRxBufs = 32768;
+
+CommandResponse UnixSocketPort::SetUpIoUring(bool sqpoll) {
+  size_t num_bufs = std::min(
+      static_cast<size_t>(align_ceil_pow2(queue_size[PACKET_DIR_INC])),
+      kMaxRxBufs);
+
+  rx_bufs_.assign(num_bufs, nullptr);
+  rx_armed_fd_ = kNotConnectedFd;
+  rx_seq_ = 0;
+  tx_inflight_ = 0;
+  tx_msgs_inflight_ = 0;
+  tx_full_ = false;
+
+  // Every buffer may have a completion pending. The RX ring needs no SQPOLL,
+  // since a receive is submitted only once per connection.
+  int ret = rx_ring_.Init(num_bufs, false);
+  if (ret < 0) {
+    return CommandFailure(-ret, "io_uring_setup() failed");
+  }
+
+  ret = tx_ring_.Init(bess::PacketBatch::kMaxBurst + 1, sqpoll);
+  if (ret < 0) {
+    return CommandFailure(-ret, "io_uring_setup() failed");
+  }
+
+  ret = rx_ring_.SetUpBufRing(num_bufs, 0);
+  if (ret < 0) {
+    return CommandFailure(-ret, "IORING_REGISTER_PBUF_RING failed");
+  }
+
+  bess::PacketPool *pool = current_worker.packet_pool();
+  for (size_t i = 0; i < num_bufs; i++) {
+    bess::Packet *pkt = pool->Alloc();
+    if (!pkt) {
+      return CommandFailure(ENOMEM, "packet allocation failed");
+    }
+    rx_bufs_[i] = pkt;
+    rx_ring_.AddBuf(pkt->data(), SNBUF_DATA, i);
+  }
+  rx_ring_.CommitBufs();
+
+  return CommandSuccess();
+}
+
+// Cancels all requests on 'ring', and waits until they complete.
+// 'on_cqe' is called for each completion but that of the cancel request.
+template <typename F>
+static void CancelAll(bess::utils::IoUring *ring, F on_cqe) {
+  io_uring_sqe *sqe = ring->GetSqe();
+  if (!sqe) {
+    return;
+  }
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+  sqe->user_data = kIoUringCancelTag;
+  if (ring->Submit() < 0) {
+    return;
+  }
+
+  bool canceled = false;
+  bool more = true;
+  while (!canceled || more) {
+    if (ring->WaitCqe() < 0) {
+      return;
+    }
+
+    io_uring_cqe *cqes[bess::PacketBatch::kMaxBurst];
+    unsigned n = ring->PeekCqes(cqes, bess::PacketBatch::kMaxBurst);
+    for (unsigned i = 0; i < n; i++) {
+      if (cqes[i]->user_data == kIoUringCancelTag) {
+        canceled = true;
+      } else {
+        more = on_cqe(cqes[i]);
+      }
+    }
+    ring->AdvanceCq(n);
+  }
+}
+
+void UnixSocketPort::TearDownIoUring() {
+  // The kernel must be done with the packets before they are freed
+  if (tx_ring_.fd() >= 0 && tx_inflight_ > 0) {
+    CancelAll(&tx_ring_, [this](io_uring_cqe *cqe) {
+      bess::Packet::Free(reinterpret_cast<bess::Packet *>(cqe->user_data));
+      return --tx_inflight_ > 0;
+    });
+  }
+
+  if (rx_ring_.fd() >= 0 && rx_armed_fd_ != kNotConnectedFd) {
+    bool armed = true;
+    CancelAll(&rx_ring_, [this, &armed](io_uring_cqe *cqe) {
+      if (cqe->user_data == rx_seq_ && !(cqe->flags & IORING_CQE_F_MORE)) {
+        armed = false;
+      }
+      return armed;
+    });
+  }
+
+  tx_ring_.Close();
+  rx_ring_.Close();
+
+  for (auto *pkt : rx_bufs_) {
+    bess::Packet::Free(pkt);
+  }
+  rx_bufs_.clear();
+}
+
+void UnixSocketPort::ArmRecv(int client_fd) {
+  io_uring_sqe *sqe;
+
+  // A receive may still run on the previous client. Its remaining
+  // completions are told apart by the sequence number.
+  if (rx_armed_fd_ != kNotConnectedFd) {
+    sqe = rx_ring_.GetSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = rx_seq_;
+    sqe->user_data = kIoUringCancelTag;
+  }
+
+  sqe = rx_ring_.GetSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = client_fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->user_data = ++rx_seq_;
+
+  if (rx_ring_.Submit() < 0) {
+    rx_armed_fd_ = kNotConnectedFd;
+  } else {
+    rx_armed_fd_ = client_fd;
+  }
+}
+
+int UnixSocketPort::RecvPacketsIoUring(bess::Packet **pkts, int cnt) {
+  int client_fd = client_fd_;
+
+  // Completions of a previous client are still handed out
+  if (client_fd != kNotConnectedFd && client_fd != rx_armed_fd_) {
+    ArmRecv(client_fd);
+  }
+
+  io_uring_cqe *cqes[bess::PacketBatch::kMaxBurst];
+  unsigned n = rx_ring_.PeekCqes(cqes, cnt);
+  if (n == 0) {
+    return 0;
+  }
+
+  uint16_t bids[bess::PacketBatch::kMaxBurst];
+  uint32_t lens[bess::PacketBatch::kMaxBurst];
+  int filled = 0;
+
+  for (unsigned i = 0; i < n; i++) {
+    io_uring_cqe *cqe = cqes[i];
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+      bids[filled] = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      lens[filled] = std::max(cqe->res, 0);
+      filled++;
+    }
+
+    // The receive ends on errors, on disconnection, or when it ran out of
+    // buffers. It is restarted by the next call, if still connected.
+    if (!(cqe->flags & IORING_CQE_F_MORE) && cqe->user_data == rx_seq_) {
+      rx_armed_fd_ = kNotConnectedFd;
+    }
+  }
+  rx_ring_.AdvanceCq(n);
+
+  // Hand out the filled packets, and give new ones to the kernel in their
+  // place. The packets are dropped if we cannot replace them.
+  bess::Packet *new_pkts[bess::PacketBatch::kMaxBurst];
+  bool allocated =
+      current_worker.packet_pool()->AllocBulk(new_pkts, filled);
+
+  int received = 0;
+  for (int i = 0; i < filled; i++) {
+    uint16_t bid = bids[i];
+
+    if (allocated && lens[i] > 0) {
+      bess::Packet *pkt = rx_bufs_[bid];
+      pkt->append(lens[i]);
+      pkts[received++] = pkt;
+      rx_bufs_[bid] = new_pkts[i];
+    } else if (allocated) {
+      bess::Packet::Free(new_pkts[i]);
+    }
+
+    rx_ring_.AddBuf(rx_bufs_[bid]->data(), SNBUF_DATA, bid);
+  }
+  rx_ring_.CommitBufs();
+
+  return received;
+}
+
+void UnixSocketPort::ReapSends() {
+  io_uring_cqe *cqes[bess::PacketBatch::kMaxBurst];
+  bess::Packet *done[bess::PacketBatch::kMaxBurst];
+
+  unsigned n = tx_ring_.PeekCqes(cqes, bess::PacketBatch::kMaxBurst);
+  uint64_t sent = 0;
+  uint64_t sent_bytes = 0;
+  for (unsigned i = 0; i < n; i++) {
+    done[i] = reinterpret_cast<bess::Packet *>(cqes[i]->user_data);
+    if (done[i]->nb_segs() > 1) {
+      tx_msgs_inflight_--;
+    }
+
+    // Sends never wait for room in the socket, but fail with EAGAIN.
+    if (cqes[i]->res >= 0) {
+      sent++;
+      sent_bytes += done[i]->total_len();
+    } else if (cqes[i]->res == -EAGAIN) {
+      tx_full_ = true;
+    }
+  }
+  tx_ring_.AdvanceCq(n);
+
+  bess::Packet::Free(done, n);
+  tx_inflight_ -= n;
+
+  auto &stats = queue_stats[PACKET_DIR_OUT][0];
+  stats.packets += sent;
+  stats.bytes += sent_bytes;
+  stats.dropped += n - sent;
+}
+
+int UnixSocketPort::SendPacketsIoUring(bess::Packet **pkts, int cnt) {
+  int client_fd = client_fd_;
+
+  ReapSends();
+
+  // The socket is full. Hold back, as sendmmsg() would with EAGAIN, until
+  // the sends in flight (which will likely fail too) are done, so that no
+  // later send overtakes them. Sends merely in flight are no sign of a full
+  // socket, as with SQPOLL they complete only after this call returns.
+  if (tx_full_) {
+    if (tx_inflight_ > 0) {
+      tx_ring_.Submit();
+      return 0;
+    }
+    tx_full_ = false;
+  }
+
+  if (client_fd == kNotConnectedFd) {
+    return 0;
+  }
+
+  size_t iovec_idx = 0;
+  int msgs = 0;
+  int i;
+
+  for (i = 0; i < cnt; i++) {
+    bess::Packet *pkt = pkts[i];
+    int nb_segs = pkt->nb_segs();
+
+    if (iovec_idx + nb_segs > send_iovecs_.size()) {
+      break;
+    }
+
+    // The messages of the previous batch may still be in use
+    if (nb_segs > 1 && tx_msgs_inflight_ > 0) {
+      break;
+    }
+
+    io_uring_sqe *sqe = tx_ring_.GetSqe();
+    if (!sqe) {
+      break;  // The SQ is full
+    }
+
+    // Not linked, so that a failed send does not cancel the next ones. Sends
+    // that do not wait are issued in order all the same.
+    sqe->fd = client_fd;
+    sqe->flags = 0;
+    sqe->msg_flags = MSG_DONTWAIT;
+    sqe->user_data = reinterpret_cast<uintptr_t>(pkt);
+
+    if (nb_segs == 1) {
+      sqe->opcode = IORING_OP_SEND;
+      sqe->addr = reinterpret_cast<uintptr_t>(pkt->head_data());
+      sqe->len = pkt->head_len();
+      continue;
+    }
+
+    // The message must stay valid until the send completes. Until then, the
+    // next batches send no messages.
+    msghdr *msg = &send_vector_[i].msg_hdr;
+    *msg = {.msg_name = nullptr,
+            .msg_namelen = 0,
+            .msg_iov = &send_iovecs_[iovec_idx],
+            .msg_iovlen = static_cast<size_t>(nb_segs),
+            .msg_control = nullptr,
+            .msg_controllen = 0,
+            .msg_flags = 0};
+
+    for (bess::Packet *seg = pkt; seg; seg = seg->next()) {
+      send_iovecs_[iovec_idx++] = {
+          .iov_base = seg->head_data(),
+          .iov_len = static_cast<size_t>(seg->head_len())};
+    }
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->addr = reinterpret_cast<uintptr_t>(msg);
+    sqe->len = 1;
+    msgs++;
+  }
+
+  if (i == 0) {
+    return 0;
+  }
+
+  tx_inflight_ += i;
+  tx_msgs_inflight_ += msgs;
+
+  // The packets now belong to the ring, even if submission failed. Such
+  // SQEs are submitted again by the next call.
+  if (tx_ring_.Submit() < 0) {
+    return i;
+  }
+
+  // Sends to a socket with room complete right away
+  ReapSends();
+
+  return i;
+}
+
+#endif  // BESS_HAVE_IO_URING
+
 ADD_DRIVER(UnixSocketPort, "unix_port",
            "packet exchange via a UNIX domain socket")
@@ -39,10 +39,12 @@
 #include <array>
 #include <atomic>
 #include <thread>
+#include <vector>
 
 #include "../message.h"
 #include "../port.h"
 
+#include "../utils/io_uring.h"
 #include "../utils/syscallthread.h"
 
 class UnixSocketPort;
@@ -73,19 +75,23 @@ class UnixSocketPort final : public Port {
  public:
   UnixSocketPort()
       : Port(),
+        pkt_recv_vector_(),
         min_rx_interval_ns_(),
         last_idle_ns_(),
         confirm_connect_(false),
         accept_thread_(this),
         listen_fd_(kNotConnectedFd),
         addr_(),
-        client_fd_(kNotConnectedFd) {}
+        client_fd_(kNotConnectedFd),
+        io_uring_(false) {}
 
   /*!
    * Initialize the port, ie, open the socket.
    *
    * PARAMETERS:
    * * string path : file name to bind the socket to.
+   * * bool io_uring : use io_uring instead of recvmmsg()/sendmmsg().
+   * * bool sqpoll : poll the io_uring TX submissions with a kernel thread.
    */
   CommandResponse Init(const bess::pb::UnixSocketPortArg &arg);
 
@@ -98,9 +104,37 @@ class UnixSocketPort final : public Port {
   int RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
   int SendPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
 
+  // The client socket, if connected. A reconnected client gets a new fd,
+  // which is picked up the next time the workers resume. In io_uring mode
+  // the socket is read by the kernel, so it cannot be used for wakeups.
+  int GetRxQueueFd(queue_t) const override {
+    return io_uring_ ? -1 : client_fd_;
+  }
+
+  // In io_uring mode, SendPackets() takes packets before they are sent, and
+  // they are counted as sent or dropped once their sends complete.
+  uint64_t GetFlags() const override {
+    return io_uring_ ? DRIVER_FLAG_SELF_OUT_STATS : 0;
+  }
+
  private:
   void ReplenishRecvVector(int cnt);
 
+#ifdef BESS_HAVE_IO_URING
+  CommandResponse SetUpIoUring(bool sqpoll);
+  void TearDownIoUring();
+
+  int RecvPacketsIoUring(bess::Packet **pkts, int cnt);
+  int SendPacketsIoUring(bess::Packet **pkts, int cnt);
+
+  // (Re)starts the multishot receive on 'client_fd'
+  void ArmRecv(int client_fd);
+
+  // Frees the packets of completed sends, and counts them as sent, or as
+  // dropped if they failed.
+  void ReapSends();
+#endif
+
   // These rely on there being no multiqueue support !!!
   std::array<bess::Packet *, bess::PacketBatch::kMaxBurst> pkt_recv_vector_;
   std::array<mmsghdr, bess::PacketBatch::kMaxBurst> recv_vector_;
@@ -148,6 +182,39 @@ class UnixSocketPort final : public Port {
   // volatile.
   /* FD for client connection.*/
   volatile int client_fd_;
+
+  bool io_uring_;
+
+#ifdef BESS_HAVE_IO_URING
+  // io_uring mode. The kernel receives into packets from a provided buffer
+  // ring, with a single multishot receive request, so that polling for
+  // packets takes no system calls. Sends are submitted once per batch, and
+  // packets are freed as their sends complete.
+  //
+  // RX and TX may run on different workers, thus have separate rings.
+  bess::utils::IoUring rx_ring_;
+  bess::utils::IoUring tx_ring_;
+
+  // The members below are initialized by SetUpIoUring().
+
+  // Packets given to the kernel, indexed by buffer ID
+  std::vector<bess::Packet *> rx_bufs_;
+
+  // The client socket that the multishot receive is running on, if any
+  int rx_armed_fd_;
+
+  // Tags the current multishot receive (as user_data)
+  uint64_t rx_seq_;
+
+  // Sends submitted but not completed yet
+  int tx_inflight_;
+
+  // ... of which are of segmented packets, using send_vector_
+  int tx_msgs_inflight_;
+
+  // A send has failed for lack of room in the socket
+  bool tx_full_;
+#endif
 };
 
 #endif  // BESS_DRIVERS_UNIXSOCKET_H_
@@ -0,0 +1,272 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "vhost_user.h"
+
+#include <linux/limits.h>
+
+#include <rte_mbuf.h>
+#include <rte_pause.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#include "../worker.h"
+
+namespace {
+
+// Packets in BESS carry no offload metadata, so neither side may leave
+// checksums or segmentation to the other.
+const uint64_t kOffloadFeatures =
+    (1ULL << VIRTIO_NET_F_CSUM) | (1ULL << VIRTIO_NET_F_GUEST_CSUM) |
+    (1ULL << VIRTIO_NET_F_GUEST_TSO4) | (1ULL << VIRTIO_NET_F_GUEST_TSO6) |
+    (1ULL << VIRTIO_NET_F_GUEST_ECN) | (1ULL << VIRTIO_NET_F_GUEST_UFO) |
+    (1ULL << VIRTIO_NET_F_HOST_TSO4) | (1ULL << VIRTIO_NET_F_HOST_TSO6) |
+    (1ULL << VIRTIO_NET_F_HOST_ECN) | (1ULL << VIRTIO_NET_F_HOST_UFO);
+
+// Ports by socket path. Callbacks hold the lock while they use a port, and
+// ports leave the map only after unregistering from the vhost library.
+std::mutex ports_mutex;
+std::map<std::string, VhostUserPort *> ports;
+
+}  // namespace
+
+const vhost_device_ops VhostUserPort::kDeviceOps = [] {
+  vhost_device_ops ops = {};
+  ops.new_device = NewDevice;
+  ops.destroy_device = DestroyDevice;
+  return ops;
+}();
+
+CommandResponse VhostUserPort::Init(const bess::pb::VhostUserPortArg &arg) {
+  if (arg.path().empty()) {
+    return CommandFailure(EINVAL, "'path' must be given");
+  }
+
+  uint64_t flags = 0;
+  if (arg.client()) {
+    flags |= RTE_VHOST_USER_CLIENT;
+  }
+  if (arg.zero_copy()) {
+#ifdef RTE_VHOST_USER_DEQUEUE_ZERO_COPY
+    flags |= RTE_VHOST_USER_DEQUEUE_ZERO_COPY;
+#else
+    return CommandFailure(ENOTSUP, "This DPDK has no dequeue zero-copy");
+#endif
+  }
+
+  uint64_t disabled_features = kOffloadFeatures;
+  if (arg.disable_mrg_rxbuf()) {
+    disabled_features |= 1ULL << VIRTIO_NET_F_MRG_RXBUF;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(ports_mutex);
+    if (!ports.emplace(arg.path(), this).second) {
+      return CommandFailure(EEXIST, "Socket '%s' is used by another port",
+                            arg.path().c_str());
+    }
+  }
+  path_ = arg.path();
+
+  if (rte_vhost_driver_register(path_.c_str(), flags) != 0) {
+    DeInit();
+    return CommandFailure(EINVAL, "rte_vhost_driver_register() failed");
+  }
+  registered_ = true;
+
+  if (rte_vhost_driver_disable_features(path_.c_str(), disabled_features) !=
+      0) {
+    DeInit();
+    return CommandFailure(EINVAL, "rte_vhost_driver_disable_features() failed");
+  }
+
+  if (rte_vhost_driver_callback_register(path_.c_str(), &kDeviceOps) != 0) {
+    DeInit();
+    return CommandFailure(EINVAL,
+                          "rte_vhost_driver_callback_register() failed");
+  }
+
+  // Servers start listening, and clients start (re)trying to connect
+  if (rte_vhost_driver_start(path_.c_str()) != 0) {
+    DeInit();
+    return CommandFailure(EINVAL, "rte_vhost_driver_start() failed on '%s'",
+                          path_.c_str());
+  }
+
+  return CommandSuccess();
+}
+
+void VhostUserPort::DeInit() {
+  // Destroys the device, if any, before it returns
+  if (registered_) {
+    rte_vhost_driver_unregister(path_.c_str());
+    registered_ = false;
+  }
+
+  std::lock_guard<std::mutex> lock(ports_mutex);
+  auto it = ports.find(path_);
+  if (it != ports.end() && it->second == this) {
+    ports.erase(it);
+  }
+}
+
+VhostUserPort *VhostUserPort::FindPort(int vid) {
+  char path[PATH_MAX];
+  if (rte_vhost_get_ifname(vid, path, sizeof(path)) != 0) {
+    return nullptr;
+  }
+
+  auto it = ports.find(path);
+  return it != ports.end() ? it->second : nullptr;
+}
+
+int VhostUserPort::NewDevice(int vid) {
+  std::lock_guard<std::mutex> lock(ports_mutex);
+  VhostUserPort *port = FindPort(vid);
+  return port ? port->OnNewDevice(vid) : -1;
+}
+
+void VhostUserPort::DestroyDevice(int vid) {
+  std::lock_guard<std::mutex> lock(ports_mutex);
+  VhostUserPort *port = FindPort(vid);
+  if (port) {
+    port->OnDestroyDevice(vid);
+  }
+}
+
+int VhostUserPort::OnNewDevice(int vid) {
+  // A server socket may take more than one connection, but a port serves
+  // only one device.
+  if (vid_ >= 0) {
+    LOG(WARNING) << name() << ": Another guest is connected already";
+    return -1;
+  }
+
+  uint16_t num_vrings = rte_vhost_get_vring_num(vid);
+  queue_t num_pairs = std::max(num_queues[PACKET_DIR_INC],
+                               num_queues[PACKET_DIR_OUT]);
+  LOG_IF(WARNING, num_vrings / VIRTIO_QNUM != num_pairs)
+      << name() << ": The guest has " << num_vrings / VIRTIO_QNUM
+      << " queue pairs, but the port has " << static_cast<int>(num_pairs);
+
+  // We poll, so guests need not kick us. Guests cannot undo this, since it
+  // is up to us (the device) to update the used ring.
+  for (uint16_t i = 0; i < num_vrings; i++) {
+    rte_vhost_enable_guest_notification(vid, i, 0);
+  }
+
+  vid_ = vid;
+
+  for (packet_dir_t dir : {PACKET_DIR_INC, PACKET_DIR_OUT}) {
+    for (queue_t qid = 0; qid < num_queues[dir]; qid++) {
+      // The vhost library itself skips vrings the guest has not enabled,
+      // but complains about those that do not exist.
+      queues_[dir][qid].allowed = vring_id(dir, qid) < num_vrings;
+    }
+  }
+
+  LOG(INFO) << name() << ": Guest connected";
+  return 0;
+}
+
+void VhostUserPort::OnDestroyDevice(int vid) {
+  if (vid != vid_) {
+    return;
+  }
+
+  for (packet_dir_t dir : {PACKET_DIR_INC, PACKET_DIR_OUT}) {
+    for (queue_t qid = 0; qid < num_queues[dir]; qid++) {
+      queues_[dir][qid].allowed = false;
+    }
+  }
+
+  // The device (and guest memory) goes away when we return
+  for (packet_dir_t dir : {PACKET_DIR_INC, PACKET_DIR_OUT}) {
+    for (queue_t qid = 0; qid < num_queues[dir]; qid++) {
+      while (queues_[dir][qid].busy) {
+        rte_pause();
+      }
+    }
+  }
+
+  vid_ = -1;
+  LOG(INFO) << name() << ": Guest disconnected";
+}
+
+int VhostUserPort::RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  Queue &q = queues_[PACKET_DIR_INC][qid];
+  if (!q.Enter()) {
+    return 0;
+  }
+
+  // With zero-copy, the packets are allocated from the pool but their data
+  // stays in guest memory, until the packets are freed back to the pool.
+  int received = rte_vhost_dequeue_burst(
+      vid_.load(std::memory_order_relaxed), vring_id(PACKET_DIR_INC, qid),
+      current_worker.packet_pool()->pool(),
+      reinterpret_cast<rte_mbuf **>(pkts), cnt);
+
+  q.Leave();
+  return received;
+}
+
+int VhostUserPort::SendPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  Queue &q = queues_[PACKET_DIR_OUT][qid];
+  int sent = 0;
+
+  if (q.Enter()) {
+    // Copies the packets, and notifies the guest once for all of them
+    sent = rte_vhost_enqueue_burst(vid_.load(std::memory_order_relaxed),
+                                   vring_id(PACKET_DIR_OUT, qid),
+                                   reinterpret_cast<rte_mbuf **>(pkts), cnt);
+    q.Leave();
+    bess::Packet::Free(pkts, sent);
+  }
+
+  auto &stats = queue_stats[PACKET_DIR_OUT][qid];
+  stats.requested_hist[cnt]++;
+  stats.actual_hist[sent]++;
+  stats.diff_hist[cnt - sent]++;
+  return sent;
+}
+
+Port::LinkStatus VhostUserPort::GetLinkStatus() {
+  return LinkStatus{
+      .speed = 0,
+      .full_duplex = true,
+      .autoneg = true,
+      .link_up = vid_ >= 0,
+  };
+}
+
+ADD_DRIVER(VhostUserPort, "vhost_user",
+           "vhost-user backend for the virtio-net device of a VM or container")
@@ -0,0 +1,135 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef BESS_DRIVERS_VHOST_USER_H_
+#define BESS_DRIVERS_VHOST_USER_H_
+
+#include <atomic>
+#include <string>
+
+#include <rte_config.h>
+
+// rte_vhost.h includes <linux/virtio_net.h>, which has a field named "class"
+// and does not compile as C++. Include it first with the field renamed.
+#define class class_
+#include <linux/virtio_net.h>
+#undef class
+
+#include <rte_vhost.h>
+
+#include "../port.h"
+
+// Port to a VM or a container, as the vhost-user backend of its virtio-net
+// device. Unlike a PMDPort on a net_vhost vdev, it decides which features are
+// offered and whether packets are copied, and keeps per-queue statistics.
+//
+// BESS queue i is queue pair i of the device: INC queue i polls the TX vring
+// of the guest, and OUT queue i fills its RX vring. The guest should use as
+// many queue pairs as the port has queues (in the larger direction); vrings
+// of other queue pairs are not served.
+//
+// The port polls its vrings, so the guest is asked not to kick it when it
+// posts buffers. The guest is still notified of used buffers once per burst,
+// unless it has turned that off itself, as polling DPDK guests do.
+//
+// Mergeable RX buffers are offered, so the guest may post small buffers and
+// still receive packets larger than them. Checksum and segmentation offloads
+// are not, since packets in BESS carry no offload metadata.
+//
+// With zero_copy, packets from the guest are handed to the pipeline in place:
+// their data stays in guest memory, and their descriptors are returned to the
+// guest once the packets are freed. Such packets have no headroom, and
+// holding on to them stalls the TX vring of the guest (and its teardown).
+// Packets to the guest are always copied.
+class VhostUserPort final : public Port {
+ public:
+  VhostUserPort() : Port(), path_(), registered_(), vid_(-1), queues_() {}
+
+  CommandResponse Init(const bess::pb::VhostUserPortArg &arg);
+
+  void DeInit() override;
+
+  int RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+  int SendPackets(queue_t qid, bess::Packet **pkts, int cnt) override;
+
+  LinkStatus GetLinkStatus() override;
+
+ private:
+  // Guards the vring of a BESS queue against the device going away. Workers
+  // call the vhost library between Enter() and Leave(). Before a device is
+  // destroyed, the vhost thread clears 'allowed' and waits for 'busy' to
+  // clear.
+  struct alignas(64) Queue {
+    std::atomic<bool> allowed;
+    std::atomic<bool> busy;
+
+    bool Enter() {
+      if (!allowed.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      // Sequentially consistent, so it is not reordered with the load below
+      busy.store(true);
+      if (allowed.load()) {
+        return true;
+      }
+      busy.store(false, std::memory_order_release);
+      return false;
+    }
+
+    void Leave() { busy.store(false, std::memory_order_release); }
+  };
+
+  // Callbacks of the vhost library, called by its thread. They find the port
+  // of a device by its socket path.
+  static int NewDevice(int vid);
+  static void DestroyDevice(int vid);
+  static VhostUserPort *FindPort(int vid);
+
+  static const vhost_device_ops kDeviceOps;
+
+  int OnNewDevice(int vid);
+  void OnDestroyDevice(int vid);
+
+  // Vring of the guest that BESS queue qid in direction dir is served by
+  static uint16_t vring_id(packet_dir_t dir, queue_t qid) {
+    return qid * VIRTIO_QNUM +
+           (dir == PACKET_DIR_INC ? VIRTIO_TXQ : VIRTIO_RXQ);
+  }
+
+  std::string path_;
+  bool registered_;  // with the vhost library
+
+  // The running device, or -1
+  std::atomic<int> vid_;
+
+  Queue queues_[PACKET_DIRS][MAX_QUEUES_PER_DIR];
+};
+
+#endif  // BESS_DRIVERS_VHOST_USER_H_
@@ -0,0 +1,368 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "vhost_user.h"
+
+#include <gtest/gtest.h>
+
+#include <rte_bus_vdev.h>
+#include <rte_ethdev.h>
+#include <rte_mbuf.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../opts.h"
+#include "../packet_pool.h"
+#include "../worker.h"
+
+namespace {
+
+const int kNumQueues = 2;
+const int kQueueSize = 256;
+const char *kPeerName = "net_virtio_user_bess_test";
+
+// The port is the backend of a virtio-user device of DPDK in the same
+// process, which plays the guest. Both are polled by the test thread.
+class VhostUserPortTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    FLAGS_m = 0;
+    if (!bess::PacketPool::GetDefaultPool(0)) {
+      bess::PacketPool::CreateDefaultPools(4096);
+    }
+    current_worker.SetNonWorker();
+
+    // The guest memory must be known to DPDK, to be shared with the backend
+    guest_pool_ = rte_pktmbuf_pool_create("vhost_user_test", 4095, 256, 0,
+                                          RTE_MBUF_DEFAULT_BUF_SIZE,
+                                          SOCKET_ID_ANY);
+    small_guest_pool_ =
+        rte_pktmbuf_pool_create("vhost_user_test_small", 4095, 256, 0,
+                                RTE_PKTMBUF_HEADROOM + 512, SOCKET_ID_ANY);
+  }
+
+  virtual void SetUp() {
+    ASSERT_NE(nullptr, guest_pool_);
+    ASSERT_NE(nullptr, small_guest_pool_);
+
+    path_ = "/tmp/bess_vhost_user_test_" + std::to_string(getpid());
+
+    bess::pb::VhostUserPortArg arg;
+    arg.set_path(path_);
+    ASSERT_FALSE(StartPort(arg).has_error());
+  }
+
+  virtual void TearDown() {
+    StopPeer();
+    port_->DeInit();
+  }
+
+  CommandResponse StartPort(const bess::pb::VhostUserPortArg &arg) {
+    port_.reset(new VhostUserPort());
+    port_->num_queues[PACKET_DIR_INC] = kNumQueues;
+    port_->num_queues[PACKET_DIR_OUT] = kNumQueues;
+    return port_->Init(arg);
+  }
+
+  // Creates the virtio-user device, with RX buffers from pool. Returns false
+  // if it cannot be created, e.g., since DPDK runs without hugepages and has
+  // no memory it can share.
+  bool StartPeer(rte_mempool *pool) {
+    std::string args = "path=" + path_ +
+                       ",queues=" + std::to_string(kNumQueues) +
+                       ",cq=1,queue_size=" + std::to_string(kQueueSize);
+    if (rte_vdev_init(kPeerName, args.c_str()) != 0) {
+      std::cerr << "virtio-user peer not available. Skipping test..."
+                << std::endl;
+      return false;
+    }
+    peer_started_ = true;
+
+    if (rte_eth_dev_get_port_by_name(kPeerName, &peer_id_) != 0) {
+      ADD_FAILURE() << "No port for " << kPeerName;
+      return false;
+    }
+
+    rte_eth_conf conf = {};
+    if (rte_eth_dev_configure(peer_id_, kNumQueues, kNumQueues, &conf) != 0) {
+      ADD_FAILURE() << "rte_eth_dev_configure() failed";
+      return false;
+    }
+    for (int i = 0; i < kNumQueues; i++) {
+      if (rte_eth_rx_queue_setup(peer_id_, i, kQueueSize, SOCKET_ID_ANY,
+                                 nullptr, pool) != 0 ||
+          rte_eth_tx_queue_setup(peer_id_, i, kQueueSize, SOCKET_ID_ANY,
+                                 nullptr) != 0) {
+        ADD_FAILURE() << "Queue setup failed";
+        return false;
+      }
+    }
+    if (rte_eth_dev_start(peer_id_) != 0) {
+      ADD_FAILURE() << "rte_eth_dev_start() failed";
+      return false;
+    }
+
+    if (!WaitForLink(true)) {
+      ADD_FAILURE() << "The guest did not show up";
+      return false;
+    }
+    return true;
+  }
+
+  void StopPeer() {
+    if (peer_started_) {
+      rte_eth_dev_stop(peer_id_);
+      rte_vdev_uninit(kPeerName);
+      peer_started_ = false;
+    }
+  }
+
+  bool WaitForLink(bool up) {
+    for (int i = 0; i < 1000; i++) {
+      if (port_->GetLinkStatus().link_up == up) {
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+  }
+
+  // Fills len bytes of data, from seed on
+  static void Fill(char *data, int len, int seed) {
+    for (int j = 0; j < len; j++) {
+      data[j] = seed + j;
+    }
+  }
+
+  static void Check(const char *data, int len, int seed) {
+    for (int j = 0; j < len; j++) {
+      ASSERT_EQ(static_cast<char>(seed + j), data[j]) << j;
+    }
+  }
+
+  // The guest transmits cnt packets of len bytes on queue qid, with data
+  // from seed + i on for packet i
+  void GuestSend(queue_t qid, int cnt, uint16_t len, int seed) {
+    rte_mbuf *mbufs[bess::PacketBatch::kMaxBurst];
+    ASSERT_EQ(0, rte_pktmbuf_alloc_bulk(guest_pool_, mbufs, cnt));
+    for (int i = 0; i < cnt; i++) {
+      Fill(rte_pktmbuf_append(mbufs[i], len), len, seed + i);
+    }
+
+    int sent = 0;
+    for (int i = 0; i < 1000 && sent < cnt; i++) {
+      sent += rte_eth_tx_burst(peer_id_, qid, mbufs + sent, cnt - sent);
+    }
+    for (int i = sent; i < cnt; i++) {
+      rte_pktmbuf_free(mbufs[i]);
+    }
+    ASSERT_EQ(cnt, sent);
+  }
+
+  // The guest receives cnt packets on queue qid and checks them
+  void GuestReceive(queue_t qid, int cnt, uint16_t len, int seed) {
+    rte_mbuf *mbufs[bess::PacketBatch::kMaxBurst];
+    int received = 0;
+    for (int i = 0; i < 1000 && received < cnt; i++) {
+      received += rte_eth_rx_burst(peer_id_, qid, mbufs + received,
+                                   cnt - received);
+    }
+
+    char buf[SNBUF_DATA];
+    for (int i = 0; i < received; i++) {
+      ASSERT_EQ(len, rte_pktmbuf_pkt_len(mbufs[i]));
+      const char *data =
+          static_cast<const char *>(rte_pktmbuf_read(mbufs[i], 0, len, buf));
+      Check(data, len, seed + i);
+      rte_pktmbuf_free(mbufs[i]);
+    }
+    ASSERT_EQ(cnt, received);
+  }
+
+  // The port sends cnt packets on queue qid, retrying until the guest has
+  // enabled the queue. Returns the number of packets sent.
+  int Send(queue_t qid, int cnt, uint16_t len, int seed) {
+    bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+    EXPECT_TRUE(current_worker.packet_pool()->AllocBulk(pkts, cnt, len));
+    for (int i = 0; i < cnt; i++) {
+      Fill(pkts[i]->head_data<char *>(), len, seed + i);
+    }
+
+    int sent = 0;
+    for (int i = 0; i < 1000 && sent < cnt; i++) {
+      sent += port_->SendPackets(qid, pkts + sent, cnt - sent);
+    }
+    bess::Packet::Free(pkts + sent, cnt - sent);
+    return sent;
+  }
+
+  // The port receives cnt packets on queue qid and checks them
+  void Receive(queue_t qid, int cnt, uint16_t len, int seed) {
+    bess::Packet *pkts[bess::PacketBatch::kMaxBurst];
+    int received = 0;
+    for (int i = 0; i < 1000 && received < cnt; i++) {
+      received += port_->RecvPackets(qid, pkts + received, cnt - received);
+    }
+
+    for (int i = 0; i < received; i++) {
+      ASSERT_EQ(len, pkts[i]->total_len());
+      ASSERT_EQ(len, pkts[i]->head_len());
+      Check(pkts[i]->head_data<const char *>(), len, seed + i);
+    }
+    bess::Packet::Free(pkts, received);
+    ASSERT_EQ(cnt, received);
+  }
+
+  static rte_mempool *guest_pool_;
+  static rte_mempool *small_guest_pool_;
+
+  std::string path_;
+  std::unique_ptr<VhostUserPort> port_;
+  bool peer_started_ = false;
+  uint16_t peer_id_ = 0;
+};
+
+rte_mempool *VhostUserPortTest::guest_pool_;
+rte_mempool *VhostUserPortTest::small_guest_pool_;
+
+TEST_F(VhostUserPortTest, NotConnected) {
+  bess::Packet *pkts[4];
+  ASSERT_TRUE(current_worker.packet_pool()->AllocBulk(pkts, 4, 60));
+
+  EXPECT_FALSE(port_->GetLinkStatus().link_up);
+  EXPECT_EQ(0, port_->SendPackets(0, pkts, 4));
+  EXPECT_EQ(0, port_->RecvPackets(0, pkts, 4));
+  EXPECT_EQ(1, port_->queue_stats[PACKET_DIR_OUT][0].diff_hist[4]);
+
+  bess::Packet::Free(pkts, 4);
+}
+
+TEST_F(VhostUserPortTest, SamePath) {
+  bess::pb::VhostUserPortArg arg;
+  arg.set_path(path_);
+  VhostUserPort other;
+  EXPECT_EQ(EEXIST, other.Init(arg).error().code());
+}
+
+TEST_F(VhostUserPortTest, GuestToHost) {
+  if (!StartPeer(guest_pool_)) {
+    return;
+  }
+
+  for (int round = 0; round < 10; round++) {
+    for (queue_t qid = 0; qid < kNumQueues; qid++) {
+      GuestSend(qid, 32, 60 + round, round + qid);
+      Receive(qid, 32, 60 + round, round + qid);
+    }
+  }
+}
+
+TEST_F(VhostUserPortTest, HostToGuest) {
+  if (!StartPeer(guest_pool_)) {
+    return;
+  }
+
+  for (int round = 0; round < 10; round++) {
+    for (queue_t qid = 0; qid < kNumQueues; qid++) {
+      ASSERT_EQ(32, Send(qid, 32, 1500, round + qid));
+      GuestReceive(qid, 32, 1500, round + qid);
+    }
+  }
+}
+
+TEST_F(VhostUserPortTest, MergeableRxBuffers) {
+  if (!StartPeer(small_guest_pool_)) {
+    return;
+  }
+
+  // Spread over several guest buffers
+  ASSERT_EQ(32, Send(0, 32, 1500, 0));
+  GuestReceive(0, 32, 1500, 0);
+}
+
+TEST_F(VhostUserPortTest, NoMergeableRxBuffers) {
+  port_->DeInit();
+  bess::pb::VhostUserPortArg arg;
+  arg.set_path(path_);
+  arg.set_disable_mrg_rxbuf(true);
+  ASSERT_FALSE(StartPort(arg).has_error());
+
+  if (!StartPeer(small_guest_pool_)) {
+    return;
+  }
+
+  // Does not fit in a guest buffer
+  EXPECT_EQ(0, Send(0, 1, 1500, 0));
+
+  ASSERT_EQ(32, Send(0, 32, 400, 0));
+  GuestReceive(0, 32, 400, 0);
+}
+
+TEST_F(VhostUserPortTest, ZeroCopy) {
+  port_->DeInit();
+  bess::pb::VhostUserPortArg arg;
+  arg.set_path(path_);
+  arg.set_zero_copy(true);
+  ASSERT_FALSE(StartPort(arg).has_error());
+
+  if (!StartPeer(guest_pool_)) {
+    return;
+  }
+
+  // Descriptors go back to the guest as packets are freed. Otherwise it
+  // would run out of them after a vring worth of packets.
+  for (int round = 0; round < 4 * kQueueSize / 32; round++) {
+    GuestSend(0, 32, 1000, round);
+    Receive(0, 32, 1000, round);
+  }
+}
+
+TEST_F(VhostUserPortTest, Reconnect) {
+  for (int round = 0; round < 5; round++) {
+    if (!StartPeer(guest_pool_)) {
+      return;
+    }
+
+    GuestSend(0, 32, 60, round);
+    Receive(0, 32, 60, round);
+    ASSERT_EQ(32, Send(0, 32, 60, round));
+    GuestReceive(0, 32, 60, round);
+
+    StopPeer();
+    ASSERT_TRUE(WaitForLink(false));
+  }
+}
+
+}  // namespace
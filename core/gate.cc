@@ -37,6 +37,7 @@
 #include <string>
 #include <utility>
 
+#include "resume_hook.h"
 #include "worker.h"
 
 namespace bess {
@@ -185,15 +186,17 @@ void Gate::RemoveHookByClass(const std::string &class_name) {
 CommandResponse GateHookBuilder::RunCommand(
     GateHook *hook, const std::string &user_cmd,
     const google::protobuf::Any &arg) const {
-  Module *mod = hook->gate()->module();
   for (auto &cmd : cmds_) {
     if (user_cmd == cmd.cmd) {
+      // Hitless rewiring does not update active workers, so hold them all.
       if (cmd.mt_safe != GateHookCommand::THREAD_SAFE &&
-          mod->HasRunningWorker()) {
-        return CommandFailure(EBUSY,
-                              "There is a running worker and command "
-                              "'%s' is not MT safe",
-                              cmd.cmd.c_str());
+          is_any_worker_running()) {
+        // Switch over to the new state between task runs of every worker.
+        WorkerHolder holder;
+        CommandResponse ret = cmd.func(hook, arg);
+        // Whatever pause_all/resume_all around the command would have redone
+        bess::run_global_resume_hooks();
+        return ret;
       }
 
       return cmd.func(hook, arg);
@@ -211,6 +214,21 @@ void Gate::ClearHooks() {
   hooks_.clear();
 }
 
+std::vector<GateHook *> Gate::TakeHooks() {
+  std::vector<GateHook *> hooks;
+  hooks.swap(hooks_);
+  return hooks;
+}
+
+void Gate::AddHooks(const std::vector<GateHook *> &hooks) {
+  for (GateHook *hook : hooks) {
+    hook->set_gate(this);
+    if (AddHook(hook) != 0) {
+      delete hook;
+    }
+  }
+}
+
 void IGate::PushOgate(OGate *og) {
   ogates_upstream_.push_back(og);
   mergeable_ = (ogates_upstream_.size() > 1);
@@ -220,7 +238,7 @@ void IGate::RemoveOgate(const OGate *og) {
   for (auto it = ogates_upstream_.begin(); it != ogates_upstream_.end(); ++it) {
     if (*it == og) {
       ogates_upstream_.erase(it);
-      return;
+      break;
     }
   }
   mergeable_ = (ogates_upstream_.size() > 1);
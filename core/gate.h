@@ -224,6 +224,14 @@ class Gate {
 
   void ClearHooks();
 
+  // Removes all hooks without deleting them, e.g., to move them over to
+  // another gate with AddHooks() before this one goes away.
+  std::vector<GateHook *> TakeHooks();
+
+  // Inserts hooks taken from another gate. The ones whose names are taken
+  // already are deleted.
+  void AddHooks(const std::vector<GateHook *> &hooks);
+
  protected:
   friend class GateTest;
 
@@ -277,7 +285,7 @@ class IGate : public Gate {
 class OGate : public Gate {
  public:
   OGate(Module *m, gate_idx_t idx, Module *next)
-      : Gate(m, idx), next_(next), igate_(), igate_idx_() {}
+      : Gate(m, idx), next_(next), igate_(), igate_idx_(), fused_(false) {}
 
   void SetIgate(IGate *ig);
 
@@ -285,12 +293,18 @@ class OGate : public Gate {
   IGate *igate() const { return igate_; }
   gate_idx_t igate_idx() const { return igate_idx_; }
 
+  // If true, batches sent through this gate are processed by the next module
+  // right away, instead of being queued in the task. Set by ModuleGraph.
+  bool fused() const { return fused_; }
+  void set_fused(bool fused) { fused_ = fused; }
+
   void AddTrackHook();
 
  private:
   Module *next_;          // next module connected with
   IGate *igate_;          // next igate connected with
   gate_idx_t igate_idx_;  // cache for igate->gate_idx
+  bool fused_;            // part of a linear chain without hooks
 
   DISALLOW_COPY_AND_ASSIGN(OGate);
 };
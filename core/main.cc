@@ -83,7 +83,7 @@ int main(int argc, char *argv[]) {
                   << FLAGS_modules;
   }
 
-  bess::PacketPool::CreateDefaultPools(FLAGS_buffers);
+  bess::PacketPool::CreateDefaultPools(FLAGS_buffers, FLAGS_buffers_max);
 
   PortBuilder::InitDrivers();
 
@@ -379,6 +379,25 @@ void DmaMemoryPool::Free(void *ptr) {
   total_free_bytes_ += size;
 }
 
+bool DmaMemoryPool::Expand(size_t size) {
+  size_t page_bytes = static_cast<size_t>(HugepageSize::k2MB);
+  size_t added = 0;
+
+  while (added < size) {
+    void *ptr = AllocHugepageFromSocket(HugepageSize::k2MB, socket_id_);
+    if (ptr == nullptr) {
+      break;
+    }
+
+    total_free_bytes_ += page_bytes;
+    AddRegion(reinterpret_cast<uintptr_t>(ptr), page_bytes);
+    pages_.push_back(ptr);
+    added += page_bytes;
+  }
+
+  return added > 0;
+}
+
 std::string DmaMemoryPool::Dump() {
   std::ostringstream out;
   int i = 0;
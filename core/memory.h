@@ -86,6 +86,10 @@ class DmaMemoryPool {
 
   void Free(void *ptr);
 
+  // Adds 2MB hugepages to the pool, at least "size" bytes in total.
+  // Returns false if not even a single page could be added.
+  bool Expand(size_t size);
+
   size_t TotalFreeBytes() const { return total_free_bytes_; }
 
   // Return human-readable debug messages
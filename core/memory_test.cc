@@ -189,6 +189,34 @@ TEST(DmaMemoryPoolTest, Dump) {
   std::cout << pool.Dump();
 }
 
+TEST(DmaMemoryPoolTest, Expand) {
+  if (geteuid() != 0) {
+    std::cerr << "CAP_SYS_ADMIN required. Skipping test..." << std::endl;
+    return;
+  }
+
+  DmaMemoryPool pool(128 * 1024 * 1024, -1);
+  if (!pool.Initialized()) {
+    std::cerr << "CAP_SYS_ADMIN required. Skipping test..." << std::endl;
+    return;
+  }
+
+  void *ptr = pool.Alloc(pool.TotalFreeBytes());
+  ASSERT_NE(ptr, static_cast<void *>(nullptr));
+  ASSERT_EQ(pool.TotalFreeBytes(), 0);
+
+  // Assume a few more 2MB hugepages are available...
+  ASSERT_TRUE(pool.Expand(3 * 1024 * 1024));
+  EXPECT_GE(pool.TotalFreeBytes(), 4 * 1024 * 1024);
+
+  void *ptr2 = pool.Alloc(2 * 1024 * 1024);
+  ASSERT_NE(ptr2, static_cast<void *>(nullptr));
+  EXPECT_EQ(Virt2Phy(ptr2), Virt2PhyGeneric(ptr2));
+
+  pool.Free(ptr2);
+  pool.Free(ptr);
+}
+
 TEST(DmaMemoryPoolTest, AlignedAlloc) {
   if (geteuid() != 0) {
     std::cerr << "CAP_SYS_ADMIN required. Skipping test..." << std::endl;
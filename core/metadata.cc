@@ -122,35 +122,34 @@ bool ScopeComponent::DisjointFrom(const ScopeComponent &rhs) {
 
 // Pipeline ----------------------------------------------------------------
 
-int Pipeline::PrepareMetadataComputation() {
+// Resets the offset of an attribute to that of no scope component.
+static void ResetAttrOffset(Module *m, const struct Attribute *attr) {
+  size_t i = attr - m->all_attrs().data();
+  if (attr->mode == Attribute::AccessMode::kWrite) {
+    m->set_attr_offset(i, kMetadataOffsetNoWrite);
+  } else {
+    m->set_attr_offset(i, kMetadataOffsetNoRead);
+  }
+}
+
+int Pipeline::PrepareMetadataComputation(std::set<Module *> *changed) {
   for (const auto &it : ModuleGraph::GetAllModules()) {
     Module *m = it.second;
     if (!m) {
       break;
     }
 
-    if (!module_components_.count(m)) {
-      module_components_.emplace(m, new scope_id_t[kMetadataTotalSize]);
-    }
-
-    if (module_components_[m] == nullptr) {
-      return -ENOMEM;
-    }
-
-    module_scopes_[m] = -1;
-    memset(module_components_[m], -1, sizeof(scope_id_t) * kMetadataTotalSize);
-
-    for (const auto &attr : m->all_attrs()) {
-      attr.scope_id = -1;
+    if (module_components_.emplace(m, std::set<scope_id_t>()).second) {
+      changed->insert(m);
     }
   }
+
+  changed->insert(dirty_modules_.begin(), dirty_modules_.end());
+  dirty_modules_.clear();
   return 0;
 }
 
 void Pipeline::CleanupMetadataComputation() {
-  for (const auto &it : module_components_) {
-    delete[] module_components_[it.first];
-  }
   module_components_.clear();
   module_scopes_.clear();
 
@@ -158,14 +157,32 @@ void Pipeline::CleanupMetadataComputation() {
     c.clear_modules();
   }
   scope_components_.clear();
+  components_.clear();
+
+  dirty_modules_.clear();
+  dirty_components_.clear();
+  conflicts_.clear();
+}
+
+void Pipeline::RemoveModule(Module *m) {
+  const auto &it = module_components_.find(m);
+  if (it != module_components_.end()) {
+    for (scope_id_t id : it->second) {
+      components_[id].remove_module(m);
+      dirty_components_.insert(id);
+    }
+    module_components_.erase(it);
+  }
+
+  module_scopes_.erase(m);
+  dirty_modules_.erase(m);
 }
 
 void Pipeline::AddModuleToComponent(Module *m, const struct Attribute *attr) {
   ScopeComponent &component = scope_components_.back();
 
   // Module has already been added to current scope component.
-  if (std::find(component.modules().begin(), component.modules().end(), m) !=
-      component.modules().end()) {
+  if (component.modules().count(m)) {
     return;
   }
 
@@ -178,8 +195,13 @@ void Pipeline::AddModuleToComponent(Module *m, const struct Attribute *attr) {
 
 const struct Attribute *Pipeline::FindAttr(Module *m,
                                            const struct Attribute *attr) const {
+  return FindAttr(m, get_attr_id(attr));
+}
+
+const struct Attribute *Pipeline::FindAttr(Module *m,
+                                           const attr_id_t &id) const {
   for (const auto &it : m->all_attrs()) {
-    if (get_attr_id(&it) == get_attr_id(attr)) {
+    if (get_attr_id(&it) == id) {
       return &it;
     }
   }
@@ -195,16 +217,19 @@ void Pipeline::TraverseUpstream(Module *m, const struct Attribute *attr) {
 
   /* end of scope component */
   if (found_attr && found_attr->mode == Attribute::AccessMode::kWrite) {
-    if (found_attr->scope_id == -1)
+    if (found_attr->scope_id == -1) {
       IdentifyScopeComponent(m, found_attr);
+    } else if (components_.count(found_attr->scope_id)) {
+      conflicts_.insert(found_attr->scope_id);
+    }
     return;
   }
 
   /* cycle detection */
-  if (module_scopes_[m] == static_cast<int>(scope_components_.size())) {
+  if (module_scopes_[m] == current_scope_id()) {
     return;
   }
-  module_scopes_[m] = static_cast<int>(scope_components_.size());
+  module_scopes_[m] = current_scope_id();
 
   for (const IGate *g : m->igates()) {
     if (g == nullptr) {
@@ -225,17 +250,21 @@ int Pipeline::TraverseDownstream(Module *m, const struct Attribute *attr) {
   int8_t in_scope = 0;
 
   // cycle detection
-  if (module_scopes_[m] == static_cast<int>(scope_components_.size())) {
+  if (module_scopes_[m] == current_scope_id()) {
     return -1;
   }
-  module_scopes_[m] = static_cast<int>(scope_components_.size());
+  module_scopes_[m] = current_scope_id();
 
   found_attr = FindAttr(m, attr);
 
   if (found_attr && (found_attr->mode == Attribute::AccessMode::kRead ||
                      found_attr->mode == Attribute::AccessMode::kUpdate)) {
+    if (components_.count(found_attr->scope_id)) {
+      conflicts_.insert(found_attr->scope_id);
+    }
+
     AddModuleToComponent(m, found_attr);
-    found_attr->scope_id = scope_components_.size();
+    found_attr->scope_id = current_scope_id();
 
     for (const auto &ogate : m->ogates()) {
       if (!ogate) {
@@ -278,15 +307,15 @@ void Pipeline::IdentifySingleScopeComponent(Module *m,
                                             const struct Attribute *attr) {
   scope_components_.emplace_back();
   IdentifyScopeComponent(m, attr);
-  scope_components_.back().set_scope_id(scope_components_.size());
+  scope_components_.back().set_scope_id(current_scope_id());
 }
 
 void Pipeline::IdentifyScopeComponent(Module *m, const struct Attribute *attr) {
   AddModuleToComponent(m, attr);
-  attr->scope_id = scope_components_.size();
+  attr->scope_id = current_scope_id();
 
   /* cycle detection */
-  module_scopes_[m] = static_cast<int>(scope_components_.size());
+  module_scopes_[m] = current_scope_id();
 
   for (const auto &ogate : m->ogates()) {
     if (!ogate) {
@@ -297,183 +326,330 @@ void Pipeline::IdentifyScopeComponent(Module *m, const struct Attribute *attr) {
   }
 }
 
-void Pipeline::FillOffsetArrays() {
-  for (size_t i = 0; i < scope_components_.size(); i++) {
-    const std::set<Module *> &modules = scope_components_[i].modules();
-    const attr_id_t &id = scope_components_[i].attr_id();
-    int size = scope_components_[i].size();
-    mt_offset_t offset = scope_components_[i].offset();
-    uint8_t invalid = scope_components_[i].invalid();
+void Pipeline::FindAffectedWriters(const std::set<Module *> &changed,
+                                   writer_set_t *writers) {
+  // A scope component reaches a module only if its writers do, without
+  // passing through other writers of the attribute.
+  for (const auto &it : registered_attrs_) {
+    const attr_id_t &id = it.first;
+    std::set<Module *> visited;
+    std::vector<Module *> stack(changed.begin(), changed.end());
+
+    while (!stack.empty()) {
+      Module *m = stack.back();
+      stack.pop_back();
+      if (!visited.insert(m).second) {
+        continue;
+      }
 
-    // attr not read donwstream.
-    if (modules.size() == 1) {
-      scope_components_[i].set_offset(kMetadataOffsetNoWrite);
-      offset = kMetadataOffsetNoWrite;
-    }
-
-    for (Module *m : modules) {
-      size_t k = 0;
-      for (const auto &attr : m->all_attrs()) {
-        if (get_attr_id(&attr) == id) {
-          if (invalid) {
-            if (attr.mode == Attribute::AccessMode::kRead) {
-              m->set_attr_offset(k, kMetadataOffsetNoRead);
-            } else {
-              m->set_attr_offset(k, kMetadataOffsetNoWrite);
-            }
-          } else {
-            m->set_attr_offset(k, offset);
-          }
-          break;
-        }
-        k++;
+      const struct Attribute *attr = FindAttr(m, id);
+      if (attr && attr->mode == Attribute::AccessMode::kWrite) {
+        writers->emplace(m, attr);
+        continue;
       }
 
-      if (!invalid && offset >= 0) {
-        for (int l = 0; l < size; l++) {
-          module_components_[m][offset + l] = i;
+      for (const IGate *g : m->igates()) {
+        if (g == nullptr) {
+          continue;
+        }
+        for (const auto &og : g->ogates_upstream()) {
+          stack.push_back(og->module());
         }
       }
     }
   }
 }
 
-void Pipeline::AssignOffsets() {
-  mt_offset_t offset = 0;
-  ScopeComponent *comp1;
-  const ScopeComponent *comp2;
+void Pipeline::DissolveScopeComponent(scope_id_t id, writer_set_t *writers,
+                                      offset_map_t *prev_offsets) {
+  const auto &it = components_.find(id);
+  if (it == components_.end()) {
+    return;
+  }
 
-  for (size_t i = 0; i < scope_components_.size(); i++) {
-    std::priority_queue<const ScopeComponent *,
-                        std::vector<const ScopeComponent *>, ScopeComponentComp>
-        h;
-    comp1 = &scope_components_[i];
+  ScopeComponent component = std::move(it->second);
+  components_.erase(it);
+
+  // Other scope components of the attribute that share a module may have
+  // set its offset or scope as well, so they go too.
+  std::set<scope_id_t> related;
+  for (Module *m : component.modules()) {
+    std::set<scope_id_t> &ids = module_components_[m];
+    ids.erase(id);
+    for (scope_id_t other : ids) {
+      if (components_[other].attr_id() == component.attr_id()) {
+        related.insert(other);
+      }
+    }
+
+    // The scope component owning the attribute, if another, is related.
+    const struct Attribute *attr = FindAttr(m, component.attr_id());
+    if (!attr || (attr->scope_id != id && attr->scope_id != -1)) {
+      continue;
+    }
+
+    if (attr->mode == Attribute::AccessMode::kWrite) {
+      writers->emplace(m, attr);
+      if (attr->scope_id == id && component.offset() >= 0) {
+        prev_offsets->emplace(std::make_pair(m, component.attr_id()),
+                              component.offset());
+      }
+    }
+    attr->scope_id = -1;
+    ResetAttrOffset(m, attr);
+  }
+
+  for (scope_id_t other : related) {
+    DissolveScopeComponent(other, writers, prev_offsets);
+  }
+}
+
+void Pipeline::DiscardScopeComponents() {
+  for (auto &component : scope_components_) {
+    for (Module *m : component.modules()) {
+      const struct Attribute *attr = FindAttr(m, component.attr_id());
+      if (attr && attr->scope_id == component.scope_id()) {
+        attr->scope_id = -1;
+        ResetAttrOffset(m, attr);
+      }
+    }
+  }
+
+  // IDs are not reused, so stale cycle detection marks never match.
+  base_scope_id_ = current_scope_id();
+  scope_components_.clear();
+}
+
+std::vector<scope_id_t> Pipeline::AddScopeComponents() {
+  std::vector<scope_id_t> ids;
+
+  for (auto &component : scope_components_) {
+    scope_id_t id = component.scope_id();
+    for (Module *m : component.modules()) {
+      module_components_[m].insert(id);
+    }
+    components_.emplace(id, std::move(component));
+    ids.push_back(id);
+  }
+
+  base_scope_id_ = current_scope_id();
+  scope_components_.clear();
+  return ids;
+}
+
+void Pipeline::FillOffsetArrays(const ScopeComponent &component) {
+  const std::set<Module *> &modules = component.modules();
+  const attr_id_t &id = component.attr_id();
+  mt_offset_t offset = component.offset();
+  uint8_t invalid = component.invalid();
+
+  for (Module *m : modules) {
+    size_t k = 0;
+    for (const auto &attr : m->all_attrs()) {
+      if (get_attr_id(&attr) == id) {
+        if (invalid) {
+          if (attr.mode == Attribute::AccessMode::kRead) {
+            m->set_attr_offset(k, kMetadataOffsetNoRead);
+          } else {
+            m->set_attr_offset(k, kMetadataOffsetNoWrite);
+          }
+        } else {
+          m->set_attr_offset(k, offset);
+        }
+        break;
+      }
+      k++;
+    }
+  }
+}
+
+void Pipeline::AssignOffsets(const std::vector<scope_id_t> &ids,
+                             const offset_map_t &prev_offsets) {
+  for (scope_id_t id : ids) {
+    ScopeComponent *comp1 = &components_[id];
 
     if (comp1->invalid()) {
       comp1->set_offset(kMetadataOffsetNoRead);
       comp1->set_assigned(true);
+      FillOffsetArrays(*comp1);
       continue;
     }
 
-    if (comp1->assigned() || comp1->modules().size() == 1) {
+    // attr not read donwstream.
+    if (comp1->modules().size() == 1) {
+      comp1->set_offset(kMetadataOffsetNoWrite);
+      comp1->set_assigned(true);
+      FillOffsetArrays(*comp1);
       continue;
     }
 
-    offset = 0;
-
-    for (size_t j = 0; j < scope_components_.size(); j++) {
-      if (i == j) {
-        continue;
+    // Scope components that share a module with this one
+    std::priority_queue<const ScopeComponent *,
+                        std::vector<const ScopeComponent *>, ScopeComponentComp>
+        h;
+    std::set<scope_id_t> neighbors;
+    for (Module *m : comp1->modules()) {
+      for (scope_id_t neighbor : module_components_[m]) {
+        const ScopeComponent *comp2 = &components_[neighbor];
+        if (neighbor != id && comp2->assigned() && comp2->offset() >= 0 &&
+            neighbors.insert(neighbor).second) {
+          h.push(comp2);
+        }
       }
+    }
 
-      if (!scope_components_[i].DisjointFrom(scope_components_[j]) &&
-          scope_components_[j].assigned()) {
-        h.push(&scope_components_[j]);
+    // Keep the previous offset of any writer, if still free, so that modules
+    // need not be reconfigured.
+    mt_offset_t offset = kMetadataOffsetNoSpace;
+    for (Module *m : comp1->modules()) {
+      const auto &it = prev_offsets.find(std::make_pair(m, comp1->attr_id()));
+      if (it != prev_offsets.end()) {
+        offset = it->second;
+        break;
+      }
+    }
+    for (scope_id_t neighbor : neighbors) {
+      const ScopeComponent &comp2 = components_[neighbor];
+      if (offset < comp2.offset() + comp2.size() &&
+          comp2.offset() < offset + comp1->size()) {
+        offset = kMetadataOffsetNoSpace;
+        break;
       }
     }
 
-    while (!h.empty()) {
-      comp2 = h.top();
-      h.pop();
+    // Otherwise take the lowest offset with enough room
+    if (offset < 0) {
+      offset = 0;
+      while (!h.empty()) {
+        const ScopeComponent *comp2 = h.top();
+        h.pop();
 
-      if (comp2->offset() == kMetadataOffsetNoRead ||
-          comp2->offset() == kMetadataOffsetNoWrite ||
-          comp2->offset() == kMetadataOffsetNoSpace) {
-        continue;
-      }
+        if (offset + comp1->size() <= comp2->offset()) {
+          break;
+        }
 
-      if (offset + comp1->size() > comp2->offset()) {
-        offset =
-            ComputeNextOffset(comp2->offset() + comp2->size(), comp1->size());
-      } else {
-        break;
+        if (comp2->offset() + comp2->size() > offset) {
+          offset = ComputeNextOffset(comp2->offset() + comp2->size(),
+                                     comp1->size());
+          if (offset == kMetadataOffsetNoSpace) {
+            break;
+          }
+        }
       }
     }
 
     comp1->set_offset(offset);
     comp1->set_assigned(true);
+    FillOffsetArrays(*comp1);
   }
-
-  FillOffsetArrays();
 }
 
 void Pipeline::LogAllScopes() const {
-  for (size_t i = 0; i < scope_components_.size(); i++) {
-    VLOG(1) << "scope component for " << scope_components_[i].size()
-            << "-byte attr " << scope_components_[i].attr_id() << " at offset "
-            << static_cast<int>(scope_components_[i].offset()) << ": {";
-
-    for (const auto &it : scope_components_[i].modules()) {
-      VLOG(1) << it->name();
+  for (const auto &it : components_) {
+    const ScopeComponent &component = it.second;
+    VLOG(1) << "scope component " << it.first << " for " << component.size()
+            << "-byte attr " << component.attr_id() << " at offset "
+            << static_cast<int>(component.offset()) << ": {";
+
+    for (const auto &m : component.modules()) {
+      VLOG(1) << m->name();
     }
 
     VLOG(1) << "}";
   }
 
-  for (const auto &it : ModuleGraph::GetAllModules()) {
-    const Module *m = it.second;
-    if (!m) {
-      break;
-    }
-
-    const scope_id_t *scope_arr = module_components_.find(m)->second;
-
-    LOG(INFO) << "Module " << m->name()
+  for (const auto &it : module_components_) {
+    LOG(INFO) << "Module " << it.first->name()
               << " part of the following scope components: ";
-    for (size_t i = 0; i < kMetadataTotalSize; i++) {
-      if (scope_arr[i] != -1) {
-        LOG(INFO) << "scope " << scope_arr[i] << " at offset " << i;
-      }
+    for (scope_id_t id : it.second) {
+      LOG(INFO) << "scope " << id << " at offset "
+                << static_cast<int>(components_.at(id).offset());
     }
   }
 }
 
-void Pipeline::ComputeScopeDegrees() {
-  for (size_t i = 0; i < scope_components_.size(); i++) {
-    for (size_t j = i + 1; j < scope_components_.size(); j++) {
-      if (!scope_components_[i].DisjointFrom(scope_components_[j])) {
-        scope_components_[i].incr_degree();
-        scope_components_[j].incr_degree();
-      }
+void Pipeline::ComputeScopeDegrees(const std::vector<scope_id_t> &ids) {
+  for (scope_id_t id : ids) {
+    std::set<scope_id_t> neighbors;
+    ScopeComponent &component = components_[id];
+    for (Module *m : component.modules()) {
+      neighbors.insert(module_components_[m].begin(),
+                       module_components_[m].end());
     }
+    component.set_degree(neighbors.size() - 1);
   }
 }
 
 /* Main entry point for calculating metadata offsets. */
 int Pipeline::ComputeMetadataOffsets() {
+  std::set<Module *> changed;
   int ret;
 
-  ret = PrepareMetadataComputation();
+  ret = PrepareMetadataComputation(&changed);
 
   if (ret) {
     CleanupMetadataComputation();
     return ret;
   }
 
-  for (const auto &it : ModuleGraph::GetAllModules()) {
-    Module *m = it.second;
-    if (!m) {
-      break;
-    }
+  if (changed.empty() && dirty_components_.empty()) {
+    return 0;
+  }
+
+  writer_set_t writers;
+  offset_map_t prev_offsets;
+  std::set<scope_id_t> dissolve;
+
+  // Start over for the changed modules, and the scope components that reach
+  // them or lost a module.
+  FindAffectedWriters(changed, &writers);
+  dissolve.swap(dirty_components_);
+  for (Module *m : changed) {
+    const std::set<scope_id_t> &ids = module_components_[m];
+    dissolve.insert(ids.begin(), ids.end());
 
-    size_t i = 0;
     for (const auto &attr : m->all_attrs()) {
-      if (attr.mode == Attribute::AccessMode::kRead ||
-          attr.mode == Attribute::AccessMode::kUpdate) {
-        m->set_attr_offset(i, kMetadataOffsetNoRead);
-      } else if (attr.mode == Attribute::AccessMode::kWrite) {
-        m->set_attr_offset(i, kMetadataOffsetNoWrite);
-        if (attr.scope_id == -1) {
-          IdentifySingleScopeComponent(m, &attr);
-        }
+      attr.scope_id = -1;
+      ResetAttrOffset(m, &attr);
+      if (attr.mode == Attribute::AccessMode::kWrite) {
+        writers.emplace(m, &attr);
       }
-      i++;
     }
   }
+  for (const auto &writer : writers) {
+    if (writer.second->scope_id != -1) {
+      dissolve.insert(writer.second->scope_id);
+    }
+  }
+
+  for (;;) {
+    for (scope_id_t id : dissolve) {
+      DissolveScopeComponent(id, &writers, &prev_offsets);
+    }
+    dissolve.clear();
+
+    for (const auto &writer : writers) {
+      if (writer.second->scope_id == -1) {
+        IdentifySingleScopeComponent(writer.first, writer.second);
+      }
+    }
+
+    if (conflicts_.empty()) {
+      break;
+    }
+
+    // Some unchanged scope components must be merged with new ones. Identify
+    // them all over again.
+    DiscardScopeComponents();
+    dissolve.swap(conflicts_);
+  }
 
-  ComputeScopeDegrees();
-  std::sort(scope_components_.begin(), scope_components_.end(), DegreeComp);
-  AssignOffsets();
+  std::vector<scope_id_t> ids = AddScopeComponents();
+  ComputeScopeDegrees(ids);
+  std::stable_sort(ids.begin(), ids.end(), [this](scope_id_t a, scope_id_t b) {
+    return DegreeComp(components_[a], components_[b]);
+  });
+  AssignOffsets(ids, prev_offsets);
 
   if (VLOG_IS_ON(1)) {
     LogAllScopes();
@@ -481,7 +657,6 @@ int Pipeline::ComputeMetadataOffsets() {
 
   CheckOrphanReaders();
 
-  CleanupMetadataComputation();
   return 0;
 }
 
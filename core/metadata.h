@@ -36,6 +36,7 @@
 #include <set>
 #include <string>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include "snbuf_layout.h"
@@ -62,7 +63,7 @@ static_assert(kMetadataTotalSize <= SIZE_MAX,
 
 // Normal offset values are 0 or a positive value.
 typedef int8_t mt_offset_t;
-typedef int16_t scope_id_t;
+typedef int32_t scope_id_t;
 
 // No downstream module reads the attribute, so the module can skip writing.
 static const mt_offset_t kMetadataOffsetNoWrite = -1;
@@ -122,10 +123,12 @@ class ScopeComponent {
 
   const std::set<Module *> &modules() const { return modules_; }
   void add_module(Module *m) { modules_.insert(m); }
+  void remove_module(Module *m) { modules_.erase(m); }
   void clear_modules() { modules_.clear(); }
 
   int degree() const { return degree_; }
   void incr_degree() { degree_++; }
+  void set_degree(int degree) { degree_ = degree; }
 
   bool DisjointFrom(const ScopeComponent &rhs);
 
@@ -148,12 +151,25 @@ class Pipeline {
   Pipeline()
       : scope_components_(),
         module_scopes_(),
+        components_(),
         module_components_(),
+        dirty_modules_(),
+        dirty_components_(),
+        conflicts_(),
+        base_scope_id_(),
         registered_attrs_() {}
 
-  // Main entry point for calculating metadata offsets.
+  // Main entry point for calculating metadata offsets. Only the scope
+  // components around the modules changed since the last call are computed
+  // again. The others keep their offsets.
   int ComputeMetadataOffsets();
 
+  // Notes that the connections or attributes of 'm' have changed.
+  void MarkModuleChanged(Module *m) { dirty_modules_.insert(m); }
+
+  // Forgets about 'm', which is being destroyed.
+  void RemoveModule(Module *m);
+
   // Registers attr and returns 0 if no attribute named @attr_name with size
   // other than @size has already been registered for this pipeline.
   // Returns -EINVAL on error.
@@ -163,21 +179,32 @@ class Pipeline {
  private:
   friend class MetadataTest;
 
-  // Allocate and initiliaze scope component storage.
-  // Returns 0 on sucess, -errno on failure.
-  int PrepareMetadataComputation();
+  typedef std::set<std::pair<Module *, const struct Attribute *>> writer_set_t;
+  typedef std::map<std::pair<const Module *, attr_id_t>, mt_offset_t>
+      offset_map_t;
+
+  // Adds modules not seen before to 'changed', along with those marked by
+  // MarkModuleChanged(). Returns 0 on sucess, -errno on failure.
+  int PrepareMetadataComputation(std::set<Module *> *changed);
 
+  // Forgets all scope components, so that the next computation starts over.
   void CleanupMetadataComputation();
 
   // Debugging tool.
   void LogAllScopes() const;
 
+  // ID of the scope component being identified
+  scope_id_t current_scope_id() const {
+    return base_scope_id_ + scope_components_.size();
+  }
+
   // Add a module to the current scope component.
   void AddModuleToComponent(Module *m, const struct Attribute *attr);
 
   // Returns a pointer to an attribute if it's contained within a module.
   const struct Attribute *FindAttr(Module *m,
                                    const struct Attribute *attr) const;
+  const struct Attribute *FindAttr(Module *m, const attr_id_t &id) const;
 
   // Traverses module graph upstream to help identify a scope component.
   void TraverseUpstream(Module *m, const struct Attribute *attr);
@@ -193,17 +220,51 @@ class Pipeline {
   // component.
   void IdentifyScopeComponent(Module *m, const struct Attribute *attr);
 
-  void FillOffsetArrays();
-  void AssignOffsets();
-  void ComputeScopeDegrees();
+  // Adds to 'writers' the writers of any attribute whose scope components
+  // may reach the 'changed' modules.
+  void FindAffectedWriters(const std::set<Module *> &changed,
+                           writer_set_t *writers);
+
+  // Removes a scope component and those of the same attribute sharing a
+  // module with it, adding their writers to 'writers' and offsets to
+  // 'prev_offsets'.
+  void DissolveScopeComponent(scope_id_t id, writer_set_t *writers,
+                              offset_map_t *prev_offsets);
+
+  // Drops the scope components being identified.
+  void DiscardScopeComponents();
 
+  // Moves the scope components just identified to 'components_', and returns
+  // their IDs.
+  std::vector<scope_id_t> AddScopeComponents();
+
+  void FillOffsetArrays(const ScopeComponent &component);
+  void AssignOffsets(const std::vector<scope_id_t> &ids,
+                     const offset_map_t &prev_offsets);
+  void ComputeScopeDegrees(const std::vector<scope_id_t> &ids);
+
+  // Scope components being identified by the current computation
   std::vector<ScopeComponent> scope_components_;
 
-  // Maps modules to the
+  // Maps modules to the scope component that last visited them.
   std::map<const Module *, scope_id_t> module_scopes_;
 
-  // Maps modules to the scope componenets they belong to.
-  std::map<const Module *, scope_id_t *> module_components_;
+  // All scope components, by ID. Kept across computations.
+  std::map<scope_id_t, ScopeComponent> components_;
+
+  // Maps modules to the IDs of the scope components they belong to.
+  std::map<const Module *, std::set<scope_id_t>> module_components_;
+
+  // Modules and scope components changed since the last computation
+  std::set<Module *> dirty_modules_;
+  std::set<scope_id_t> dirty_components_;
+
+  // Scope components in 'components_' that the ones being identified ran
+  // into, and thus must be merged with.
+  std::set<scope_id_t> conflicts_;
+
+  // Scope components being identified get IDs above this.
+  scope_id_t base_scope_id_;
 
   // Keeps track of the attributes used by modules in this pipeline
   // count(=int) represents how many modules registered the attribute, and the
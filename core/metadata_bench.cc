@@ -0,0 +1,156 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmarks for computing metadata offsets after a change of the pipeline.
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include <string>
+#include <vector>
+
+#include "metadata.h"
+#include "module.h"
+#include "module_graph.h"
+
+namespace {
+
+using bess::metadata::Attribute;
+using bess::metadata::default_pipeline;
+
+class BenchNode final : public Module {
+ public:
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+};
+
+DEF_MODULE(BenchNode, "bench_node", "does nothing");
+
+Module *CreateBenchModule(const std::string &name) {
+  const ModuleBuilder &builder =
+      ModuleBuilder::all_module_builders().find("BenchNode")->second;
+
+  bess::pb::EmptyArg arg_;
+  google::protobuf::Any arg;
+  arg.PackFrom(arg_);
+
+  pb_error_t perr;
+  Module *m = ModuleGraph::CreateModule(builder, name, arg, &perr);
+  CHECK(m) << perr.errmsg();
+  return m;
+}
+
+// Sets up state.range(0) modules as chains of kChainLength, all ending in a
+// common sink. The head of each chain writes "a" and "b", the middle reads
+// "a" and writes "c", and the tail reads "b" and "c".
+class MetadataFixture : public benchmark::Fixture {
+ public:
+  static const int kChainLength = 10;
+
+  MetadataFixture() : chains_() {}
+
+  void SetUp(benchmark::State &state) override {
+    const auto kRead = Attribute::AccessMode::kRead;
+    const auto kWrite = Attribute::AccessMode::kWrite;
+    int num_chains = state.range(0) / kChainLength;
+    Module *sink = CreateBenchModule("sink");
+
+    for (int i = 0; i < num_chains; i++) {
+      std::vector<Module *> chain;
+      for (int j = 0; j < kChainLength; j++) {
+        chain.push_back(CreateBenchModule("node" + std::to_string(i) + "_" +
+                                          std::to_string(j)));
+        if (j > 0) {
+          CHECK_EQ(ModuleGraph::ConnectModules(chain[j - 1], 0, chain[j], 0),
+                   0);
+        }
+      }
+      CHECK_EQ(ModuleGraph::ConnectModules(chain.back(), 0, sink, 0), 0);
+
+      CHECK_LE(0, chain.front()->AddMetadataAttr("a", 4, kWrite));
+      CHECK_LE(0, chain.front()->AddMetadataAttr("b", 8, kWrite));
+      CHECK_LE(0, chain[kChainLength / 2]->AddMetadataAttr("a", 4, kRead));
+      CHECK_LE(0, chain[kChainLength / 2]->AddMetadataAttr("c", 2, kWrite));
+      CHECK_LE(0, chain.back()->AddMetadataAttr("b", 8, kRead));
+      CHECK_LE(0, chain.back()->AddMetadataAttr("c", 2, kRead));
+      chains_.push_back(chain);
+    }
+
+    CHECK_EQ(default_pipeline.ComputeMetadataOffsets(), 0);
+  }
+
+  void TearDown(benchmark::State &) override {
+    chains_.clear();
+    ModuleGraph::DestroyAllModules();
+  }
+
+ protected:
+  BenchNode_class BenchNode_singleton_;
+
+  std::vector<std::vector<Module *>> chains_;
+};
+
+// Recomputes the offsets of the whole pipeline, as if every module changed.
+BENCHMARK_DEFINE_F(MetadataFixture, Full)(benchmark::State &state) {
+  while (state.KeepRunning()) {
+    for (const auto &chain : chains_) {
+      for (Module *m : chain) {
+        default_pipeline.MarkModuleChanged(m);
+      }
+    }
+    CHECK_EQ(default_pipeline.ComputeMetadataOffsets(), 0);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Cuts a link in the middle of one chain and restores it, recomputing the
+// offsets after each change.
+BENCHMARK_DEFINE_F(MetadataFixture, Incremental)(benchmark::State &state) {
+  size_t i = 0;
+
+  while (state.KeepRunning()) {
+    Module *m = chains_[i++ % chains_.size()][kChainLength / 2 - 1];
+    Module *next = m->ogates()[0]->igate()->module();
+
+    CHECK_EQ(ModuleGraph::DisconnectModule(m, 0), 0);
+    CHECK_EQ(default_pipeline.ComputeMetadataOffsets(), 0);
+    CHECK_EQ(ModuleGraph::ConnectModules(m, 0, next, 0), 0);
+    CHECK_EQ(default_pipeline.ComputeMetadataOffsets(), 0);
+  }
+
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+
+BENCHMARK_REGISTER_F(MetadataFixture, Full)->Arg(100)->Arg(1000);
+BENCHMARK_REGISTER_F(MetadataFixture, Incremental)->Arg(100)->Arg(1000);
+
+}  // namespace
+
+BENCHMARK_MAIN();
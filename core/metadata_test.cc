@@ -33,6 +33,8 @@
 #include <gtest/gtest.h>
 
 #include <cstdlib>
+#include <map>
+#include <random>
 #include <vector>
 
 #include "module.h"
@@ -94,6 +96,55 @@ class MetadataTest : public ::testing::Test {
 
   virtual void TearDown() { ModuleGraph::DestroyAllModules(); }
 
+  // Checks that scope components sharing a module do not overlap.
+  void CheckOverlaps() {
+    for (const auto &it : default_pipeline.module_components_) {
+      std::vector<bool> used(kMetadataTotalSize);
+      for (scope_id_t id : it.second) {
+        const ScopeComponent &c = default_pipeline.components_.at(id);
+        for (int i = 0; c.offset() >= 0 && i < c.size(); i++) {
+          ASSERT_FALSE(used[c.offset() + i]) << it.first->name();
+          used[c.offset() + i] = true;
+        }
+      }
+    }
+  }
+
+  // Returns the offsets of all attributes that belong to at most one scope
+  // component. Which of several components such an attribute follows depends
+  // on the order of traversal.
+  std::map<std::pair<Module *, size_t>, mt_offset_t> GetOffsets() {
+    std::map<std::pair<Module *, size_t>, mt_offset_t> offsets;
+    for (const auto &it : ModuleGraph::GetAllModules()) {
+      Module *m = it.second;
+      for (size_t i = 0; i < m->all_attrs().size(); i++) {
+        int n = 0;
+        for (scope_id_t id : default_pipeline.module_components_[m]) {
+          n += default_pipeline.components_.at(id).attr_id() ==
+               m->all_attrs()[i].name;
+        }
+        if (n <= 1) {
+          offsets.emplace(std::make_pair(m, i), m->attr_offset(i));
+        }
+      }
+    }
+    return offsets;
+  }
+
+  void ComputeFromScratch() {
+    for (const auto &it : ModuleGraph::GetAllModules()) {
+      Module *m = it.second;
+      for (size_t i = 0; i < m->all_attrs().size(); i++) {
+        m->set_attr_offset(
+            i, m->all_attrs()[i].mode == Attribute::AccessMode::kWrite
+                   ? kMetadataOffsetNoWrite
+                   : kMetadataOffsetNoRead);
+      }
+    }
+    default_pipeline.CleanupMetadataComputation();
+    ASSERT_EQ(0, default_pipeline.ComputeMetadataOffsets());
+  }
+
   Module *m0;
   Module *m1;
   Foo_class Foo_singleton;
@@ -351,5 +402,109 @@ TEST_F(MetadataTest, ScopeComponentDegreeOrder) {
               (m4->attr_offset(1) + 6 <= m3->attr_offset(4)));
 }
 
+// Offsets of scope components that a change does not reach stay as they are,
+// and those of changed ones are kept if possible.
+TEST_F(MetadataTest, IncrementalStable) {
+  Module *p0 = create_foo();
+  Module *p1 = create_foo();
+  Module *m2 = create_foo();
+  ASSERT_EQ(0, m0->AddMetadataAttr("a", 4, Attribute::AccessMode::kWrite));
+  ASSERT_EQ(0, m1->AddMetadataAttr("a", 4, Attribute::AccessMode::kRead));
+  ASSERT_EQ(0, p0->AddMetadataAttr("a", 4, Attribute::AccessMode::kWrite));
+  ASSERT_EQ(0, p1->AddMetadataAttr("a", 4, Attribute::AccessMode::kRead));
+  ASSERT_EQ(0, m2->AddMetadataAttr("b", 2, Attribute::AccessMode::kRead));
+  ASSERT_EQ(1, m1->AddMetadataAttr("b", 2, Attribute::AccessMode::kWrite));
+  ModuleGraph::ConnectModules(m0, 0, m1, 0);
+  ModuleGraph::ConnectModules(p0, 0, p1, 0);
+  ASSERT_EQ(0, default_pipeline.ComputeMetadataOffsets());
+
+  mt_offset_t offset = m1->attr_offset(0);
+  int p_scope = p1->all_attrs()[0].scope_id;
+  ASSERT_LE(0, offset);
+  ASSERT_EQ(kMetadataOffsetNoWrite, m1->attr_offset(1));
+
+  ModuleGraph::ConnectModules(m1, 0, m2, 0);
+  ASSERT_EQ(0, default_pipeline.ComputeMetadataOffsets());
+  CheckOverlaps();
+  EXPECT_EQ(offset, m0->attr_offset(0));
+  EXPECT_EQ(offset, m1->attr_offset(0));
+  EXPECT_LE(0, m2->attr_offset(0));
+  EXPECT_EQ(m1->attr_offset(1), m2->attr_offset(0));
+  EXPECT_EQ(p_scope, p1->all_attrs()[0].scope_id);
+
+  ModuleGraph::DisconnectModule(m0, 0);
+  ASSERT_EQ(0, default_pipeline.ComputeMetadataOffsets());
+  EXPECT_EQ(kMetadataOffsetNoWrite, m0->attr_offset(0));
+  EXPECT_EQ(kMetadataOffsetNoRead, m1->attr_offset(0));
+  EXPECT_LE(0, m2->attr_offset(0));
+
+  ModuleGraph::ConnectModules(m0, 0, m1, 0);
+  ASSERT_EQ(0, default_pipeline.ComputeMetadataOffsets());
+  CheckOverlaps();
+  EXPECT_EQ(m0->attr_offset(0), m1->attr_offset(0));
+  EXPECT_LE(0, m1->attr_offset(0));
+  EXPECT_EQ(p_scope, p1->all_attrs()[0].scope_id);
+
+  // Destroying a module leaves no trace of it.
+  ModuleGraph::DestroyModule(m2);
+  ASSERT_EQ(0, default_pipeline.ComputeMetadataOffsets());
+  EXPECT_EQ(kMetadataOffsetNoWrite, m1->attr_offset(1));
+  CheckOverlaps();
+}
+
+// Random changes of a graph, each followed by an incremental computation,
+// give offsets as valid as a computation from scratch.
+TEST_F(MetadataTest, IncrementalRandom) {
+  const char *names[] = {"a", "b", "c", "d", "e", "f"};
+  const size_t sizes[] = {1, 2, 4, 8, 3, 6};
+  std::mt19937 rng(1);
+
+  std::vector<Module *> mods = {m0, m1};
+  for (int i = 0; i < 30; i++) {
+    mods.push_back(create_foo());
+  }
+  for (Module *m : mods) {
+    int num_attrs = 0;
+    for (size_t i = 0; i < 6; i++) {
+      if (rng() % 3 == 0) {
+        auto mode = static_cast<Attribute::AccessMode>(rng() % 3);
+        ASSERT_EQ(num_attrs++, m->AddMetadataAttr(names[i], sizes[i], mode));
+      }
+    }
+  }
+
+  for (int step = 0; step < 300; step++) {
+    Module *m = mods[rng() % mods.size()];
+    gate_idx_t ogate = rng() % 3;
+    if (rng() % 3 == 0) {
+      ModuleGraph::DisconnectModule(m, ogate);
+    } else {
+      ModuleGraph::ConnectModules(m, ogate, mods[rng() % mods.size()],
+                                  rng() % 2);
+    }
+
+    ASSERT_EQ(0, default_pipeline.ComputeMetadataOffsets());
+    CheckOverlaps();
+    auto incremental = GetOffsets();
+
+    ComputeFromScratch();
+    auto scratch = GetOffsets();
+
+    for (const auto &it : scratch) {
+      const auto &found = incremental.find(it.first);
+      if (found == incremental.end()) {
+        continue;
+      }
+      mt_offset_t expected = it.second;
+      mt_offset_t actual = found->second;
+      if (expected < 0 || actual < 0) {
+        ASSERT_EQ(expected, actual) << "step " << step << " "
+                                    << it.first.first->name() << " attr "
+                                    << it.first.second;
+      }
+    }
+  }
+}
+
 }  // namespace metadata
 }  // namespace bess
@@ -37,12 +37,42 @@
 
 #include "gate.h"
 #include "module_graph.h"
+#include "resume_hook.h"
 #include "scheduler.h"
 #include "task.h"
 #include "utils/pcap.h"
 
+const char *DropReasonName(DropReason reason) {
+  switch (reason) {
+    case DropReason::kUnspecified:
+      return "unspecified";
+    case DropReason::kNoOGate:
+      return "no_ogate";
+    case DropReason::kQueueFull:
+      return "queue_full";
+    case DropReason::kNoBuffer:
+      return "no_buffer";
+    case DropReason::kPolicy:
+      return "policy";
+    case DropReason::kNoMatch:
+      return "no_match";
+    case DropReason::kMalformed:
+      return "malformed";
+    case DropReason::kTtlExpired:
+      return "ttl_expired";
+    case DropReason::kTxFailed:
+      return "tx_failed";
+    case DropReason::kUnhandled:
+      return "unhandled";
+    default:
+      return "invalid";
+  }
+}
+
 const Commands Module::cmds;
 
+std::atomic<bool> Module::profiling_;
+
 bool ModuleBuilder::RegisterModuleClass(
     std::function<Module *()> module_generator, const std::string &class_name,
     const std::string &name_template, const std::string &help_text,
@@ -94,11 +124,14 @@ CommandResponse ModuleBuilder::RunCommand(
     const google::protobuf::Any &arg) const {
   for (auto &cmd : cmds_) {
     if (user_cmd == cmd.cmd) {
-      if (cmd.mt_safe != Command::THREAD_SAFE && m->HasRunningWorker()) {
-        return CommandFailure(EBUSY,
-                              "There is a running worker and command "
-                              "'%s' is not MT safe",
-                              cmd.cmd.c_str());
+      // Hitless rewiring does not update active workers, so hold them all.
+      if (cmd.mt_safe != Command::THREAD_SAFE && is_any_worker_running()) {
+        // Switch over to the new state between task runs of every worker.
+        WorkerHolder holder;
+        CommandResponse ret = cmd.func(m, arg);
+        // Whatever pause_all/resume_all around the command would have redone
+        bess::run_global_resume_hooks();
+        return ret;
       }
 
       return cmd.func(m, arg);
@@ -216,6 +249,79 @@ void Module::AddActiveWorker(int wid, const Task *t) {
   }
 }
 
+void Module::AddStealingWorker(int wid, int owner_wid, const Task *t,
+                               std::unordered_set<const Module *> *visited) {
+  if (!visited->insert(this).second) {
+    return;
+  }
+
+  if (!active_workers_[wid]) {
+    active_workers_[wid] = true;
+    stealing_workers_[wid] = true;
+  }
+
+  bool propagate = propagate_workers_ ||
+                   std::find(tasks_.begin(), tasks_.end(), t) != tasks_.end();
+  if (propagate) {
+    for (auto ogate : ogates_) {
+      if (ogate) {
+        auto next = static_cast<Module *>(ogate->next());
+        next->AddStealingWorker(wid, owner_wid, t, visited);
+      }
+    }
+  }
+}
+
+bool Module::IsPipelineMigratable(
+    const Task *task, bool exclusive,
+    std::unordered_set<const Module *> *visited) const {
+  if (!visited->insert(this).second) {
+    return true;
+  }
+
+  bool is_task_module =
+      std::find(tasks_.begin(), tasks_.end(), task) != tasks_.end();
+
+  if (is_task_module) {
+    // Input gates do not matter if they are served by other workers anyway.
+    exclusive = (tasks_.size() == 1);
+    if (propagate_workers_) {
+      for (auto igate : igates_) {
+        if (igate && !igate->ogates_upstream().empty()) {
+          exclusive = false;
+        }
+      }
+    }
+  } else {
+    size_t num_upstream = 0;
+    for (auto igate : igates_) {
+      if (igate) {
+        num_upstream += igate->ogates_upstream().size();
+      }
+    }
+    exclusive = exclusive && num_upstream == 1 && tasks_.empty();
+  }
+
+  if (!exclusive && max_allowed_workers_ < 2) {
+    return false;
+  }
+
+  // The rest is run by the task of this module, e.g., Queue.
+  if (!propagate_workers_ && !is_task_module) {
+    return true;
+  }
+
+  for (auto ogate : ogates_) {
+    if (ogate) {
+      auto next = static_cast<Module *>(ogate->next());
+      if (!next->IsPipelineMigratable(task, exclusive, visited)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 CheckConstraintResult Module::CheckModuleConstraints() const {
   int active_workers = num_active_workers();
   CheckConstraintResult valid = CHECK_OK;
@@ -276,6 +382,7 @@ int Module::AddMetadataAttr(const std::string &name, size_t size,
   attr.scope_id = -1;
 
   attrs_.push_back(attr);
+  pipeline_->MarkModuleChanged(this);
 
   return attrs_.size() - 1;
 }
@@ -286,63 +393,113 @@ int Module::ConnectGate(gate_idx_t ogate_idx, Module *m_next,
     return -EBUSY;
   }
 
-  if (ogate_idx >= ogates_.size()) {
-    ogates_.resize(ogate_idx + 1, nullptr);
+  bess::IGate *new_igate;
+  bess::OGate *ogate = NewGate(ogate_idx, m_next, igate_idx, &new_igate);
+  if (!ogate) {
+    return -ENOMEM;
   }
 
-  if (igate_idx >= m_next->igates_.size()) {
-    m_next->igates_.resize(igate_idx + 1, nullptr);
-  }
+  LinkGate(ogate);
+
+  return 0;
+}
+
+bess::OGate *Module::NewGate(gate_idx_t ogate_idx, Module *m_next,
+                             gate_idx_t igate_idx, bess::IGate **new_igate) {
+  *new_igate = nullptr;
 
   bess::OGate *ogate = new bess::OGate(this, ogate_idx, m_next);
   if (!ogate) {
-    return -ENOMEM;
+    return nullptr;
   }
 
   bess::IGate *igate;
-  if (m_next->igates_[igate_idx] == nullptr) {
-    igate = new bess::IGate(m_next, igate_idx);
+  if (igate_idx < m_next->igates_.size() && m_next->igates_[igate_idx]) {
+    igate = m_next->igates_[igate_idx];
+  } else {
+    igate = *new_igate = new bess::IGate(m_next, igate_idx);
     if (igate == nullptr) {
-      return -ENOMEM;
+      delete ogate;
+      return nullptr;
     }
-    m_next->igates_[igate_idx] = igate;
-  } else {
-    igate = m_next->igates_[igate_idx];
   }
 
-  ogates_[ogate_idx] = ogate;
-
   ogate->SetIgate(igate);  // an ogate allowed to be connected to a single igate
+
+  return ogate;
+}
+
+void Module::LinkGate(bess::OGate *ogate) {
+  bess::IGate *igate = ogate->igate();
+  Module *m_next = igate->module();
+  gate_idx_t ogate_idx = ogate->gate_idx();
+  gate_idx_t igate_idx = igate->gate_idx();
+
+  if (igate_idx >= m_next->igates_.size()) {
+    m_next->igates_.resize(igate_idx + 1, nullptr);
+  }
+  m_next->igates_[igate_idx] = igate;
+
   igate->PushOgate(ogate);  // an igate can connected to multiple ogates
 
-  return 0;
+  if (ogate_idx >= ogates_.size()) {
+    ogates_.resize(ogate_idx + 1, nullptr);
+  }
+
+  // Workers may follow the ogate as soon as it is stored.
+  STORE_BARRIER();
+  ogates_[ogate_idx] = ogate;
+
+  if (pipeline_) {
+    pipeline_->MarkModuleChanged(this);
+    pipeline_->MarkModuleChanged(m_next);
+  }
 }
 
 int Module::DisconnectGate(gate_idx_t ogate_idx) {
-  if (!is_active_gate<bess::OGate>(ogates_, ogate_idx)) {
+  bess::IGate *orphan_igate;
+  bess::OGate *ogate = UnlinkGate(ogate_idx, &orphan_igate);
+  if (ogate == nullptr) {
     return 0;
   }
 
-  bess::OGate *ogate = ogates_[ogate_idx];
-  if (ogate == nullptr) {
-    return 0;
+  if (orphan_igate) {
+    orphan_igate->ClearHooks();
+    delete orphan_igate;
+  }
+
+  ogate->ClearHooks();
+  delete ogate;
+
+  return 0;
+}
+
+bess::OGate *Module::UnlinkGate(gate_idx_t ogate_idx,
+                                bess::IGate **orphan_igate) {
+  *orphan_igate = nullptr;
+
+  if (!is_active_gate<bess::OGate>(ogates_, ogate_idx)) {
+    return nullptr;
   }
 
+  bess::OGate *ogate = ogates_[ogate_idx];
   bess::IGate *igate = ogate->igate();
 
+  ogates_[ogate_idx] = nullptr;
+
   igate->RemoveOgate(ogate);
   if (igate->ogates_upstream().empty()) {
     Module *m_next = igate->module();
     m_next->igates_[igate->gate_idx()] = nullptr;
-    igate->ClearHooks();
-    delete igate;
+    *orphan_igate = igate;
   }
 
-  ogates_[ogate_idx] = nullptr;
-  ogate->ClearHooks();
-  delete ogate;
+  if (pipeline_) {
+    pipeline_->MarkModuleChanged(this);
+    pipeline_->MarkModuleChanged(igate->module());
+  }
 
-  return 0;
+  return ogate;
 }
 
 void Module::Destroy() {
@@ -362,6 +519,10 @@ void Module::Destroy() {
 
   DestroyAllTasks();
   DeregisterAllAttributes();
+
+  if (pipeline_) {
+    pipeline_->RemoveModule(this);
+  }
 }
 
 void Module::DisconnectModulesUpstream(gate_idx_t igate_idx) {
@@ -382,6 +543,10 @@ void Module::DisconnectModulesUpstream(gate_idx_t igate_idx) {
   for (const auto &ogate : igate->ogates_upstream()) {
     Module *m_prev = ogate->module();
     m_prev->ogates_[ogate->gate_idx()] = nullptr;
+    if (pipeline_) {
+      pipeline_->MarkModuleChanged(m_prev);
+      pipeline_->MarkModuleChanged(this);
+    }
     ogate->ClearHooks();
 
     delete ogate;
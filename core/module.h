@@ -31,9 +31,11 @@
 #ifndef BESS_MODULE_H_
 #define BESS_MODULE_H_
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <map>
+#include <memory>
 #include <numeric>
 #include <string>
 #include <unordered_map>
@@ -47,6 +49,8 @@
 #include "message.h"
 #include "metadata.h"
 #include "packet_pool.h"
+#include "utils/counter.h"
+#include "utils/time.h"
 #include "worker.h"
 
 using bess::gate_idx_t;
@@ -61,17 +65,59 @@ struct Context {
   uint64_t current_tsc;
   uint64_t current_ns;
   int wid;
+  int owner_wid;  // worker that owns 'task'; differs from wid if stolen
   Task *task;
+  uint32_t batch_limit;  // Max. packets the task should produce in this run
 
   // Set by module scheduler, read by a task scheduler
   uint64_t silent_drops;
 
   // Temporary variables to be accessed and updated by module scheduler
   gate_idx_t current_igate;
+  // Output gates used by the current batch. Each packet goes to at most one
+  // gate, so a batch touches no more than kMaxBurst of them. Kept as pointers,
+  // since the gate may be disconnected from its module meanwhile.
   int gate_with_hook_cnt = 0;
   int gate_without_hook_cnt = 0;
-  gate_idx_t gate_with_hook[bess::PacketBatch::kMaxBurst];
-  gate_idx_t gate_without_hook[bess::PacketBatch::kMaxBurst];
+  bess::OGate *gate_with_hook[bess::PacketBatch::kMaxBurst];
+  bess::OGate *gate_without_hook[bess::PacketBatch::kMaxBurst];
+
+  // Packets passed on to output gates, and cycles spent in fused downstream
+  // modules, for Module::Profile().
+  uint64_t pkts_emitted;
+  uint64_t child_cycles;
+};
+
+// Why a module has dropped packets. See Module::DropPacket().
+enum class DropReason : uint8_t {
+  kUnspecified = 0,  // DropPacket() without a reason
+  kNoOGate,          // sent to an output gate that is not connected
+  kQueueFull,        // no room in a queue
+  kNoBuffer,         // no memory to keep the packet (e.g., queue resize)
+  kPolicy,           // dropped by configuration or a rule (e.g., ACL deny)
+  kNoMatch,          // no matching table entry
+  kMalformed,        // malformed or unsupported packet
+  kTtlExpired,       // TTL has run out
+  kTxFailed,         // a port did not take the packet
+  kUnhandled,        // valid, but of a kind the module does not handle
+  kNumReasons,
+};
+
+// e.g., "queue_full" for DropReason::kQueueFull
+const char *DropReasonName(DropReason reason);
+
+// Per-worker packet drops of a module, indexed by DropReason
+using DropCounts =
+    std::array<uint64_t, static_cast<size_t>(DropReason::kNumReasons)>;
+
+// Per-worker profile of a module. Only counted while profiling is enabled.
+// See ModuleGraph::SetProfiling().
+struct alignas(64) ModuleProfile {
+  bess::utils::SingleWriterCounter cnt;       // ProcessBatch()/RunTask() calls
+  bess::utils::SingleWriterCounter pkts_in;   // packets passed in
+  bess::utils::SingleWriterCounter pkts_out;  // packets emitted to ogates
+  // Cycles spent, excluding those of fused downstream modules
+  bess::utils::SingleWriterCounter cycles;
 };
 
 using module_cmd_func_t =
@@ -194,8 +240,10 @@ class alignas(64) Module {
         tasks_(),
         igates_(),
         ogates_(),
-        deadends_(),
+        drops_(),
+        alloc_failures_(),
         active_workers_(Worker::kMaxWorkers, false),
+        stealing_workers_(Worker::kMaxWorkers, false),
         visited_tasks_(),
         is_task_(false),
         parent_tasks_(),
@@ -233,6 +281,27 @@ class alignas(64) Module {
 
   virtual std::string GetDesc() const { return ""; }
 
+  // Returns a file descriptor that becomes readable when the task registered
+  // with 'arg' has new work (e.g., incoming packets), or -1 if not supported.
+  // Idle workers sleep on it instead of polling the task.
+  virtual int GetTaskWakeupFd([[maybe_unused]] void *arg) const { return -1; }
+
+  // Returns true if the task registered with 'arg' may be run by workers other
+  // than the owner of its traffic class (never by two at the same time), e.g.,
+  // for work stealing. The rest of the pipeline is checked separately with
+  // IsPipelineMigratable().
+  virtual bool IsTaskMigratable([[maybe_unused]] void *arg) const {
+    return false;
+  }
+
+  // Returns the TSC at which the oldest work pending for the task registered
+  // with 'arg' was queued, or 0 if there is none or it is unknown. May be an
+  // estimate, but should never be later than the actual time. Used by
+  // "deadline" traffic classes.
+  virtual uint64_t GetTaskHeadTsc([[maybe_unused]] void *arg) const {
+    return 0;
+  }
+
   static const gate_idx_t kNumIGates = 1;
   static const gate_idx_t kNumOGates = 1;
 
@@ -247,7 +316,8 @@ class alignas(64) Module {
   CommandResponse InitWithGenericArg(const google::protobuf::Any &arg);
 
   // With the contexts('ctx'), pass packet batch ('batch') to the next module
-  // connected with 'ogate_idx'
+  // connected with 'ogate_idx'. If the gate is part of a fused chain (see
+  // ModuleGraph::UpdateFusedChains()), the next module runs before returning.
   inline void RunChooseModule(Context *ctx, gate_idx_t ogate_idx,
                               bess::PacketBatch *batch);
 
@@ -255,16 +325,61 @@ class alignas(64) Module {
   // next module ('ogate_idx' == 0)
   inline void RunNextModule(Context *ctx, bess::PacketBatch *batch);
 
-  // With the contexts('ctx'), drop a packet. Dropped packets will be freed.
-  inline void DropPacket(Context *ctx, bess::Packet *pkt);
+  // With the contexts('ctx'), drop a packet for 'reason'. Dropped packets
+  // will be freed.
+  inline void DropPacket(Context *ctx, bess::Packet *pkt,
+                         DropReason reason = DropReason::kUnspecified);
+
+  // Same as DropPacket(), but 'cnt' packets are freed right away.
+  inline void DropPackets(Context *ctx, bess::Packet **pkts, int cnt,
+                          DropReason reason);
+
+  // Accounts for 'cnt' packets of this module lost for 'reason', which are
+  // freed by the caller.
+  inline void CountDrops(Context *ctx, uint64_t cnt, DropReason reason) {
+    drops_[ctx->wid][static_cast<size_t>(reason)] += cnt;
+  }
+
+  // Accounts for 'cnt' packets (or clones) that this module failed to
+  // allocate. They never existed, so they are not drops.
+  inline void CountAllocFailures(Context *ctx, uint64_t cnt) {
+    alloc_failures_[ctx->wid] += cnt;
+  }
 
   // With the contexts('ctx'), emit (forward) a packet ('pkt') to the next
   // module connected with 'ogate'
   inline void EmitPacket(Context *ctx, bess::Packet *pkt, gate_idx_t ogate = 0);
 
+  // With the contexts('ctx'), emit each packet in 'batch' to the ogate given
+  // by the same index of 'ogates'. Same as calling EmitPacket() on every
+  // packet, but the batch is partitioned in one pass, and passed on as a
+  // whole if all packets go to the same ogate. Do not use 'batch' afterwards.
+  inline void EmitBatch(Context *ctx, bess::PacketBatch *batch,
+                        const gate_idx_t *ogates);
+
   // Process OGate hooks and forward packet batches into next modules.
   inline void ProcessOGates(Context *ctx);
 
+  // ProcessBatch() followed by ProcessOGates(), profiled if enabled.
+  inline void RunProcessBatch(Context *ctx, bess::PacketBatch *batch);
+
+  // Runs 'run' (a call into this module that received 'pkts_in' packets), and
+  // accounts it to the worker's ModuleProfile.
+  template <typename F>
+  inline void Profile(Context *ctx, uint64_t pkts_in, F run);
+
+  static bool profiling_enabled() {
+    return profiling_.load(std::memory_order_relaxed);
+  }
+
+  // Per-worker profiles, indexed by worker ID. nullptr if profiling has never
+  // been enabled.
+  const ModuleProfile *profile() const { return profile_.get(); }
+
+  // Returns the batch that collects packets emitted to 'ogate', with room for
+  // at least one more packet.
+  inline bess::PacketBatch *GetEmitBatch(Context *ctx, bess::OGate *ogate);
+
   /*
    * Split a batch into several, one for each ogate
    * NOTE:
@@ -332,8 +447,22 @@ class alignas(64) Module {
 
   const std::vector<bess::OGate *> &ogates() const { return ogates_; }
 
+  // Packets dropped for any reason, by all workers
   uint64_t deadends() const {
-    return std::accumulate(deadends_.begin(), deadends_.end(), 0);
+    uint64_t sum = 0;
+    for (const DropCounts &counts : drops_) {
+      sum = std::accumulate(counts.begin(), counts.end(), sum);
+    }
+    return sum;
+  }
+
+  // Packet drops of worker 'wid', by reason
+  const DropCounts &drops(int wid) const { return drops_[wid]; }
+
+  // Packets this module failed to allocate, by all workers
+  uint64_t alloc_failures() const {
+    return std::accumulate(alloc_failures_.begin(), alloc_failures_.end(),
+                           uint64_t{0});
   }
 
   // Compute placement constraints based on the current module and all
@@ -344,18 +473,28 @@ class alignas(64) Module {
   // Reset the set of active workers.
   void ResetActiveWorkerSet() {
     std::fill(active_workers_.begin(), active_workers_.end(), false);
+    std::fill(stealing_workers_.begin(), stealing_workers_.end(), false);
     visited_tasks_.clear();
-    deadends_.fill(0);
+    drops_.fill({});
+    alloc_failures_.fill(0);
   }
 
   const std::vector<bool> &active_workers() const { return active_workers_; }
 
-  // Number of active workers attached to this module.
+  // Number of active workers attached to this module. Workers that only run
+  // stolen tasks are not counted, as they never run them along with the owner.
   inline size_t num_active_workers() const {
-    return std::count_if(active_workers_.begin(), active_workers_.end(),
-                         [](bool b) { return b; });
+    size_t cnt = 0;
+    for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+      cnt += active_workers_[wid] && !stealing_workers_[wid];
+    }
+    return cnt;
   }
 
+  // True if worker 'wid' is active only because it may steal tasks that
+  // reach this module.
+  bool is_stealing_worker(int wid) const { return stealing_workers_[wid]; }
+
   // True if any worker attached to this module is running.
   inline bool HasRunningWorker() const {
     for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
@@ -379,6 +518,19 @@ class alignas(64) Module {
 
   virtual void AddActiveWorker(int wid, const Task *task);
 
+  // Marks worker 'wid' as active on the pipeline of 'task', which it may run
+  // by stealing it from its owner 'owner_wid' (see Scheduler::TrySteal()), so
+  // that modules with per-worker state are set up for it as well.
+  virtual void AddStealingWorker(int wid, int owner_wid, const Task *task,
+                                 std::unordered_set<const Module *> *visited);
+
+  // Returns true if 'task' can be run by another worker while the owner runs
+  // other tasks, i.e., every module in the pipeline from here is either
+  // thread safe or reachable only from 'task'. 'exclusive' tells whether this
+  // module is reachable only from 'task'.
+  bool IsPipelineMigratable(const Task *task, bool exclusive,
+                            std::unordered_set<const Module *> *visited) const;
+
   virtual CheckConstraintResult CheckModuleConstraints() const;
 
   // For testing.
@@ -417,6 +569,18 @@ class alignas(64) Module {
   // ModuleGraph class
   int ConnectGate(gate_idx_t ogate_idx, Module *m_next, gate_idx_t igate_idx);
   int DisconnectGate(gate_idx_t ogate_idx);
+
+  // ConnectGate() in two steps. NewGate() creates an ogate to 'igate_idx' of
+  // 'm_next', and also the igate if there is none yet ('*new_igate' is set to
+  // it then). LinkGate() puts them into the graph, storing the ogate last.
+  bess::OGate *NewGate(gate_idx_t ogate_idx, Module *m_next,
+                       gate_idx_t igate_idx, bess::IGate **new_igate);
+  void LinkGate(bess::OGate *ogate);
+
+  // Takes the ogate (and its igate, returned in '*orphan_igate', if no other
+  // ogates are connected to it) out of the graph without freeing them.
+  // Returns nullptr if the ogate is not connected.
+  bess::OGate *UnlinkGate(gate_idx_t ogate_idx, bess::IGate **orphan_igate);
   void DisconnectModulesUpstream(gate_idx_t igate_idx);
   void DestroyAllTasks();
   void DeregisterAllAttributes();
@@ -452,11 +616,17 @@ class alignas(64) Module {
 
   std::vector<bess::IGate *> igates_;
   std::vector<bess::OGate *> ogates_;
-  std::array<uint64_t, Worker::kMaxWorkers> deadends_;
+  std::array<DropCounts, Worker::kMaxWorkers> drops_;
+  std::array<uint64_t, Worker::kMaxWorkers> alloc_failures_;
+
+  static std::atomic<bool> profiling_;
+  std::unique_ptr<ModuleProfile[]> profile_;
 
  protected:
   // Set of active workers accessing this module.
   std::vector<bool> active_workers_;
+  // Subset of active_workers_ that only run stolen tasks.
+  std::vector<bool> stealing_workers_;
   // Set of tasks we have already accounted for when propagating workers.
   std::vector<const Task *> visited_tasks_;
 
@@ -507,7 +677,7 @@ inline void Module::RunChooseModule(Context *ctx, gate_idx_t ogate_idx,
   }
 
   if (unlikely(ogate_idx >= ogates_.size())) {
-    deadends_[ctx->wid] += batch->cnt();
+    CountDrops(ctx, batch->cnt(), DropReason::kNoOGate);
     deadend(ctx, batch);
     return;
   }
@@ -515,11 +685,26 @@ inline void Module::RunChooseModule(Context *ctx, gate_idx_t ogate_idx,
   ogate = ogates_[ogate_idx];
 
   if (unlikely(!ogate)) {
-    deadends_[ctx->wid] += batch->cnt();
+    CountDrops(ctx, batch->cnt(), DropReason::kNoOGate);
     deadend(ctx, batch);
     return;
   }
 
+  ctx->pkts_emitted += batch->cnt();
+
+  // Skip the task's queue, unless this module has already emitted packets
+  // that ProcessOGates() has yet to flush.
+  if (ogate->fused() && ctx->gate_with_hook_cnt == 0 &&
+      ctx->gate_without_hook_cnt == 0) {
+    Module *next = ogate->next();
+    gate_idx_t igate_idx = ctx->current_igate;
+
+    ctx->current_igate = ogate->igate_idx();
+    next->RunProcessBatch(ctx, batch);
+    ctx->current_igate = igate_idx;
+    return;
+  }
+
   for (auto &hook : ogate->hooks()) {
     hook->ProcessBatch(batch);
   }
@@ -531,27 +716,27 @@ inline void Module::RunNextModule(Context *ctx, bess::PacketBatch *batch) {
   RunChooseModule(ctx, 0, batch);
 }
 
-inline void Module::DropPacket(Context *ctx, bess::Packet *pkt) {
+inline void Module::DropPacket(Context *ctx, bess::Packet *pkt,
+                               DropReason reason) {
   ctx->task->dead_batch()->add(pkt);
-  deadends_[ctx->wid]++;
+  drops_[ctx->wid][static_cast<size_t>(reason)]++;
   if (static_cast<size_t>(ctx->task->dead_batch()->cnt()) >=
       bess::PacketBatch::kMaxBurst) {
     deadend(ctx, ctx->task->dead_batch());
   }
 }
 
-inline void Module::EmitPacket(Context *ctx, bess::Packet *pkt,
-                               gate_idx_t ogate_idx) {
-  // Check if valid ogate is set
-  if (unlikely(ogates_.size() <= ogate_idx) || unlikely(!ogates_[ogate_idx])) {
-    DropPacket(ctx, pkt);
-    return;
-  }
+inline void Module::DropPackets(Context *ctx, bess::Packet **pkts, int cnt,
+                                DropReason reason) {
+  CountDrops(ctx, cnt, reason);
+  ctx->silent_drops += cnt;
+  bess::Packet::Free(pkts, cnt);
+}
 
+inline bess::PacketBatch *Module::GetEmitBatch(Context *ctx,
+                                               bess::OGate *ogate) {
   Task *task = ctx->task;
 
-  // Put a packet into the ogate
-  bess::OGate *ogate = ogates_[ogate_idx];
   bess::IGate *igate = ogate->igate();
   bess::PacketBatch *batch = task->get_gate_batch(ogate);
   if (!batch) {
@@ -559,7 +744,7 @@ inline void Module::EmitPacket(Context *ctx, bess::Packet *pkt,
       // Having separate batch to run ogate hooks
       batch = task->AllocPacketBatch();
       task->set_gate_batch(ogate, batch);
-      ctx->gate_with_hook[ctx->gate_with_hook_cnt++] = ogate_idx;
+      ctx->gate_with_hook[ctx->gate_with_hook_cnt++] = ogate;
     } else {
       // If no ogate hooks, just use next igate batch
       batch = task->get_gate_batch(igate);
@@ -570,7 +755,7 @@ inline void Module::EmitPacket(Context *ctx, bess::Packet *pkt,
       } else {
         task->set_gate_batch(ogate, task->get_gate_batch(igate));
       }
-      ctx->gate_without_hook[ctx->gate_without_hook_cnt++] = ogate_idx;
+      ctx->gate_without_hook[ctx->gate_without_hook_cnt++] = ogate;
     }
   }
 
@@ -590,7 +775,105 @@ inline void Module::EmitPacket(Context *ctx, bess::Packet *pkt,
     }
   }
 
-  batch->add(pkt);
+  return batch;
+}
+
+inline void Module::EmitPacket(Context *ctx, bess::Packet *pkt,
+                               gate_idx_t ogate_idx) {
+  // Check if valid ogate is set
+  bess::OGate *ogate =
+      likely(ogate_idx < ogates_.size()) ? ogates_[ogate_idx] : nullptr;
+  if (unlikely(!ogate)) {
+    DropPacket(ctx, pkt, DropReason::kNoOGate);
+    return;
+  }
+
+  // Put a packet into the ogate
+  GetEmitBatch(ctx, ogate)->add(pkt);
+  ctx->pkts_emitted++;
+}
+
+inline void Module::EmitBatch(Context *ctx, bess::PacketBatch *batch,
+                              const gate_idx_t *ogates) {
+  const int cnt = batch->cnt();
+  if (unlikely(cnt <= 0)) {
+    return;
+  }
+
+  // Fast path: the whole batch goes to a single ogate, with nothing emitted to
+  // it before. Pass the batch on as is.
+  const gate_idx_t first = ogates[0];
+  int same = 1;
+  while (same < cnt && ogates[same] == first) {
+    same++;
+  }
+
+  if (same == cnt) {
+    bess::OGate *ogate = first < ogates_.size() ? ogates_[first] : nullptr;
+    if (!ogate || !ctx->task->get_gate_batch(ogate)) {
+      RunChooseModule(ctx, first, batch);
+      return;
+    }
+  }
+
+  // Otherwise, append each packet to the batch of its ogate in one pass. The
+  // per-ogate work of EmitPacket() is done once for each distinct ogate (a
+  // "slot"), or when its batch becomes full. Small ogate numbers map to slots
+  // directly, others with a linear search.
+  static const gate_idx_t kNumDirect = 64;
+  static const uint16_t kNoSlot = UINT16_MAX;
+  uint16_t direct[kNumDirect];
+  gate_idx_t gates[bess::PacketBatch::kMaxBurst];
+  bess::OGate *gate_ptrs[bess::PacketBatch::kMaxBurst];
+  bess::PacketBatch *out[bess::PacketBatch::kMaxBurst];
+  int num_slots = 0;
+
+  std::fill(direct, direct + kNumDirect, kNoSlot);
+
+  auto add_slot = [&](gate_idx_t ogate) {
+    gates[num_slots] = ogate;
+    gate_ptrs[num_slots] = ogate < ogates_.size() ? ogates_[ogate] : nullptr;
+    if (likely(gate_ptrs[num_slots] != nullptr)) {
+      out[num_slots] = GetEmitBatch(ctx, gate_ptrs[num_slots]);
+    } else {
+      out[num_slots] = nullptr;  // packets will be dropped
+    }
+    return num_slots++;
+  };
+
+  for (int i = 0; i < cnt; i++) {
+    gate_idx_t ogate = ogates[i];
+    bess::Packet *pkt = batch->pkts()[i];
+    int slot;
+
+    if (likely(ogate < kNumDirect)) {
+      slot = direct[ogate];
+      if (slot == kNoSlot) {
+        slot = direct[ogate] = add_slot(ogate);
+      }
+    } else {
+      slot = 0;
+      while (slot < num_slots && gates[slot] != ogate) {
+        slot++;
+      }
+      if (slot == num_slots) {
+        add_slot(ogate);
+      }
+    }
+
+    bess::PacketBatch *ogate_batch = out[slot];
+    if (unlikely(!ogate_batch)) {
+      DropPacket(ctx, pkt, DropReason::kNoOGate);
+      continue;
+    }
+
+    if (unlikely(static_cast<size_t>(ogate_batch->cnt()) >=
+                 bess::PacketBatch::kMaxBurst)) {
+      ogate_batch = out[slot] = GetEmitBatch(ctx, gate_ptrs[slot]);
+    }
+    ogate_batch->add(pkt);
+    ctx->pkts_emitted++;
+  }
 }
 
 inline void Module::ProcessOGates(Context *ctx) {
@@ -598,7 +881,7 @@ inline void Module::ProcessOGates(Context *ctx) {
 
   // Running ogate hooks, then add next igate to be scheduled
   for (int i = 0; i < ctx->gate_with_hook_cnt; i++) {
-    bess::OGate *ogate = ogates_[ctx->gate_with_hook[i]];  // should not be null
+    bess::OGate *ogate = ctx->gate_with_hook[i];
     for (auto &hook : ogate->hooks()) {
       hook->ProcessBatch(task->get_gate_batch(ogate));
     }
@@ -608,15 +891,48 @@ inline void Module::ProcessOGates(Context *ctx) {
 
   // Clear packet batch for ogates without hook
   for (int i = 0; i < ctx->gate_without_hook_cnt; i++) {
-    bess::OGate *ogate =
-        ogates_[ctx->gate_without_hook[i]];  // should not be null
-    task->set_gate_batch(ogate, nullptr);
+    task->set_gate_batch(ctx->gate_without_hook[i], nullptr);
   }
 
   ctx->gate_with_hook_cnt = 0;
   ctx->gate_without_hook_cnt = 0;
 }
 
+inline void Module::RunProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  if (likely(!profiling_enabled())) {
+    ProcessBatch(ctx, batch);
+    ProcessOGates(ctx);
+    return;
+  }
+
+  Profile(ctx, batch->cnt(), [&]() {
+    ProcessBatch(ctx, batch);
+    ProcessOGates(ctx);
+  });
+}
+
+template <typename F>
+inline void Module::Profile(Context *ctx, uint64_t pkts_in, F run) {
+  // Fused downstream modules are nested calls, profiled on their own.
+  uint64_t pkts_emitted = ctx->pkts_emitted;
+  uint64_t child_cycles = ctx->child_cycles;
+  ctx->pkts_emitted = 0;
+  ctx->child_cycles = 0;
+
+  uint64_t start = rdtsc();
+  run();
+  uint64_t cycles = rdtsc() - start;
+
+  ModuleProfile &p = profile_[ctx->wid];
+  ++p.cnt;
+  p.pkts_in += pkts_in;
+  p.pkts_out += ctx->pkts_emitted;
+  p.cycles += cycles - std::min(cycles, ctx->child_cycles);
+
+  ctx->pkts_emitted = pkts_emitted;
+  ctx->child_cycles = child_cycles + cycles;
+}
+
 inline void Module::RunSplit(Context *ctx, const gate_idx_t *out_gates,
                              bess::PacketBatch *mixed_batch) {
   int pkt_cnt = mixed_batch->cnt();
@@ -626,7 +942,7 @@ inline void Module::RunSplit(Context *ctx, const gate_idx_t *out_gates,
 
   int gate_cnt = ogates_.size();
   if (unlikely(gate_cnt <= 0)) {
-    deadends_[ctx->wid] += mixed_batch->cnt();
+    CountDrops(ctx, mixed_batch->cnt(), DropReason::kNoOGate);
     deadend(ctx, mixed_batch);
     return;
   }
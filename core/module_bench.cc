@@ -0,0 +1,232 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmarks for splitting a batch over output gates.
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "module.h"
+#include "module_graph.h"
+#include "packet_pool.h"
+#include "pktbatch.h"
+#include "task.h"
+#include "utils/random.h"
+#include "utils/time.h"
+
+namespace {
+
+// Allocates a full batch per run.
+class BenchSource final : public Module {
+ public:
+  static const gate_idx_t kNumIGates = 0;
+
+  BenchSource() : Module(), pool_() { is_task_ = true; }
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
+                             void *) override {
+    const uint32_t burst = bess::PacketBatch::kMaxBurst;
+    CHECK(pool_->AllocBulk(batch->pkts(), burst, 60));
+    batch->set_cnt(burst);
+    RunNextModule(ctx, batch);
+    return {.block = false, .packets = burst, .bits = burst * 60 * 8};
+  }
+
+  void set_pool(bess::PacketPool *pool) { pool_ = pool; }
+
+ private:
+  bess::PacketPool *pool_;
+};
+
+// Sends packets to precomputed output gates, like a classifier would, with
+// either EmitPacket() or EmitBatch().
+class BenchClassifier final : public Module {
+ public:
+  static const gate_idx_t kNumOGates = MAX_GATES;
+  static const int kNumPatterns = 64;
+
+  BenchClassifier() : Module(), bulk_(), patterns_(), next_() {}
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override {
+    const gate_idx_t *ogates = patterns_[next_++ % kNumPatterns].data();
+
+    if (bulk_) {
+      EmitBatch(ctx, batch, ogates);
+    } else {
+      int cnt = batch->cnt();
+      for (int i = 0; i < cnt; i++) {
+        EmitPacket(ctx, batch->pkts()[i], ogates[i]);
+      }
+    }
+  }
+
+  // Every pattern hits exactly 'num_gates' distinct gates in random order.
+  void Setup(bool bulk, int num_gates) {
+    Random rng(num_gates);
+
+    bulk_ = bulk;
+    patterns_.resize(kNumPatterns);
+    for (auto &pattern : patterns_) {
+      pattern.resize(bess::PacketBatch::kMaxBurst);
+      for (size_t i = 0; i < pattern.size(); i++) {
+        pattern[i] = (static_cast<int>(i) < num_gates)
+                         ? i
+                         : rng.GetRange(num_gates);
+      }
+      for (size_t i = pattern.size() - 1; i > 0; i--) {
+        std::swap(pattern[i], pattern[rng.GetRange(i + 1)]);
+      }
+    }
+  }
+
+ private:
+  bool bulk_;
+  std::vector<std::vector<gate_idx_t>> patterns_;
+  uint64_t next_;
+};
+
+// Frees the batch.
+class BenchSink final : public Module {
+ public:
+  static const gate_idx_t kNumOGates = 0;
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *, bess::PacketBatch *batch) override {
+    bess::Packet::Free(batch);
+  }
+};
+
+DEF_MODULE(BenchSource, "bench_source", "allocates packets");
+DEF_MODULE(BenchClassifier, "bench_classifier", "emits packets to gates");
+DEF_MODULE(BenchSink, "bench_sink", "frees packets");
+
+Module *CreateBenchModule(const std::string &class_name,
+                          const std::string &name) {
+  const ModuleBuilder &builder =
+      ModuleBuilder::all_module_builders().find(class_name)->second;
+
+  bess::pb::EmptyArg arg_;
+  google::protobuf::Any arg;
+  arg.PackFrom(arg_);
+
+  pb_error_t perr;
+  Module *m = ModuleGraph::CreateModule(builder, name, arg, &perr);
+  CHECK(m) << perr.errmsg();
+  return m;
+}
+
+// Sets up "source -> classifier -> sink x state.range(0)", run as a single
+// task. The classifier uses EmitBatch() unless state.range(1) is 0.
+class EmitFixture : public benchmark::Fixture {
+ public:
+  EmitFixture() : pool_(), task_() {}
+
+  void SetUp(benchmark::State &state) override {
+    int num_gates = state.range(0);
+    bool bulk = state.range(1);
+
+    pool_ = new bess::PlainPacketPool();
+
+    BenchSource *src =
+        static_cast<BenchSource *>(CreateBenchModule("BenchSource", "src"));
+    src->set_pool(pool_);
+
+    BenchClassifier *classifier = static_cast<BenchClassifier *>(
+        CreateBenchModule("BenchClassifier", "classifier"));
+    classifier->Setup(bulk, num_gates);
+    CHECK_EQ(ModuleGraph::ConnectModules(src, 0, classifier, 0, true), 0);
+
+    for (int i = 0; i < num_gates; i++) {
+      Module *sink = CreateBenchModule("BenchSink", "sink" + std::to_string(i));
+      CHECK_EQ(ModuleGraph::ConnectModules(classifier, i, sink, 0, true), 0);
+    }
+
+    ModuleGraph::UpdateTaskGraph();
+    task_ = new Task(src, nullptr);
+    task_->UpdatePerGateBatch(2 * num_gates + 2);
+  }
+
+  void TearDown(benchmark::State &) override {
+    delete task_;
+    task_ = nullptr;
+
+    ModuleGraph::DestroyAllModules();
+
+    delete pool_;
+    pool_ = nullptr;
+  }
+
+ protected:
+  BenchSource_class BenchSource_singleton_;
+  BenchClassifier_class BenchClassifier_singleton_;
+  BenchSink_class BenchSink_singleton_;
+
+  bess::PacketPool *pool_;
+  Task *task_;
+};
+
+// Runs the pipeline once per iteration and reports cycles per packet.
+BENCHMARK_DEFINE_F(EmitFixture, RunTask)(benchmark::State &state) {
+  Context ctx = {};
+  ctx.task = task_;
+
+  uint64_t pkts = 0;
+  uint64_t start = rdtsc();
+  while (state.KeepRunning()) {
+    ctx.current_tsc = rdtsc();
+    pkts += (*task_)(&ctx).packets;
+  }
+  uint64_t cycles = rdtsc() - start;
+
+  state.SetItemsProcessed(pkts);
+  state.counters["cycles/pkt"] = static_cast<double>(cycles) / pkts;
+}
+
+void NumGates(benchmark::internal::Benchmark *b) {
+  for (size_t gates = 1; gates <= bess::PacketBatch::kMaxBurst; gates *= 2) {
+    b->Args({static_cast<int>(gates), 0});
+    b->Args({static_cast<int>(gates), 1});
+  }
+}
+
+BENCHMARK_REGISTER_F(EmitFixture, RunTask)->Apply(NumGates);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -32,16 +32,25 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <set>
+#include <vector>
+
 #include "gate.h"
 #include "gate_hooks/track.h"
 #include "module.h"
+#include "pb/module_msg.pb.h"
 #include "scheduler.h"
 #include "utils/extended_priority_queue.h"
 
 std::map<std::string, Module *> ModuleGraph::all_modules_;
 std::unordered_set<std::string> ModuleGraph::tasks_;
 bool ModuleGraph::changes_made_ = false;
-uint32_t ModuleGraph::gate_cnt_;
+uint64_t ModuleGraph::generation_ = 0;
+std::atomic<uint32_t> ModuleGraph::gate_cnt_;
+uint32_t ModuleGraph::task_gate_cnt_ = ModuleGraph::kTaskGateHeadroom;
 
 struct IGateGreater {
   bool operator()(const bess::IGate *left, const bess::IGate *right) const {
@@ -182,22 +191,149 @@ void ModuleGraph::SetUniqueGateIdx() {
 }
 
 void ModuleGraph::ConfigureTasks() {
-  for (int i = 0; i < Worker::kMaxWorkers; i++) {
-    if (workers[i] == nullptr) {
+  // Workers may be held rather than paused (see WorkerHolder), and no task may
+  // grow its per-gate batches under them. Indices only shrink by
+  // SetUniqueGateIdx(), so the room made in the last pause is still enough.
+  if (is_any_worker_running()) {
+    return;
+  }
+
+  // Leave room for the gates that ConnectModulesHitless() may add until then.
+  task_gate_cnt_ = gate_cnt_ + kTaskGateHeadroom;
+
+  for (const auto &tc_pair : bess::TrafficClassBuilder::all_tcs()) {
+    bess::TrafficClass *c = tc_pair.second;
+    if (c->policy() == bess::POLICY_LEAF) {
+      auto leaf = static_cast<bess::LeafTrafficClass *>(c);
+      leaf->task()->UpdatePerGateBatch(task_gate_cnt_);
+    }
+  }
+}
+
+void ModuleGraph::UpdateFusedChains() {
+  // Single-ogate -> single-igate links without gate hooks on either side
+  std::unordered_map<Module *, bess::OGate *> links;
+
+  for (auto const &e : all_modules_) {
+    Module *m = e.second;
+
+    bess::OGate *ogate = nullptr;
+    int num_ogates = 0;
+    for (bess::OGate *og : m->ogates()) {
+      if (og) {
+        ogate = og;
+        num_ogates++;
+      }
+    }
+
+    if (num_ogates != 1 || !ogate->hooks().empty()) {
       continue;
     }
 
-    for (const auto &tc_pair : bess::TrafficClassBuilder::all_tcs()) {
-      bess::TrafficClass *c = tc_pair.second;
-      if (c->policy() == bess::POLICY_LEAF) {
-        auto leaf = static_cast<bess::LeafTrafficClass *>(c);
-        leaf->task()->UpdatePerGateBatch(gate_cnt_);
+    Module *next = ogate->next();
+    bess::IGate *igate = ogate->igate();
+    int num_igates = 0;
+    for (bess::IGate *ig : next->igates()) {
+      if (ig) {
+        num_igates++;
+      }
+    }
+
+    if (next == m || num_igates != 1 || !igate->hooks().empty() ||
+        igate->ogates_upstream().size() != 1) {
+      continue;
+    }
+
+    links.emplace(m, ogate);
+  }
+
+  // A fused hop is a nested call, so a chain must not loop back to itself.
+  // Leave the link that would close a loop unfused.
+  std::unordered_set<bess::OGate *> fused;
+  for (auto const &link : links) {
+    Module *start = link.first;
+    Module *m = link.second->next();
+    bool loop = false;
+    for (size_t i = 0; i < links.size(); i++) {
+      if (m == start) {
+        loop = true;
+        break;
+      }
+      auto it = links.find(m);
+      if (it == links.end() || !fused.count(it->second)) {
+        break;
+      }
+      m = it->second->next();
+    }
+
+    if (!loop) {
+      fused.insert(link.second);
+    }
+  }
+
+  // Workers may be running. Clear the flags that go first, and set new ones
+  // only once no task run can still see the old ones, so that not even a mix
+  // of old and new fused links can form a loop.
+  bool cleared = false;
+  for (auto const &e : all_modules_) {
+    for (bess::OGate *og : e.second->ogates()) {
+      if (og && og->fused() && !fused.count(og)) {
+        og->set_fused(false);
+        cleared = true;
+      }
+    }
+  }
+
+  if (cleared) {
+    synchronize_workers();
+  }
+
+  for (bess::OGate *og : fused) {
+    og->set_fused(true);
+  }
+}
+
+void ModuleGraph::AllocProfile(Module *m) {
+  if (!m->profile_) {
+    m->profile_.reset(new ModuleProfile[Worker::kMaxWorkers]);
+  }
+}
+
+void ModuleGraph::SetProfiling(bool enable, bool reset) {
+  if (enable) {
+    // Workers index profiles as soon as they see the flag set.
+    for (auto const &e : all_modules_) {
+      AllocProfile(e.second);
+    }
+  }
+
+  if (reset) {
+    // Counters have a single writer each, so stop the workers from counting
+    // before clearing them.
+    Module::profiling_.store(false, std::memory_order_release);
+    synchronize_workers();
+
+    for (auto const &e : all_modules_) {
+      ModuleProfile *profile = e.second->profile_.get();
+      if (!profile) {
+        continue;
+      }
+      for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+        profile[wid].cnt.Reset();
+        profile[wid].pkts_in.Reset();
+        profile[wid].pkts_out.Reset();
+        profile[wid].cycles.Reset();
       }
     }
   }
+
+  Module::profiling_.store(enable, std::memory_order_release);
 }
 
 void ModuleGraph::UpdateTaskGraph() {
+  // Gate hooks can be added or removed without changing the graph itself.
+  UpdateFusedChains();
+
   if (!changes_made_) {
     return;
   }
@@ -250,6 +386,15 @@ Module *ModuleGraph::CreateModule(const ModuleBuilder &builder,
   Module *m =
       builder.CreateModule(module_name, &bess::metadata::default_pipeline);
 
+  // Leave room for connecting the first few gates without workers paused.
+  // See ConnectModulesHitless().
+  m->igates_.reserve(std::min<size_t>(builder.NumIGates(), kReservedGates));
+  m->ogates_.reserve(std::min<size_t>(builder.NumOGates(), kReservedGates));
+
+  if (Module::profiling_enabled()) {
+    AllocProfile(m);
+  }
+
   CommandResponse ret = m->InitWithGenericArg(arg);
   {
     google::protobuf::Any empty;
@@ -290,11 +435,14 @@ Module *ModuleGraph::CreateModule(const ModuleBuilder &builder,
     return nullptr;
   }
 
+  generation_++;
+
   return m;
 }
 
 void ModuleGraph::DestroyModule(Module *m, bool erase) {
   changes_made_ = true;
+  generation_++;
 
   m->Destroy();
 
@@ -311,6 +459,7 @@ void ModuleGraph::DestroyModule(Module *m, bool erase) {
 
 void ModuleGraph::DestroyAllModules() {
   changes_made_ = true;
+  generation_++;
 
   for (auto it = all_modules_.begin(); it != all_modules_.end();) {
     auto it_next = std::next(it);
@@ -334,14 +483,23 @@ int ModuleGraph::ConnectModules(Module *module, gate_idx_t ogate_idx,
   }
 
   changes_made_ = true;
+  generation_++;
 
   int ret = module->ConnectGate(ogate_idx, m_next, igate_idx);
   if (ret != 0)
     return ret;
 
+  bess::OGate *ogate = module->ogates()[ogate_idx];
   if (!skip_default_hooks) {
     // Gate tracking is enabled by default
-    module->ogates()[ogate_idx]->AddTrackHook();
+    ogate->AddTrackHook();
+  }
+
+  // Indices stay unique until the next UpdateTaskGraph(), as running workers
+  // may reach these gates sooner through ConnectModulesHitless().
+  ogate->SetUniqueIdx(gate_cnt_++);
+  if (ogate->igate()->ogates_upstream().size() == 1) {
+    ogate->igate()->SetUniqueIdx(gate_cnt_++);
   }
 
   return 0;
@@ -353,12 +511,498 @@ int ModuleGraph::DisconnectModule(Module *module, gate_idx_t ogate_idx) {
   }
 
   changes_made_ = true;
+  generation_++;
 
   module->DisconnectGate(ogate_idx);
 
   return 0;
 }
 
+bool ModuleGraph::ChangesMetadataOffsets(Module *module, Module *m_next) {
+  std::unordered_set<Module *> visited;
+  std::vector<Module *> stack = {module, m_next};
+
+  // Metadata offsets are assigned over connected modules.
+  while (!stack.empty()) {
+    Module *m = stack.back();
+    stack.pop_back();
+    if (!visited.insert(m).second) {
+      continue;
+    }
+
+    if (!m->all_attrs().empty()) {
+      return true;
+    }
+
+    for (bess::OGate *og : m->ogates()) {
+      if (og) {
+        stack.push_back(og->next());
+      }
+    }
+    for (bess::IGate *ig : m->igates()) {
+      if (ig) {
+        for (bess::OGate *og : ig->ogates_upstream()) {
+          stack.push_back(og->module());
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+void ModuleGraph::UpdateMetadataOffsets() {
+  int ret = bess::metadata::default_pipeline.ComputeMetadataOffsets();
+  if (ret) {
+    // The metadata resume hook tries again on the next resume.
+    LOG(ERROR) << "Failed to compute metadata offsets: " << ret;
+  }
+}
+
+bool ModuleGraph::IsHitlessChange(Module *module, Module *m_next,
+                                  bool connect) {
+  // Taking modules away from workers is always fine.
+  if (!connect) {
+    return true;
+  }
+
+  // Which tasks are stealable is decided when workers resume.
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    if (is_worker_running(wid) &&
+        workers[wid]->scheduler()->opts().work_stealing) {
+      return false;
+    }
+  }
+
+  // The workers of 'module' will run the modules from 'm_next' on as well.
+  const std::vector<bool> &new_workers = module->active_workers();
+  std::unordered_set<Module *> visited;
+  std::vector<Module *> stack = {m_next};
+  while (!stack.empty()) {
+    Module *m = stack.back();
+    stack.pop_back();
+    if (!visited.insert(m).second) {
+      continue;
+    }
+
+    int num_workers = 0;
+    bool more_workers = false;
+    for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+      if (m->active_workers()[wid] || new_workers[wid]) {
+        num_workers++;
+        more_workers |= !m->active_workers()[wid];
+      }
+    }
+
+    if (more_workers && num_workers > m->max_allowed_workers_) {
+      return false;
+    }
+
+    if (!m->propagate_workers_) {
+      continue;
+    }
+
+    for (bess::OGate *og : m->ogates()) {
+      if (og) {
+        stack.push_back(og->next());
+      }
+    }
+  }
+
+  return true;
+}
+
+int ModuleGraph::ConnectModulesHitless(Module *module, gate_idx_t ogate_idx,
+                                       Module *m_next, gate_idx_t igate_idx,
+                                       bool skip_default_hooks) {
+  if (ogate_idx >= module->module_builder()->NumOGates() ||
+      ogate_idx >= MAX_GATES) {
+    return -EINVAL;
+  }
+
+  if (igate_idx >= m_next->module_builder()->NumIGates() ||
+      igate_idx >= MAX_GATES) {
+    return -EINVAL;
+  }
+
+  if (is_active_gate<bess::OGate>(module->ogates(), ogate_idx)) {
+    return -EBUSY;
+  }
+
+  // Growing a gate array, or the per-gate batches of tasks, would move it
+  // under the workers' feet.
+  if (ogate_idx >= module->ogates_.capacity() ||
+      igate_idx >= m_next->igates_.capacity() ||
+      gate_cnt_ + 2 > task_gate_cnt_ ||
+      !IsHitlessChange(module, m_next, true)) {
+    return -EAGAIN;
+  }
+
+  bool metadata = ChangesMetadataOffsets(module, m_next);
+
+  bess::IGate *new_igate;
+  bess::OGate *ogate =
+      module->NewGate(ogate_idx, m_next, igate_idx, &new_igate);
+  if (!ogate) {
+    return -ENOMEM;
+  }
+
+  if (!skip_default_hooks) {
+    // Gate tracking is enabled by default
+    ogate->AddTrackHook();
+  }
+
+  // Until the next UpdateTaskGraph(), the new gates get indices past all
+  // others, and a new igate is scheduled after those of 'module'.
+  ogate->SetUniqueIdx(gate_cnt_++);
+  if (new_igate) {
+    uint32_t priority = 1;
+    for (bess::IGate *ig : module->igates()) {
+      if (ig) {
+        priority = std::max(priority, ig->priority() + 1);
+      }
+    }
+    new_igate->SetPriority(priority);
+    new_igate->SetUniqueIdx(gate_cnt_++);
+  }
+
+  changes_made_ = true;
+  generation_++;
+
+  // Workers must not see metadata offsets change in the middle of a pipeline,
+  // so they switch over to the new ones along with the gate.
+  std::unique_ptr<WorkerHolder> holder;
+  if (metadata) {
+    holder.reset(new WorkerHolder());
+  }
+
+  module->LinkGate(ogate);
+  UpdateFusedChains();
+
+  if (metadata) {
+    UpdateMetadataOffsets();
+  }
+
+  return 0;
+}
+
+int ModuleGraph::DisconnectModuleHitless(Module *module, gate_idx_t ogate_idx) {
+  if (ogate_idx >= module->module_builder()->NumOGates()) {
+    return -EINVAL;
+  }
+
+  if (!is_active_gate<bess::OGate>(module->ogates(), ogate_idx)) {
+    return 0;
+  }
+
+  Module *m_next = module->ogates()[ogate_idx]->next();
+  if (!IsHitlessChange(module, m_next, false)) {
+    return -EAGAIN;
+  }
+
+  bool metadata = ChangesMetadataOffsets(module, m_next);
+
+  changes_made_ = true;
+  generation_++;
+
+  bess::IGate *orphan_igate;
+  bess::OGate *ogate;
+  {
+    // See ConnectModulesHitless().
+    std::unique_ptr<WorkerHolder> holder;
+    if (metadata) {
+      holder.reset(new WorkerHolder());
+    }
+
+    ogate = module->UnlinkGate(ogate_idx, &orphan_igate);
+    UpdateFusedChains();
+
+    if (metadata) {
+      UpdateMetadataOffsets();
+    }
+  }
+
+  // No task run can be using the gates after this.
+  synchronize_workers();
+
+  if (orphan_igate) {
+    orphan_igate->ClearHooks();
+    delete orphan_igate;
+  }
+
+  ogate->ClearHooks();
+  delete ogate;
+
+  return 0;
+}
+
+// Sums up the per-worker profiles of the module. Returns false if it has never
+// been profiled.
+static bool SumProfile(const Module *m, uint64_t *cycles, uint64_t *pkts_in,
+                       uint64_t *pkts_out) {
+  const ModuleProfile *profile = m->profile();
+  *cycles = *pkts_in = *pkts_out = 0;
+  if (!profile) {
+    return false;
+  }
+
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    *cycles += profile[wid].cycles;
+    *pkts_in += profile[wid].pkts_in;
+    *pkts_out += profile[wid].pkts_out;
+  }
+  return true;
+}
+
+int ModuleGraph::ProposePartition(Module *task_module,
+                                  const std::vector<int> &wids,
+                                  PipelinePartition *partition) {
+  if (!task_module->is_task()) {
+    return -EINVAL;
+  }
+
+  // Modules in BFS order, so that most links go forward. Other task modules
+  // run the rest of their pipelines by themselves.
+  std::vector<Module *> order = {task_module};
+  std::unordered_map<Module *, size_t> index = {{task_module, 0}};
+  for (size_t i = 0; i < order.size(); i++) {
+    Module *m = order[i];
+    if (m != task_module && m->is_task()) {
+      continue;
+    }
+    for (bess::OGate *ogate : m->ogates()) {
+      if (ogate && index.emplace(ogate->next(), order.size()).second) {
+        order.push_back(ogate->next());
+      }
+    }
+  }
+
+  uint64_t cycles, pkts_in, pkts_out;
+  if (!SumProfile(task_module, &cycles, &pkts_in, &pkts_out) || !pkts_out) {
+    return -ENODATA;
+  }
+
+  // All costs are in cycles per packet out of the task module.
+  const double task_pkts = pkts_out;
+  const size_t n = order.size();
+  std::vector<double> prefix(n + 1);
+  std::vector<uint64_t> mod_pkts_in(n);
+  std::vector<uint64_t> mod_pkts_out(n);
+  for (size_t i = 0; i < n; i++) {
+    SumProfile(order[i], &cycles, &mod_pkts_in[i], &mod_pkts_out[i]);
+    prefix[i + 1] = prefix[i] + cycles / task_pkts;
+  }
+
+  // best[k][j] is the lowest cost of the costliest stage when the first j
+  // modules are split into k stages, and split[k][j] the start of the last
+  // one. O(k * n^2), which is fine for the control plane.
+  const size_t max_stages = std::min(wids.size() + 1, n);
+  const double inf = std::numeric_limits<double>::infinity();
+  std::vector<std::vector<double>> best(max_stages + 1,
+                                        std::vector<double>(n + 1, inf));
+  std::vector<std::vector<size_t>> split(max_stages + 1,
+                                         std::vector<size_t>(n + 1));
+  best[0][0] = 0;
+  for (size_t k = 1; k <= max_stages; k++) {
+    for (size_t j = k; j <= n; j++) {
+      for (size_t i = k - 1; i < j; i++) {
+        double cost = std::max(best[k - 1][i], prefix[j] - prefix[i]);
+        if (cost < best[k][j]) {
+          best[k][j] = cost;
+          split[k][j] = i;
+        }
+      }
+    }
+  }
+
+  int task_wid = Worker::kAnyWorker;
+  if (!task_module->tasks().empty() && task_module->tasks()[0]->GetTC()) {
+    task_wid = task_module->tasks()[0]->GetTC()->WorkerId();
+  }
+
+  // More stages need more Queues, so fewer may do better. Try all counts.
+  double best_cost = inf;
+  for (size_t num_stages = 1; num_stages <= max_stages; num_stages++) {
+    std::vector<size_t> stage_of(n);
+    for (size_t k = num_stages, j = n; k > 0; k--) {
+      for (size_t i = split[k][j]; i < j; i++) {
+        stage_of[i] = k - 1;
+      }
+      j = split[k][j];
+    }
+
+    PipelinePartition p;
+    p.cycles_per_pkt = prefix[n];
+    for (size_t k = 0; k < num_stages; k++) {
+      int wid = (k == 0) ? task_wid : wids[k - 1];
+      p.stages.push_back({wid, {}, 0.0});
+    }
+    for (size_t i = 0; i < n; i++) {
+      PipelinePartition::Stage &stage = p.stages[stage_of[i]];
+      stage.modules.push_back(order[i]);
+      stage.cycles_per_pkt += prefix[i + 1] - prefix[i];
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      Module *m = order[i];
+      if (m != task_module && m->is_task()) {
+        continue;
+      }
+      for (gate_idx_t ogate_idx = 0; ogate_idx < m->ogates().size();
+           ogate_idx++) {
+        bess::OGate *ogate = m->ogates()[ogate_idx];
+        if (!ogate) {
+          continue;
+        }
+        size_t j = index[ogate->next()];
+        if (stage_of[i] == stage_of[j]) {
+          continue;
+        }
+
+        // Packets on the link, at most
+        double pkts = std::min(mod_pkts_out[i], mod_pkts_in[j]) / task_pkts;
+        p.stages[stage_of[i]].cycles_per_pkt += kQueueCyclesPerPkt * pkts;
+        p.stages[stage_of[j]].cycles_per_pkt += kQueueCyclesPerPkt * pkts;
+        p.cuts.push_back({m, ogate_idx, p.stages[stage_of[j]].wid});
+      }
+    }
+
+    double cost = 0.0;
+    for (const auto &stage : p.stages) {
+      cost = std::max(cost, stage.cycles_per_pkt);
+    }
+    if (cost < best_cost) {
+      best_cost = cost;
+      *partition = std::move(p);
+    }
+  }
+
+  return 0;
+}
+
+static void DeleteHooks(const std::vector<bess::GateHook *> &hooks) {
+  for (bess::GateHook *hook : hooks) {
+    delete hook;
+  }
+}
+
+int ModuleGraph::ApplyPartition(
+    const std::vector<PipelinePartition::Cut> &cuts,
+    std::vector<std::string> *queues) {
+  const auto &builders = ModuleBuilder::all_module_builders();
+  const auto &it = builders.find("Queue");
+  if (it == builders.end()) {
+    return -ENOENT;
+  }
+
+  // Check all cuts first, not to leave the pipeline half rewired.
+  std::set<std::pair<Module *, gate_idx_t>> seen;
+  for (const auto &cut : cuts) {
+    if (!is_active_gate<bess::OGate>(cut.module->ogates(), cut.ogate_idx) ||
+        !seen.emplace(cut.module, cut.ogate_idx).second) {
+      return -EINVAL;
+    }
+  }
+
+  bess::pb::QueueArg queue_arg;
+  google::protobuf::Any arg;
+  arg.PackFrom(queue_arg);
+
+  // Create all Queues before touching the pipeline.
+  std::vector<Module *> new_queues;
+  for (size_t i = 0; i < cuts.size(); i++) {
+    pb_error_t perr;
+    Module *queue =
+        CreateModule(it->second, GenerateDefaultName("Queue", ""), arg, &perr);
+    if (!queue) {
+      for (Module *m : new_queues) {
+        DestroyModule(m);
+      }
+      return -perr.code();
+    }
+    new_queues.push_back(queue);
+  }
+
+  // Original links of the cuts that have been rewired so far, and the gate
+  // hooks on either side, which go to the gates that replace them.
+  struct Link {
+    Module *next;
+    gate_idx_t igate_idx;
+    std::vector<bess::GateHook *> ogate_hooks;
+    std::vector<bess::GateHook *> igate_hooks;
+  };
+  std::vector<Link> links;
+
+  for (size_t i = 0; i < cuts.size(); i++) {
+    const PipelinePartition::Cut &cut = cuts[i];
+    Module *queue = new_queues[i];
+    bess::OGate *ogate = cut.module->ogates()[cut.ogate_idx];
+    Link link = {ogate->next(), ogate->igate_idx(), ogate->TakeHooks(), {}};
+
+    // The igate goes away along with its last upstream ogate.
+    if (ogate->igate()->ogates_upstream().size() == 1) {
+      link.igate_hooks = ogate->igate()->TakeHooks();
+    }
+
+    int ret = DisconnectModule(cut.module, cut.ogate_idx);
+    if (ret == 0) {
+      links.push_back(link);
+      ret = ConnectModules(cut.module, cut.ogate_idx, queue, 0, true);
+    } else {
+      ogate->AddHooks(link.ogate_hooks);
+      ogate->igate()->AddHooks(link.igate_hooks);
+    }
+    if (ret == 0) {
+      ret = ConnectModules(queue, 0, link.next, link.igate_idx);
+    }
+    if (ret != 0) {
+      // Put the pipeline back as it was. Destroying a Queue disconnects it
+      // on both sides.
+      for (Module *m : new_queues) {
+        DestroyModule(m);
+      }
+      for (size_t j = 0; j < links.size(); j++) {
+        Module *m = cuts[j].module;
+        gate_idx_t ogate_idx = cuts[j].ogate_idx;
+        int err = ConnectModules(m, ogate_idx, links[j].next,
+                                 links[j].igate_idx, true);
+        if (err) {
+          LOG(ERROR) << "Failed to restore " << m->name() << ":" << ogate_idx
+                     << "->" << links[j].igate_idx << ":"
+                     << links[j].next->name() << ": " << err;
+          DeleteHooks(links[j].ogate_hooks);
+          DeleteHooks(links[j].igate_hooks);
+          continue;
+        }
+        m->ogates()[ogate_idx]->AddHooks(links[j].ogate_hooks);
+        m->ogates()[ogate_idx]->igate()->AddHooks(links[j].igate_hooks);
+      }
+      return ret;
+    }
+  }
+
+  for (size_t i = 0; i < cuts.size(); i++) {
+    Module *queue = new_queues[i];
+    bess::OGate *ogate = cuts[i].module->ogates()[cuts[i].ogate_idx];
+    ogate->AddHooks(links[i].ogate_hooks);
+    queue->ogates()[0]->igate()->AddHooks(links[i].igate_hooks);
+  }
+
+  for (size_t i = 0; i < cuts.size(); i++) {
+    Module *queue = new_queues[i];
+
+    // Run the dequeuing side on the worker of the downstream stage.
+    bess::LeafTrafficClass *c = queue->tasks()[0]->GetTC();
+    if (remove_tc_from_orphan(c)) {
+      add_tc_to_orphan(c, cuts[i].wid);
+    }
+
+    queues->push_back(queue->name());
+  }
+
+  return 0;
+}
+
 std::string ModuleGraph::GenerateDefaultName(
     const std::string &class_name, const std::string &default_template) {
   std::string name_template;
@@ -409,4 +1053,33 @@ void ModuleGraph::PropagateActiveWorker() {
       }
     }
   }
+
+  // Stealable tasks may be run by any other worker that steals as well. This
+  // over-approximates what RefreshStealSources() publishes, which is fine.
+  for (int i = 0; i < Worker::kMaxWorkers; i++) {
+    if (workers[i] == nullptr ||
+        !workers[i]->scheduler()->opts().work_stealing) {
+      continue;
+    }
+    bess::TrafficClass *root = workers[i]->scheduler()->root();
+    if (!root) {
+      continue;
+    }
+    for (const auto &tc_pair : bess::TrafficClassBuilder::all_tcs()) {
+      bess::TrafficClass *c = tc_pair.second;
+      if (c->policy() != bess::POLICY_LEAF || c->Root() != root) {
+        continue;
+      }
+      auto leaf = static_cast<bess::LeafTrafficClass *>(c);
+      if (!leaf->task()->IsMigratable()) {
+        continue;
+      }
+      for (int j = 0; j < Worker::kMaxWorkers; j++) {
+        if (j != i && workers[j] &&
+            workers[j]->scheduler()->opts().work_stealing) {
+          leaf->task()->AddStealingWorker(j, i);
+        }
+      }
+    }
+  }
 }
@@ -31,10 +31,12 @@
 #ifndef BESS_MODULE_GRAPH_H_
 #define BESS_MODULE_GRAPH_H_
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "gate.h"
 #include "message.h"
@@ -46,6 +48,30 @@ using bess::gate_idx_t;
 class Module;
 class ModuleBuilder;
 
+// A split of the pipeline downstream of a task module into stages, each run
+// by its own worker. See ModuleGraph::ProposePartition().
+struct PipelinePartition {
+  struct Stage {
+    int wid;  // The worker of the task module for the first stage
+    std::vector<Module *> modules;
+    double cycles_per_pkt;  // Estimated, including the Queue overhead
+  };
+
+  // An ogate whose link is to be replaced with a Queue module, whose task
+  // runs on worker 'wid'
+  struct Cut {
+    Module *module;
+    gate_idx_t ogate_idx;
+    int wid;
+  };
+
+  std::vector<Stage> stages;
+  std::vector<Cut> cuts;
+
+  // Estimated cycles per packet of the whole pipeline on a single worker
+  double cycles_per_pkt;
+};
+
 // Manages a global graph of modules
 class ModuleGraph {
  public:
@@ -68,20 +94,65 @@ class ModuleGraph {
                             bool skip_default_hooks = false);
   static int DisconnectModule(Module *module, gate_idx_t ogate_idx);
 
+  // Same as above, but while workers keep running: the new wiring is published
+  // to them, and a removed gate is freed after synchronize_workers(). If packet
+  // metadata offsets may change, they are recomputed while workers are held
+  // between task runs (see WorkerHolder). Return -EAGAIN if the change needs
+  // the workers paused instead, i.e., if a gate array must grow, or (for
+  // connecting) modules would be run by more workers than they allow, or
+  // workers steal tasks. Call PropagateActiveWorker() first.
+  static int ConnectModulesHitless(Module *module, gate_idx_t ogate_idx,
+                                   Module *m_next, gate_idx_t igate_idx,
+                                   bool skip_default_hooks = false);
+  static int DisconnectModuleHitless(Module *module, gate_idx_t ogate_idx);
+
   static const std::map<std::string, Module *> &GetAllModules();
 
   static std::string GenerateDefaultName(const std::string &class_name,
                                          const std::string &default_template);
 
-  // Updates the parents of tasks
+  // Updates the parents of tasks and the fused chains. Must be called with
+  // all workers paused.
   static void UpdateTaskGraph();
 
   // Cleans the parents of modules
   static void CleanTaskGraph();
 
-  // Update information about what workers are accessing what module
+  // Update information about what workers are accessing what module,
+  // including the ones that may steal tasks (see Module::AddStealingWorker())
   static void PropagateActiveWorker();
 
+  // Number of gate indices in use.
+  static uint32_t gate_cnt() {
+    return gate_cnt_.load(std::memory_order_relaxed);
+  }
+
+  // Number of gate indices that tasks size their per-gate batches by.
+  static uint32_t task_gate_cnt() { return task_gate_cnt_; }
+
+  // Incremented on every change of modules or their connections, so that
+  // resume hooks can skip work if nothing has changed since their last run.
+  static uint64_t generation() { return generation_; }
+
+  // Turns per-module profiling on or off. If reset is set, all profiles are
+  // cleared. Safe to call while workers are running.
+  static void SetProfiling(bool enable, bool reset);
+
+  // Proposes a split of the pipeline of 'task_module' into up to
+  // 1 + wids.size() stages, balancing the cycles per packet in the module
+  // profiles. Stages after the first one run on the workers of 'wids'.
+  // Returns -ENODATA if the pipeline has not been profiled yet.
+  static int ProposePartition(Module *task_module, const std::vector<int> &wids,
+                              PipelinePartition *partition);
+
+  // Inserts a Queue module into each of the links of 'cuts', and attaches
+  // the task of the Queue to the worker of the cut. The names of new modules
+  // are added to 'queues'. Gate hooks of the cut links stay on the same gates
+  // of the same modules. Workers must be paused. On failure, the pipeline is
+  // left as it was.
+  static int ApplyPartition(const std::vector<PipelinePartition::Cut> &cuts,
+                            std::vector<std::string> *queues);
+
  private:
   static void UpdateParentsAs(Module *parent_task, Module *module,
                               std::unordered_set<Module *> &visited_modules);
@@ -95,15 +166,48 @@ class ModuleGraph {
   static void SetUniqueGateIdx();
   static void ConfigureTasks();
 
+  // True if wiring 'module' to 'm_next' (or, if 'connect' is false, unwiring
+  // them) can be done while workers are running.
+  static bool IsHitlessChange(Module *module, Module *m_next, bool connect);
+
+  // True if any module connected to 'module' or 'm_next' has metadata
+  // attributes, whose offsets may change with the wiring between them.
+  static bool ChangesMetadataOffsets(Module *module, Module *m_next);
+
+  // Recomputes metadata offsets after the wiring has changed.
+  static void UpdateMetadataOffsets();
+
+  // Marks the output gates that link a linear chain of modules, so that the
+  // batches on them skip the task's queue. See Module::RunChooseModule().
+  static void UpdateFusedChains();
+
+  // Allocates the per-worker profiles of the module, if not done yet.
+  static void AllocProfile(Module *m);
+
+  // Estimated cost of passing a packet through a Queue module, on each of the
+  // enqueuing and dequeuing sides.
+  static constexpr double kQueueCyclesPerPkt = 30.0;
+
+  // Gates a new module has room for in its gate arrays.
+  static const gate_idx_t kReservedGates = 16;
+
+  // Gate indices that tasks have room for past the ones in use. Also the
+  // room of a new Task.
+  static const uint32_t kTaskGateHeadroom = 64;
+
   // All modules that are tasks in the current pipeline.
   static std::unordered_set<std::string> tasks_;
 
   // All modules
   static std::map<std::string, Module *> all_modules_;
 
-  static uint32_t gate_cnt_;
+  static std::atomic<uint32_t> gate_cnt_;
+  // Gate indices that all tasks have room for, as of the last pause. Gates
+  // connected hitlessly must stay below it (see ConfigureTasks()).
+  static uint32_t task_gate_cnt_;
   // Check if any changes on module graphs
   static bool changes_made_;
+  static uint64_t generation_;
 };
 
 #endif
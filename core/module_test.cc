@@ -33,6 +33,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <set>
+
 #include <gtest/gtest.h>
 
 namespace {
@@ -80,6 +82,78 @@ class AcmeModuleWithTask : public Module {
 
 DEF_MODULE(AcmeModuleWithTask, "acme_module_with_task", "foo bar");
 
+// Passes a batch with a single fake packet to its ogate.
+class FeederModule : public Module {
+ public:
+  FeederModule() : Module() { is_task_ = true; }
+
+  static const gate_idx_t kNumIGates = 0;
+  static const gate_idx_t kNumOGates = 1;
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandResponse(); }
+
+  struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
+                             void *) override {
+    batch->clear();
+    batch->add(reinterpret_cast<bess::Packet *>(1));
+    RunNextModule(ctx, batch);
+    return task_result();
+  }
+};
+
+DEF_MODULE(FeederModule, "feeder_module", "foo bar");
+
+// Replaces the input batch with fake packets, and emits them with
+// EmitBatch(), after emitting 'pre_emit' packets with EmitPacket(). Packets
+// are numbered from 1.
+class EmitterModule : public Module {
+ public:
+  EmitterModule() : Module() {}
+
+  static const gate_idx_t kNumIGates = 1;
+  static const gate_idx_t kNumOGates = 3;
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandResponse(); }
+
+  void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override {
+    uintptr_t n = 1;
+    for (gate_idx_t gate : pre_emit) {
+      EmitPacket(ctx, reinterpret_cast<bess::Packet *>(n++), gate);
+    }
+
+    batch->clear();
+    for (size_t i = 0; i < ogates.size(); i++) {
+      batch->add(reinterpret_cast<bess::Packet *>(n++));
+    }
+    EmitBatch(ctx, batch, ogates.data());
+  }
+
+  std::vector<gate_idx_t> pre_emit;
+  std::vector<gate_idx_t> ogates;
+};
+
+DEF_MODULE(EmitterModule, "emitter_module", "foo bar");
+
+// Records the numbers of the fake packets it receives.
+class RecorderModule : public Module {
+ public:
+  RecorderModule() : Module() {}
+
+  static const gate_idx_t kNumOGates = 0;
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandResponse(); }
+
+  void ProcessBatch(Context *, bess::PacketBatch *batch) override {
+    for (int i = 0; i < batch->cnt(); i++) {
+      pkts.push_back(reinterpret_cast<uintptr_t>(batch->pkts()[i]));
+    }
+  }
+
+  std::vector<uintptr_t> pkts;
+};
+
+DEF_MODULE(RecorderModule, "recorder_module", "foo bar");
+
 // Simple harness for testing the Module class.
 class ModuleTester : public ::testing::Test {
  protected:
@@ -252,6 +326,53 @@ TEST_F(ModuleTester, ConnectModules) {
   }
 }
 
+TEST_F(ModuleTester, ConnectModulesHitless) {
+  pb_error_t perr;
+  Module *m1, *m2, *m3;
+
+  ASSERT_NE(nullptr, m1 = create_acme("m1", &perr));
+  ASSERT_NE(nullptr, m2 = create_acme("m2", &perr));
+  ASSERT_NE(nullptr, m3 = create_acme("m3", &perr));
+
+  EXPECT_EQ(0, ModuleGraph::ConnectModulesHitless(m1, 0, m2, 0));
+  EXPECT_EQ(-EBUSY, ModuleGraph::ConnectModulesHitless(m1, 0, m3, 0));
+  EXPECT_EQ(0, ModuleGraph::ConnectModulesHitless(m1, 1, m2, 0));
+  ASSERT_EQ(2, m1->ogates().size());
+  EXPECT_EQ(m2, m1->ogates()[0]->igate()->module());
+  EXPECT_EQ(m2->igates()[0], m1->ogates()[1]->igate());
+  EXPECT_TRUE(m2->igates()[0]->mergeable());
+
+  // Each gate gets an index of its own.
+  std::unordered_set<uint32_t> indices = {
+      m1->ogates()[0]->global_gate_index(),
+      m1->ogates()[1]->global_gate_index(),
+      m2->igates()[0]->global_gate_index()};
+  EXPECT_EQ(3, indices.size());
+  for (uint32_t idx : indices) {
+    EXPECT_LT(idx, ModuleGraph::gate_cnt());
+  }
+
+  EXPECT_EQ(0, ModuleGraph::DisconnectModuleHitless(m1, 0));
+  EXPECT_EQ(nullptr, m1->ogates()[0]);
+  EXPECT_FALSE(m2->igates()[0]->mergeable());
+  EXPECT_EQ(0, ModuleGraph::DisconnectModuleHitless(m1, 1));
+  EXPECT_EQ(nullptr, m2->igates()[0]);
+
+  // Metadata offsets of modules with attributes follow the wiring.
+  ASSERT_EQ(0, m1->AddMetadataAttr(
+                   "foo", 4, bess::metadata::Attribute::AccessMode::kWrite));
+  ASSERT_EQ(0, m3->AddMetadataAttr(
+                   "foo", 4, bess::metadata::Attribute::AccessMode::kRead));
+  EXPECT_EQ(0, ModuleGraph::ConnectModulesHitless(m1, 0, m3, 0));
+  EXPECT_TRUE(bess::metadata::IsValidOffset(m1->attr_offset(0)));
+  EXPECT_EQ(m1->attr_offset(0), m3->attr_offset(0));
+
+  EXPECT_EQ(0, ModuleGraph::DisconnectModuleHitless(m1, 0));
+  EXPECT_EQ(nullptr, m1->ogates()[0]);
+  EXPECT_EQ(bess::metadata::kMetadataOffsetNoWrite, m1->attr_offset(0));
+  EXPECT_EQ(bess::metadata::kMetadataOffsetNoRead, m3->attr_offset(0));
+}
+
 TEST_F(ModuleTester, ResetModules) {
   pb_error_t perr;
 
@@ -275,6 +396,71 @@ TEST(ModuleBuilderTest, GenerateDefaultNameTemplate) {
   EXPECT_EQ("foo_abcbar0", name3);
 }
 
+TEST(DropReasonTest, Names) {
+  std::set<std::string> names;
+  for (size_t i = 0; i < static_cast<size_t>(DropReason::kNumReasons); i++) {
+    std::string name = DropReasonName(static_cast<DropReason>(i));
+    EXPECT_NE("invalid", name);
+    EXPECT_TRUE(names.insert(name).second) << name;
+  }
+  EXPECT_STREQ("queue_full", DropReasonName(DropReason::kQueueFull));
+  EXPECT_STREQ("invalid", DropReasonName(DropReason::kNumReasons));
+}
+
+// Drops are counted by the worker and reason, and add up to deadends() and
+// the silent drops of the worker. Allocation failures are not drops.
+TEST_F(ModuleTester, DropCounts) {
+  bess::PlainPacketPool pool(64);
+  size_t size = pool.Size();
+
+  pb_error_t perr;
+  Module *m = create_acme("m", &perr);
+  ASSERT_NE(nullptr, m);
+
+  Task task(m, nullptr);
+  Context ctx = {};
+  ctx.wid = 1;
+  ctx.task = &task;
+
+  bess::Packet *pkts[5];
+  ASSERT_TRUE(pool.AllocBulk(pkts, 5, 60));
+  m->DropPacket(&ctx, pkts[0], DropReason::kPolicy);
+  m->DropPacket(&ctx, pkts[1]);
+  m->DropPackets(&ctx, &pkts[2], 2, DropReason::kQueueFull);
+  EXPECT_EQ(2, ctx.silent_drops);
+
+  // Ogate 1 is not connected.
+  bess::PacketBatch batch;
+  batch.clear();
+  batch.add(pkts[4]);
+  m->RunChooseModule(&ctx, 1, &batch);
+
+  m->CountAllocFailures(&ctx, 32);
+
+  // Packets dropped one by one are freed at the end of the task.
+  deadend(&ctx, task.dead_batch());
+  EXPECT_EQ(5, ctx.silent_drops);
+  EXPECT_EQ(size, pool.Size());
+
+  const DropCounts &counts = m->drops(1);
+  auto count = [&counts](DropReason reason) {
+    return counts[static_cast<size_t>(reason)];
+  };
+  EXPECT_EQ(1, count(DropReason::kPolicy));
+  EXPECT_EQ(1, count(DropReason::kUnspecified));
+  EXPECT_EQ(2, count(DropReason::kQueueFull));
+  EXPECT_EQ(1, count(DropReason::kNoOGate));
+  EXPECT_EQ(0, count(DropReason::kNoBuffer));
+  EXPECT_EQ(DropCounts(), m->drops(0));
+
+  EXPECT_EQ(5, m->deadends());
+  EXPECT_EQ(32, m->alloc_failures());
+
+  m->ResetActiveWorkerSet();
+  EXPECT_EQ(0, m->deadends());
+  EXPECT_EQ(0, m->alloc_failures());
+}
+
 TEST_F(ModuleTester, GenerateTCGraph) {
   pb_error_t perr;
   Module *t1, *t2, *t3, *t4, *m1, *m2, *m3;
@@ -333,6 +519,352 @@ TEST_F(ModuleTester, GenerateTCGraph) {
   EXPECT_EQ(0, t4->parent_tasks().size());
 }
 
+// Tests that workers that may steal a task become active on its pipeline,
+// without counting towards the workers of the modules.
+TEST_F(ModuleTester, AddStealingWorker) {
+  pb_error_t perr;
+  Module *t1, *t2, *m1, *m2;
+
+  /* Test Topology
+   *
+   * t1 -> m1 -> m2
+   *            /
+   *          t2
+   */
+  ASSERT_NE(nullptr, t1 = create_acme_with_task("t1", &perr));
+  ASSERT_NE(nullptr, t2 = create_acme_with_task("t2", &perr));
+  ASSERT_NE(nullptr, m1 = create_acme("m1", &perr));
+  ASSERT_NE(nullptr, m2 = create_acme("m2", &perr));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(t1, 0, m1, 0));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m1, 0, m2, 0));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(t2, 0, m2, 0));
+  t1->RegisterTask(nullptr);
+  t2->RegisterTask(nullptr);
+
+  // Worker 0 runs t1 and worker 1 runs t2. Both may be stolen by the others.
+  for (Module *m : {t1, t2, m1, m2}) {
+    m->ResetActiveWorkerSet();
+  }
+  t1->tasks()[0]->AddActiveWorker(0);
+  t2->tasks()[0]->AddActiveWorker(1);
+  t1->tasks()[0]->AddStealingWorker(1, 0);
+  t1->tasks()[0]->AddStealingWorker(2, 0);
+  t2->tasks()[0]->AddStealingWorker(0, 1);
+  t2->tasks()[0]->AddStealingWorker(2, 1);
+
+  for (Module *m : {t1, m1}) {
+    EXPECT_TRUE(m->active_workers()[0]);
+    EXPECT_TRUE(m->active_workers()[1]);
+    EXPECT_TRUE(m->active_workers()[2]);
+    EXPECT_FALSE(m->is_stealing_worker(0));
+    EXPECT_TRUE(m->is_stealing_worker(1));
+    EXPECT_TRUE(m->is_stealing_worker(2));
+    EXPECT_EQ(1, m->num_active_workers());
+  }
+
+  // Workers 0 and 1 run m2 anyway.
+  EXPECT_TRUE(m2->active_workers()[2]);
+  EXPECT_FALSE(m2->is_stealing_worker(0));
+  EXPECT_FALSE(m2->is_stealing_worker(1));
+  EXPECT_TRUE(m2->is_stealing_worker(2));
+  EXPECT_EQ(2, m2->num_active_workers());
+  EXPECT_EQ(2, m2->num_active_tasks());
+
+  m1->ResetActiveWorkerSet();
+  EXPECT_FALSE(m1->active_workers()[2]);
+  EXPECT_FALSE(m1->is_stealing_worker(2));
+}
+
+TEST_F(ModuleTester, FusedChains) {
+  pb_error_t perr;
+  Module *t1, *t2, *m1, *m2, *m3, *m4;
+
+  /* Test Topology
+   *
+   * t1 -> m1 -> m2 -(track)-> m3
+   */
+  ASSERT_NE(nullptr, t1 = create_acme_with_task("t1", &perr));
+  ASSERT_NE(nullptr, m1 = create_acme("m1", &perr));
+  ASSERT_NE(nullptr, m2 = create_acme("m2", &perr));
+  ASSERT_NE(nullptr, m3 = create_acme("m3", &perr));
+
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(t1, 0, m1, 0, true));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m1, 0, m2, 0, true));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m2, 0, m3, 0));
+
+  ModuleGraph::UpdateTaskGraph();
+  EXPECT_TRUE(t1->ogates()[0]->fused());
+  EXPECT_TRUE(m1->ogates()[0]->fused());
+  EXPECT_FALSE(m2->ogates()[0]->fused());  // has a hook
+
+  // Removing the hook fuses the gate, even without other graph changes.
+  m2->ogates()[0]->ClearHooks();
+  ModuleGraph::UpdateTaskGraph();
+  EXPECT_TRUE(m2->ogates()[0]->fused());
+
+  // A second ogate on m1 and a second upstream ogate of m3 break the chain.
+  ASSERT_NE(nullptr, m4 = create_acme("m4", &perr));
+  ASSERT_NE(nullptr, t2 = create_acme_with_task("t2", &perr));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m1, 1, m4, 0, true));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(t2, 0, m3, 0, true));
+
+  ModuleGraph::UpdateTaskGraph();
+  EXPECT_TRUE(t1->ogates()[0]->fused());
+  EXPECT_FALSE(m1->ogates()[0]->fused());
+  EXPECT_FALSE(m1->ogates()[1]->fused());
+  EXPECT_FALSE(m2->ogates()[0]->fused());
+  EXPECT_FALSE(t2->ogates()[0]->fused());
+}
+
+TEST_F(ModuleTester, FusedChainsLoop) {
+  pb_error_t perr;
+  Module *m1, *m2, *m3;
+
+  ASSERT_NE(nullptr, m1 = create_acme("m1", &perr));
+  ASSERT_NE(nullptr, m2 = create_acme("m2", &perr));
+  ASSERT_NE(nullptr, m3 = create_acme("m3", &perr));
+
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m1, 0, m2, 0, true));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m2, 0, m3, 0, true));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m3, 0, m1, 0, true));
+
+  ModuleGraph::UpdateTaskGraph();
+  int fused = m1->ogates()[0]->fused() + m2->ogates()[0]->fused() +
+              m3->ogates()[0]->fused();
+  EXPECT_EQ(2, fused);
+}
+
+// Runs a FeederModule task with an EmitterModule, and two RecorderModules on
+// its ogates 0 and 1.
+class EmitBatchTest : public ::testing::Test {
+ protected:
+  EmitBatchTest()
+      : FeederModule_singleton(),
+        EmitterModule_singleton(),
+        RecorderModule_singleton(),
+        feeder(),
+        emitter(),
+        recorders() {}
+
+  virtual void SetUp() {
+    feeder = Create("FeederModule", "f");
+    ASSERT_NE(nullptr, feeder);
+    emitter = static_cast<EmitterModule *>(Create("EmitterModule", "e"));
+    ASSERT_NE(nullptr, emitter);
+    ASSERT_EQ(0, ModuleGraph::ConnectModules(feeder, 0, emitter, 0, true));
+    for (int i = 0; i < 2; i++) {
+      recorders[i] = static_cast<RecorderModule *>(
+          Create("RecorderModule", "r" + std::to_string(i)));
+      ASSERT_NE(nullptr, recorders[i]);
+      ASSERT_EQ(0, ModuleGraph::ConnectModules(emitter, i, recorders[i], 0,
+                                               true));
+    }
+    ModuleGraph::UpdateTaskGraph();
+  }
+
+  virtual void TearDown() { ModuleGraph::DestroyAllModules(); }
+
+  Module *Create(const std::string &class_name, const std::string &name) {
+    const ModuleBuilder &builder =
+        ModuleBuilder::all_module_builders().find(class_name)->second;
+    bess::pb::EmptyArg arg_;
+    google::protobuf::Any arg;
+    arg.PackFrom(arg_);
+    pb_error_t perr;
+    return ModuleGraph::CreateModule(builder, name, arg, &perr);
+  }
+
+  void Run() {
+    Task task(feeder, nullptr);
+    task.UpdatePerGateBatch(6);
+    Context ctx = {};
+    ctx.task = &task;
+    task(&ctx);
+  }
+
+  FeederModule_class FeederModule_singleton;
+  EmitterModule_class EmitterModule_singleton;
+  RecorderModule_class RecorderModule_singleton;
+
+  Module *feeder;
+  EmitterModule *emitter;
+  RecorderModule *recorders[2];
+};
+
+TEST_F(EmitBatchTest, SingleGate) {
+  emitter->ogates = {1, 1, 1, 1};
+  Run();
+  EXPECT_EQ(std::vector<uintptr_t>(), recorders[0]->pkts);
+  EXPECT_EQ(std::vector<uintptr_t>({1, 2, 3, 4}), recorders[1]->pkts);
+}
+
+TEST_F(EmitBatchTest, SingleGateAfterEmitPacket) {
+  emitter->pre_emit = {1, 0};
+  emitter->ogates = {1, 1, 1};
+  Run();
+  EXPECT_EQ(std::vector<uintptr_t>({2}), recorders[0]->pkts);
+  EXPECT_EQ(std::vector<uintptr_t>({1, 3, 4, 5}), recorders[1]->pkts);
+}
+
+TEST_F(EmitBatchTest, Mixed) {
+  emitter->ogates = {0, 1, 1, 0, 1, 0};
+  Run();
+  EXPECT_EQ(std::vector<uintptr_t>({1, 4, 6}), recorders[0]->pkts);
+  EXPECT_EQ(std::vector<uintptr_t>({2, 3, 5}), recorders[1]->pkts);
+}
+
+TEST_F(EmitBatchTest, FullBatch) {
+  // Ogate 0 gets one packet more than a batch can hold.
+  std::vector<uintptr_t> expected[2];
+  emitter->pre_emit = {0, 0};
+  expected[0] = {1, 2};
+  for (size_t i = 0; i < bess::PacketBatch::kMaxBurst; i++) {
+    emitter->ogates.push_back(i == 0);
+    expected[i == 0].push_back(i + 3);
+  }
+  Run();
+  EXPECT_EQ(expected[0], recorders[0]->pkts);
+  EXPECT_EQ(expected[1], recorders[1]->pkts);
+}
+
+TEST_F(EmitBatchTest, Rewire) {
+  // Move ogate 1 to ogate 2. Tasks have room for the new gate index.
+  EXPECT_EQ(0, ModuleGraph::DisconnectModuleHitless(emitter, 1));
+  EXPECT_EQ(0, ModuleGraph::ConnectModulesHitless(emitter, 2, recorders[1], 0,
+                                                  true));
+  EXPECT_LT(6u, ModuleGraph::gate_cnt());
+  emitter->ogates = {2, 0, 2};
+  Run();
+  EXPECT_EQ(std::vector<uintptr_t>({2}), recorders[0]->pkts);
+  EXPECT_EQ(std::vector<uintptr_t>({1, 3}), recorders[1]->pkts);
+}
+
+TEST_F(EmitBatchTest, Profile) {
+  EXPECT_EQ(nullptr, emitter->profile());
+  ModuleGraph::SetProfiling(true, false);
+  emitter->ogates = {0, 1, 1, 0};
+  Run();
+  ModuleGraph::SetProfiling(false, false);
+
+  const ModuleProfile &f = feeder->profile()[0];
+  EXPECT_EQ(1, f.cnt);
+  EXPECT_EQ(0, f.pkts_in);
+  EXPECT_EQ(1, f.pkts_out);
+
+  // The emitter replaces the packet with four.
+  const ModuleProfile &e = emitter->profile()[0];
+  EXPECT_EQ(1, e.cnt);
+  EXPECT_EQ(1, e.pkts_in);
+  EXPECT_EQ(4, e.pkts_out);
+  EXPECT_LT(0, e.cycles);
+
+  EXPECT_EQ(2, recorders[0]->profile()[0].pkts_in);
+  EXPECT_EQ(2, recorders[1]->profile()[0].pkts_in);
+
+  // Nothing is counted while disabled.
+  Run();
+  EXPECT_EQ(1, e.cnt);
+
+  ModuleGraph::SetProfiling(false, true);
+  EXPECT_EQ(0, e.cnt);
+  EXPECT_EQ(0, e.cycles);
+}
+
+TEST_F(EmitBatchTest, ProposePartition) {
+  PipelinePartition partition;
+  EXPECT_EQ(-EINVAL, ModuleGraph::ProposePartition(emitter, {1}, &partition));
+  EXPECT_EQ(-ENODATA, ModuleGraph::ProposePartition(feeder, {1}, &partition));
+
+  ModuleGraph::SetProfiling(true, false);
+  emitter->ogates = {0, 1, 1, 0};
+  Run();
+  ModuleGraph::SetProfiling(false, false);
+  ASSERT_EQ(0, ModuleGraph::ProposePartition(feeder, {1, 2}, &partition));
+
+  // Each module is run by one stage, and only links between stages are cut.
+  ASSERT_LE(1, partition.stages.size());
+  ASSERT_GE(3, partition.stages.size());
+  EXPECT_EQ(feeder, partition.stages[0].modules[0]);
+  std::map<Module *, int> wid_of;
+  for (const auto &stage : partition.stages) {
+    for (Module *m : stage.modules) {
+      EXPECT_TRUE(wid_of.emplace(m, stage.wid).second);
+    }
+  }
+  EXPECT_EQ(4, wid_of.size());
+
+  size_t num_cuts = 0;
+  for (Module *m : {feeder, static_cast<Module *>(emitter)}) {
+    for (bess::OGate *ogate : m->ogates()) {
+      if (ogate && wid_of[m] != wid_of[ogate->next()]) {
+        num_cuts++;
+      }
+    }
+  }
+  EXPECT_EQ(num_cuts, partition.cuts.size());
+  for (const auto &cut : partition.cuts) {
+    EXPECT_EQ(wid_of[cut.module->ogates()[cut.ogate_idx]->next()], cut.wid);
+  }
+
+  ModuleGraph::SetProfiling(false, true);
+}
+
+// Tests that stages balance uneven module costs, with a cut on each side of
+// the costliest module.
+TEST_F(ModuleTester, ProposePartitionCosts) {
+  pb_error_t perr;
+  Module *t1, *m1, *m2, *m3, *m4;
+
+  // t1 -> m1 -> m2 -> m3 -> m4
+  ASSERT_NE(nullptr, t1 = create_acme_with_task("t1", &perr));
+  ASSERT_NE(nullptr, m1 = create_acme("m1", &perr));
+  ASSERT_NE(nullptr, m2 = create_acme("m2", &perr));
+  ASSERT_NE(nullptr, m3 = create_acme("m3", &perr));
+  ASSERT_NE(nullptr, m4 = create_acme("m4", &perr));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(t1, 0, m1, 0, true));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m1, 0, m2, 0, true));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m2, 0, m3, 0, true));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m3, 0, m4, 0, true));
+
+  // 1000 packets through all, with m2 four times as costly as the others.
+  ModuleGraph::SetProfiling(true, true);
+  ModuleGraph::SetProfiling(false, false);
+  const std::vector<std::pair<Module *, uint64_t>> costs = {
+      {t1, 100}, {m1, 100}, {m2, 400}, {m3, 100}, {m4, 100}};
+  for (const auto &c : costs) {
+    ModuleProfile &p = const_cast<ModuleProfile *>(c.first->profile())[0];
+    p.cnt += 1;
+    p.pkts_in += (c.first == t1) ? 0 : 1000;
+    p.pkts_out += (c.first == m4) ? 0 : 1000;
+    p.cycles += c.second * 1000;
+  }
+
+  PipelinePartition partition;
+  ASSERT_EQ(0, ModuleGraph::ProposePartition(t1, {1, 2, 3}, &partition));
+  EXPECT_DOUBLE_EQ(800.0, partition.cycles_per_pkt);
+
+  // [t1 m1] [m2] [m3 m4]. A fourth stage would not make m2 any cheaper.
+  ASSERT_EQ(3, partition.stages.size());
+  EXPECT_EQ(std::vector<Module *>({t1, m1}), partition.stages[0].modules);
+  EXPECT_EQ(std::vector<Module *>({m2}), partition.stages[1].modules);
+  EXPECT_EQ(std::vector<Module *>({m3, m4}), partition.stages[2].modules);
+  EXPECT_EQ(1, partition.stages[1].wid);
+  EXPECT_EQ(2, partition.stages[2].wid);
+
+  // The middle stage pays for a Queue on either side.
+  EXPECT_DOUBLE_EQ(400.0 + 2 * 30.0, partition.stages[1].cycles_per_pkt);
+
+  ASSERT_EQ(2, partition.cuts.size());
+  EXPECT_EQ(m1, partition.cuts[0].module);
+  EXPECT_EQ(0, partition.cuts[0].ogate_idx);
+  EXPECT_EQ(1, partition.cuts[0].wid);
+  EXPECT_EQ(m2, partition.cuts[1].module);
+  EXPECT_EQ(0, partition.cuts[1].ogate_idx);
+  EXPECT_EQ(2, partition.cuts[1].wid);
+
+  ModuleGraph::SetProfiling(false, true);
+}
+
 TEST_F(ModuleTester, SetIGatePriority) {
   pb_error_t perr;
   Module *t1, *m1, *m2, *m3, *m4, *m5, *m6, *m7, *m8;
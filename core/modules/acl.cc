@@ -32,6 +32,7 @@
 #include "../utils/ether.h"
 #include "../utils/ip.h"
 #include "../utils/udp.h"
+#include "parse_headers.h"
 
 const Commands ACL::cmds = {
     {"add", "ACLArg", MODULE_CMD_FUNC(&ACL::CommandAdd),
@@ -49,6 +50,15 @@ CommandResponse ACL::Init(const bess::pb::ACLArg &arg) {
         .drop = rule.drop()};
     rules_.push_back(new_rule);
   }
+
+  // Also called by add(), after the attribute has been registered
+  if (arg.parsed_headers() && hdrs_attr_id_ < 0) {
+    hdrs_attr_id_ = ParseHeaders::AddReader(this);
+    if (hdrs_attr_id_ < 0) {
+      return CommandFailure(-hdrs_attr_id_,
+                            "Failed to register metadata attribute");
+    }
+  }
   return CommandSuccess();
 }
 
@@ -65,23 +75,52 @@ CommandResponse ACL::CommandClear(const bess::pb::EmptyArg &) {
 void ACL::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   using bess::utils::Ethernet;
   using bess::utils::Ipv4;
+  using bess::utils::ParsedHeaders;
   using bess::utils::Udp;
 
   gate_idx_t incoming_gate = ctx->current_igate;
+  bess::metadata::mt_offset_t hdrs_offset =
+      ParseHeaders::ReaderOffset(this, hdrs_attr_id_);
 
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
     bess::Packet *pkt = batch->pkts()[i];
 
-    Ethernet *eth = pkt->head_data<Ethernet *>();
-    Ipv4 *ip = reinterpret_cast<Ipv4 *>(eth + 1);
-    size_t ip_bytes = ip->header_length << 2;
-    Udp *udp =
-        reinterpret_cast<Udp *>(reinterpret_cast<uint8_t *>(ip) + ip_bytes);
+    // Missing fields (e.g., of ARP packets) are matched as 0.0.0.0 or 0.
+    be32_t src_ip(0), dst_ip(0);
+    be16_t src_port(0), dst_port(0);
+
+    const ParsedHeaders *hdrs = ParseHeaders::Cached(hdrs_offset, pkt);
+    if (hdrs) {
+      if (hdrs->has(ParsedHeaders::kIpv4)) {
+        const Ipv4 *ip = hdrs->l3<const Ipv4>(pkt->head_data());
+        src_ip = ip->src;
+        dst_ip = ip->dst;
+      }
+      if (hdrs->has(ParsedHeaders::kL4) &&
+          (hdrs->ip_proto == Ipv4::Proto::kTcp ||
+           hdrs->ip_proto == Ipv4::Proto::kUdp)) {
+        // UDP and TCP share the same layout for port numbers
+        const Udp *udp = hdrs->l4<const Udp>(pkt->head_data());
+        src_port = udp->src_port;
+        dst_port = udp->dst_port;
+      }
+    } else {
+      // Assumes untagged IPv4 packets
+      Ethernet *eth = pkt->head_data<Ethernet *>();
+      Ipv4 *ip = reinterpret_cast<Ipv4 *>(eth + 1);
+      size_t ip_bytes = ip->header_length << 2;
+      Udp *udp =
+          reinterpret_cast<Udp *>(reinterpret_cast<uint8_t *>(ip) + ip_bytes);
+      src_ip = ip->src;
+      dst_ip = ip->dst;
+      src_port = udp->src_port;
+      dst_port = udp->dst_port;
+    }
 
     bool emitted = false;
     for (const auto &rule : rules_) {
-      if (rule.Match(ip->src, ip->dst, udp->src_port, udp->dst_port)) {
+      if (rule.Match(src_ip, dst_ip, src_port, dst_port)) {
         if (!rule.drop) {
           emitted = true;
           EmitPacket(ctx, pkt, incoming_gate);
@@ -91,7 +130,7 @@ void ACL::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     }
 
     if (!emitted) {
-      DropPacket(ctx, pkt);
+      DropPacket(ctx, pkt, DropReason::kPolicy);
     }
   }
 }
@@ -58,7 +58,9 @@ class ACL final : public Module {
 
   static const Commands cmds;
 
-  ACL() : Module() { max_allowed_workers_ = Worker::kMaxWorkers; }
+  ACL() : Module(), hdrs_attr_id_(-1) {
+    max_allowed_workers_ = Worker::kMaxWorkers;
+  }
 
   CommandResponse Init(const bess::pb::ACLArg &arg);
 
@@ -69,6 +71,9 @@ class ACL final : public Module {
 
  private:
   std::vector<ACLRule> rules_;
+
+  // "parsed_headers" metadata attribute, or -1 to parse packets here
+  int hdrs_attr_id_;
 };
 
 #endif  // BESS_MODULES_ACL_H_
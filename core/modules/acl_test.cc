@@ -0,0 +1,239 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "acl.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../module_graph.h"
+#include "../packet_pool.h"
+#include "../task.h"
+#include "../utils/ether.h"
+#include "../utils/ip.h"
+#include "../utils/tcp.h"
+#include "parse_headers.h"
+
+namespace {
+
+using bess::utils::be16_t;
+using bess::utils::be32_t;
+using bess::utils::Ethernet;
+using bess::utils::Ipv4;
+using bess::utils::ParsedHeaders;
+using bess::utils::Tcp;
+using bess::utils::Vlan;
+
+const uint16_t kLen = 64;
+
+// Sends the packets in 'pkts' once. After Parse(), it also fills in their
+// "parsed_headers" attribute, as a ParseHeaders module would.
+class TestSource final : public Module {
+ public:
+  static const gate_idx_t kNumIGates = 0;
+
+  TestSource() : Module(), attr_id_(-1) { is_task_ = true; }
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void Parse() {
+    attr_id_ = AddMetadataAttr(ParseHeaders::kAttrName, sizeof(ParsedHeaders),
+                               bess::metadata::Attribute::AccessMode::kWrite);
+  }
+
+  struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
+                             void *) override {
+    uint32_t cnt = pkts.size();
+    batch->clear();
+    for (bess::Packet *pkt : pkts) {
+      if (attr_id_ >= 0) {
+        bess::utils::ParseHeaders(
+            pkt->head_data(), pkt->head_len(),
+            _ptr_attr_with_offset<ParsedHeaders>(attr_offset(attr_id_), pkt));
+      }
+      batch->add(pkt);
+    }
+    pkts.clear();
+    RunNextModule(ctx, batch);
+    return {.block = false, .packets = cnt, .bits = cnt * kLen * 8};
+  }
+
+  std::vector<bess::Packet *> pkts;
+
+ private:
+  int attr_id_;
+};
+
+// Keeps the packets it receives.
+class TestSink final : public Module {
+ public:
+  static const gate_idx_t kNumOGates = 0;
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *, bess::PacketBatch *batch) override {
+    for (int i = 0; i < batch->cnt(); i++) {
+      pkts.push_back(batch->pkts()[i]);
+    }
+  }
+
+  std::vector<bess::Packet *> pkts;
+};
+
+DEF_MODULE(TestSource, "test_source", "sends given packets");
+DEF_MODULE(TestSink, "test_sink", "keeps packets");
+
+template <typename T, typename Arg>
+T *CreateModule(const std::string &class_name, const std::string &name,
+                const Arg &arg_) {
+  const ModuleBuilder &builder =
+      ModuleBuilder::all_module_builders().find(class_name)->second;
+
+  google::protobuf::Any arg;
+  arg.PackFrom(arg_);
+
+  pb_error_t perr;
+  Module *m = ModuleGraph::CreateModule(builder, name, arg, &perr);
+  EXPECT_NE(nullptr, m) << perr.errmsg();
+  return static_cast<T *>(m);
+}
+
+// src -> acl -> sink, with a rule that lets TCP port 80 through
+class ACLTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() override {
+    pool_.reset(new bess::PlainPacketPool(1024));
+    size_ = pool_->Size();
+  }
+
+  virtual void TearDown() override {
+    task_.reset();
+    ModuleGraph::DestroyAllModules();
+    EXPECT_EQ(size_, pool_->Size());
+  }
+
+  // With 'parsed', the packets come with parsed headers and the ACL uses
+  // them.
+  void Build(bool parsed) {
+    bess::pb::EmptyArg empty;
+    bess::pb::ACLArg arg;
+    bess::pb::ACLArg::Rule *rule = arg.add_rules();
+    rule->set_dst_port(80);
+    rule->set_drop(false);
+    arg.set_parsed_headers(parsed);
+
+    src_ = CreateModule<TestSource>("TestSource", "src", empty);
+    acl_ = CreateModule<ACL>("ACL", "acl", arg);
+    sink_ = CreateModule<TestSink>("TestSink", "sink", empty);
+    ASSERT_EQ(0, ModuleGraph::ConnectModules(src_, 0, acl_, 0, true));
+    ASSERT_EQ(0, ModuleGraph::ConnectModules(acl_, 0, sink_, 0, true));
+    if (parsed) {
+      src_->Parse();
+    }
+    ASSERT_EQ(0, bess::metadata::default_pipeline.ComputeMetadataOffsets());
+
+    ModuleGraph::UpdateTaskGraph();
+    task_.reset(new Task(src_, nullptr));
+    task_->UpdatePerGateBatch(8);
+  }
+
+  // Sends a TCP packet to 'port', 802.1Q tagged if 'vlan'. Returns true if
+  // the ACL has let it through.
+  bool Send(uint16_t port, bool vlan) {
+    bess::Packet *pkt = pool_->Alloc(kLen);
+    EXPECT_NE(nullptr, pkt);
+    uint8_t *p = pkt->head_data<uint8_t *>();
+    memset(p, 0, kLen);
+
+    Ethernet *eth = reinterpret_cast<Ethernet *>(p);
+    eth->ether_type =
+        be16_t(vlan ? Ethernet::Type::kVlan : Ethernet::Type::kIpv4);
+    p += sizeof(Ethernet);
+    if (vlan) {
+      reinterpret_cast<Vlan *>(p)->ether_type = be16_t(Ethernet::Type::kIpv4);
+      p += sizeof(Vlan);
+    }
+
+    Ipv4 *ip = reinterpret_cast<Ipv4 *>(p);
+    ip->version = 4;
+    ip->header_length = 5;
+    ip->protocol = Ipv4::Proto::kTcp;
+    ip->src = be32_t(0x0a000001);
+    ip->dst = be32_t(0x0a000002);
+
+    Tcp *tcp = reinterpret_cast<Tcp *>(ip + 1);
+    tcp->src_port = be16_t(1000);
+    tcp->dst_port = be16_t(port);
+    tcp->offset = 5;
+
+    src_->pkts.push_back(pkt);
+
+    Context ctx = {};
+    ctx.task = task_.get();
+    (*task_)(&ctx);
+
+    bool passed = !sink_->pkts.empty();
+    bess::Packet::Free(sink_->pkts.data(), sink_->pkts.size());
+    sink_->pkts.clear();
+    return passed;
+  }
+
+  TestSource_class TestSource_singleton_;
+  TestSink_class TestSink_singleton_;
+
+  std::unique_ptr<bess::PacketPool> pool_;
+  size_t size_;  // available packets of an untouched pool
+  std::unique_ptr<Task> task_;
+  TestSource *src_;
+  ACL *acl_;
+  TestSink *sink_;
+};
+
+// Without parsed headers, packets are taken as untagged.
+TEST_F(ACLTest, Unparsed) {
+  Build(false);
+  EXPECT_TRUE(Send(80, false));
+  EXPECT_FALSE(Send(81, false));
+  EXPECT_EQ(1, acl_->deadends());
+}
+
+// With parsed headers, the ports of tagged packets are found, too.
+TEST_F(ACLTest, Parsed) {
+  Build(true);
+  EXPECT_TRUE(Send(80, false));
+  EXPECT_FALSE(Send(81, false));
+  EXPECT_TRUE(Send(80, true));
+  EXPECT_FALSE(Send(81, true));
+  EXPECT_EQ(2, acl_->deadends());
+}
+
+}  // namespace
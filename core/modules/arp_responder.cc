@@ -61,6 +61,8 @@ CommandResponse ArpResponder::CommandAdd(const bess::pb::ArpResponderArg &arg) {
 }
 
 void ArpResponder::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
     // we should drop-or-emit each packet
@@ -69,7 +71,7 @@ void ArpResponder::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     Ethernet *eth = pkt->head_data<Ethernet *>();
     if (eth->ether_type != be16_t(Ethernet::Type::kArp)) {
       // Currently drop all non ARP packets
-      DropPacket(ctx, pkt);
+      DropPacket(ctx, pkt, DropReason::kUnhandled);
       continue;
     }
 
@@ -95,14 +97,14 @@ void ArpResponder::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
       } else {
         // Did not find an ARP entry in cache, drop packet
         // TODO(galsagie) Optinally emit packet to next module here
-        DropPacket(ctx, pkt);
+        DropPacket(ctx, pkt, DropReason::kNoMatch);
       }
     } else if (arp->opcode == be16_t(Arp::Opcode::kReply)) {
       // TODO(galsagie) When learn is added, learn SRC MAC here
-      DropPacket(ctx, pkt);
+      DropPacket(ctx, pkt, DropReason::kUnhandled);
     } else {
       // TODO(galsagie) Other opcodes are not handled yet.
-      DropPacket(ctx, pkt);
+      DropPacket(ctx, pkt, DropReason::kUnhandled);
     }
   }
 }
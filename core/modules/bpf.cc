@@ -163,6 +163,7 @@ inline bool BPF::Match(const bess::utils::Filter &filter, u_char *pkt,
 
 void BPF::ProcessBatch1Filter(Context *ctx, bess::PacketBatch *batch) {
   const bess::utils::Filter &filter = filters_[0];
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
 
   int cnt = batch->cnt();
 
@@ -171,11 +172,13 @@ void BPF::ProcessBatch1Filter(Context *ctx, bess::PacketBatch *batch) {
 
     if (Match(filter, pkt->head_data<u_char *>(), pkt->total_len(),
               pkt->head_len())) {
-      EmitPacket(ctx, pkt, filter.gate);
+      ogates[i] = filter.gate;
     } else {
-      EmitPacket(ctx, pkt);
+      ogates[i] = 0;
     }
   }
+
+  EmitBatch(ctx, batch, ogates);
 }
 
 void BPF::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
@@ -190,6 +193,7 @@ void BPF::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   }
 
   // slow version for general cases
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
@@ -204,8 +208,10 @@ void BPF::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
         break;
       }
     }
-    EmitPacket(ctx, pkt, gate);
+    ogates[i] = gate;
   }
+
+  EmitBatch(ctx, batch, ogates);
 }
 
 ADD_MODULE(BPF, "bpf", "classifies packets with pcap-filter(7) syntax")
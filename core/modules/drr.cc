@@ -61,7 +61,8 @@ DRR::DRR()
       max_queue_size_(kFlowQueueMax),
       max_number_flows_(kDefaultNumFlows),
       flow_ring_(nullptr),
-      current_flow_(nullptr) {
+      current_flow_(nullptr),
+      head_tsc_(0) {
   is_task_ = true;
   max_allowed_workers_ = Worker::kMaxWorkers;
 }
@@ -120,9 +121,13 @@ CommandResponse DRR::CommandMaxFlowQueueSize(
   return SetMaxFlowQueueSize(arg.max_queue_size());
 }
 
-void DRR::ProcessBatch(Context *, bess::PacketBatch *batch) {
+void DRR::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   int err = 0;
 
+  if (!head_tsc_) {
+    head_tsc_ = ctx->current_tsc;
+  }
+
   // insert packets in the batch into their corresponding flows
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
@@ -136,13 +141,13 @@ void DRR::ProcessBatch(Context *, bess::PacketBatch *batch) {
     // and add the packet to the new Flow
     if (it == nullptr) {
       if (llring_full(flow_ring_)) {
-        bess::Packet::Free(pkt);
+        DropPacket(ctx, pkt, DropReason::kQueueFull);
       } else {
-        AddNewFlow(pkt, id, &err);
+        AddNewFlow(ctx, pkt, id, &err);
         assert(err == 0);
       }
     } else {
-      Enqueue(it->second, pkt, &err);
+      Enqueue(ctx, it->second, pkt, &err);
       assert(err == 0);
     }
   }
@@ -164,6 +169,12 @@ struct task_result DRR::RunTask(Context *ctx, bess::PacketBatch *batch,
   }
   assert(err >= 0);  // TODO(joshua) do proper error checking
 
+  // GetNextBatch() stops short only after a whole round over the flows
+  // yielded nothing more, i.e., (almost always) when all of them are drained.
+  if (!batch->full()) {
+    head_tsc_ = 0;
+  }
+
   if (total_bytes > 0) {
     RunNextModule(ctx, batch);
   }
@@ -306,7 +317,7 @@ DRR::FlowId DRR::GetId(bess::Packet *pkt) {
   return id;
 }
 
-void DRR::AddNewFlow(bess::Packet *pkt, FlowId id, int *err) {
+void DRR::AddNewFlow(Context *ctx, bess::Packet *pkt, FlowId id, int *err) {
   // creates flow
   Flow *f = new Flow(id);
 
@@ -319,7 +330,7 @@ void DRR::AddNewFlow(bess::Packet *pkt, FlowId id, int *err) {
 
   flows_.Insert(id, f);
 
-  Enqueue(f, pkt, err);
+  Enqueue(ctx, f, pkt, err);
   if (*err != 0) {
     return;
   }
@@ -355,10 +366,10 @@ llring *DRR::AddQueue(uint32_t slots, int *err) {
   return queue;
 }
 
-void DRR::Enqueue(Flow *f, bess::Packet *newpkt, int *err) {
+void DRR::Enqueue(Context *ctx, Flow *f, bess::Packet *newpkt, int *err) {
   // if the queue is full. drop the packet.
   if (llring_count(f->queue) >= max_queue_size_) {
-    bess::Packet::Free(newpkt);
+    DropPacket(ctx, newpkt, DropReason::kQueueFull);
     return;
   }
 
@@ -369,7 +380,7 @@ void DRR::Enqueue(Flow *f, bess::Packet *newpkt, int *err) {
         RoundToPowerTwo(llring_count(f->queue) * kQueueGrowthFactor);
     f->queue = ResizeQueue(f->queue, slots, err);
     if (*err != 0) {
-      bess::Packet::Free(newpkt);
+      DropPacket(ctx, newpkt, DropReason::kNoBuffer);
       return;
     }
   }
@@ -378,7 +389,7 @@ void DRR::Enqueue(Flow *f, bess::Packet *newpkt, int *err) {
   if (*err == 0) {
     f->timer = get_epoch_time();
   } else {
-    bess::Packet::Free(newpkt);
+    DropPacket(ctx, newpkt, DropReason::kQueueFull);
   }
 }
 
@@ -164,6 +164,8 @@ class DRR final : public Module {
   struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
                              void *arg) override;
 
+  uint64_t GetTaskHeadTsc(void *) const override { return head_tsc_; }
+
   CommandResponse CommandQuantumSize(const bess::pb::DRRQuantumArg &arg);
   CommandResponse CommandMaxFlowQueueSize(
       const bess::pb::DRRMaxFlowQueueSizeArg &arg);
@@ -192,10 +194,10 @@ class DRR final : public Module {
   //  nullptr. Returns a pointer to the new llring otherwise.
   llring *ResizeQueue(llring *old_queue, uint32_t new_size, int *err);
 
-  //  Puts the packet into the llring queue within the flow. Takes the flow to
-  //  enqueue the packet into, the packet to enqueue into the flow's queue
-  //  and integer pointer to be set on error.
-  void Enqueue(Flow *f, bess::Packet *pkt, int *err);
+  //  Puts the packet into the llring queue within the flow. Takes the context
+  //  to drop packets with, the flow to enqueue the packet into, the packet to
+  //  enqueue into the flow's queue and integer pointer to be set on error.
+  void Enqueue(Context *ctx, Flow *f, bess::Packet *pkt, int *err);
 
   //  Takes a Packet to get a flow id for. Returns the 5 element identifier for
   //  the flow that the packet belongs to
@@ -205,7 +207,7 @@ class DRR final : public Module {
   //  pkt
   //  to be enqueued in the new flow, the id of the new flow to be created and
   //  integer pointer to set on error.
-  void AddNewFlow(bess::Packet *pkt, FlowId id, int *err);
+  void AddNewFlow(Context *ctx, bess::Packet *pkt, FlowId id, int *err);
 
   //  Removes the flow from the hash table and frees all the packets within its
   //  queue. Takes the pointer to the flow to remove
@@ -248,5 +250,10 @@ class DRR final : public Module {
   CuckooMap<FlowId, Flow *, Hash, EqualTo> flows_;
   llring *flow_ring_;   // llring used for round robin.
   Flow *current_flow_;  // store current flow between batch rounds.
+
+  // When the module last went from having no packets to having some (0 if it
+  // has none). Packets are not served in arrival order, so the oldest pending
+  // packet may have arrived at any time since then.
+  uint64_t head_tsc_;
 };
 #endif  // BESS_MODULES_DRR_H_
@@ -52,6 +52,8 @@ CommandResponse EtherEncap::Init(
 };
 
 void EtherEncap::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
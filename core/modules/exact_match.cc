@@ -224,6 +224,7 @@ CommandResponse ExactMatch::SetRuntimeConfig(
 void ExactMatch::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   gate_idx_t default_gate;
   ExactMatchKey keys[bess::PacketBatch::kMaxBurst] __ymm_aligned;
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
 
   default_gate = ACCESS_ONCE(default_gate_);
 
@@ -238,9 +239,10 @@ void ExactMatch::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
-    bess::Packet *pkt = batch->pkts()[i];
-    EmitPacket(ctx, pkt, table_.Find(keys[i], default_gate));
+    ogates[i] = table_.Find(keys[i], default_gate);
   }
+
+  EmitBatch(ctx, batch, ogates);
 }
 
 std::string ExactMatch::GetDesc() const {
@@ -515,6 +515,8 @@ void FlowGen::GeneratePackets(Context *ctx, bess::PacketBatch *batch) {
     }
     if (pkt) {
       batch->add(pkt);
+    } else {
+      CountAllocFailures(ctx, 1);
     }
 
     if (f->first_pkt) {
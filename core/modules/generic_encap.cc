@@ -126,6 +126,8 @@ CommandResponse GenericEncap::Init(const bess::pb::GenericEncapArg &arg) {
 }
 
 void GenericEncap::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   int cnt = batch->cnt();
 
   int encap_size = encap_size_;
@@ -33,6 +33,12 @@
 #include <utility>
 #include <vector>
 
+#include "../utils/ip.h"
+#include "parse_headers.h"
+
+using bess::utils::Ipv4;
+using bess::utils::ParsedHeaders;
+
 static inline uint32_t hash_16(uint16_t val, uint32_t init_val) {
 #if __x86_64
   return crc32c_sse42_u16(val, init_val);
@@ -131,6 +137,14 @@ CommandResponse HashLB::Init(const bess::pb::HashLBArg &arg) {
     return ret;
   }
 
+  if (arg.parsed_headers()) {
+    hdrs_attr_id_ = ParseHeaders::AddReader(this);
+    if (hdrs_attr_id_ < 0) {
+      return CommandFailure(-hdrs_attr_id_,
+                            "Failed to register metadata attribute");
+    }
+  }
+
   if (!arg.mode().size() && !arg.fields_size()) {
     mode_ = kDefaultMode;
     return CommandSuccess();
@@ -150,6 +164,7 @@ inline void HashLB::DoProcessBatch<HashLB::Mode::kOther>(
     Context *ctx, bess::PacketBatch *batch) {
   void *bufs[bess::PacketBatch::kMaxBurst];
   ExactMatchKey keys[bess::PacketBatch::kMaxBurst];
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
 
   size_t cnt = batch->cnt();
   for (size_t i = 0; i < cnt; i++) {
@@ -159,14 +174,17 @@ inline void HashLB::DoProcessBatch<HashLB::Mode::kOther>(
   fields_table_.MakeKeys((const void **)bufs, keys, cnt);
 
   for (size_t i = 0; i < cnt; i++) {
-    EmitPacket(ctx, batch->pkts()[i],
-               gates_[hash_range(hasher_(keys[i]), num_gates_)]);
+    ogates[i] = gates_[hash_range(hasher_(keys[i]), num_gates_)];
   }
+
+  EmitBatch(ctx, batch, ogates);
 }
 
 template <>
 inline void HashLB::DoProcessBatch<HashLB::Mode::kL2>(
     Context *ctx, bess::PacketBatch *batch) {
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
+
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
     bess::Packet *snb = batch->pkts()[i];
@@ -180,57 +198,95 @@ inline void HashLB::DoProcessBatch<HashLB::Mode::kL2>(
 
     uint32_t hash_val = hash_16(sum, 0);
 
-    EmitPacket(ctx, snb, gates_[hash_range(hash_val, num_gates_)]);
+    ogates[i] = gates_[hash_range(hash_val, num_gates_)];
   }
+
+  EmitBatch(ctx, batch, ogates);
 }
 
 template <>
 inline void HashLB::DoProcessBatch<HashLB::Mode::kL3>(
     Context *ctx, bess::PacketBatch *batch) {
-  /* assumes untagged packets */
-  const int ip_offset = 14;
+  bess::metadata::mt_offset_t hdrs_offset =
+      ParseHeaders::ReaderOffset(this, hdrs_attr_id_);
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
 
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
     bess::Packet *snb = batch->pkts()[i];
-    char *head = snb->head_data<char *>();
+    const ParsedHeaders *hdrs = ParseHeaders::Cached(hdrs_offset, snb);
 
     uint32_t hash_val;
-    uint32_t v0 =
-        *(reinterpret_cast<uint32_t *>(head + ip_offset + 12));   /* src IP */
-    v0 ^= *(reinterpret_cast<uint32_t *>(head + ip_offset + 16)); /* dst IP */
+    uint32_t v0;
+    if (hdrs) {
+      v0 = 0; /* non-IPv4 packets all hash the same */
+      if (hdrs->has(ParsedHeaders::kIpv4)) {
+        const Ipv4 *ip = hdrs->l3<const Ipv4>(snb->head_data());
+        v0 = ip->src.raw_value() ^ ip->dst.raw_value();
+      }
+    } else {
+      /* assumes untagged packets */
+      const int ip_offset = 14;
+      char *head = snb->head_data<char *>();
+      v0 = *(reinterpret_cast<uint32_t *>(head + ip_offset + 12)); /* src IP */
+      v0 ^= *(reinterpret_cast<uint32_t *>(head + ip_offset + 16)); /* dst IP */
+    }
 
     hash_val = hash_32(v0, 0);
-    EmitPacket(ctx, snb, gates_[hash_range(hash_val, num_gates_)]);
+    ogates[i] = gates_[hash_range(hash_val, num_gates_)];
   }
+
+  EmitBatch(ctx, batch, ogates);
 }
 
 template <>
 inline void HashLB::DoProcessBatch<HashLB::Mode::kL4>(
     Context *ctx, bess::PacketBatch *batch) {
-  /* assumes untagged packets */
-  const int ip_offset = 14;
+  bess::metadata::mt_offset_t hdrs_offset =
+      ParseHeaders::ReaderOffset(this, hdrs_attr_id_);
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
 
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
     bess::Packet *snb = batch->pkts()[i];
-    char *head = snb->head_data<char *>();
-    uint32_t l4_offset =
-        ip_offset + ((*(reinterpret_cast<uint8_t *>(head + ip_offset)) & 0x0F)
-                     << 2); /* ip_offset + IHL */
-    uint32_t hash_val;
-    uint32_t v0 =
-        *(reinterpret_cast<uint32_t *>(head + ip_offset + 12));   /* src IP */
-    v0 ^= *(reinterpret_cast<uint32_t *>(head + ip_offset + 16)); /* dst IP*/
-    v0 ^= *(reinterpret_cast<uint16_t *>(head + l4_offset));      /* src port */
-    v0 ^= *(reinterpret_cast<uint16_t *>(head + l4_offset + 2));  /* dst port */
+    const ParsedHeaders *hdrs = ParseHeaders::Cached(hdrs_offset, snb);
 
-    v0 ^= *(reinterpret_cast<uint8_t *>(head + ip_offset + 9)); /* ip_proto */
+    uint32_t hash_val;
+    uint32_t v0;
+    if (hdrs) {
+      v0 = 0; /* non-IPv4 packets all hash the same */
+      if (hdrs->has(ParsedHeaders::kIpv4)) {
+        const Ipv4 *ip = hdrs->l3<const Ipv4>(snb->head_data());
+        v0 = ip->src.raw_value() ^ ip->dst.raw_value() ^ ip->protocol;
+      }
+      /* Ports, or the first 4 bytes of other L4 headers. Skipped for all
+       * fragments, so that they stay together with the first one. */
+      if (hdrs->has(ParsedHeaders::kL4) &&
+          !hdrs->has(ParsedHeaders::kFragment)) {
+        const uint16_t *ports = hdrs->l4<const uint16_t>(snb->head_data());
+        v0 ^= ports[0];
+        v0 ^= ports[1];
+      }
+    } else {
+      /* assumes untagged packets */
+      const int ip_offset = 14;
+      char *head = snb->head_data<char *>();
+      uint32_t l4_offset =
+          ip_offset + ((*(reinterpret_cast<uint8_t *>(head + ip_offset)) & 0x0F)
+                       << 2); /* ip_offset + IHL */
+      v0 = *(reinterpret_cast<uint32_t *>(head + ip_offset + 12)); /* src IP */
+      v0 ^= *(reinterpret_cast<uint32_t *>(head + ip_offset + 16)); /* dst IP */
+      v0 ^= *(reinterpret_cast<uint16_t *>(head + l4_offset)); /* src port */
+      v0 ^= *(reinterpret_cast<uint16_t *>(head + l4_offset + 2)); /* dport */
+      v0 ^= *(reinterpret_cast<uint8_t *>(head + ip_offset + 9)); /* ip_proto */
+    }
 
     hash_val = hash_32(v0, 0);
 
-    EmitPacket(ctx, snb, gates_[hash_range(hash_val, num_gates_)]);
+    ogates[i] = gates_[hash_range(hash_val, num_gates_)];
   }
+
+  EmitBatch(ctx, batch, ogates);
 }
 
 void HashLB::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
@@ -47,7 +47,13 @@ class HashLB final : public Module {
   static const Commands cmds;
 
   HashLB()
-      : Module(), gates_(), num_gates_(), mode_(), fields_table_(), hasher_(0) {
+      : Module(),
+        gates_(),
+        num_gates_(),
+        mode_(),
+        fields_table_(),
+        hasher_(0),
+        hdrs_attr_id_(-1) {
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
 
@@ -77,6 +83,9 @@ class HashLB final : public Module {
   // No rules are ever added to this table, we just use it for MakeKeys().
   ExactMatchTable<int> fields_table_;
   ExactMatchKeyHash hasher_;
+
+  // "parsed_headers" metadata attribute, or -1 to parse packets here
+  int hdrs_attr_id_;
 };
 
 #endif  // BESS_MODULES_HASHLB_H_
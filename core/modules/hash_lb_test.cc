@@ -0,0 +1,271 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "hash_lb.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../module_graph.h"
+#include "../packet_pool.h"
+#include "../task.h"
+#include "../utils/ether.h"
+#include "../utils/ip.h"
+#include "../utils/tcp.h"
+#include "parse_headers.h"
+
+namespace {
+
+using bess::utils::be16_t;
+using bess::utils::be32_t;
+using bess::utils::Ethernet;
+using bess::utils::Ipv4;
+using bess::utils::ParsedHeaders;
+using bess::utils::Tcp;
+using bess::utils::Vlan;
+
+const uint16_t kLen = 64;
+const int kFlows = 16;
+
+// Sends the packets in 'pkts' once. After Parse(), it also fills in their
+// "parsed_headers" attribute, as a ParseHeaders module would.
+class TestSource final : public Module {
+ public:
+  static const gate_idx_t kNumIGates = 0;
+
+  TestSource() : Module(), attr_id_(-1) { is_task_ = true; }
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void Parse() {
+    attr_id_ = AddMetadataAttr(ParseHeaders::kAttrName, sizeof(ParsedHeaders),
+                               bess::metadata::Attribute::AccessMode::kWrite);
+  }
+
+  struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
+                             void *) override {
+    uint32_t cnt = pkts.size();
+    batch->clear();
+    for (bess::Packet *pkt : pkts) {
+      if (attr_id_ >= 0) {
+        bess::utils::ParseHeaders(
+            pkt->head_data(), pkt->head_len(),
+            _ptr_attr_with_offset<ParsedHeaders>(attr_offset(attr_id_), pkt));
+      }
+      batch->add(pkt);
+    }
+    pkts.clear();
+    RunNextModule(ctx, batch);
+    return {.block = false, .packets = cnt, .bits = cnt * kLen * 8};
+  }
+
+  std::vector<bess::Packet *> pkts;
+
+ private:
+  int attr_id_;
+};
+
+// Keeps the packets it receives.
+class TestSink final : public Module {
+ public:
+  static const gate_idx_t kNumOGates = 0;
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *, bess::PacketBatch *batch) override {
+    for (int i = 0; i < batch->cnt(); i++) {
+      pkts.push_back(batch->pkts()[i]);
+    }
+  }
+
+  std::vector<bess::Packet *> pkts;
+};
+
+DEF_MODULE(TestSource, "test_source", "sends given packets");
+DEF_MODULE(TestSink, "test_sink", "keeps packets");
+
+template <typename T, typename Arg>
+T *CreateModule(const std::string &class_name, const std::string &name,
+                const Arg &arg_) {
+  const ModuleBuilder &builder =
+      ModuleBuilder::all_module_builders().find(class_name)->second;
+
+  google::protobuf::Any arg;
+  arg.PackFrom(arg_);
+
+  pb_error_t perr;
+  Module *m = ModuleGraph::CreateModule(builder, name, arg, &perr);
+  EXPECT_NE(nullptr, m) << perr.errmsg();
+  return static_cast<T *>(m);
+}
+
+// src -> lb -> sink0, sink1
+class HashLBTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() override {
+    pool_.reset(new bess::PlainPacketPool(1024));
+    size_ = pool_->Size();
+  }
+
+  virtual void TearDown() override {
+    Destroy();
+    EXPECT_EQ(size_, pool_->Size());
+  }
+
+  // With 'parsed', the packets come with parsed headers and the HashLB
+  // uses them.
+  void Build(const std::string &mode, bool parsed) {
+    Destroy();
+
+    bess::pb::EmptyArg empty;
+    bess::pb::HashLBArg arg;
+    arg.add_gates(0);
+    arg.add_gates(1);
+    arg.set_mode(mode);
+    arg.set_parsed_headers(parsed);
+
+    src_ = CreateModule<TestSource>("TestSource", "src", empty);
+    Module *lb = CreateModule<HashLB>("HashLB", "lb", arg);
+    ASSERT_EQ(0, ModuleGraph::ConnectModules(src_, 0, lb, 0, true));
+    for (int i = 0; i < 2; i++) {
+      sinks_[i] =
+          CreateModule<TestSink>("TestSink", "sink" + std::to_string(i), empty);
+      ASSERT_EQ(0, ModuleGraph::ConnectModules(lb, i, sinks_[i], 0, true));
+    }
+    if (parsed) {
+      src_->Parse();
+    }
+    ASSERT_EQ(0, bess::metadata::default_pipeline.ComputeMetadataOffsets());
+
+    ModuleGraph::UpdateTaskGraph();
+    task_.reset(new Task(src_, nullptr));
+    task_->UpdatePerGateBatch(8);
+  }
+
+  void Destroy() {
+    task_.reset();
+    ModuleGraph::DestroyAllModules();
+  }
+
+  // Returns the gate of each flow, with packets that are 802.1Q tagged if
+  // 'vlan'. All flows have the same source address and destination port.
+  std::vector<int> Gates(bool vlan) {
+    std::vector<bess::Packet *> pkts;
+    for (int i = 0; i < kFlows; i++) {
+      bess::Packet *pkt = pool_->Alloc(kLen);
+      EXPECT_NE(nullptr, pkt);
+      uint8_t *p = pkt->head_data<uint8_t *>();
+      memset(p, 0, kLen);
+
+      Ethernet *eth = reinterpret_cast<Ethernet *>(p);
+      eth->ether_type =
+          be16_t(vlan ? Ethernet::Type::kVlan : Ethernet::Type::kIpv4);
+      p += sizeof(Ethernet);
+      if (vlan) {
+        reinterpret_cast<Vlan *>(p)->ether_type = be16_t(Ethernet::Type::kIpv4);
+        p += sizeof(Vlan);
+      }
+
+      Ipv4 *ip = reinterpret_cast<Ipv4 *>(p);
+      ip->version = 4;
+      ip->header_length = 5;
+      ip->protocol = Ipv4::Proto::kTcp;
+      ip->src = be32_t(0x0a000001);
+      ip->dst = be32_t(0x0a000100 + i);
+
+      Tcp *tcp = reinterpret_cast<Tcp *>(ip + 1);
+      tcp->src_port = be16_t(1000 + i);
+      tcp->dst_port = be16_t(80);
+      tcp->offset = 5;
+
+      pkts.push_back(pkt);
+    }
+    src_->pkts = pkts;
+
+    Context ctx = {};
+    ctx.task = task_.get();
+    (*task_)(&ctx);
+
+    std::vector<int> gates(kFlows, -1);
+    for (int gate = 0; gate < 2; gate++) {
+      for (bess::Packet *pkt : sinks_[gate]->pkts) {
+        for (int i = 0; i < kFlows; i++) {
+          if (pkts[i] == pkt) {
+            gates[i] = gate;
+          }
+        }
+      }
+      bess::Packet::Free(sinks_[gate]->pkts.data(),
+                         sinks_[gate]->pkts.size());
+      sinks_[gate]->pkts.clear();
+    }
+    return gates;
+  }
+
+  TestSource_class TestSource_singleton_;
+  TestSink_class TestSink_singleton_;
+
+  std::unique_ptr<bess::PacketPool> pool_;
+  size_t size_;  // available packets of an untouched pool
+  std::unique_ptr<Task> task_;
+  TestSource *src_;
+  TestSink *sinks_[2];
+};
+
+// Without parsed headers, untagged packets are hashed in place. With them,
+// the flows go to the same gates, whether their packets are tagged or not.
+TEST_F(HashLBTest, L3) {
+  Build("l3", false);
+  std::vector<int> gates = Gates(false);
+  EXPECT_EQ(0, std::count(gates.begin(), gates.end(), -1));
+  EXPECT_NE(0, std::count(gates.begin(), gates.end(), 0));
+  EXPECT_NE(0, std::count(gates.begin(), gates.end(), 1));
+
+  Build("l3", true);
+  EXPECT_EQ(gates, Gates(false));
+  EXPECT_EQ(gates, Gates(true));
+}
+
+TEST_F(HashLBTest, L4) {
+  Build("l4", false);
+  std::vector<int> gates = Gates(false);
+  EXPECT_EQ(0, std::count(gates.begin(), gates.end(), -1));
+  EXPECT_NE(0, std::count(gates.begin(), gates.end(), 0));
+  EXPECT_NE(0, std::count(gates.begin(), gates.end(), 1));
+
+  Build("l4", true);
+  EXPECT_EQ(gates, Gates(false));
+  EXPECT_EQ(gates, Gates(true));
+}
+
+}  // namespace
@@ -31,49 +31,35 @@
 #include "ip_checksum.h"
 
 #include "../utils/checksum.h"
-#include "../utils/ether.h"
 #include "../utils/ip.h"
+#include "parse_headers.h"
 
 enum { FORWARD_GATE = 0, FAIL_GATE };
 
 void IPChecksum::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
-  using bess::utils::be16_t;
-  using bess::utils::Ethernet;
   using bess::utils::Ipv4;
-  using bess::utils::Vlan;
+  using bess::utils::ParsedHeaders;
 
+  if (!verify_) {
+    bess::Packet::Unshare(batch);
+  }
+
+  bess::metadata::mt_offset_t hdrs_offset =
+      ParseHeaders::ReaderOffset(this, hdrs_attr_id_);
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
-    Ethernet *eth = batch->pkts()[i]->head_data<Ethernet *>();
-    void *data = eth + 1;
-    Ipv4 *ip;
-
-    be16_t ether_type = eth->ether_type;
+    ParsedHeaders buf;
+    const ParsedHeaders *hdrs =
+        ParseHeaders::Get(hdrs_offset, batch->pkts()[i], &buf);
 
-    if (ether_type == be16_t(Ethernet::Type::kQinQ)) {
-      Vlan *qinq = reinterpret_cast<Vlan *>(data);
-      data = qinq + 1;
-      ether_type = qinq->ether_type;
-      if (ether_type != be16_t(Ethernet::Type::kVlan)) {
-	EmitPacket(ctx, batch->pkts()[i], FORWARD_GATE);
-	continue;
-      }
-    }
-
-    if (ether_type == be16_t(Ethernet::Type::kVlan)) {
-      Vlan *vlan = reinterpret_cast<Vlan *>(data);
-      data = vlan + 1;
-      ether_type = vlan->ether_type;
-    }
-
-    if (ether_type == be16_t(Ethernet::Type::kIpv4)) {
-      ip = reinterpret_cast<Ipv4 *>(data);
-    } else {
+    if (!hdrs->has(ParsedHeaders::kIpv4)) {
       EmitPacket(ctx, batch->pkts()[i], FORWARD_GATE);
       continue;
     }
 
+    Ipv4 *ip = hdrs->l3<Ipv4>(batch->pkts()[i]->head_data());
+
     if (verify_) {
       EmitPacket(ctx, batch->pkts()[i], (VerifyIpv4Checksum(*ip)) ? FORWARD_GATE : FAIL_GATE);
     } else {
@@ -85,6 +71,13 @@ void IPChecksum::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 
 CommandResponse IPChecksum::Init(const bess::pb::IPChecksumArg &arg) {
   verify_ = arg.verify();
+  if (arg.parsed_headers()) {
+    hdrs_attr_id_ = ParseHeaders::AddReader(this);
+    if (hdrs_attr_id_ < 0) {
+      return CommandFailure(-hdrs_attr_id_,
+                            "Failed to register metadata attribute");
+    }
+  }
   return CommandSuccess();
 }
 
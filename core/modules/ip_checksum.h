@@ -37,7 +37,9 @@
 // Compute IP checksum on packet
 class IPChecksum final : public Module {
  public:
-  IPChecksum() : Module(), verify_(false) { max_allowed_workers_ = Worker::kMaxWorkers; }
+  IPChecksum() : Module(), verify_(false), hdrs_attr_id_(-1) {
+    max_allowed_workers_ = Worker::kMaxWorkers;
+  }
 
   /* Gates: (0) Default, (1) Drop */
   static const gate_idx_t kNumOGates = 2;
@@ -47,6 +49,9 @@ class IPChecksum final : public Module {
  private:
   /* enable checksum verification */
   bool verify_;
+
+  // "parsed_headers" metadata attribute, or -1 to parse packets here
+  int hdrs_attr_id_;
 };
 
 #endif  // BESS_MODULES_IP_CHECKSUM_H_
@@ -60,6 +60,8 @@ CommandResponse IPEncap::Init(const bess::pb::IPEncapArg &arg[[maybe_unused]]) {
 }
 
 void IPEncap::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
@@ -82,9 +82,10 @@ void IPLookup::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   using bess::utils::Ipv4;
 
   gate_idx_t default_gate = default_gate_;
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
 
   int cnt = batch->cnt();
-  int i;
+  int i = 0;
 
 #if VECTOR_OPTIMIZATION
   // Convert endianness for four addresses at the same time
@@ -122,10 +123,10 @@ void IPLookup::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 
     rte_lpm_lookupx4(lpm_, ip_addr, next_hops, default_gate);
 
-    EmitPacket(ctx, batch->pkts()[i], next_hops[0]);
-    EmitPacket(ctx, batch->pkts()[i + 1], next_hops[1]);
-    EmitPacket(ctx, batch->pkts()[i + 2], next_hops[2]);
-    EmitPacket(ctx, batch->pkts()[i + 3], next_hops[3]);
+    ogates[i] = next_hops[0];
+    ogates[i + 1] = next_hops[1];
+    ogates[i + 2] = next_hops[2];
+    ogates[i + 3] = next_hops[3];
   }
 #endif
 
@@ -143,11 +144,13 @@ void IPLookup::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     ret = rte_lpm_lookup(lpm_, ip->dst.value(), &next_hop);
 
     if (ret == 0) {
-      EmitPacket(ctx, batch->pkts()[i], next_hop);
+      ogates[i] = next_hop;
     } else {
-      EmitPacket(ctx, batch->pkts()[i], default_gate);
+      ogates[i] = default_gate;
     }
   }
+
+  EmitBatch(ctx, batch, ogates);
 }
 
 ParsedPrefix IPLookup::ParseIpv4Prefix(
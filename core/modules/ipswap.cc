@@ -39,6 +39,8 @@ void IPSwap::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   using bess::utils::Ipv4;
   using bess::utils::Udp;
 
+  bess::Packet::Unshare(batch);
+
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
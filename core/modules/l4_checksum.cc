@@ -31,59 +31,76 @@
 #include "l4_checksum.h"
 
 #include "../utils/checksum.h"
-#include "../utils/ether.h"
 #include "../utils/ip.h"
 #include "../utils/tcp.h"
 #include "../utils/udp.h"
+#include "parse_headers.h"
 
 enum { FORWARD_GATE = 0, FAIL_GATE };
 
 void L4Checksum::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
-  using bess::utils::be16_t;
-  using bess::utils::Ethernet;
   using bess::utils::Ipv4;
+  using bess::utils::ParsedHeaders;
   using bess::utils::Tcp;
   using bess::utils::Udp;
 
+  if (!verify_) {
+    bess::Packet::Unshare(batch);
+  }
+
+  bess::metadata::mt_offset_t hdrs_offset =
+      ParseHeaders::ReaderOffset(this, hdrs_attr_id_);
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
-    Ethernet *eth = batch->pkts()[i]->head_data<Ethernet *>();
+    bess::Packet *pkt = batch->pkts()[i];
+    ParsedHeaders buf;
+    const ParsedHeaders *hdrs = ParseHeaders::Get(hdrs_offset, pkt, &buf);
 
-    // Calculate checksum only for IPv4 packets
-    if (eth->ether_type != be16_t(Ethernet::Type::kIpv4)) {
-      EmitPacket(ctx, batch->pkts()[i], FORWARD_GATE);
+    // Calculate checksum only for (unfragmented) TCP/UDP over IPv4 packets
+    if (!hdrs->has(ParsedHeaders::kL4) ||
+        hdrs->has(ParsedHeaders::kFragment)) {
+      EmitPacket(ctx, pkt, FORWARD_GATE);
       continue;
     }
 
-    Ipv4 *ip = reinterpret_cast<Ipv4 *>(eth + 1);
+    Ipv4 *ip = hdrs->l3<Ipv4>(pkt->head_data());
 
-    if (ip->protocol == Ipv4::Proto::kUdp) {
-      size_t ip_bytes = (ip->header_length) << 2;
-      Udp *udp =
-          reinterpret_cast<Udp *>(reinterpret_cast<uint8_t *>(ip) + ip_bytes);
+    if (hdrs->ip_proto == Ipv4::Proto::kUdp) {
+      Udp *udp = hdrs->l4<Udp>(pkt->head_data());
       if (verify_) {
-	EmitPacket(ctx, batch->pkts()[i],
-		   (VerifyIpv4UdpChecksum(*ip, *udp)) ? FORWARD_GATE : FAIL_GATE);
+        EmitPacket(ctx, pkt,
+                   (VerifyIpv4UdpChecksum(*ip, *udp)) ? FORWARD_GATE
+                                                       : FAIL_GATE);
       } else {
-	udp->checksum = CalculateIpv4UdpChecksum(*ip, *udp);
-	EmitPacket(ctx, batch->pkts()[i], FORWARD_GATE);
+        udp->checksum = CalculateIpv4UdpChecksum(*ip, *udp);
+        EmitPacket(ctx, pkt, FORWARD_GATE);
       }
-    } else if (ip->protocol == Ipv4::Proto::kTcp) {
-      size_t ip_bytes = (ip->header_length) << 2;
-      Tcp *tcp =
-          reinterpret_cast<Tcp *>(reinterpret_cast<uint8_t *>(ip) + ip_bytes);
-      if (verify_)
-	EmitPacket(ctx, batch->pkts()[i],
-		   (VerifyIpv4TcpChecksum(*ip, *tcp)) ? FORWARD_GATE : FAIL_GATE);
-      else
-	tcp->checksum = CalculateIpv4TcpChecksum(*ip, *tcp);
+    } else if (hdrs->ip_proto == Ipv4::Proto::kTcp) {
+      Tcp *tcp = hdrs->l4<Tcp>(pkt->head_data());
+      if (verify_) {
+        EmitPacket(ctx, pkt,
+                   (VerifyIpv4TcpChecksum(*ip, *tcp)) ? FORWARD_GATE
+                                                       : FAIL_GATE);
+      } else {
+        tcp->checksum = CalculateIpv4TcpChecksum(*ip, *tcp);
+        EmitPacket(ctx, pkt, FORWARD_GATE);
+      }
+    } else {
+      EmitPacket(ctx, pkt, FORWARD_GATE);
     }
   }
 }
 
 CommandResponse L4Checksum::Init(const bess::pb::L4ChecksumArg &arg) {
   verify_ = arg.verify();
+  if (arg.parsed_headers()) {
+    hdrs_attr_id_ = ParseHeaders::AddReader(this);
+    if (hdrs_attr_id_ < 0) {
+      return CommandFailure(-hdrs_attr_id_,
+                            "Failed to register metadata attribute");
+    }
+  }
   return CommandSuccess();
 }
 
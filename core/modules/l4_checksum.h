@@ -36,7 +36,9 @@
 // Compute L4 checksum on packet
 class L4Checksum final : public Module {
  public:
- L4Checksum() : Module(), verify_(false) { max_allowed_workers_ = Worker::kMaxWorkers; }
+  L4Checksum() : Module(), verify_(false), hdrs_attr_id_(-1) {
+    max_allowed_workers_ = Worker::kMaxWorkers;
+  }
 
   /* Gates: (0) Default, (1) Drop */
   static const gate_idx_t kNumOGates = 2;
@@ -46,6 +48,9 @@ class L4Checksum final : public Module {
 
  private:
   bool verify_;
+
+  // "parsed_headers" metadata attribute, or -1 to parse packets here
+  int hdrs_attr_id_;
 };
 
 #endif  // BESS_MODULES_L4_CHECKSUM_H_
@@ -35,6 +35,8 @@
 void MACSwap::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   using bess::utils::Ethernet;
 
+  bess::Packet::Unshare(batch);
+
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
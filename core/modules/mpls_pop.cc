@@ -49,6 +49,8 @@ MPLSPop::MPLSPop()
 }
 
 void MPLSPop::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
@@ -35,19 +35,19 @@
 
 #include "../utils/checksum.h"
 #include "../utils/common.h"
-#include "../utils/ether.h"
 #include "../utils/format.h"
 #include "../utils/icmp.h"
 #include "../utils/ip.h"
 #include "../utils/tcp.h"
 #include "../utils/udp.h"
+#include "parse_headers.h"
 
-using bess::utils::Ethernet;
 using bess::utils::Ipv4;
 using IpProto = bess::utils::Ipv4::Proto;
 using bess::utils::Udp;
 using bess::utils::Tcp;
 using bess::utils::Icmp;
+using bess::utils::ParsedHeaders;
 using bess::utils::ChecksumIncrement16;
 using bess::utils::ChecksumIncrement32;
 using bess::utils::UpdateChecksumWithIncrement;
@@ -109,6 +109,14 @@ CommandResponse NAT::Init(const bess::pb::NATArg &arg) {
   // Sort so that GetInitialArg is predictable and consistent.
   std::sort(ext_addrs_.begin(), ext_addrs_.end());
 
+  if (arg.parsed_headers()) {
+    hdrs_attr_id_ = ParseHeaders::AddReader(this);
+    if (hdrs_attr_id_ < 0) {
+      return CommandFailure(-hdrs_attr_id_,
+                            "Failed to register metadata attribute");
+    }
+  }
+
   return CommandSuccess();
 }
 
@@ -124,6 +132,7 @@ CommandResponse NAT::GetInitialArg(const bess::pb::EmptyArg &) {
       erange->set_suspended(irange.suspended);
     }
   }
+  resp.set_parsed_headers(hdrs_attr_id_ >= 0);
   return CommandSuccess(resp);
 }
 
@@ -327,21 +336,29 @@ inline void NAT::DoProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   gate_idx_t ogate_idx = dir == kForward ? 1 : 0;
   int cnt = batch->cnt();
   uint64_t now = ctx->current_ns;
+  bess::metadata::mt_offset_t hdrs_offset =
+      ParseHeaders::ReaderOffset(this, hdrs_attr_id_);
 
   for (int i = 0; i < cnt; i++) {
     bess::Packet *pkt = batch->pkts()[i];
 
-    Ethernet *eth = pkt->head_data<Ethernet *>();
-    Ipv4 *ip = reinterpret_cast<Ipv4 *>(eth + 1);
-    size_t ip_bytes = (ip->header_length) << 2;
-    void *l4 = reinterpret_cast<uint8_t *>(ip) + ip_bytes;
+    ParsedHeaders buf;
+    const ParsedHeaders *hdrs = ParseHeaders::Get(hdrs_offset, pkt, &buf);
+    if (!hdrs->has(ParsedHeaders::kL4)) {
+      DropPacket(ctx, pkt, DropReason::kMalformed);
+      continue;
+    }
+
+    void *head = pkt->head_data();
+    Ipv4 *ip = hdrs->l3<Ipv4>(head);
+    void *l4 = hdrs->l4<uint8_t>(head);
 
     bool valid_protocol;
     Endpoint before;
     std::tie(valid_protocol, before) = ExtractEndpoint(ip, l4, dir);
 
     if (!valid_protocol) {
-      DropPacket(ctx, pkt);
+      DropPacket(ctx, pkt, DropReason::kMalformed);
       continue;
     }
 
@@ -349,7 +366,7 @@ inline void NAT::DoProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 
     if (hash_item == nullptr) {
       if (dir != kForward || !(hash_item = CreateNewEntry(before, now))) {
-        DropPacket(ctx, pkt);
+        DropPacket(ctx, pkt, DropReason::kNoMatch);
         continue;
       }
     }
@@ -365,6 +382,8 @@ inline void NAT::DoProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 }
 
 void NAT::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   gate_idx_t incoming_gate = ctx->current_igate;
 
   if (incoming_gate == 0) {
@@ -176,6 +176,9 @@ class NAT final : public Module {
 
   HashTable map_;
   Random rng_;
+
+  // "parsed_headers" metadata attribute, or -1 to parse packets here
+  int hdrs_attr_id_ = -1;
 };
 
 #endif  // BESS_MODULES_NAT_H_
@@ -0,0 +1,96 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef BESS_MODULES_PARSE_HEADERS_H_
+#define BESS_MODULES_PARSE_HEADERS_H_
+
+#include "../module.h"
+#include "../pb/module_msg.pb.h"
+#include "../utils/parsed_headers.h"
+
+// Parses the Ethernet/VLAN/IPv4/L4 headers of each packet once and stores
+// their offsets as the "parsed_headers" metadata attribute, for downstream
+// modules that are configured to consume it.
+class ParseHeaders final : public Module {
+ public:
+  static constexpr const char *kAttrName = "parsed_headers";
+
+  ParseHeaders() : Module(), attr_id_(-1) {
+    max_allowed_workers_ = Worker::kMaxWorkers;
+  }
+
+  CommandResponse Init(const bess::pb::ParseHeadersArg &arg);
+
+  void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
+
+  // For consumers: registers 'm' as a reader of the attribute. Returns the
+  // attribute ID, or a negative error code.
+  static int AddReader(Module *m) {
+    return m->AddMetadataAttr(kAttrName, sizeof(bess::utils::ParsedHeaders),
+                              bess::metadata::Attribute::AccessMode::kRead);
+  }
+
+  // Returns the metadata offset of the attribute for 'm', which got 'attr_id'
+  // from AddReader(). An invalid offset if 'attr_id' is negative.
+  static bess::metadata::mt_offset_t ReaderOffset(const Module *m,
+                                                  int attr_id) {
+    return attr_id >= 0 ? m->attr_offset(attr_id)
+                        : bess::metadata::kMetadataOffsetNoRead;
+  }
+
+  // Returns the headers of 'pkt' at metadata 'offset', as parsed by an
+  // upstream ParseHeaders module, or nullptr if the consumer did not opt in.
+  // For consumers that have a cheaper way of their own to find the fields.
+  static const bess::utils::ParsedHeaders *Cached(
+      bess::metadata::mt_offset_t offset, const bess::Packet *pkt) {
+    if (bess::metadata::IsValidOffset(offset)) {
+      return _ptr_attr_with_offset<bess::utils::ParsedHeaders>(offset, pkt);
+    }
+    return nullptr;
+  }
+
+  // Same as Cached(), but if there are no parsed headers, parses them into
+  // 'buf' instead.
+  static const bess::utils::ParsedHeaders *Get(
+      bess::metadata::mt_offset_t offset, const bess::Packet *pkt,
+      bess::utils::ParsedHeaders *buf) {
+    const bess::utils::ParsedHeaders *hdrs = Cached(offset, pkt);
+    if (hdrs) {
+      return hdrs;
+    }
+    bess::utils::ParseHeaders(pkt->head_data(), pkt->head_len(), buf);
+    return buf;
+  }
+
+ private:
+  int attr_id_;
+};
+
+#endif  // BESS_MODULES_PARSE_HEADERS_H_
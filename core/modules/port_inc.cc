@@ -29,6 +29,9 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include "port_inc.h"
+
+#include <algorithm>
+
 #include "../utils/format.h"
 
 const Commands PortInc::cmds = {
@@ -124,7 +127,8 @@ struct task_result PortInc::RunTask(Context *ctx, bess::PacketBatch *batch,
 
   uint64_t received_bytes = 0;
 
-  const int burst = ACCESS_ONCE(burst_);
+  const int max_burst = ACCESS_ONCE(burst_);
+  const int burst = std::min<int>(max_burst, ctx->batch_limit);
   const int pkt_overhead = 24;
 
   batch->set_cnt(p->RecvPackets(qid, batch->pkts(), burst));
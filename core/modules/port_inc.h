@@ -56,6 +56,10 @@ class PortInc final : public Module {
 
   std::string GetDesc() const override;
 
+  int GetTaskWakeupFd(void *arg) const override {
+    return port_->GetRxQueueFd((queue_t)(uintptr_t)arg);
+  }
+
   CommandResponse CommandSetBurst(
       const bess::pb::PortIncCommandSetBurstArg &arg);
 
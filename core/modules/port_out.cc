@@ -130,7 +130,8 @@ void PortOut::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   }
 
   if (sent_pkts < batch->cnt()) {
-    bess::Packet::Free(batch->pkts() + sent_pkts, batch->cnt() - sent_pkts);
+    DropPackets(ctx, batch->pkts() + sent_pkts, batch->cnt() - sent_pkts,
+                DropReason::kTxFailed);
   }
 }
 
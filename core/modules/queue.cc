@@ -30,6 +30,7 @@
 
 #include "queue.h"
 
+#include <algorithm>
 #include <cstdlib>
 
 #include "../utils/format.h"
@@ -170,9 +171,12 @@ std::string Queue::GetDesc() const {
 }
 
 /* from upstream */
-void Queue::ProcessBatch(Context *, bess::PacketBatch *batch) {
+void Queue::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   int queued =
       llring_mp_enqueue_burst(queue_, (void **)batch->pkts(), batch->cnt());
+  if (queued && !head_tsc_) {
+    head_tsc_ = ctx->current_tsc;
+  }
   if (backpressure_ && llring_count(queue_) > high_water_) {
     SignalOverload();
   }
@@ -182,7 +186,7 @@ void Queue::ProcessBatch(Context *, bess::PacketBatch *batch) {
   if (queued < batch->cnt()) {
     int to_drop = batch->cnt() - queued;
     stats_.dropped += to_drop;
-    bess::Packet::Free(batch->pkts() + queued, to_drop);
+    DropPackets(ctx, batch->pkts() + queued, to_drop, DropReason::kQueueFull);
   }
 }
 
@@ -197,7 +201,8 @@ struct task_result Queue::RunTask(Context *ctx, bess::PacketBatch *batch,
     };
   }
 
-  const int burst = ACCESS_ONCE(burst_);
+  const int max_burst = ACCESS_ONCE(burst_);
+  const int burst = std::min<int>(max_burst, ctx->batch_limit);
   const int pkt_overhead = 24;
 
   uint64_t total_bytes = 0;
@@ -205,11 +210,13 @@ struct task_result Queue::RunTask(Context *ctx, bess::PacketBatch *batch,
   uint32_t cnt = llring_sc_dequeue_burst(queue_, (void **)batch->pkts(), burst);
 
   if (cnt == 0) {
+    head_tsc_ = 0;
     return {.block = true, .packets = 0, .bits = 0};
   }
 
   stats_.dequeued += cnt;
   batch->set_cnt(cnt);
+  UpdateHeadTsc(ctx->current_tsc);
 
   if (prefetch_) {
     for (uint32_t i = 0; i < cnt; i++) {
@@ -233,6 +240,18 @@ struct task_result Queue::RunTask(Context *ctx, bess::PacketBatch *batch,
           .bits = (total_bytes + cnt * pkt_overhead) * 8};
 }
 
+void Queue::UpdateHeadTsc(uint64_t now) {
+  if (llring_empty(queue_)) {
+    head_tsc_ = 0;
+    mark_enqueued_ = stats_.enqueued;
+    mark_tsc_ = now;
+  } else if (stats_.dequeued >= mark_enqueued_) {
+    head_tsc_ = std::max(head_tsc_, mark_tsc_);
+    mark_enqueued_ = stats_.enqueued;
+    mark_tsc_ = now;
+  }
+}
+
 CommandResponse Queue::CommandSetBurst(
     const bess::pb::QueueCommandSetBurstArg &arg) {
   uint64_t burst = arg.burst();
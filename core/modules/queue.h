@@ -48,7 +48,10 @@ class Queue : public Module {
         size_(),
         high_water_(),
         low_water_(),
-        stats_() {
+        stats_(),
+        head_tsc_(),
+        mark_enqueued_(),
+        mark_tsc_() {
     is_task_ = true;
     propagate_workers_ = false;
     max_allowed_workers_ = Worker::kMaxWorkers;
@@ -67,6 +70,11 @@ class Queue : public Module {
 
   std::string GetDesc() const override;
 
+  // The dequeuing side is self-contained unless it has to signal upstream.
+  bool IsTaskMigratable(void *) const override { return !backpressure_; }
+
+  uint64_t GetTaskHeadTsc(void *) const override { return head_tsc_; }
+
   CommandResponse CommandSetBurst(const bess::pb::QueueCommandSetBurstArg &arg);
   CommandResponse CommandSetSize(const bess::pb::QueueCommandSetSizeArg &arg);
   CommandResponse CommandGetStatus(
@@ -85,6 +93,9 @@ class Queue : public Module {
 
   CommandResponse SetSize(uint64_t size);
 
+  // Called by the consumer after dequeuing. See head_tsc_.
+  void UpdateHeadTsc(uint64_t now);
+
   struct llring *queue_;
   bool prefetch_;
 
@@ -109,6 +120,14 @@ class Queue : public Module {
     uint64_t dropped;
   } stats_;
 
+  // Estimated arrival time of the packet at the head of the queue (0 if
+  // empty). Packets are not timestamped, so once all packets that had been
+  // enqueued by the time of the last mark are gone, the head is known to have
+  // arrived after the mark, and a new mark is taken.
+  uint64_t head_tsc_;
+  uint64_t mark_enqueued_;
+  uint64_t mark_tsc_;
+
   bess::pb::QueueArg init_arg_;
 };
 
@@ -30,6 +30,8 @@
 
 #include "queue_inc.h"
 
+#include <algorithm>
+
 #include "../port.h"
 #include "../utils/format.h"
 
@@ -96,7 +98,8 @@ struct task_result QueueInc::RunTask(Context *ctx, bess::PacketBatch *batch,
 
   uint64_t received_bytes = 0;
 
-  const int burst = ACCESS_ONCE(burst_);
+  const int max_burst = ACCESS_ONCE(burst_);
+  const int burst = std::min<int>(max_burst, ctx->batch_limit);
   const int pkt_overhead = 24;
 
   batch->set_cnt(p->RecvPackets(qid, batch->pkts(), burst));
@@ -104,6 +107,12 @@ struct task_result QueueInc::RunTask(Context *ctx, bess::PacketBatch *batch,
   p->queue_stats[PACKET_DIR_INC][qid].requested_hist[burst]++;
   p->queue_stats[PACKET_DIR_INC][qid].actual_hist[cnt]++;
   p->queue_stats[PACKET_DIR_INC][qid].diff_hist[burst - cnt]++;
+  if (cnt < static_cast<uint32_t>(burst)) {
+    head_tsc_ = 0;
+    last_short_tsc_ = ctx->current_tsc;
+  } else {
+    head_tsc_ = last_short_tsc_;
+  }
   if (cnt == 0) {
     return {.block = true, .packets = 0, .bits = 0};
   }
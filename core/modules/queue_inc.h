@@ -41,7 +41,14 @@ class QueueInc final : public Module {
 
   static const Commands cmds;
 
-  QueueInc() : Module(), port_(), qid_(), prefetch_(), burst_() {}
+  QueueInc()
+      : Module(),
+        port_(),
+        qid_(),
+        prefetch_(),
+        burst_(),
+        head_tsc_(),
+        last_short_tsc_() {}
 
   CommandResponse Init(const bess::pb::QueueIncArg &arg);
   void DeInit() override;
@@ -51,6 +58,15 @@ class QueueInc final : public Module {
 
   std::string GetDesc() const override;
 
+  int GetTaskWakeupFd(void *arg) const override {
+    return port_->GetRxQueueFd((queue_t)(uintptr_t)arg);
+  }
+
+  // Each queue is polled by a single task, so any worker can run it.
+  bool IsTaskMigratable(void *) const override { return true; }
+
+  uint64_t GetTaskHeadTsc(void *) const override { return head_tsc_; }
+
   CommandResponse CommandSetBurst(
       const bess::pb::QueueIncCommandSetBurstArg &arg);
 
@@ -59,6 +75,11 @@ class QueueInc final : public Module {
   queue_t qid_;
   int prefetch_;
   int burst_;
+
+  // The RX queue has no timestamps, but if the last poll filled the whole
+  // burst, the pending packets arrived after the last poll that did not.
+  uint64_t head_tsc_;
+  uint64_t last_short_tsc_;
 };
 
 #endif  // BESS_MODULES_QUEUEINC_H_
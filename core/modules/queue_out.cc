@@ -73,7 +73,7 @@ std::string QueueOut::GetDesc() const {
                              port_->port_builder()->class_name().c_str());
 }
 
-void QueueOut::ProcessBatch(Context *, bess::PacketBatch *batch) {
+void QueueOut::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   Port *p = port_;
 
   const queue_t qid = qid_;
@@ -98,7 +98,8 @@ void QueueOut::ProcessBatch(Context *, bess::PacketBatch *batch) {
   }
 
   if (sent_pkts < batch->cnt()) {
-    bess::Packet::Free(batch->pkts() + sent_pkts, batch->cnt() - sent_pkts);
+    DropPackets(ctx, batch->pkts() + sent_pkts, batch->cnt() - sent_pkts,
+                DropReason::kTxFailed);
   }
 }
 
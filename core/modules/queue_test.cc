@@ -0,0 +1,138 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "queue.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../module_graph.h"
+
+namespace {
+
+// Passes packets on to ogate 0.
+class TestForward final : public Module {
+ public:
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override {
+    RunNextModule(ctx, batch);
+  }
+};
+
+DEF_MODULE(TestForward, "test_forward", "forwards packets");
+
+class TestHook final : public bess::GateHook {
+ public:
+  explicit TestHook(const std::string &name)
+      : bess::GateHook("TestHook", name) {}
+};
+
+template <typename T, typename Arg>
+T *CreateModule(const std::string &class_name, const std::string &name,
+                const Arg &arg_) {
+  const ModuleBuilder &builder =
+      ModuleBuilder::all_module_builders().find(class_name)->second;
+
+  google::protobuf::Any arg;
+  arg.PackFrom(arg_);
+
+  pb_error_t perr;
+  Module *m = ModuleGraph::CreateModule(builder, name, arg, &perr);
+  EXPECT_NE(nullptr, m) << perr.errmsg();
+  return static_cast<T *>(m);
+}
+
+// a -> b, with a hook on either side of the link
+class ApplyPartitionTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() override {
+    bess::pb::EmptyArg empty;
+
+    a_ = CreateModule<TestForward>("TestForward", "a", empty);
+    b_ = CreateModule<TestForward>("TestForward", "b", empty);
+    ASSERT_EQ(0, ModuleGraph::ConnectModules(a_, 0, b_, 0, true));
+
+    ohook_ = new TestHook("out");
+    ihook_ = new TestHook("in");
+    a_->ogates()[0]->AddHooks({ohook_});
+    b_->igates()[0]->AddHooks({ihook_});
+  }
+
+  virtual void TearDown() override { ModuleGraph::DestroyAllModules(); }
+
+  TestForward_class TestForward_singleton_;
+
+  TestForward *a_;
+  TestForward *b_;
+  TestHook *ohook_;
+  TestHook *ihook_;
+};
+
+// Hooks of a cut link stay on the same gates of the same modules.
+TEST_F(ApplyPartitionTest, KeepsHooks) {
+  std::vector<std::string> queues;
+  ASSERT_EQ(0, ModuleGraph::ApplyPartition({{a_, 0, Worker::kAnyWorker}},
+                                           &queues));
+  ASSERT_EQ(1, queues.size());
+
+  Module *queue = ModuleGraph::GetAllModules().find(queues[0])->second;
+  bess::OGate *ogate = a_->ogates()[0];
+  ASSERT_EQ(queue, ogate->next());
+  EXPECT_EQ(b_, queue->ogates()[0]->next());
+
+  ASSERT_EQ(1, ogate->hooks().size());
+  EXPECT_EQ(ohook_, ogate->hooks()[0]);
+  EXPECT_EQ(ogate, ohook_->gate());
+
+  bess::IGate *igate = b_->igates()[0];
+  ASSERT_EQ(1, igate->hooks().size());
+  EXPECT_EQ(ihook_, igate->hooks()[0]);
+  EXPECT_EQ(igate, ihook_->gate());
+
+  // The new link gets the default hooks.
+  EXPECT_NE(nullptr, queue->ogates()[0]->FindHookByClass("Track"));
+}
+
+// Nothing changes if any of the cuts is invalid.
+TEST_F(ApplyPartitionTest, InvalidCut) {
+  std::vector<std::string> queues;
+  EXPECT_EQ(-EINVAL,
+            ModuleGraph::ApplyPartition({{a_, 0, Worker::kAnyWorker},
+                                         {b_, 0, Worker::kAnyWorker}},
+                                        &queues));
+  EXPECT_TRUE(queues.empty());
+  EXPECT_EQ(b_, a_->ogates()[0]->next());
+  EXPECT_EQ(ohook_, a_->ogates()[0]->FindHook("out"));
+  EXPECT_EQ(ihook_, b_->igates()[0]->FindHook("in"));
+}
+
+}  // namespace
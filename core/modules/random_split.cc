@@ -101,7 +101,7 @@ CommandResponse RandomSplit::CommandSetGates(
 
 void RandomSplit::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   if (ngates_ <= 0) {
-    bess::Packet::Free(batch);
+    DropPackets(ctx, batch->pkts(), batch->cnt(), DropReason::kNoOGate);
     return;
   }
 
@@ -111,7 +111,7 @@ void RandomSplit::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     if (rng_.GetReal() > drop_rate_) {
       EmitPacket(ctx, pkt, gates_[rng_.GetRange(ngates_)]);
     } else {
-      DropPacket(ctx, pkt);
+      DropPacket(ctx, pkt, DropReason::kPolicy);
     }
   }
 }
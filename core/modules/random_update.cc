@@ -114,6 +114,8 @@ CommandResponse RandomUpdate::CommandClear(const bess::pb::EmptyArg &) {
 }
 
 void RandomUpdate::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   int cnt = batch->cnt();
 
   for (size_t i = 0; i < num_vars_; i++) {
@@ -66,17 +66,36 @@ CommandResponse Replicate::CommandSetGates(
 
 void Replicate::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   int cnt = batch->cnt();
+  if (ngates_ <= 1) {
+    for (int i = 0; i < cnt; i++) {
+      EmitPacket(ctx, batch->pkts()[i], 0);
+    }
+    return;
+  }
+
+  // Every replica is a clone sharing the data of the original packet, which
+  // is freed right away so that none of the replicas are left to modify
+  // a buffer that others still see. Modules unshare() them before writing.
   for (int i = 0; i < cnt; i++) {
-    bess::Packet *tocopy = batch->pkts()[i];
+    bess::Packet *orig = batch->pkts()[i];
     for (int j = 1; j < ngates_; j++) {
-      bess::Packet *newpkt = bess::Packet::copy(tocopy);
+      bess::Packet *newpkt = bess::Packet::clone(orig);
       if (newpkt) {
         EmitPacket(ctx, newpkt, gates_[j]);
+      } else {
+        CountAllocFailures(ctx, 1);
       }
     }
-    EmitPacket(ctx, tocopy, 0);
+
+    bess::Packet *newpkt = bess::Packet::clone(orig);
+    if (newpkt) {
+      EmitPacket(ctx, newpkt, 0);
+    } else {
+      CountAllocFailures(ctx, 1);
+    }
+    bess::Packet::Free(orig);
   }
 }
 
 ADD_MODULE(Replicate, "repl",
-           "makes a copy of a packet and sends it out over n gates")
+           "makes zero-copy clones of a packet and sends them out over n gates")
@@ -0,0 +1,208 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "replicate.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../module_graph.h"
+#include "../packet_pool.h"
+#include "../task.h"
+
+namespace {
+
+const uint16_t kLen = 60;
+
+// Sends the packets in 'pkts' once.
+class TestSource final : public Module {
+ public:
+  static const gate_idx_t kNumIGates = 0;
+
+  TestSource() : Module() { is_task_ = true; }
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
+                             void *) override {
+    uint32_t cnt = pkts.size();
+    batch->clear();
+    for (bess::Packet *pkt : pkts) {
+      batch->add(pkt);
+    }
+    pkts.clear();
+    RunNextModule(ctx, batch);
+    return {.block = false, .packets = cnt, .bits = cnt * kLen * 8};
+  }
+
+  std::vector<bess::Packet *> pkts;
+};
+
+// Keeps the packets it receives, after overwriting their first byte with
+// 'mark' (if nonzero), as a module that modifies packets would.
+class TestSink final : public Module {
+ public:
+  static const gate_idx_t kNumOGates = 0;
+
+  TestSink() : Module(), mark() {}
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *, bess::PacketBatch *batch) override {
+    if (mark) {
+      bess::Packet::Unshare(batch);
+    }
+    for (int i = 0; i < batch->cnt(); i++) {
+      bess::Packet *pkt = batch->pkts()[i];
+      if (mark) {
+        pkt->head_data<char *>()[0] = mark;
+      }
+      pkts.push_back(pkt);
+    }
+  }
+
+  char mark;
+  std::vector<bess::Packet *> pkts;
+};
+
+DEF_MODULE(TestSource, "test_source", "sends given packets");
+DEF_MODULE(TestSink, "test_sink", "keeps packets");
+
+template <typename T, typename Arg>
+T *CreateModule(const std::string &class_name, const std::string &name,
+                const Arg &arg_) {
+  const ModuleBuilder &builder =
+      ModuleBuilder::all_module_builders().find(class_name)->second;
+
+  google::protobuf::Any arg;
+  arg.PackFrom(arg_);
+
+  pb_error_t perr;
+  Module *m = ModuleGraph::CreateModule(builder, name, arg, &perr);
+  EXPECT_NE(nullptr, m) << perr.errmsg();
+  return static_cast<T *>(m);
+}
+
+// src -> repl -> sink0 (reader), sink1 (writer), sink2 (writer)
+class ReplicateTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() override {
+    pool_.reset(new bess::PlainPacketPool(1024));
+    size_ = pool_->Size();
+
+    bess::pb::EmptyArg empty;
+    bess::pb::ReplicateArg arg;
+    arg.add_gates(0);
+    arg.add_gates(1);
+    arg.add_gates(2);
+
+    src_ = CreateModule<TestSource>("TestSource", "src", empty);
+    Module *repl = CreateModule<Replicate>("Replicate", "repl", arg);
+    ASSERT_EQ(0, ModuleGraph::ConnectModules(src_, 0, repl, 0, true));
+    for (int i = 0; i < 3; i++) {
+      sinks_[i] =
+          CreateModule<TestSink>("TestSink", "sink" + std::to_string(i), empty);
+      ASSERT_EQ(0, ModuleGraph::ConnectModules(repl, i, sinks_[i], 0, true));
+    }
+    sinks_[1]->mark = 'b';
+    sinks_[2]->mark = 'c';
+
+    ModuleGraph::UpdateTaskGraph();
+    task_.reset(new Task(src_, nullptr));
+    task_->UpdatePerGateBatch(8);
+  }
+
+  virtual void TearDown() override {
+    task_.reset();
+    for (TestSink *sink : sinks_) {
+      for (bess::Packet *pkt : sink->pkts) {
+        bess::Packet::Free(pkt);
+      }
+    }
+    ModuleGraph::DestroyAllModules();
+    EXPECT_EQ(size_, pool_->Size());
+  }
+
+  void Run() {
+    Context ctx = {};
+    ctx.task = task_.get();
+    (*task_)(&ctx);
+  }
+
+  TestSource_class TestSource_singleton_;
+  TestSink_class TestSink_singleton_;
+
+  std::unique_ptr<bess::PacketPool> pool_;
+  size_t size_;  // available packets of an untouched pool
+  TestSource *src_;
+  TestSink *sinks_[3];
+  std::unique_ptr<Task> task_;
+};
+
+// Each replica sees its own data, whatever the others do with theirs.
+TEST_F(ReplicateTest, Independent) {
+  bess::Packet *pkt = pool_->Alloc(kLen);
+  ASSERT_NE(nullptr, pkt);
+  memset(pkt->head_data(), 'a', kLen);
+  src_->pkts.push_back(pkt);
+
+  Run();
+
+  std::vector<bess::Packet *> replicas;
+  for (TestSink *sink : sinks_) {
+    ASSERT_EQ(1, sink->pkts.size());
+    replicas.push_back(sink->pkts[0]);
+  }
+
+  // The reader still shares the buffer of the original, which Replicate has
+  // freed; the writers have their own copies.
+  EXPECT_TRUE(replicas[0]->is_clone());
+  EXPECT_FALSE(replicas[1]->is_clone());
+  EXPECT_FALSE(replicas[2]->is_clone());
+  EXPECT_NE(replicas[0]->head_data(), replicas[1]->head_data());
+  EXPECT_NE(replicas[1]->head_data(), replicas[2]->head_data());
+
+  const char expected[] = {'a', 'b', 'c'};
+  for (int i = 0; i < 3; i++) {
+    const char *data = replicas[i]->head_data<const char *>();
+    EXPECT_EQ(kLen, replicas[i]->total_len());
+    EXPECT_EQ(expected[i], data[0]);
+    for (int j = 1; j < kLen; j++) {
+      ASSERT_EQ('a', data[j]) << "replica " << i << " byte " << j;
+    }
+  }
+
+  // The original and the three replicas
+  EXPECT_EQ(size_ - 4, pool_->Size());
+}
+
+}  // namespace
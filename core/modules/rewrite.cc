@@ -75,7 +75,10 @@ CommandResponse Rewrite::CommandAdd(const bess::pb::RewriteArg &arg) {
     size_t j = i % num_templates_;
     bess::utils::Copy(templates_[i], templates_[j], template_size_[j]);
     template_size_[i] = template_size_[j];
-    jump_[i] = j;
+  }
+
+  for (size_t i = 0; i <= kNumSlots; i++) {
+    jump_[i] = i % num_templates_;
   }
 
   return CommandSuccess();
@@ -108,6 +111,9 @@ inline void Rewrite::DoRewrite(bess::PacketBatch *batch) {
   size_t start = next_turn_;
   const size_t cnt = batch->cnt();
 
+  DCHECK_LT(start, num_templates_);
+  DCHECK_LE(start + cnt, kNumSlots);
+
   for (size_t i = 0; i < cnt; i++) {
     uint16_t size = template_size_[start + i];
     bess::Packet *pkt = batch->pkts()[i];
@@ -124,6 +130,8 @@ inline void Rewrite::DoRewrite(bess::PacketBatch *batch) {
 }
 
 void Rewrite::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   if (num_templates_ == 1) {
     DoRewriteSingle(batch);
   } else if (num_templates_ > 1) {
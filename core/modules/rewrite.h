@@ -36,6 +36,8 @@
 
 class Rewrite final : public Module {
  public:
+  // DoRewrite() reads up to kMaxBurst - 1 slots past the last template, so
+  // the templates are unrolled to cover a full batch from any starting turn.
   static const size_t kNumSlots = bess::PacketBatch::kMaxBurst * 2 - 1;
   static const size_t kMaxTemplateSize = 1536;
 
@@ -63,11 +65,19 @@ class Rewrite final : public Module {
 
   // For fair round robin we remember the next index in [0, num_templates_).
   size_t next_turn_;
-  size_t jump_[kNumSlots];  // precalculated "index % num_templates_"
+  // precalculated "index % num_templates_", for the next turn after a batch
+  // that ended at "index" (up to and including kNumSlots).
+  size_t jump_[kNumSlots + 1];
 
   size_t num_templates_;
   uint16_t template_size_[kNumSlots];
   unsigned char templates_[kNumSlots][kMaxTemplateSize];
 };
 
+// Templates are copied in whole 32-byte blocks into the data area of packets.
+static_assert(Rewrite::kMaxTemplateSize % 32 == 0,
+              "Rewrite template slots must be a multiple of the copy block");
+static_assert(Rewrite::kMaxTemplateSize <= SNBUF_DATA,
+              "Rewrite templates must fit in a packet buffer");
+
 #endif  // BESS_MODULES_REWRITE_H_
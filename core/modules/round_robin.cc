@@ -100,7 +100,7 @@ CommandResponse RoundRobin::CommandSetGates(
 
 void RoundRobin::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   if (ngates_ <= 0) {
-    bess::Packet::Free(batch);
+    DropPackets(ctx, batch->pkts(), batch->cnt(), DropReason::kNoOGate);
     return;
   }
 
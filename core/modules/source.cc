@@ -30,6 +30,8 @@
 
 #include "source.h"
 
+#include <algorithm>
+
 const Commands Source::cmds = {
     {"set_pkt_size", "SourceCommandSetPktSizeArg",
      MODULE_CMD_FUNC(&Source::CommandSetPktSize), Command::THREAD_SAFE},
@@ -88,7 +90,8 @@ struct task_result Source::RunTask(Context *ctx, bess::PacketBatch *batch,
 
   const int pkt_overhead = 24;
   const int pkt_size = ACCESS_ONCE(pkt_size_);
-  const uint32_t burst = ACCESS_ONCE(burst_);
+  const uint32_t max_burst = ACCESS_ONCE(burst_);
+  const uint32_t burst = std::min(max_burst, ctx->batch_limit);
 
   if (current_worker.packet_pool()->AllocBulk(batch->pkts(), burst, pkt_size)) {
     batch->set_cnt(burst);
@@ -98,6 +101,7 @@ struct task_result Source::RunTask(Context *ctx, bess::PacketBatch *batch,
             .bits = (pkt_size + pkt_overhead) * burst * 8};
   }
 
+  CountAllocFailures(ctx, burst);
   return {.block = true, .packets = 0, .bits = 0};
 }
 
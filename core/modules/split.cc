@@ -64,6 +64,7 @@ CommandResponse Split::Init(const bess::pb::SplitArg &arg) {
 void Split::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   using bess::utils::be64_t;
 
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
   int cnt = batch->cnt();
 
   if (attr_id_ >= 0) {
@@ -71,17 +72,17 @@ void Split::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     for (int i = 0; i < cnt; i++) {
       bess::Packet *pkt = batch->pkts()[i];
       uint64_t val = get_attr_with_offset<be64_t>(offset, pkt).value();
-      val = (val >> shift_) & mask_;
-      EmitPacket(ctx, pkt, val);
+      ogates[i] = (val >> shift_) & mask_;
     }
   } else {
     for (int i = 0; i < cnt; i++) {
       bess::Packet *pkt = batch->pkts()[i];
       uint64_t val = (pkt->head_data<be64_t *>(offset_))->value();
-      val = (val >> shift_) & mask_;
-      EmitPacket(ctx, pkt, val);
+      ogates[i] = (val >> shift_) & mask_;
     }
   }
+
+  EmitBatch(ctx, batch, ogates);
 }
 
 ADD_MODULE(Split, "split",
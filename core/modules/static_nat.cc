@@ -177,6 +177,8 @@ inline void StaticNAT::DoProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 }
 
 void StaticNAT::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   gate_idx_t incoming_gate = ctx->current_igate;
 
   if (incoming_gate == 0) {
@@ -76,6 +76,10 @@ CommandResponse Timestamp::Init(const bess::pb::TimestampArg &arg) {
 }
 
 void Timestamp::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  if (attr_id_ == -1) {
+    bess::Packet::Unshare(batch);
+  }
+
   // We don't use ctx->current_ns here for better accuracy
   uint64_t now_ns = tsc_to_ns(rdtsc());
   size_t offset = offset_;
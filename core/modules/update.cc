@@ -44,6 +44,8 @@ CommandResponse Update::Init(const bess::pb::UpdateArg &arg) {
 }
 
 void Update::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   int cnt = batch->cnt();
 
   for (size_t i = 0; i < num_fields_; i++) {
@@ -38,6 +38,8 @@ using bess::utils::Ethernet;
 using bess::utils::Ipv4;
 
 void UpdateTTL::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
@@ -53,7 +55,7 @@ void UpdateTTL::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
       ip->ttl -= 1;
       EmitPacket(ctx, pkt);
     } else {
-      DropPacket(ctx, pkt);
+      DropPacket(ctx, pkt, DropReason::kTtlExpired);
     }
   }
 }
@@ -37,9 +37,11 @@
 #include "../utils/format.h"
 #include "../utils/http_parser.h"
 #include "../utils/ip.h"
+#include "parse_headers.h"
 
 using bess::utils::Ethernet;
 using bess::utils::Ipv4;
+using bess::utils::ParsedHeaders;
 using bess::utils::Tcp;
 using bess::utils::be16_t;
 
@@ -177,6 +179,15 @@ CommandResponse UrlFilter::Init(const bess::pb::UrlFilterArg &arg) {
   for (const auto &url : arg.blacklist()) {
     blacklist_[url.host()].Insert(url.path(), {});
   }
+
+  // Also called by add(), after the attribute has been registered
+  if (arg.parsed_headers() && hdrs_attr_id_ < 0) {
+    hdrs_attr_id_ = ParseHeaders::AddReader(this);
+    if (hdrs_attr_id_ < 0) {
+      return CommandFailure(-hdrs_attr_id_,
+                            "Failed to register metadata attribute");
+    }
+  }
   return CommandSuccess();
 }
 
@@ -194,8 +205,9 @@ CommandResponse UrlFilter::CommandClear(const bess::pb::EmptyArg &) {
 // such a way that SetRuntimeConfig would build the same one.
 CommandResponse UrlFilter::GetInitialArg(const bess::pb::EmptyArg &) {
   bess::pb::UrlFilterArg resp;
-  // Our return value is empty since we return
+  // Our return value has no blacklist since we return
   // the current blacklist as the runtime config.
+  resp.set_parsed_headers(hdrs_attr_id_ >= 0);
   return CommandSuccess(resp);
 }
 
@@ -242,22 +254,25 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     return;
   }
 
+  bess::metadata::mt_offset_t hdrs_offset =
+      ParseHeaders::ReaderOffset(this, hdrs_attr_id_);
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
     bess::Packet *pkt = batch->pkts()[i];
 
-    Ethernet *eth = pkt->head_data<Ethernet *>();
-    Ipv4 *ip = reinterpret_cast<Ipv4 *>(eth + 1);
+    ParsedHeaders buf;
+    const ParsedHeaders *hdrs = ParseHeaders::Get(hdrs_offset, pkt, &buf);
 
-    if (ip->protocol != Ipv4::Proto::kTcp) {
+    if (!hdrs->has(ParsedHeaders::kL4) ||
+        hdrs->ip_proto != Ipv4::Proto::kTcp) {
       EmitPacket(ctx, pkt, 0);
       continue;
     }
 
-    int ip_bytes = ip->header_length << 2;
-    Tcp *tcp =
-        reinterpret_cast<Tcp *>(reinterpret_cast<uint8_t *>(ip) + ip_bytes);
+    Ethernet *eth = pkt->head_data<Ethernet *>();
+    Ipv4 *ip = hdrs->l3<Ipv4>(eth);
+    Tcp *tcp = hdrs->l4<Tcp>(eth);
 
     Flow flow;
     flow.src_ip = ip->src;
@@ -280,7 +295,7 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
         // Once we're finished analyzing, we only record *blocked* flows.
         // Continue blocking this flow for TIME_OUT_NS more ns.
         it->second.SetExpiryTime(now + TIME_OUT_NS);
-        DropPacket(ctx, pkt);
+        DropPacket(ctx, pkt, DropReason::kPolicy);
         continue;
       }
     }
@@ -306,7 +321,7 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     // as a flow to pass.  Note: we only get failure if there is
     // something seriously wrong; we get success if there are holes
     // in the data (in which case the contiguous_len() below is short).
-    bool success = buffer.InsertPacket(pkt);
+    bool success = buffer.InsertPacket(pkt, hdrs->l3_offset);
     if (!success) {
       VLOG(1) << "Reconstruction failure";
       flow_cache_.erase(it);
@@ -380,7 +395,7 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
                  1);
 
       // Drop the data packet
-      DropPacket(ctx, pkt);
+      DropPacket(ctx, pkt, DropReason::kPolicy);
     }
   }
 }
@@ -132,6 +132,9 @@ class UrlFilter final : public Module {
  private:
   std::unordered_map<std::string, Trie<std::tuple<>>> blacklist_;
   std::unordered_map<Flow, FlowRecord, FlowHash> flow_cache_;
+
+  // "parsed_headers" metadata attribute, or -1 to parse packets here
+  int hdrs_attr_id_ = -1;
 };
 
 #endif  // BESS_MODULES_URL_FILTER_H_
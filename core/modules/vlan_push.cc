@@ -58,6 +58,8 @@ CommandResponse VLANPush::CommandSetTci(const bess::pb::VLANPushArg &arg) {
 
 // the behavior is undefined if a packet is already double tagged
 void VLANPush::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  bess::Packet::Unshare(batch);
+
   int cnt = batch->cnt();
 
   be32_t vlan_tag = vlan_tag_;
@@ -160,6 +160,7 @@ void WildcardMatch::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   gate_idx_t default_gate;
 
   wm_hkey_t keys[bess::PacketBatch::kMaxBurst] __ymm_aligned;
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
 
   int cnt = batch->cnt();
 
@@ -197,9 +198,10 @@ void WildcardMatch::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   }
 
   for (int i = 0; i < cnt; i++) {
-    bess::Packet *pkt = batch->pkts()[i];
-    EmitPacket(ctx, pkt, LookupEntry(keys[i], default_gate));
+    ogates[i] = LookupEntry(keys[i], default_gate);
   }
+
+  EmitBatch(ctx, batch, ogates);
 }
 
 std::string WildcardMatch::GetDesc() const {
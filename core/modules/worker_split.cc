@@ -63,11 +63,12 @@ CommandResponse WorkerSplit::CommandReset(const bess::pb::WorkerSplitArg &arg) {
 }
 
 void WorkerSplit::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
-  int gate = gates_[ctx->wid];
+  // Stolen runs go where they would have if the owner ran them
+  int gate = gates_[ctx->owner_wid];
   if (gate >= 0) {
     RunChooseModule(ctx, gate, batch);
   } else {
-    bess::Packet::Free(batch);
+    DropPackets(ctx, batch->pkts(), batch->cnt(), DropReason::kNoOGate);
   }
 }
 
@@ -85,5 +86,26 @@ void WorkerSplit::AddActiveWorker(int wid, const Task *t) {
   }
 }
 
+void WorkerSplit::AddStealingWorker(
+    int wid, int owner_wid, const Task *t,
+    std::unordered_set<const Module *> *visited) {
+  if (!visited->insert(this).second) {
+    return;
+  }
+
+  if (!active_workers_[wid]) {
+    active_workers_[wid] = true;
+    stealing_workers_[wid] = true;
+  }
+
+  // Stolen runs are split by the worker that owns the task.
+  int g = gates_[owner_wid];
+  bess::OGate *ogate = (g < 0) ? nullptr : ogates()[g];
+  if (ogate) {
+    auto next = static_cast<Module *>(ogate->next());
+    next->AddStealingWorker(wid, owner_wid, t, visited);
+  }
+}
+
 ADD_MODULE(WorkerSplit, "ws",
            "send packets to output gate X, the id of current worker")
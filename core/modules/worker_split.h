@@ -49,6 +49,9 @@ class WorkerSplit final : public Module {
 
   void AddActiveWorker(int wid, const Task *task) override;
 
+  void AddStealingWorker(int wid, int owner_wid, const Task *task,
+                         std::unordered_set<const Module *> *visited) override;
+
  private:
   int gates_[Worker::kMaxWorkers];
 };
@@ -0,0 +1,188 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "worker_split.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../module_graph.h"
+#include "../packet_pool.h"
+#include "../task.h"
+
+namespace {
+
+const uint16_t kLen = 60;
+
+// Sends the packets in 'pkts' once.
+class TestSource final : public Module {
+ public:
+  static const gate_idx_t kNumIGates = 0;
+
+  TestSource() : Module() {
+    is_task_ = true;
+    max_allowed_workers_ = Worker::kMaxWorkers;
+  }
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
+                             void *) override {
+    uint32_t cnt = pkts.size();
+    batch->clear();
+    for (bess::Packet *pkt : pkts) {
+      batch->add(pkt);
+    }
+    pkts.clear();
+    RunNextModule(ctx, batch);
+    return {.block = false, .packets = cnt, .bits = cnt * kLen * 8};
+  }
+
+  std::vector<bess::Packet *> pkts;
+};
+
+// Keeps the packets it receives.
+class TestSink final : public Module {
+ public:
+  static const gate_idx_t kNumOGates = 0;
+
+  TestSink() : Module() { max_allowed_workers_ = Worker::kMaxWorkers; }
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *, bess::PacketBatch *batch) override {
+    for (int i = 0; i < batch->cnt(); i++) {
+      pkts.push_back(batch->pkts()[i]);
+    }
+  }
+
+  std::vector<bess::Packet *> pkts;
+};
+
+DEF_MODULE(TestSource, "test_source", "sends given packets");
+DEF_MODULE(TestSink, "test_sink", "keeps packets");
+
+template <typename T, typename Arg>
+T *CreateModule(const std::string &class_name, const std::string &name,
+                const Arg &arg_) {
+  const ModuleBuilder &builder =
+      ModuleBuilder::all_module_builders().find(class_name)->second;
+
+  google::protobuf::Any arg;
+  arg.PackFrom(arg_);
+
+  pb_error_t perr;
+  Module *m = ModuleGraph::CreateModule(builder, name, arg, &perr);
+  EXPECT_NE(nullptr, m) << perr.errmsg();
+  return static_cast<T *>(m);
+}
+
+// src -> ws -> sink0 (worker 0), sink1 (worker 1)
+class WorkerSplitTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() override {
+    pool_.reset(new bess::PlainPacketPool(1024));
+
+    bess::pb::EmptyArg empty;
+    bess::pb::WorkerSplitArg arg;
+
+    src_ = CreateModule<TestSource>("TestSource", "src", empty);
+    ws_ = CreateModule<WorkerSplit>("WorkerSplit", "ws", arg);
+    ASSERT_EQ(0, ModuleGraph::ConnectModules(src_, 0, ws_, 0, true));
+    for (int i = 0; i < 2; i++) {
+      sinks_[i] =
+          CreateModule<TestSink>("TestSink", "sink" + std::to_string(i), empty);
+      ASSERT_EQ(0, ModuleGraph::ConnectModules(ws_, i, sinks_[i], 0, true));
+    }
+
+    ModuleGraph::UpdateTaskGraph();
+    task_.reset(new Task(src_, nullptr));
+    task_->UpdatePerGateBatch(8);
+  }
+
+  virtual void TearDown() override {
+    task_.reset();
+    for (TestSink *sink : sinks_) {
+      bess::Packet::Free(sink->pkts.data(), sink->pkts.size());
+    }
+    ModuleGraph::DestroyAllModules();
+  }
+
+  void Run(int wid, int owner_wid) {
+    bess::Packet *pkt = pool_->Alloc(kLen);
+    ASSERT_NE(nullptr, pkt);
+    src_->pkts.push_back(pkt);
+
+    Context ctx = {};
+    ctx.wid = wid;
+    ctx.owner_wid = owner_wid;
+    ctx.task = task_.get();
+    (*task_)(&ctx);
+  }
+
+  TestSource_class TestSource_singleton_;
+  TestSink_class TestSink_singleton_;
+
+  std::unique_ptr<bess::PacketPool> pool_;
+  TestSource *src_;
+  WorkerSplit *ws_;
+  TestSink *sinks_[2];
+  std::unique_ptr<Task> task_;
+};
+
+TEST_F(WorkerSplitTest, SplitByWorker) {
+  Run(0, 0);
+  Run(1, 1);
+  EXPECT_EQ(1, sinks_[0]->pkts.size());
+  EXPECT_EQ(1, sinks_[1]->pkts.size());
+}
+
+// Runs of worker 0's task stolen by worker 1 take the gate of worker 0, and
+// so does the stealing worker when it is propagated downstream.
+TEST_F(WorkerSplitTest, Stolen) {
+  Run(1, 0);
+  EXPECT_EQ(1, sinks_[0]->pkts.size());
+  EXPECT_EQ(0, sinks_[1]->pkts.size());
+
+  for (Module *m : std::vector<Module *>{src_, ws_, sinks_[0], sinks_[1]}) {
+    m->ResetActiveWorkerSet();
+  }
+  task_->AddActiveWorker(0);
+  task_->AddStealingWorker(1, 0);
+
+  EXPECT_TRUE(ws_->is_stealing_worker(1));
+  EXPECT_TRUE(sinks_[0]->active_workers()[0]);
+  EXPECT_TRUE(sinks_[0]->is_stealing_worker(1));
+  EXPECT_FALSE(sinks_[1]->active_workers()[0]);
+  EXPECT_FALSE(sinks_[1]->active_workers()[1]);
+}
+
+}  // namespace
@@ -34,6 +34,7 @@
 #include <cstdint>
 
 #include "bessd.h"
+#include "packet_pool.h"
 #include "worker.h"
 
 // Port this BESS instance listens on.
@@ -129,3 +130,32 @@ DEFINE_int32(buffers, 262144,
              " must be a power of 2.");
 static const bool _buffers_dummy[[maybe_unused]] =
     google::RegisterFlagValidator(&FLAGS_buffers, &ValidateBuffersPerSocket);
+
+static bool ValidateMaxBuffersPerSocket(const char *, int32_t value) {
+  if (value < 0) {
+    LOG(ERROR) << "Invalid number of buffers: " << value;
+    return false;
+  }
+  return true;
+}
+DEFINE_int32(buffers_max, 0,
+             "Specifies how many packet buffers per socket the packet pools"
+             " may grow to when running low. 0 (or no more than --buffers)"
+             " disables growth.");
+static const bool _buffers_max_dummy[[maybe_unused]] =
+    google::RegisterFlagValidator(&FLAGS_buffers_max,
+                                  &ValidateMaxBuffersPerSocket);
+
+static bool ValidateWorkerCacheSize(const char *, int32_t value) {
+  if (value < 0 ||
+      value > static_cast<int32_t>(bess::PacketPool::kMaxWorkerCacheSize)) {
+    LOG(ERROR) << "Invalid packet cache size: " << value;
+    return false;
+  }
+  return true;
+}
+DEFINE_int32(pkt_cache, 256,
+             "Specifies how many packet buffers each worker caches per socket,"
+             " in front of the packet pool. 0 disables the cache.");
+static const bool _pkt_cache_dummy[[maybe_unused]] =
+    google::RegisterFlagValidator(&FLAGS_pkt_cache, &ValidateWorkerCacheSize);
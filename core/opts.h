@@ -49,6 +49,8 @@ DECLARE_string(modules);
 DECLARE_bool(core_dump);
 DECLARE_bool(no_crashlog);
 DECLARE_int32(buffers);
+DECLARE_int32(buffers_max);
+DECLARE_int32(pkt_cache);
 DECLARE_bool(dpdk);
 DECLARE_string(iova);
 
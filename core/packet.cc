@@ -42,6 +42,7 @@
 
 #include "dpdk.h"
 #include "opts.h"
+#include "packet_pool.h"
 #include "utils/common.h"
 
 namespace bess {
@@ -62,6 +63,40 @@ Packet *Packet::copy(const Packet *src) {
   return dst;
 }
 
+Packet *Packet::clone(Packet *src) {
+  DCHECK(src->is_linear());
+
+  Packet *dst = PacketPool::FromMempool(src->pool_)->Alloc();
+  if (!dst) {
+    return nullptr;  // FAIL.
+  }
+
+  // dst now points to the data buffer of src (or of the packet src is a clone
+  // of), whose refcnt keeps it alive until all clones are freed.
+  rte_pktmbuf_attach(&dst->mbuf_, &src->mbuf_);
+  bess::utils::CopyInlined(dst->metadata_, src->metadata_, SNBUF_METADATA);
+
+  return dst;
+}
+
+void Packet::do_unshare() {
+  DCHECK(is_linear());
+
+  // Keep the data at the same offset if it fits, so that the headroom
+  // remains available for prepend().
+  uint16_t len = data_len_;
+  uint16_t offset =
+      std::min<uint16_t>(data_off_, SNBUF_HEADROOM + SNBUF_DATA - len);
+
+  // The data must be copied before detaching, which may free the buffer.
+  bess::utils::Copy(headroom_ + offset, head_data(), len);
+  rte_pktmbuf_detach(&mbuf_);
+
+  data_off_ = offset;
+  data_len_ = len;
+  pkt_len_ = len;
+}
+
 // basically rte_hexdump() from eal_common_hexdump.c
 static std::string HexDump(const void *buffer, size_t len) {
   std::ostringstream dump;
@@ -180,6 +180,34 @@ class alignas(64) Packet {
   // Returns nullptr if memory allocation failed
   static Packet *copy(const Packet *src);
 
+  // Create a new Packet object that shares the data buffer of src, without
+  // copying the data. The metadata is copied. src must be linear, and must not
+  // be modified as long as its clones exist (just Free() it when done).
+  // Returns nullptr if memory allocation failed
+  static Packet *clone(Packet *src);
+
+  // Does this packet share the data buffer of another (see clone())?
+  bool is_clone() const { return RTE_MBUF_INDIRECT(&mbuf_); }
+
+  // Modules must call this before modifying packet data (including headroom
+  // and tailroom). If this packet is a clone, its data is copied to the
+  // private buffer of the packet, which then stops sharing the data buffer.
+  // The whole packet is copied, even if only the headers are to be modified:
+  // a private header segment would need another allocation and leave the
+  // packet non-linear, which most modules do not handle (see packet_bench).
+  void unshare() {
+    if (unlikely(is_clone())) {
+      do_unshare();
+    }
+  }
+
+  // Same as unshare(), for all packets in the batch
+  static void Unshare(PacketBatch *batch) {
+    for (int i = 0; i < batch->cnt(); i++) {
+      batch->pkts()[i]->unshare();
+    }
+  }
+
   phys_addr_t dma_addr() { return buf_physaddr_ + data_off_; }
 
   std::string Dump();
@@ -192,7 +220,11 @@ class alignas(64) Packet {
 
   // pkt may be nullptr
   static void Free(Packet *pkt) {
-    rte_pktmbuf_free(reinterpret_cast<struct rte_mbuf *>(pkt));
+    if (pkt && pkt->refcnt_ == 1 && pkt->is_simple()) {
+      FreeToPool(pkt->pool_, &pkt, 1);
+    } else {
+      rte_pktmbuf_free(reinterpret_cast<struct rte_mbuf *>(pkt));
+    }
   }
 
   // All pointers in pkts must not be nullptr.
@@ -203,6 +235,12 @@ class alignas(64) Packet {
   static void Free(PacketBatch *batch) { Free(batch->pkts(), batch->cnt()); }
 
  private:
+  // Returns simple packets with refcnt 1 to the worker cache of their pool,
+  // or to the mempool. Defined in packet_pool.cc.
+  static void FreeToPool(struct rte_mempool *pool, Packet **pkts, size_t cnt);
+
+  void do_unshare();
+
   union {
     struct {
       // offset 0: Virtual address of segment buffer.
@@ -348,7 +386,7 @@ inline void Packet::Free(Packet **pkts, size_t cnt) {
 
   /* NOTE: it seems that zeroing the refcnt of mbufs is not necessary.
    *   (allocators will reset them) */
-  rte_mempool_put_bulk(pool, reinterpret_cast<void **>(pkts), cnt);
+  FreeToPool(pool, pkts, cnt);
   return;
 
 slow_path:
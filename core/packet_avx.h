@@ -113,7 +113,7 @@ inline void Packet::Free(Packet **pkts, size_t cnt) {
     DCHECK_EQ(pkt->mbuf_.next, static_cast<struct rte_mbuf *>(nullptr));
   }
 
-  rte_mempool_put_bulk(_pool, reinterpret_cast<void **>(pkts), cnt);
+  FreeToPool(_pool, pkts, cnt);
   return;
 
 slow_path:
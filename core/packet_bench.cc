@@ -0,0 +1,111 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmarks clone() and unshare() for a batch of packets of each size in
+// state.range(0), as in Replicate followed by a module that modifies the
+// replicas. Unsharing copies the whole packet, so the gap between the two
+// grows with the size.
+
+#include "packet.h"
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include <cstring>
+
+#include "packet_pool.h"
+#include "pktbatch.h"
+#include "utils/time.h"
+
+namespace {
+
+class CloneFixture : public benchmark::Fixture {
+ public:
+  CloneFixture() : pool_(), orig_() {}
+
+  void SetUp(benchmark::State &state) override {
+    pool_ = new bess::PlainPacketPool();
+
+    size_t len = state.range(0);
+    CHECK(pool_->AllocBulk(orig_.pkts(), bess::PacketBatch::kMaxBurst, len));
+    orig_.set_cnt(bess::PacketBatch::kMaxBurst);
+    for (int i = 0; i < orig_.cnt(); i++) {
+      memset(orig_.pkts()[i]->head_data(), 'a', len);
+    }
+  }
+
+  void TearDown(benchmark::State &) override {
+    bess::Packet::Free(&orig_);
+    delete pool_;
+    pool_ = nullptr;
+  }
+
+ protected:
+  // Runs 'fn' on a batch of clones of orig_ per iteration, and reports cycles
+  // per packet.
+  template <typename F>
+  void Run(benchmark::State &state, F fn) {
+    bess::PacketBatch batch;
+
+    uint64_t pkts = 0;
+    uint64_t start = rdtsc();
+    while (state.KeepRunning()) {
+      batch.clear();
+      for (int i = 0; i < orig_.cnt(); i++) {
+        batch.add(bess::Packet::clone(orig_.pkts()[i]));
+      }
+      fn(&batch);
+      pkts += batch.cnt();
+      bess::Packet::Free(&batch);
+    }
+    uint64_t cycles = rdtsc() - start;
+
+    state.SetItemsProcessed(pkts);
+    state.counters["cycles/pkt"] = static_cast<double>(cycles) / pkts;
+  }
+
+  bess::PacketPool *pool_;
+  bess::PacketBatch orig_;
+};
+
+// Readers only
+BENCHMARK_DEFINE_F(CloneFixture, Clone)(benchmark::State &state) {
+  Run(state, [](bess::PacketBatch *) {});
+}
+
+BENCHMARK_DEFINE_F(CloneFixture, Unshare)(benchmark::State &state) {
+  Run(state, [](bess::PacketBatch *batch) { bess::Packet::Unshare(batch); });
+}
+
+BENCHMARK_REGISTER_F(CloneFixture, Clone)->Arg(60)->Arg(512)->Arg(1514);
+BENCHMARK_REGISTER_F(CloneFixture, Unshare)->Arg(60)->Arg(512)->Arg(1514);
+
+}  // namespace
+
+BENCHMARK_MAIN();
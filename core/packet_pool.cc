@@ -1,6 +1,15 @@
 #include "packet_pool.h"
 
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
 #include <rte_errno.h>
 #include <rte_mempool.h>
@@ -31,35 +40,221 @@ void DoMunmap(rte_mempool_memhdr *memhdr, void *) {
   }
 }
 
+// Maps a new memfd of at least '*size' bytes, preferring hugepages. Rounds
+// '*size' up to the page size of the memfd, so that it can be munmap()ed
+// whole. Returns the fd, or -1.
+int MapMemfd(const char *name, size_t *size, void **addr) {
+  for (unsigned int flags : {MFD_CLOEXEC | MFD_HUGETLB, MFD_CLOEXEC}) {
+    int fd = memfd_create(name, flags);
+    if (fd < 0) {
+      continue;
+    }
+
+    // st_blksize is the hugepage size of hugetlb files
+    struct stat st;
+    size_t len = *size;
+    if (fstat(fd, &st) == 0) {
+      len = RTE_ALIGN_CEIL(len, static_cast<size_t>(st.st_blksize));
+    }
+
+    // Hugepages are reserved by mmap(), which fails if there are not enough
+    if (ftruncate(fd, len) == 0) {
+      void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, 0);
+      if (p != MAP_FAILED) {
+        *size = len;
+        *addr = p;
+        return fd;
+      }
+    }
+    close(fd);
+  }
+
+  return -1;
+}
+
+// Same as "ring_mp_mc", but initializes packets as they are populated.
+const char kMempoolOps[] = "bess_ring_mp_mc";
+
+struct PopulateArg {
+  rte_mempool_populate_obj_cb_t *obj_cb;
+  void *obj_cb_arg;
+};
+
+// DPDK puts each object into the ring as soon as it has been populated, so
+// a pool that grows while in use must initialize packets before that.
+void InitAndAddPacket(rte_mempool *mp, void *opaque, void *obj,
+                      rte_iova_t iova) {
+  auto *arg = static_cast<PopulateArg *>(opaque);
+
+  // rte_pktmbuf_init() takes the IOVA from the header, which is not set yet
+  auto *hdr = static_cast<rte_mempool_objhdr *>(
+      RTE_PTR_SUB(obj, sizeof(rte_mempool_objhdr)));
+  hdr->mp = mp;
+  hdr->iova = iova;
+
+  InitPacket(mp, nullptr, obj, 0);
+  arg->obj_cb(mp, arg->obj_cb_arg, obj, iova);
+}
+
+int PopulatePackets(rte_mempool *mp, unsigned int max_objs, void *vaddr,
+                    rte_iova_t iova, size_t len,
+                    rte_mempool_populate_obj_cb_t *obj_cb, void *obj_cb_arg) {
+  PopulateArg arg = {.obj_cb = obj_cb, .obj_cb_arg = obj_cb_arg};
+  return rte_mempool_op_populate_default(mp, max_objs, vaddr, iova, len,
+                                         InitAndAddPacket, &arg);
+}
+
+void RegisterMempoolOps() {
+  static bool registered;
+  if (registered) {
+    return;
+  }
+
+  for (unsigned i = 0; i < rte_mempool_ops_table.num_ops; i++) {
+    const rte_mempool_ops &ring_ops = rte_mempool_ops_table.ops[i];
+    if (strcmp(ring_ops.name, "ring_mp_mc") != 0) {
+      continue;
+    }
+
+    rte_mempool_ops ops = ring_ops;
+    snprintf(ops.name, sizeof(ops.name), "%s", kMempoolOps);
+    ops.populate = PopulatePackets;
+
+    int ret = rte_mempool_register_ops(&ops);
+    if (ret < 0) {
+      LOG(FATAL) << "rte_mempool_register_ops() returned " << ret;
+    }
+    registered = true;
+    return;
+  }
+
+  LOG(FATAL) << "Mempool ops ring_mp_mc not found";
+}
+
+// Wakes up GrowDefaultPools()
+std::mutex grow_mutex;
+std::condition_variable grow_cv;
+
 }  // namespace
 
 PacketPool *PacketPool::default_pools_[RTE_MAX_NUMA_NODES];
+std::vector<std::pair<std::unique_ptr<PacketPool>, size_t>>
+    PacketPool::retired_pools_;
+
+__thread int PacketPool::current_wid_ = -1;
+__thread int PacketPool::current_socket_ = -1;
+__thread uint32_t PacketPool::direct_gets_ = 0;
 
-void PacketPool::CreateDefaultPools(size_t capacity) {
+void PacketPool::CreateDefaultPools(size_t capacity, size_t max_capacity) {
   InitDpdk(FLAGS_dpdk ? FLAGS_m : 0);
 
   rte_dump_physmem_layout(stdout);
 
+  bool elastic = false;
+
   for (int sid = 0; sid < NumNumaNodes(); sid++) {
     if (FLAGS_m == 0) {
       LOG(WARNING) << "Hugepage is disabled! Creating PlainPacketPool for "
                    << capacity << " packets on node " << sid;
+      LOG_IF(WARNING, max_capacity > capacity)
+          << "PlainPacketPool cannot grow";
       default_pools_[sid] = new PlainPacketPool(capacity, sid);
     } else if (FLAGS_dpdk) {
       LOG(INFO) << "Creating DpdkPacketPool for " << capacity
                 << " packets on node " << sid;
+      LOG_IF(WARNING, max_capacity > capacity) << "DpdkPacketPool cannot grow";
       default_pools_[sid] = new DpdkPacketPool(capacity, sid);
     } else {
       LOG(INFO) << "Creating BessPacketPool for " << capacity
                 << " packets on node " << sid;
-      default_pools_[sid] = new BessPacketPool(capacity, sid);
+      default_pools_[sid] = new BessPacketPool(capacity, sid, max_capacity);
+      elastic |= max_capacity > capacity;
     }
     CHECK(default_pools_[sid])
         << "Packet pool allocation on node " << sid << " failed!";
+    default_pools_[sid]->EnableWorkerCache(FLAGS_pkt_cache);
+  }
+
+  if (elastic) {
+    std::thread(GrowDefaultPools).detach();
+  }
+}
+
+void PacketPool::GrowDefaultPools() {
+  std::unique_lock<std::mutex> lock(grow_mutex);
+
+  while (true) {
+    // A request may come in just before we start waiting, without waking us
+    // up. Time out to pick it up anyway.
+    grow_cv.wait_for(lock, std::chrono::milliseconds(100));
+
+    for (int sid = 0; sid < RTE_MAX_NUMA_NODES; sid++) {
+      PacketPool *pool = default_pools_[sid];
+      if (!pool || !pool->grow_requested_) {
+        continue;
+      }
+
+      size_t step = std::max<size_t>(pool->Capacity() / kGrowStepDivisor, 1);
+      size_t added = pool->Grow(step);
+      if (added > 0) {
+        pool->grow_count_++;
+        LOG(INFO) << pool->name_ << " has grown by " << added << " to "
+                  << pool->Capacity() << " packets";
+      } else {
+        pool->grow_failures_++;
+        LOG(WARNING) << pool->name_ << " failed to grow from "
+                     << pool->Capacity() << " packets";
+      }
+
+      if (pool->Capacity() < pool->MaxCapacity()) {
+        pool->grow_watermark_ = pool->Capacity() / kGrowWatermarkDivisor;
+      } else {
+        pool->grow_watermark_ = 0;
+      }
+      pool->grow_requested_ = false;
+    }
+  }
+}
+
+void PacketPool::FlushDefaultPoolCaches() {
+  for (int sid = 0; sid < RTE_MAX_NUMA_NODES; sid++) {
+    if (default_pools_[sid]) {
+      default_pools_[sid]->FlushWorkerCache();
+    }
+  }
+}
+
+void PacketPool::Retire(std::unique_ptr<PacketPool> pool, size_t lost) {
+  DCHECK_EQ(pool->cache_size_, 0);
+  retired_pools_.emplace_back(std::move(pool), lost);
+  ReapRetired();
+}
+
+void PacketPool::ReapRetired() {
+  auto it = retired_pools_.begin();
+  while (it != retired_pools_.end()) {
+    PacketPool *pool = it->first.get();
+    size_t lost = it->second;
+    if (pool->Size() + lost >= pool->Capacity()) {
+      VLOG(1) << pool->name_ << " retired";
+      it = retired_pools_.erase(it);
+    } else {
+      ++it;
+    }
   }
 }
 
-PacketPool::PacketPool(size_t capacity, int socket_id) {
+PacketPool::PacketPool(size_t capacity, int socket_id, size_t max_capacity)
+    : socket_id_(socket_id),
+      cache_size_(),
+      caches_(),
+      cache_pkts_(),
+      grow_watermark_(),
+      grow_requested_(),
+      peak_in_use_(),
+      grow_count_(),
+      grow_failures_() {
   if (!IsDpdkInitialized()) {
     InitDpdk(0);
   }
@@ -68,8 +263,13 @@ PacketPool::PacketPool(size_t capacity, int socket_id) {
   name_ = "PacketPool" + std::to_string(next_id_++);
 
   LOG(INFO) << name_ << " requests for " << capacity << " packets";
+  max_capacity = std::max(capacity, max_capacity);
+  LOG_IF(INFO, max_capacity > capacity)
+      << name_ << " may grow up to " << max_capacity << " packets";
 
-  pool_ = rte_mempool_create_empty(name_.c_str(), capacity, sizeof(Packet),
+  // The ring is sized for the maximum capacity, while only as many packets
+  // as the child class populates are backed by memory.
+  pool_ = rte_mempool_create_empty(name_.c_str(), max_capacity, sizeof(Packet),
                                    capacity > 1024 ? kMaxCacheSize : 0,
                                    sizeof(PoolPrivate), socket_id, 0);
   if (!pool_) {
@@ -77,10 +277,22 @@ PacketPool::PacketPool(size_t capacity, int socket_id) {
                << " (rte_errno=" << rte_errno << ")";
   }
 
-  int ret = rte_mempool_set_ops_byname(pool_, "ring_mp_mc", NULL);
+  RegisterMempoolOps();
+  int ret = rte_mempool_set_ops_byname(pool_, kMempoolOps, NULL);
   if (ret < 0) {
     LOG(FATAL) << "rte_mempool_set_ops_byname() returned " << ret;
   }
+
+  PoolPrivate priv = {
+      .dpdk_priv = {.mbuf_data_room_size = SNBUF_HEADROOM + SNBUF_DATA,
+                    .mbuf_priv_size = SNBUF_RESERVE,
+                    .flags = 0},
+      .owner = this};
+
+  // rte_pktmbuf_pool_init() only copies the DPDK part. Packets are
+  // initialized with it as they are populated (see PopulatePackets()).
+  rte_pktmbuf_pool_init(pool_, &priv.dpdk_priv);
+  static_cast<PoolPrivate *>(rte_mempool_get_priv(pool_))->owner = this;
 }
 
 PacketPool::~PacketPool() {
@@ -88,8 +300,153 @@ PacketPool::~PacketPool() {
   rte_mempool_free(pool_);
 }
 
+void PacketPool::EnableWorkerCache(size_t size) {
+  CHECK_LE(size, kMaxWorkerCacheSize);
+
+  // Room for a whole batch on top of a full cache, before it gets flushed
+  size_t room = size + PacketBatch::kMaxBurst;
+
+  cache_size_ = size;
+  caches_.reset();
+  cache_pkts_.reset();
+  if (size == 0) {
+    return;
+  }
+
+  caches_.reset(new WorkerCache[kMaxWorkers]());
+  cache_pkts_.reset(new Packet *[kMaxWorkers * room]);
+  for (int wid = 0; wid < kMaxWorkers; wid++) {
+    caches_[wid].pkts = &cache_pkts_[wid * room];
+  }
+
+  LOG(INFO) << name_ << ": caching up to " << size << " packets per worker";
+}
+
+void PacketPool::FlushWorkerCache() {
+  int wid = current_wid_;
+  if (!cache_size_ || wid < 0) {
+    return;
+  }
+
+  WorkerCache &cache = caches_[wid];
+  if (cache.cnt > 0) {
+    rte_mempool_put_bulk(pool_, reinterpret_cast<void **>(cache.pkts),
+                         cache.cnt);
+    cache.cnt = 0;
+    cache.stats.flushes++;
+  }
+}
+
+PacketPool::CacheStats PacketPool::GetCacheStats() const {
+  CacheStats total = {};
+
+  for (int wid = 0; cache_size_ && wid < kMaxWorkers; wid++) {
+    const WorkerCache &cache = caches_[wid];
+    total.count += cache.cnt;
+    total.allocs += cache.stats.allocs;
+    total.frees += cache.stats.frees;
+    total.remote_frees += cache.stats.remote_frees;
+    total.refills += cache.stats.refills;
+    total.flushes += cache.stats.flushes;
+  }
+
+  return total;
+}
+
+void PacketPool::CheckWatermark() {
+  // Not counting the per-core caches of the mempool is fine for both
+  size_t avail = rte_mempool_ops_get_count(pool_);
+  size_t in_use = pool_->populated_size - avail;
+
+  // Racy, but only to miss a peak that another worker has just seen
+  if (in_use > peak_in_use_.load(std::memory_order_relaxed)) {
+    peak_in_use_.store(in_use, std::memory_order_relaxed);
+  }
+
+  if (unlikely(avail < grow_watermark_.load(std::memory_order_relaxed)) &&
+      !grow_requested_.exchange(true)) {
+    grow_cv.notify_one();
+  }
+}
+
+PacketPool *PacketPool::FromMempool(rte_mempool *mp) {
+  return static_cast<PoolPrivate *>(rte_mempool_get_priv(mp))->owner;
+}
+
+bool PacketPool::GetBulk(Packet **pkts, size_t count) {
+  int wid = current_wid_;
+  size_t batch = cache_size_ / 2;
+
+  // Larger requests than a refill go straight to the mempool.
+  if (!cache_size_ || wid < 0 || count > batch) {
+    int ret =
+        rte_mempool_get_bulk(pool_, reinterpret_cast<void **>(pkts), count);
+    if (unlikely(ret < 0 || ++direct_gets_ % kWatermarkSampleInterval == 0)) {
+      CheckWatermark();
+    }
+    return ret == 0;
+  }
+
+  WorkerCache &cache = caches_[wid];
+  if (cache.cnt < count) {
+    size_t n = batch + count - cache.cnt;
+    int ret = rte_mempool_get_bulk(
+        pool_, reinterpret_cast<void **>(cache.pkts + cache.cnt), n);
+    CheckWatermark();
+    if (ret < 0) {
+      // The mempool may still have enough for this request alone.
+      return rte_mempool_get_bulk(pool_, reinterpret_cast<void **>(pkts),
+                                  count) == 0;
+    }
+    cache.cnt += n;
+    cache.stats.refills++;
+  }
+
+  // Most recently freed packets first, as they are likely in the CPU cache
+  cache.cnt -= count;
+  for (size_t i = 0; i < count; i++) {
+    pkts[i] = cache.pkts[cache.cnt + count - 1 - i];
+  }
+  cache.stats.allocs += count;
+  return true;
+}
+
+void PacketPool::FreeBulk(Packet **pkts, size_t cnt) {
+  int wid = current_wid_;
+  if (!cache_size_ || wid < 0 || cnt > PacketBatch::kMaxBurst) {
+    rte_mempool_put_bulk(pool_, reinterpret_cast<void **>(pkts), cnt);
+    return;
+  }
+
+  WorkerCache &cache = caches_[wid];
+  bool remote = socket_id_ >= 0 && current_socket_ != socket_id_;
+  size_t batch = cache_size_ / 2;
+
+  memcpy(cache.pkts + cache.cnt, pkts, cnt * sizeof(Packet *));
+  cache.cnt += cnt;
+  cache.stats.frees += cnt;
+
+  if (remote) {
+    // This worker will not allocate these, so hand them back in one go.
+    cache.stats.remote_frees += cnt;
+    if (cache.cnt >= batch) {
+      rte_mempool_put_bulk(pool_, reinterpret_cast<void **>(cache.pkts),
+                           cache.cnt);
+      cache.cnt = 0;
+      cache.stats.flushes++;
+    }
+  } else if (cache.cnt > cache_size_) {
+    // Flush down to half, so that both allocations and frees that follow
+    // find the cache useful.
+    rte_mempool_put_bulk(pool_, reinterpret_cast<void **>(cache.pkts + batch),
+                         cache.cnt - batch);
+    cache.cnt = batch;
+    cache.stats.flushes++;
+  }
+}
+
 bool PacketPool::AllocBulk(Packet **pkts, size_t count, size_t len) {
-  if (rte_mempool_get_bulk(pool_, reinterpret_cast<void **>(pkts), count) < 0) {
+  if (!GetBulk(pkts, count)) {
     return false;
   }
 
@@ -145,14 +502,9 @@ bool PacketPool::AllocBulk(Packet **pkts, size_t count, size_t len) {
 }
 
 void PacketPool::PostPopulate() {
-  PoolPrivate priv = {
-      .dpdk_priv = {.mbuf_data_room_size = SNBUF_HEADROOM + SNBUF_DATA,
-                    .mbuf_priv_size = SNBUF_RESERVE,
-                    .flags = 0},
-      .owner = this};
-
-  rte_pktmbuf_pool_init(pool_, &priv.dpdk_priv);
-  rte_mempool_obj_iter(pool_, InitPacket, nullptr);
+  if (Capacity() < MaxCapacity()) {
+    grow_watermark_ = Capacity() / kGrowWatermarkDivisor;
+  }
 
   LOG(INFO) << name_ << " has been created with " << Capacity() << " packets";
   if (Capacity() == 0) {
@@ -164,26 +516,43 @@ void PacketPool::PostPopulate() {
   }
 }
 
-PlainPacketPool::PlainPacketPool(size_t capacity, int socket_id)
-    : PacketPool(capacity, socket_id) {
+PlainPacketPool::PlainPacketPool(size_t capacity, int socket_id,
+                                 bool shareable)
+    : PacketPool(capacity, socket_id), region_fd_(-1) {
   pool_->flags |= MEMPOOL_F_NO_IOVA_CONTIG;
 
   size_t page_shift = __builtin_ffs(getpagesize());
   size_t min_chunk_size, align;
   size_t size = rte_mempool_op_calc_mem_size_default(pool_, pool_->size, page_shift, &min_chunk_size, &align);
 
-  void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
-                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-  if (addr == MAP_FAILED) {
-    PLOG(FATAL) << "mmap()";
+  void *addr;
+  if (shareable) {
+    region_fd_ = MapMemfd(name_.c_str(), &size, &addr);
+    if (region_fd_ < 0) {
+      // Left empty, for the owner to fail
+      PLOG(ERROR) << name_ << ": memfd_create()/mmap()";
+      pinned_ = false;
+      region_ = nullptr;
+      region_size_ = 0;
+      return;
+    }
+  } else {
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+      PLOG(FATAL) << "mmap()";
+    }
   }
 
   // No error check, as we do not provide a guarantee that memory is pinned.
   int ret = mlock(addr, size);
   pinned_ = (ret == 0);  // may fail as non-root users have mlock limit
 
-  ret = rte_mempool_populate_iova(pool_, static_cast<char *>(addr),
-                                  RTE_BAD_IOVA, size, DoMunmap, nullptr);
+  region_ = static_cast<char *>(addr);
+  region_size_ = RTE_ALIGN_CEIL(size, getpagesize());  // as mapped
+
+  ret = rte_mempool_populate_iova(pool_, region_, RTE_BAD_IOVA, size,
+                                  DoMunmap, nullptr);
   if (ret < static_cast<ssize_t>(pool_->size)) {
     LOG(WARNING) << "rte_mempool_populate_iova() returned " << ret
                  << " (rte_errno=" << rte_errno << ", "
@@ -193,22 +562,43 @@ PlainPacketPool::PlainPacketPool(size_t capacity, int socket_id)
   PostPopulate();
 }
 
-BessPacketPool::BessPacketPool(size_t capacity, int socket_id)
-    : PacketPool(capacity, socket_id),
+PlainPacketPool::~PlainPacketPool() {
+  // The mapping outlives the fd, until the mempool is freed
+  if (region_fd_ >= 0) {
+    close(region_fd_);
+  }
+}
+
+BessPacketPool::BessPacketPool(size_t capacity, int socket_id,
+                               size_t max_capacity)
+    : PacketPool(capacity, socket_id, max_capacity),
       mem_(static_cast<size_t>(FLAGS_m) * 1024 * 1024, socket_id) {
+  if (Populate(capacity, false) < capacity) {
+    LOG(WARNING) << "Node " << socket_id << ": " << capacity
+                 << " packets requested, but only " << pool_->populated_size
+                 << " allocated in total";
+  }
+
+  PostPopulate();
+}
+
+size_t BessPacketPool::Populate(size_t count, bool expand) {
   size_t page_shift = __builtin_ffs(getpagesize());
+  size_t populated = pool_->populated_size;
+  size_t target = std::min<size_t>(populated + count, pool_->size);
+  int socket_id = mem_.SocketId();
 
-  while (pool_->populated_size < pool_->size) {
-    size_t deficit = pool_->size - pool_->populated_size;
+  while (pool_->populated_size < target) {
+    size_t deficit = target - pool_->populated_size;
     size_t min_chunk_size, align;
     size_t bytes =
         rte_mempool_op_calc_mem_size_default(pool_, deficit, page_shift, &min_chunk_size, &align);
 
     auto [addr, alloced_bytes] = mem_.AllocUpto(bytes);
     if (addr == nullptr) {
-      LOG(WARNING) << "Node " << socket_id << ": " << capacity
-                   << " packets requested, but only " << pool_->populated_size
-                   << " allocated in total";
+      if (expand && mem_.Expand(bytes)) {
+        continue;
+      }
       break;
     }
 
@@ -218,13 +608,18 @@ BessPacketPool::BessPacketPool(size_t capacity, int socket_id)
     if (ret < 0) {
       LOG(WARNING) << "Node " << socket_id
                    << ": rte_mempool_populate_iova() returned " << ret;
+      if (expand) {
+        // Do not keep allocating hugepages in vain
+        mem_.Free(addr);
+        break;
+      }
     } else {
       LOG(INFO) << "Node " << socket_id << ": " << ret << " packets added from "
                 << alloced_bytes << " bytes";
     }
   }
 
-  PostPopulate();
+  return pool_->populated_size - populated;
 }
 
 DpdkPacketPool::DpdkPacketPool(size_t capacity, int socket_id)
@@ -239,6 +634,10 @@ DpdkPacketPool::DpdkPacketPool(size_t capacity, int socket_id)
   PostPopulate();
 }
 
+void Packet::FreeToPool(rte_mempool *mp, Packet **pkts, size_t cnt) {
+  PacketPool::FromMempool(mp)->FreeBulk(pkts, cnt);
+}
+
 static Packet *paddr_to_snb_memchunk(struct rte_mempool_memhdr *chunk,
                                      phys_addr_t paddr) {
   if (chunk->phys_addr == RTE_BAD_IOVA) {
@@ -1,6 +1,11 @@
 #ifndef BESS_PACKET_POOL_H_
 #define BESS_PACKET_POOL_H_
 
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "memory.h"
 #include "packet.h"
 
@@ -11,6 +16,9 @@
 // --------------------------------------------------------------------------
 // PlainPacketPool   Plain 4k pages   O        X         X          O
 //   : For standalone benchmarks and unittests. Cannot be used for DMA.
+//     Also backs the UMEM of AF_XDP ports, which the kernel pins itself.
+//     A shareable one lives in a memfd (of hugepages, if any are spare)
+//     that other processes can map, for the buffers of shm ports.
 //
 // BessPacketPool    BESS hugepages   O        O         O          X
 //   : BESS default. It allocates and manages huge pages internally.
@@ -27,14 +35,66 @@ namespace bess {
 // PacketPool is a C++ wrapper for DPDK rte_mempool. It has a pool of
 // pre-populated Packet objects, which can be fetched via Alloc().
 // Alloc() and Free() are thread-safe.
+//
+// With EnableWorkerCache(), each worker keeps a private freelist in front of
+// the mempool, refilled and flushed in batches, so that packets handed off
+// between workers do not bounce the mempool cache lines on every batch.
+// Packets of a pool on another NUMA node are never allocated by the freeing
+// worker, so they are only batched up and returned to their pool.
+//
+// A pool may be created with a larger maximum capacity than its initial one.
+// When workers find less than 1/kGrowWatermarkDivisor of its packets
+// available, a background thread Grow()s it by 1/kGrowStepDivisor (DPDK
+// mempools cannot give populated memory back, so pools never shrink).
 class PacketPool {
  public:
+  // Must be no less than Worker::kMaxWorkers
+  static const int kMaxWorkers = 64;
+
+  // Largest per-worker cache size
+  static const size_t kMaxWorkerCacheSize = 4096;
+
+  // Counters of the worker caches of a pool, summed over all workers
+  struct CacheStats {
+    uint64_t count;         // packets currently held by worker caches
+    uint64_t allocs;        // packets allocated from worker caches
+    uint64_t frees;         // packets freed to worker caches
+    uint64_t remote_frees;  // ... of which by workers on another node
+    uint64_t refills;       // bulk gets from the mempool
+    uint64_t flushes;       // bulk puts to the mempool
+  };
+
   static PacketPool *GetDefaultPool(int node) { return default_pools_[node]; }
 
-  static void CreateDefaultPools(size_t capacity = kDefaultCapacity);
+  // max_capacity == 0 means the same as capacity, i.e., fixed-size pools.
+  static void CreateDefaultPools(size_t capacity = kDefaultCapacity,
+                                 size_t max_capacity = 0);
+
+  // Makes the calling thread use the worker caches of 'wid', running on NUMA
+  // node 'socket'. wid == -1 means "not a worker".
+  static void SetCurrentWorker(int wid, int socket) {
+    current_wid_ = wid;
+    current_socket_ = socket;
+  }
+
+  // Returns the packets in the caches of the calling worker to the default
+  // pools. Workers call this before they block.
+  static void FlushDefaultPoolCaches();
+
+  // Takes over a pool whose packets may still be in use, e.g., by the
+  // pipeline after the port that received them is gone, and destroys it once
+  // they are all back. 'lost' of them never come back (e.g., those left with
+  // the kernel). The pool must have no worker caches.
+  static void Retire(std::unique_ptr<PacketPool> pool, size_t lost = 0);
+
+  // Destroys the retired pools that have all their packets back. Called on
+  // the master thread, by Retire() and the "reap_packet_pools" resume hook.
+  static void ReapRetired();
 
   // socket_id == -1 means "I don't care".
-  PacketPool(size_t capacity = kDefaultCapacity, int socket_id = -1);
+  // max_capacity == 0 means the same as capacity.
+  PacketPool(size_t capacity = kDefaultCapacity, int socket_id = -1,
+             size_t max_capacity = 0);
   virtual ~PacketPool();
 
   // PacketPool is neither copyable nor movable.
@@ -43,6 +103,11 @@ class PacketPool {
 
   // Allocate a packet from the pool, with specified initial packet size.
   Packet *Alloc(size_t len = 0) {
+    if (cache_size_ && current_wid_ >= 0) {
+      Packet *pkt;
+      return AllocBulk(&pkt, 1, len) ? pkt : nullptr;
+    }
+
     Packet *pkt = reinterpret_cast<Packet *>(rte_pktmbuf_alloc(pool_));
     if (pkt) {
       pkt->pkt_len_ = len;
@@ -60,9 +125,39 @@ class PacketPool {
   // The number of total packets in the pool. 0 if initialization failed.
   size_t Capacity() const { return pool_->populated_size; }
 
+  // The number of packets the pool may grow to.
+  size_t MaxCapacity() const { return pool_->size; }
+
   // The number of available packets in the pool. Approximate by nature.
+  // Packets held by worker caches are not counted.
   size_t Size() const { return rte_mempool_avail_count(pool_); }
 
+  // Adds up to 'count' packets to the pool, within MaxCapacity(). Returns the
+  // number of packets added. Safe to call while the pool is in use, but slow.
+  // Not all pools can grow; they return 0.
+  virtual size_t Grow(size_t) { return 0; }
+
+  // The highest number of packets seen in use (not in the mempool ring,
+  // thus including those in per-core and worker caches). Sampled, so short
+  // peaks may be missed.
+  size_t PeakInUse() const { return peak_in_use_; }
+
+  // The number of times the pool has grown, and has failed to
+  uint64_t grow_count() const { return grow_count_; }
+  uint64_t grow_failures() const { return grow_failures_; }
+
+  // Gives each worker a cache of up to 'size' packets, refilled and flushed
+  // 'size / 2' at a time. 0 disables the caches. Must be called before any
+  // worker uses the pool.
+  void EnableWorkerCache(size_t size);
+
+  size_t worker_cache_size() const { return cache_size_; }
+
+  // Returns the packets in the cache of the calling worker to the mempool.
+  void FlushWorkerCache();
+
+  CacheStats GetCacheStats() const;
+
   // Note: It would be ideal to not expose this
   rte_mempool *pool() { return pool_; }
 
@@ -76,6 +171,13 @@ class PacketPool {
   static const size_t kDefaultCapacity = (1 << 16) - 1;  // 64k - 1
   static const size_t kMaxCacheSize = 512;               // per-core cache size
 
+  static const size_t kGrowWatermarkDivisor = 8;
+  static const size_t kGrowStepDivisor = 4;
+
+  // Gets that bypass the worker caches check the watermark once in this many
+  // per thread, so as not to read the mempool counters on every batch.
+  static const uint32_t kWatermarkSampleInterval = 16;
+
   // Child classes are expected to call this function in their constructor
   void PostPopulate();
 
@@ -83,33 +185,102 @@ class PacketPool {
   rte_mempool *pool_;
 
  private:
+  // Freelist of a worker. Only the worker touches it, except for the
+  // counters, which may be read by others.
+  struct alignas(64) WorkerCache {
+    Packet **pkts;
+    size_t cnt;
+    CacheStats stats;
+  };
+
+  static PacketPool *FromMempool(rte_mempool *mp);
+
+  // Called by Packet::Free() for packets of this pool
+  void FreeBulk(Packet **pkts, size_t cnt);
+
+  bool GetBulk(Packet **pkts, size_t count);
+
+  // Updates PeakInUse() and asks for growth if the pool is running low.
+  // Called after refills of worker caches, failed gets, and a sample of the
+  // other gets from the mempool.
+  void CheckWatermark();
+
+  // Body of the thread that grows the default pools on request
+  static void GrowDefaultPools();
+
   // Default per-node packet pools
   static PacketPool *default_pools_[RTE_MAX_NUMA_NODES];
 
+  // Pools passed to Retire(), with the number of packets lost from each
+  static std::vector<std::pair<std::unique_ptr<PacketPool>, size_t>>
+      retired_pools_;
+
+  // Worker ID and NUMA node of the calling thread (see SetCurrentWorker())
+  static __thread int current_wid_;
+  static __thread int current_socket_;
+
+  // Gets of the calling thread that bypassed the worker caches
+  static __thread uint32_t direct_gets_;
+
+  int socket_id_;
+
+  size_t cache_size_;
+  std::unique_ptr<WorkerCache[]> caches_;
+  std::unique_ptr<Packet *[]> cache_pkts_;
+
+  // Grow when fewer packets than this are available. 0 if the pool is full.
+  std::atomic<size_t> grow_watermark_;
+  std::atomic<bool> grow_requested_;
+  std::atomic<size_t> peak_in_use_;
+  uint64_t grow_count_;
+  uint64_t grow_failures_;
+
   friend class Packet;
 };
 
 class PlainPacketPool : public PacketPool {
  public:
-  PlainPacketPool(size_t capacity = kDefaultCapacity, int socket_id = -1);
+  // If 'shareable' is set, the memory is a memfd, see region_fd(). If the
+  // memfd cannot be set up, the pool has no packets and region_fd() is -1.
+  PlainPacketPool(size_t capacity = kDefaultCapacity, int socket_id = -1,
+                  bool shareable = false);
+  ~PlainPacketPool() override;
 
   virtual bool IsVirtuallyContiguous() override { return true; }
   virtual bool IsPhysicallyContiguous() override { return false; }
   virtual bool IsPinned() override { return pinned_; }
 
+  // The single memory region all packets of the pool reside in
+  char *region() const { return region_; }
+  size_t region_size() const { return region_size_; }
+
+  // The memfd of the region of a shareable pool, or -1. Mapping region_size()
+  // bytes of it gives another view of the packets.
+  int region_fd() const { return region_fd_; }
+
  private:
   bool pinned_;
+  char *region_;
+  size_t region_size_;
+  int region_fd_;
 };
 
 class BessPacketPool : public PacketPool {
  public:
-  BessPacketPool(size_t capacity = kDefaultCapacity, int socket_id = -1);
+  BessPacketPool(size_t capacity = kDefaultCapacity, int socket_id = -1,
+                 size_t max_capacity = 0);
+
+  virtual size_t Grow(size_t count) override { return Populate(count, true); }
 
   virtual bool IsVirtuallyContiguous() override { return true; }
   virtual bool IsPhysicallyContiguous() override { return true; }
   virtual bool IsPinned() override { return true; }
 
  private:
+  // Adds up to 'count' packets from mem_, expanding it with more hugepages
+  // if 'expand' is set. Returns the number of packets added.
+  size_t Populate(size_t count, bool expand);
+
   DmaMemoryPool mem_;
 };
 
@@ -0,0 +1,250 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "packet_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <utility>
+
+namespace bess {
+
+namespace {
+
+const size_t kCapacity = 1024;
+const size_t kCacheSize = 64;
+const size_t kBatch = kCacheSize / 2;
+
+class PacketPoolCacheTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() override {
+    pool_.reset(new PlainPacketPool(kCapacity, 0));
+    ASSERT_EQ(kCapacity, pool_->Capacity());
+    pool_->EnableWorkerCache(kCacheSize);
+    size_ = pool_->Size();
+  }
+
+  virtual void TearDown() override {
+    PacketPool::SetCurrentWorker(-1, -1);
+  }
+
+  std::unique_ptr<PacketPool> pool_;
+  size_t size_;  // available packets of an untouched pool
+};
+
+// Allocations take kBatch packets more than needed from the mempool, and
+// frees beyond the cache size give back all but kBatch.
+TEST_F(PacketPoolCacheTest, RefillAndFlush) {
+  Packet *pkts[3][kBatch];
+
+  PacketPool::SetCurrentWorker(0, 0);
+
+  ASSERT_TRUE(pool_->AllocBulk(pkts[0], kBatch));
+  PacketPool::CacheStats stats = pool_->GetCacheStats();
+  EXPECT_EQ(1, stats.refills);
+  EXPECT_EQ(kBatch, stats.allocs);
+  EXPECT_EQ(kBatch, stats.count);
+  EXPECT_EQ(size_ - 2 * kBatch, pool_->Size());
+
+  // Served from the cache alone
+  ASSERT_TRUE(pool_->AllocBulk(pkts[1], kBatch));
+  stats = pool_->GetCacheStats();
+  EXPECT_EQ(1, stats.refills);
+  EXPECT_EQ(0, stats.count);
+  EXPECT_EQ(size_ - 2 * kBatch, pool_->Size());
+
+  ASSERT_TRUE(pool_->AllocBulk(pkts[2], kBatch));
+  stats = pool_->GetCacheStats();
+  EXPECT_EQ(2, stats.refills);
+  EXPECT_EQ(3 * kBatch, stats.allocs);
+  EXPECT_EQ(kBatch, stats.count);
+  EXPECT_EQ(size_ - 4 * kBatch, pool_->Size());
+
+  Packet::Free(pkts[0], kBatch);
+  stats = pool_->GetCacheStats();
+  EXPECT_EQ(kCacheSize, stats.count);
+  EXPECT_EQ(0, stats.flushes);
+
+  // Over the cache size, so down to kBatch
+  Packet::Free(pkts[1], kBatch);
+  stats = pool_->GetCacheStats();
+  EXPECT_EQ(kBatch, stats.count);
+  EXPECT_EQ(1, stats.flushes);
+  EXPECT_EQ(2 * kBatch, stats.frees);
+  EXPECT_EQ(size_ - 2 * kBatch, pool_->Size());
+
+  Packet::Free(pkts[2], kBatch);
+  stats = pool_->GetCacheStats();
+  EXPECT_EQ(kCacheSize, stats.count);
+  EXPECT_EQ(1, stats.flushes);
+  EXPECT_EQ(0, stats.remote_frees);
+  EXPECT_EQ(size_ - kCacheSize, pool_->Size());
+
+  pool_->FlushWorkerCache();
+  stats = pool_->GetCacheStats();
+  EXPECT_EQ(0, stats.count);
+  EXPECT_EQ(2, stats.flushes);
+  EXPECT_EQ(size_, pool_->Size());
+}
+
+// Requests larger than a refill bypass the cache.
+TEST_F(PacketPoolCacheTest, LargeAlloc) {
+  Packet *pkts[kBatch + 1];
+
+  PacketPool::SetCurrentWorker(0, 0);
+
+  ASSERT_TRUE(pool_->AllocBulk(pkts, kBatch + 1));
+  PacketPool::CacheStats stats = pool_->GetCacheStats();
+  EXPECT_EQ(0, stats.refills);
+  EXPECT_EQ(0, stats.allocs);
+  EXPECT_EQ(size_ - kBatch - 1, pool_->Size());
+
+  Packet::Free(pkts, kBatch);
+  Packet::Free(pkts[kBatch]);
+  stats = pool_->GetCacheStats();
+  EXPECT_EQ(kBatch + 1, stats.frees);
+  EXPECT_EQ(kBatch + 1, stats.count);
+
+  pool_->FlushWorkerCache();
+  EXPECT_EQ(size_, pool_->Size());
+}
+
+// Workers on another node batch up frees and return them all at once.
+TEST_F(PacketPoolCacheTest, RemoteFree) {
+  Packet *pkts[kBatch];
+  const size_t half = kBatch / 2;
+
+  ASSERT_TRUE(pool_->AllocBulk(pkts, kBatch));
+
+  PacketPool::SetCurrentWorker(1, 1);
+
+  Packet::Free(pkts, half);
+  PacketPool::CacheStats stats = pool_->GetCacheStats();
+  EXPECT_EQ(half, stats.frees);
+  EXPECT_EQ(half, stats.remote_frees);
+  EXPECT_EQ(half, stats.count);
+  EXPECT_EQ(0, stats.flushes);
+  EXPECT_EQ(size_ - kBatch, pool_->Size());
+
+  Packet::Free(pkts + half, kBatch - half);
+  stats = pool_->GetCacheStats();
+  EXPECT_EQ(kBatch, stats.remote_frees);
+  EXPECT_EQ(0, stats.count);
+  EXPECT_EQ(1, stats.flushes);
+  EXPECT_EQ(size_, pool_->Size());
+}
+
+// Each worker flushes its own cache only.
+TEST_F(PacketPoolCacheTest, FlushWorkerCache) {
+  Packet *pkts[2][kBatch];
+
+  PacketPool::SetCurrentWorker(0, 0);
+  ASSERT_TRUE(pool_->AllocBulk(pkts[0], kBatch));
+  PacketPool::SetCurrentWorker(1, 0);
+  ASSERT_TRUE(pool_->AllocBulk(pkts[1], kBatch));
+  Packet::Free(pkts[1], kBatch);
+  EXPECT_EQ(3 * kBatch, pool_->GetCacheStats().count);
+
+  PacketPool::SetCurrentWorker(0, 0);
+  Packet::Free(pkts[0], kBatch);
+  pool_->FlushWorkerCache();
+  PacketPool::CacheStats stats = pool_->GetCacheStats();
+  EXPECT_EQ(2 * kBatch, stats.count);
+  EXPECT_EQ(1, stats.flushes);
+  EXPECT_EQ(size_ - 2 * kBatch, pool_->Size());
+
+  // Nothing left to flush
+  pool_->FlushWorkerCache();
+  EXPECT_EQ(1, pool_->GetCacheStats().flushes);
+
+  PacketPool::SetCurrentWorker(1, 0);
+  pool_->FlushWorkerCache();
+  EXPECT_EQ(0, pool_->GetCacheStats().count);
+  EXPECT_EQ(size_, pool_->Size());
+}
+
+// Threads other than workers go straight to the mempool.
+TEST_F(PacketPoolCacheTest, NonWorker) {
+  Packet *pkts[kBatch];
+
+  PacketPool::SetCurrentWorker(-1, -1);
+
+  ASSERT_TRUE(pool_->AllocBulk(pkts, kBatch));
+  Packet *pkt = pool_->Alloc();
+  ASSERT_NE(nullptr, pkt);
+  EXPECT_EQ(size_ - kBatch - 1, pool_->Size());
+
+  Packet::Free(pkts, kBatch);
+  Packet::Free(pkt);
+  pool_->FlushWorkerCache();
+
+  PacketPool::CacheStats stats = pool_->GetCacheStats();
+  EXPECT_EQ(0, stats.count);
+  EXPECT_EQ(0, stats.allocs);
+  EXPECT_EQ(0, stats.frees);
+  EXPECT_EQ(0, stats.refills);
+  EXPECT_EQ(0, stats.flushes);
+  EXPECT_EQ(size_, pool_->Size());
+}
+
+// Sets 'destroyed' when it goes away.
+class TestPool final : public PlainPacketPool {
+ public:
+  explicit TestPool(bool *destroyed)
+      : PlainPacketPool(kCapacity), destroyed_(destroyed) {}
+  ~TestPool() override { *destroyed_ = true; }
+
+ private:
+  bool *destroyed_;
+};
+
+// Retired pools live on until all packets but the lost ones are back.
+TEST(PacketPoolRetireTest, Retire) {
+  bool destroyed = false;
+  std::unique_ptr<PacketPool> pool(new TestPool(&destroyed));
+  Packet *pkts[3];
+  ASSERT_TRUE(pool->AllocBulk(pkts, 3));
+
+  PacketPool::Retire(std::move(pool), 1);
+  EXPECT_FALSE(destroyed);
+
+  Packet::Free(pkts[0]);
+  PacketPool::ReapRetired();
+  EXPECT_FALSE(destroyed);
+
+  // pkts[2] counts as lost.
+  Packet::Free(pkts[1]);
+  PacketPool::ReapRetired();
+  EXPECT_TRUE(destroyed);
+}
+
+}  // namespace
+
+}  // namespace bess
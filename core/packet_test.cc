@@ -0,0 +1,180 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "packet.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+
+#include "packet_pool.h"
+
+namespace bess {
+
+namespace {
+
+const uint16_t kLen = 60;
+
+int refcnt(const Packet *pkt) {
+  return rte_mbuf_refcnt_read(reinterpret_cast<const rte_mbuf *>(pkt));
+}
+
+char *metadata(const Packet *pkt) {
+  return reinterpret_cast<char *>(pkt->metadata<uintptr_t>());
+}
+
+class PacketCloneTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() override {
+    pool_.reset(new PlainPacketPool(1024));
+    size_ = pool_->Size();
+
+    pkt_ = pool_->Alloc(kLen);
+    ASSERT_NE(nullptr, pkt_);
+    memset(pkt_->head_data(), 'a', kLen);
+    memset(metadata(pkt_), 'm', SNBUF_METADATA);
+  }
+
+  std::unique_ptr<PacketPool> pool_;
+  size_t size_;  // available packets of an untouched pool
+  Packet *pkt_;
+};
+
+TEST_F(PacketCloneTest, Clone) {
+  Packet *clone = Packet::clone(pkt_);
+  ASSERT_NE(nullptr, clone);
+
+  EXPECT_FALSE(pkt_->is_clone());
+  EXPECT_TRUE(clone->is_clone());
+  EXPECT_FALSE(clone->is_simple());
+  EXPECT_EQ(2, refcnt(pkt_));
+  EXPECT_EQ(1, refcnt(clone));
+
+  // Same data, but its own metadata
+  EXPECT_EQ(pkt_->head_data(), clone->head_data());
+  EXPECT_EQ(kLen, clone->total_len());
+  EXPECT_EQ(kLen, clone->head_len());
+  EXPECT_EQ(0, memcmp(metadata(pkt_), metadata(clone), SNBUF_METADATA));
+  metadata(clone)[0] = 'x';
+  EXPECT_EQ('m', metadata(pkt_)[0]);
+
+  // Clones of a clone share the buffer of the original.
+  Packet *clone2 = Packet::clone(clone);
+  ASSERT_NE(nullptr, clone2);
+  EXPECT_EQ(pkt_->head_data(), clone2->head_data());
+  EXPECT_EQ(3, refcnt(pkt_));
+
+  Packet::Free(clone2);
+  EXPECT_EQ(2, refcnt(pkt_));
+  Packet::Free(clone);
+  EXPECT_EQ(1, refcnt(pkt_));
+  EXPECT_EQ(size_ - 1, pool_->Size());
+
+  Packet::Free(pkt_);
+  EXPECT_EQ(size_, pool_->Size());
+}
+
+// The buffer of the original outlives it as long as a clone exists.
+TEST_F(PacketCloneTest, FreeOriginalFirst) {
+  Packet *clone = Packet::clone(pkt_);
+  ASSERT_NE(nullptr, clone);
+
+  Packet::Free(pkt_);
+  EXPECT_EQ(size_ - 2, pool_->Size());
+  EXPECT_EQ('a', clone->head_data<char *>()[kLen - 1]);
+
+  Packet::Free(clone);
+  EXPECT_EQ(size_, pool_->Size());
+}
+
+TEST_F(PacketCloneTest, Unshare) {
+  pkt_->adj(10);
+  uint16_t headroom = pkt_->headroom();
+
+  Packet *clone = Packet::clone(pkt_);
+  ASSERT_NE(nullptr, clone);
+
+  clone->unshare();
+  EXPECT_FALSE(clone->is_clone());
+  EXPECT_TRUE(clone->is_simple());
+  EXPECT_EQ(1, refcnt(pkt_));
+  EXPECT_EQ(1, refcnt(clone));
+
+  // A private copy at the same offset
+  EXPECT_NE(pkt_->head_data(), clone->head_data());
+  EXPECT_EQ(headroom, clone->headroom());
+  EXPECT_EQ(kLen - 10, clone->total_len());
+  EXPECT_EQ(kLen - 10, clone->head_len());
+  EXPECT_EQ(0, memcmp(pkt_->head_data(), clone->head_data(), kLen - 10));
+
+  // Writes, including into the headroom, stay private.
+  char *head = static_cast<char *>(clone->prepend(4));
+  ASSERT_NE(nullptr, head);
+  memset(head, 'b', 8);
+  EXPECT_EQ('a', pkt_->head_data<char *>()[0]);
+  EXPECT_EQ('a', *(pkt_->head_data<char *>() - 1));
+
+  // Not a clone anymore, so no-op
+  void *data = clone->head_data();
+  clone->unshare();
+  EXPECT_EQ(data, clone->head_data());
+
+  Packet::Free(clone);
+  Packet::Free(pkt_);
+  EXPECT_EQ(size_, pool_->Size());
+}
+
+TEST_F(PacketCloneTest, UnshareBatch) {
+  PacketBatch batch;
+  batch.clear();
+  batch.add(pkt_);
+  for (int i = 0; i < 3; i++) {
+    Packet *clone = Packet::clone(pkt_);
+    ASSERT_NE(nullptr, clone);
+    batch.add(clone);
+  }
+  EXPECT_EQ(4, refcnt(pkt_));
+
+  Packet::Unshare(&batch);
+  EXPECT_EQ(pkt_, batch.pkts()[0]);
+  EXPECT_EQ(1, refcnt(pkt_));
+  for (int i = 0; i < batch.cnt(); i++) {
+    EXPECT_FALSE(batch.pkts()[i]->is_clone());
+    EXPECT_EQ(0, memcmp(pkt_->head_data(), batch.pkts()[i]->head_data(),
+                        kLen));
+  }
+
+  Packet::Free(&batch);
+  EXPECT_EQ(size_, pool_->Size());
+}
+
+}  // namespace
+
+}  // namespace bess
@@ -33,6 +33,13 @@
 
 #include "utils/copy.h"
 
+// Maximum number of packets in a PacketBatch. Override at build time with
+// "make BESS_MAX_BURST=<n>" (requires a clean rebuild). Must be a power of two
+// so that vector PMDs, which receive in multiples of 4, can fill a batch.
+#ifndef BESS_MAX_BURST
+#define BESS_MAX_BURST 32
+#endif
+
 namespace bess {
 
 class Packet;
@@ -67,7 +74,7 @@ class PacketBatch {
     bess::utils::CopyInlined(pkts_, src->pkts_, cnt_ * sizeof(Packet *));
   }
 
-  inline static const size_t kMaxBurst = 32;
+  inline static const size_t kMaxBurst = BESS_MAX_BURST;
 
  private:
   int cnt_;
@@ -75,6 +82,10 @@ class PacketBatch {
 };
 
 static_assert(std::is_pod<PacketBatch>::value, "PacketBatch is not a POD Type");
+static_assert(PacketBatch::kMaxBurst >= 4 && PacketBatch::kMaxBurst <= 256,
+              "BESS_MAX_BURST must be in [4, 256]");
+static_assert((PacketBatch::kMaxBurst & (PacketBatch::kMaxBurst - 1)) == 0,
+              "BESS_MAX_BURST must be a power of two");
 
 }  // namespace bess
 
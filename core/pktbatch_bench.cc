@@ -0,0 +1,204 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmarks a reference pipeline at every burst size up to
+// PacketBatch::kMaxBurst. Build with BESS_MAX_BURST=<n> to cover larger sizes.
+// Each size runs with and without fused chains (see ModuleGraph).
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include <string>
+
+#include "module.h"
+#include "module_graph.h"
+#include "packet_pool.h"
+#include "pktbatch.h"
+#include "task.h"
+#include "utils/ether.h"
+#include "utils/time.h"
+
+namespace {
+
+// Allocates 'burst' packets per run, like a PortInc on a busy port would.
+class BenchSource final : public Module {
+ public:
+  static const gate_idx_t kNumIGates = 0;
+
+  BenchSource() : Module(), pool_(), burst_() { is_task_ = true; }
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
+                             void *) override {
+    CHECK(pool_->AllocBulk(batch->pkts(), burst_, 60));
+    batch->set_cnt(burst_);
+    RunNextModule(ctx, batch);
+    return {.block = false, .packets = burst_, .bits = burst_ * 60 * 8};
+  }
+
+  void set_pool(bess::PacketPool *pool) { pool_ = pool; }
+  void set_burst(uint32_t burst) { burst_ = burst; }
+
+ private:
+  bess::PacketPool *pool_;
+  uint32_t burst_;
+};
+
+// Touches every packet in the batch, like MACSwap.
+class BenchSwap final : public Module {
+ public:
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override {
+    using bess::utils::Ethernet;
+
+    int cnt = batch->cnt();
+    for (int i = 0; i < cnt; i++) {
+      Ethernet *eth = batch->pkts()[i]->head_data<Ethernet *>();
+      Ethernet::Address tmp = eth->dst_addr;
+      eth->dst_addr = eth->src_addr;
+      eth->src_addr = tmp;
+    }
+    RunNextModule(ctx, batch);
+  }
+};
+
+// Frees the batch, like a PortOut that always succeeds.
+class BenchSink final : public Module {
+ public:
+  static const gate_idx_t kNumOGates = 0;
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *, bess::PacketBatch *batch) override {
+    bess::Packet::Free(batch);
+  }
+};
+
+DEF_MODULE(BenchSource, "bench_source", "allocates packets");
+DEF_MODULE(BenchSwap, "bench_swap", "swaps MAC addresses");
+DEF_MODULE(BenchSink, "bench_sink", "frees packets");
+
+Module *CreateBenchModule(const std::string &class_name,
+                          const std::string &name) {
+  const ModuleBuilder &builder =
+      ModuleBuilder::all_module_builders().find(class_name)->second;
+
+  bess::pb::EmptyArg arg_;
+  google::protobuf::Any arg;
+  arg.PackFrom(arg_);
+
+  pb_error_t perr;
+  Module *m = ModuleGraph::CreateModule(builder, name, arg, &perr);
+  CHECK(m) << perr.errmsg();
+  return m;
+}
+
+// Sets up "source -> swap x kNumStages -> sink", run as a single task.
+// Unless state.range(1) is 0, gates are connected without the default track
+// hook, so that the pipeline runs as one fused chain.
+class PipelineFixture : public benchmark::Fixture {
+ public:
+  static const int kNumStages = 4;
+
+  PipelineFixture() : pool_(), task_(), src_() {}
+
+  void SetUp(benchmark::State &state) override {
+    pool_ = new bess::PlainPacketPool();
+
+    src_ = static_cast<BenchSource *>(CreateBenchModule("BenchSource", "src"));
+    src_->set_pool(pool_);
+    src_->set_burst(state.range(0));
+    bool fused = state.range(1);
+
+    Module *prev = src_;
+    for (int i = 0; i < kNumStages; i++) {
+      Module *m = CreateBenchModule("BenchSwap", "swap" + std::to_string(i));
+      CHECK_EQ(ModuleGraph::ConnectModules(prev, 0, m, 0, fused), 0);
+      prev = m;
+    }
+    Module *sink = CreateBenchModule("BenchSink", "sink");
+    CHECK_EQ(ModuleGraph::ConnectModules(prev, 0, sink, 0, fused), 0);
+    ModuleGraph::UpdateTaskGraph();
+    CHECK_EQ(src_->ogates()[0]->fused(), fused);
+
+    task_ = new Task(src_, nullptr);
+  }
+
+  void TearDown(benchmark::State &) override {
+    delete task_;
+    task_ = nullptr;
+
+    ModuleGraph::DestroyAllModules();
+
+    delete pool_;
+    pool_ = nullptr;
+  }
+
+ protected:
+  BenchSource_class BenchSource_singleton_;
+  BenchSwap_class BenchSwap_singleton_;
+  BenchSink_class BenchSink_singleton_;
+
+  bess::PacketPool *pool_;
+  Task *task_;
+  BenchSource *src_;
+};
+
+// Runs the pipeline once per iteration and reports cycles per packet.
+BENCHMARK_DEFINE_F(PipelineFixture, RunTask)(benchmark::State &state) {
+  Context ctx = {};
+  ctx.task = task_;
+
+  uint64_t pkts = 0;
+  uint64_t start = rdtsc();
+  while (state.KeepRunning()) {
+    ctx.current_tsc = rdtsc();
+    pkts += (*task_)(&ctx).packets;
+  }
+  uint64_t cycles = rdtsc() - start;
+
+  state.SetItemsProcessed(pkts);
+  state.counters["cycles/pkt"] = static_cast<double>(cycles) / pkts;
+}
+
+void BurstSizes(benchmark::internal::Benchmark *b) {
+  for (size_t burst = 1; burst <= bess::PacketBatch::kMaxBurst; burst *= 2) {
+    b->Args({static_cast<int>(burst), 0});
+    b->Args({static_cast<int>(burst), 1});
+  }
+}
+
+BENCHMARK_REGISTER_F(PipelineFixture, RunTask)->Apply(BurstSizes);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -176,6 +176,8 @@ class PortBuilder {
                       // InitPortClass()?
 };
 
+// Indexed by a number of packets in [0, kMaxBurst], so it has as many bins as
+// the build's BESS_MAX_BURST plus one.
 struct BatchHistogram
     : public std::array<uint64_t, bess::PacketBatch::kMaxBurst + 1> {
   BatchHistogram &operator+=(const BatchHistogram &rhs) {
@@ -249,6 +251,10 @@ class Port {
 
   virtual uint64_t GetFlags() const { return 0; }
 
+  // Returns a file descriptor that becomes readable when the incoming queue
+  // 'qid' has packets to receive, or -1 if the driver cannot tell (optional).
+  virtual int GetRxQueueFd([[maybe_unused]] queue_t qid) const { return -1; }
+
   /*!
    * Get any placement constraints that need to be met when receiving from this
    * port.
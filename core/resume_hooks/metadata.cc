@@ -29,18 +29,29 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include "../metadata.h"
+#include "../module_graph.h"
 #include "metadata.h"
 
 const std::string SetupMetadata::kName = "setup_metadata";
 
-SetupMetadata::SetupMetadata() : bess::ResumeHook(kName, kPriority, true) {}
+SetupMetadata::SetupMetadata()
+    : bess::ResumeHook(kName, kPriority, true), computed_(), generation_() {}
 
 CommandResponse SetupMetadata::Init(const bess::pb::EmptyArg &) {
   return CommandSuccess();
 }
 
 void SetupMetadata::Run() {
-  bess::metadata::default_pipeline.ComputeMetadataOffsets();
+  // Offsets only depend on the modules and how they are connected.
+  uint64_t generation = ModuleGraph::generation();
+  if (computed_ && generation == generation_) {
+    return;
+  }
+
+  if (bess::metadata::default_pipeline.ComputeMetadataOffsets() == 0) {
+    computed_ = true;
+    generation_ = generation;
+  }
 }
 
 ADD_RESUME_HOOK(SetupMetadata)
@@ -46,6 +46,11 @@ class SetupMetadata final : public bess::ResumeHook {
 
   static constexpr uint16_t kPriority = 0;
   static const std::string kName;
+
+ private:
+  // Set once offsets are computed for ModuleGraph::generation() 'generation_'.
+  bool computed_;
+  uint64_t generation_;
 };
 
 #endif  // BESS_RESUME_HOOKS_METADATA_
@@ -0,0 +1,427 @@
+// Copyright (c) 2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "scheduler.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <functional>
+
+namespace bess {
+
+void Scheduler::RebuildFlatTree() {
+  auto tree = std::make_shared<TcFlatTree>();
+
+  // Pre-order, so that the nodes on the path from the root to a leaf tend to
+  // share cache lines. Also passes the batch limits of pacing rate limiters
+  // down to the leaves.
+  std::function<void(TrafficClass *, uint32_t, bool)> collect =
+      [&](TrafficClass *c, uint32_t batch_limit, bool paced) {
+        c->flat_tree_ = tree;
+        c->flat_idx_ = tree->size();
+        tree->push_back({c, c->policy_, -1});
+
+        if (c->policy_ == POLICY_RATE_LIMIT) {
+          auto *rl = static_cast<RateLimitTrafficClass *>(c);
+          batch_limit = std::min(batch_limit, rl->batch_limit());
+          paced = paced || rl->pacing_gap_ns();
+        } else if (c->policy_ == POLICY_LEAF) {
+          auto *leaf = static_cast<LeafTrafficClass *>(c);
+          leaf->batch_limit_ = batch_limit;
+          leaf->paced_ = paced;
+        }
+
+        for (TrafficClass *child : c->Children()) {
+          collect(child, batch_limit, paced);
+        }
+      };
+
+  if (root_) {
+    collect(root_, bess::PacketBatch::kMaxBurst, false);
+  }
+
+  // Now that all classes have their indices
+  for (TcFlatNode &node : *tree) {
+    node.tc->UpdateFlatPick();
+  }
+
+  flat_tree_ = tree;
+  flat_root_ = root_;
+  flat_version_ = TrafficClass::tree_version();
+}
+
+void Scheduler::set_opts(const SchedulerOpts &opts) {
+  CloseIdle();
+  opts_ = opts;
+
+  wakeup_queue_.set_type(opts_.wakeup_timing_wheel
+                             ? SchedWakeupQueue::kTimingWheel
+                             : SchedWakeupQueue::kHeap);
+
+  if (!opts_.idle_sleep) {
+    return;
+  }
+
+  idle_epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  PCHECK(idle_epoll_fd_ >= 0) << "epoll_create1()";
+
+  idle_timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  PCHECK(idle_timer_fd_ >= 0) << "timerfd_create()";
+
+  idle_event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  PCHECK(idle_event_fd_ >= 0) << "eventfd()";
+
+  // data.ptr is nullptr for our own fds, and an IdleSource for task fds.
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  PCHECK(epoll_ctl(idle_epoll_fd_, EPOLL_CTL_ADD, idle_timer_fd_, &ev) == 0);
+  PCHECK(epoll_ctl(idle_epoll_fd_, EPOLL_CTL_ADD, idle_event_fd_, &ev) == 0);
+}
+
+void Scheduler::CloseIdle() {
+  for (int *fd : {&idle_epoll_fd_, &idle_timer_fd_, &idle_event_fd_}) {
+    if (*fd >= 0) {
+      close(*fd);
+      *fd = -1;
+    }
+  }
+  idle_sources_.clear();
+}
+
+void Scheduler::InterruptIdle() {
+  if (idle_event_fd_ < 0) {
+    return;
+  }
+
+  uint64_t one = 1;
+  ssize_t ret = write(idle_event_fd_, &one, sizeof(one));
+  // EAGAIN means the counter is saturated, so the worker will wake up anyway.
+  if (ret != sizeof(one) && errno != EAGAIN) {
+    PLOG(ERROR) << "write(idle eventfd)";
+  }
+}
+
+void Scheduler::RefreshIdleSources() {
+  if (idle_epoll_fd_ < 0) {
+    return;
+  }
+
+  // Let the kernel fire our timers as precisely as it can.
+  prctl(PR_SET_TIMERSLACK, 1UL);
+
+  for (const auto &src : idle_sources_) {
+    // May fail if the fd has been closed in the meantime. That's fine.
+    epoll_ctl(idle_epoll_fd_, EPOLL_CTL_DEL, src.fd, nullptr);
+  }
+  idle_sources_.clear();
+
+  if (!root_) {
+    return;
+  }
+
+  std::function<void(TrafficClass *)> collect = [&](TrafficClass *c) {
+    if (c->policy() != POLICY_LEAF) {
+      for (TrafficClass *child : c->Children()) {
+        collect(child);
+      }
+      return;
+    }
+
+    LeafTrafficClass *leaf = static_cast<LeafTrafficClass *>(c);
+    int fd = leaf->task()->GetWakeupFd();
+    if (fd >= 0) {
+      idle_sources_.push_back({fd, leaf, false});
+    }
+  };
+  collect(root_);
+
+  // The pointers to elements are handed to the kernel, so do not resize the
+  // vector after this point. Sources are registered disarmed; IdleWait() arms
+  // those whose leaf is waiting for work.
+  for (auto &src : idle_sources_) {
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = &src;
+    if (epoll_ctl(idle_epoll_fd_, EPOLL_CTL_ADD, src.fd, &ev) != 0) {
+      PLOG(WARNING) << "Cannot watch wakeup fd " << src.fd << " of TC "
+                    << src.leaf->name();
+      src.fd = -1;
+      continue;
+    }
+    // EPOLLONESHOT fds are armed upon ADD. Disarm until needed.
+    ev.events = EPOLLONESHOT;
+    epoll_ctl(idle_epoll_fd_, EPOLL_CTL_MOD, src.fd, &ev);
+  }
+}
+
+void Scheduler::WakeLeaf(LeafTrafficClass *leaf, uint64_t tsc) {
+  if (!leaf->wakeup_time_) {
+    return;
+  }
+
+  wakeup_queue_.Remove(leaf);
+  leaf->wakeup_time_ = 0;
+  leaf->UnblockTowardsRoot(tsc);
+}
+
+void Scheduler::IdleWait(uint64_t now) {
+  // We will not come back here for a while once we are asked to pause.
+  if (current_worker.is_pause_requested()) {
+    return;
+  }
+
+  const uint64_t max_sleep = opts_.idle_max_sleep_us * tsc_hz / 1000000;
+  const uint64_t margin = opts_.idle_wakeup_margin_us * tsc_hz / 1000000;
+
+  uint64_t deadline = now + max_sleep;
+  if (!wakeup_queue_.empty()) {
+    deadline = std::min(deadline, wakeup_queue_.NextWakeupTime());
+  }
+
+  // Too close to be worth a sleep; keep spinning.
+  if (deadline <= now + margin) {
+    return;
+  }
+
+  const uint64_t wakeup_tsc = deadline - margin;
+  const uint64_t sleep_ns = tsc_to_ns(wakeup_tsc - now);
+
+  struct itimerspec its = {};
+  its.it_value.tv_sec = sleep_ns / 1000000000;
+  its.it_value.tv_nsec = sleep_ns % 1000000000;
+  PCHECK(timerfd_settime(idle_timer_fd_, 0, &its, nullptr) == 0);
+
+  // Arm the wakeup fds of leaves that are backing off for lack of work.
+  for (auto &src : idle_sources_) {
+    if (src.fd >= 0 && !src.armed && src.leaf->wakeup_time_) {
+      struct epoll_event ev = {};
+      ev.events = EPOLLIN | EPOLLONESHOT;
+      ev.data.ptr = &src;
+      src.armed = (epoll_ctl(idle_epoll_fd_, EPOLL_CTL_MOD, src.fd, &ev) == 0);
+    }
+  }
+
+  static const int kMaxEvents = 16;
+  struct epoll_event events[kMaxEvents];
+  int num_events;
+  do {
+    num_events = epoll_wait(idle_epoll_fd_, events, kMaxEvents, -1);
+  } while (num_events < 0 && errno == EINTR);
+  PCHECK(num_events >= 0) << "epoll_wait()";
+
+  uint64_t woken = rdtsc();
+  bool timer_fired = false;
+
+  for (int i = 0; i < num_events; i++) {
+    IdleSource *src = static_cast<IdleSource *>(events[i].data.ptr);
+    if (src) {
+      src->armed = false;
+      WakeLeaf(src->leaf, woken);
+    } else {
+      // Either the timer or an interruption. Just drain both.
+      uint64_t val;
+      if (read(idle_timer_fd_, &val, sizeof(val)) == sizeof(val)) {
+        timer_fired = true;
+      }
+      [[maybe_unused]] ssize_t ret = read(idle_event_fd_, &val, sizeof(val));
+    }
+  }
+
+  if (!timer_fired) {
+    // Woken up early. Cancel the timer so that it won't fire spuriously.
+    its = {};
+    timerfd_settime(idle_timer_fd_, 0, &its, nullptr);
+  }
+
+  ++stats_.cnt_sleep;
+  stats_.cycles_sleep += woken - now;
+  if (timer_fired) {
+    uint64_t jitter = (woken > wakeup_tsc) ? woken - wakeup_tsc : 0;
+    ++stats_.cnt_timer_wakeup;
+    stats_.cycles_wakeup_jitter += jitter;
+    stats_.max_cycles_wakeup_jitter.UpdateMax(jitter);
+  }
+
+  // Busy-wait the rest of the margin, so that the deadline is met precisely.
+  if (timer_fired) {
+    while (rdtsc() < deadline) {
+      __builtin_ia32_pause();
+    }
+  }
+}
+
+void Scheduler::RefreshStealSources() {
+  steal_peers_.clear();
+  steal_next_peer_ = 0;
+  steal_next_leaf_ = 0;
+
+  load_.store(0, std::memory_order_relaxed);
+  load_checkpoint_ = rdtsc();
+  busy_cycles_ = 0;
+
+  int num_leaves = 0;
+
+  // Every leaf must be visited, to reset the ones that used to be stealable.
+  std::function<void(TrafficClass *, bool)> collect = [&](TrafficClass *c,
+                                                          bool limited) {
+    if (c->policy() != POLICY_LEAF) {
+      limited = limited || (c->policy() == POLICY_RATE_LIMIT);
+      for (TrafficClass *child : c->Children()) {
+        collect(child, limited);
+      }
+      return;
+    }
+
+    // Stolen runs are not accounted in our tree, so leaves under a rate
+    // limiter are never stolen.
+    LeafTrafficClass *leaf = static_cast<LeafTrafficClass *>(c);
+    leaf->stealable_ = opts_.work_stealing && !limited &&
+                       num_leaves < kMaxStealLeaves &&
+                       leaf->task()->IsMigratable();
+    if (leaf->stealable_) {
+      // It may be still held by RevokeStealSources().
+      leaf->running_.store(false, std::memory_order_relaxed);
+      steal_leaves_[num_leaves++].store(leaf, std::memory_order_relaxed);
+    }
+  };
+
+  if (root_) {
+    collect(root_, false);
+  }
+
+  if (!opts_.work_stealing) {
+    return;
+  }
+
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    Worker *w = workers[wid];
+    if (!w) {
+      continue;
+    }
+    if (w->scheduler() == this) {
+      wid_ = wid;
+    } else if (w->scheduler()->opts().work_stealing) {
+      steal_peers_.push_back(w->scheduler());
+    }
+  }
+
+  num_steal_leaves_.store(num_leaves, std::memory_order_release);
+}
+
+void Scheduler::RevokeStealSources() {
+  int num_leaves = num_steal_leaves_.load(std::memory_order_relaxed);
+  num_steal_leaves_.store(0, std::memory_order_release);
+
+  // Peers may have picked up a leaf right before. Hold every leaf until we
+  // resume, as the TC tree and the pipelines may change in the meantime.
+  for (int i = 0; i < num_leaves; i++) {
+    LeafTrafficClass *leaf = steal_leaves_[i].load(std::memory_order_relaxed);
+    while (!leaf->TryAcquire()) {
+      __builtin_ia32_pause();
+    }
+  }
+}
+
+void Scheduler::UpdateLoad(uint64_t now) {
+  // 100us
+  const uint64_t period = tsc_hz / 10000;
+
+  uint64_t elapsed = now - load_checkpoint_;
+  if (elapsed < period) {
+    return;
+  }
+
+  uint64_t load = std::min<uint64_t>(busy_cycles_ * kLoadScale / elapsed,
+                                     kLoadScale);
+  load_.store(load, std::memory_order_relaxed);
+  load_checkpoint_ = now;
+  busy_cycles_ = 0;
+}
+
+bool Scheduler::TrySteal(Context *ctx) {
+  const size_t num_peers = steal_peers_.size();
+
+  for (size_t i = 0; i < num_peers; i++) {
+    size_t peer_idx = (steal_next_peer_ + i) % num_peers;
+    Scheduler *peer = steal_peers_[peer_idx];
+    if (peer->load() < kStealMinPeerLoad) {
+      continue;
+    }
+
+    int num_leaves = peer->num_steal_leaves_.load(std::memory_order_acquire);
+    for (int j = 0; j < num_leaves; j++) {
+      size_t leaf_idx = (steal_next_leaf_ + j) % num_leaves;
+      LeafTrafficClass *leaf =
+          peer->steal_leaves_[leaf_idx].load(std::memory_order_relaxed);
+      if (!leaf->TryAcquire()) {
+        continue;
+      }
+
+      uint64_t start = rdtsc();
+      ctx->current_tsc = start;
+      ctx->current_ns = start * ns_per_cycle_;
+      current_worker.set_current_tsc(ctx->current_tsc);
+      current_worker.set_current_ns(ctx->current_ns);
+
+      ctx->task = leaf->task();
+      ctx->batch_limit = leaf->batch_limit();
+      ctx->silent_drops = 0;
+      ctx->owner_wid = peer->wid_;
+
+      auto ret = (*ctx->task)(ctx);
+      leaf->Release();
+      ctx->owner_wid = ctx->wid;
+
+      uint64_t cycles = rdtsc() - start;
+      current_worker.incr_silent_drops(ctx->silent_drops);
+      leaf->AccountStolen(cycles, ret.packets);
+
+      ++stats_.cnt_steal;
+      stats_.cycles_steal += cycles;
+
+      // Stick to the same task as long as it has work to do.
+      steal_next_peer_ = peer_idx;
+      steal_next_leaf_ = ret.packets ? leaf_idx : leaf_idx + 1;
+      return true;
+    }
+  }
+
+  steal_next_peer_++;
+  return false;
+}
+
+}  // namespace bess
@@ -31,29 +31,65 @@
 #ifndef BESS_SCHEDULER_H_
 #define BESS_SCHEDULER_H_
 
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "module.h"
 #include "traffic_class.h"
+#include "utils/counter.h"
 #include "utils/extended_priority_queue.h"
+#include "utils/timing_wheel.h"
 #include "worker.h"
 
 namespace bess {
 
-struct sched_stats {
-  resource_arr_t usage;
-  uint64_t cnt_idle;
-  uint64_t cycles_idle;
+// Scheduler-wide statistics of a worker. Only the worker updates them, but the
+// control thread may read them at any time without pausing the worker.
+// Cache-line aligned to avoid false sharing with the other fields.
+struct alignas(64) sched_stats {
+  using counter = utils::SingleWriterCounter;
+
+  // Bucket i of run_length_hist counts the task runs that took [2^(i-1), 2^i)
+  // cycles. Bucket 0 is for zero-cycle runs, and the last one for the rest.
+  static constexpr int kNumRunLengthBuckets = 40;
+
+  counter usage[NUM_RESOURCES];  // Sum of all task runs
+  counter run_length_hist[kNumRunLengthBuckets];
+  counter cnt_idle;
+  counter cycles_idle;
+
+  // Idle mode (see Scheduler::IdleWait())
+  counter cnt_sleep;             // # of times the worker went to sleep
+  counter cycles_sleep;          // Cycles spent sleeping
+  counter cnt_timer_wakeup;      // # of sleeps ended by the deadline timer
+  counter cycles_wakeup_jitter;  // Sum of timer wakeup lateness
+  counter max_cycles_wakeup_jitter;
+
+  // Work stealing (see Scheduler::TrySteal())
+  counter cnt_steal;     // # of tasks run on behalf of other workers
+  counter cycles_steal;  // Cycles spent on them
+
+  // Task runs within run budgets that did not go through Next(). See
+  // LeafTrafficClass::run_budget_cycles().
+  counter cnt_budget_rerun;
 };
 
 class Scheduler;
 
 // Queue of blocked traffic classes ordered by time expiration.
+// Backed by either a binary heap (default) or a hierarchical timing wheel,
+// which has O(1) Add(), Remove() and expiration.
 class SchedWakeupQueue {
  public:
+  enum Type {
+    kHeap = 0,
+    kTimingWheel,
+  };
+
   struct WakeupComp {
     bool operator()(const TrafficClass *left, const TrafficClass *right) const {
       // Reversed so that priority_queue is a min priority queue.
@@ -61,22 +97,72 @@ class SchedWakeupQueue {
     }
   };
 
-  SchedWakeupQueue() : q_() {}
+  SchedWakeupQueue() : type_(kHeap), q_(), wheel_() {}
+
+  Type type() const { return type_; }
+
+  // Switches the underlying data structure. The queue must be empty.
+  void set_type(Type type) {
+    CHECK(empty());
+    type_ = type;
+  }
 
   // Adds the given traffic class to those that are considered blocked.
-  void Add(TrafficClass *c) { q_.push(c); }
+  void Add(TrafficClass *c) {
+    if (type_ == kTimingWheel) {
+      wheel_.Add(c, c->wakeup_time());
+    } else {
+      q_.push(c);
+    }
+  }
+
+  bool empty() const {
+    return (type_ == kTimingWheel) ? wheel_.empty() : q_.empty();
+  }
+
+  // Returns the earliest wakeup time. The queue must not be empty.
+  uint64_t NextWakeupTime() const {
+    return (type_ == kTimingWheel) ? wheel_.NextExpiry()
+                                   : q_.top()->wakeup_time();
+  }
 
   // Removes the given traffic class from the blocked list.
-  void Remove(const TrafficClass *c) {
+  void Remove(TrafficClass *c) {
+    if (type_ == kTimingWheel) {
+      wheel_.Remove(c);
+      return;
+    }
     const auto del_pred = [&](const TrafficClass *t) { return t == c; };
     q_.delete_single_element(del_pred);
   }
 
+  // Removes all traffic classes whose wakeup time is before 'tsc', calling
+  // func(c) for each.
+  template <typename F>
+  void Expire(uint64_t tsc, F func) {
+    if (type_ == kTimingWheel) {
+      wheel_.Expire(tsc, func);
+      return;
+    }
+
+    while (!q_.empty()) {
+      TrafficClass *c = q_.top();
+      if (c->wakeup_time() < tsc) {
+        q_.pop();
+        func(c);
+      } else {
+        break;
+      }
+    }
+  }
+
  private:
-  friend class Scheduler;
+  Type type_;
 
   // A priority queue of TrafficClasses to wake up ordered by time.
   bess::utils::extended_priority_queue<TrafficClass *, WakeupComp> q_;
+
+  bess::utils::TimingWheel<TrafficClass, &TrafficClass::wheel_link_> wheel_;
 };
 
 // The non-instantiable base class for schedulers.  Implements common routines
@@ -86,13 +172,31 @@ class Scheduler {
   explicit Scheduler(TrafficClass *root = nullptr)
       : root_(root),
         default_rr_class_(),
+        flat_tree_(),
+        flat_root_(),
+        flat_version_(),
         wakeup_queue_(),
         stats_(),
         checkpoint_(),
-        ns_per_cycle_(1e9 / tsc_hz) {}
+        ns_per_cycle_(1e9 / tsc_hz),
+        opts_(),
+        busy_cycles_(),
+        idle_epoll_fd_(-1),
+        idle_timer_fd_(-1),
+        idle_event_fd_(-1),
+        idle_sources_(),
+        load_(),
+        load_checkpoint_(),
+        num_steal_leaves_(),
+        steal_leaves_(),
+        steal_peers_(),
+        wid_(),
+        steal_next_peer_(),
+        steal_next_leaf_() {}
 
   // TODO(barath): Do real cleanup, akin to sched_free() from the old impl.
   virtual ~Scheduler() {
+    CloseIdle();
     if (root_) {
       TrafficClassBuilder::Clear(root_);
     }
@@ -102,21 +206,49 @@ class Scheduler {
   // Runs the scheduler loop forever.
   virtual void ScheduleLoop() = 0;
 
+  const SchedulerOpts &opts() const { return opts_; }
+
+  // Must be called before the worker starts running.
+  void set_opts(const SchedulerOpts &opts);
+
+  const struct sched_stats &stats() const { return stats_; }
+
+  // Puts the worker to sleep while everything is blocked, until the earliest
+  // wakeup deadline (minus the configured margin, which is busy-waited), a
+  // task wakeup fd becoming readable, InterruptIdle(), or at most
+  // opts().idle_max_sleep_us, whichever comes first. Only for schedulers with
+  // opts().idle_sleep set, right after Next() has returned nullptr.
+  void IdleWait(uint64_t now);
+
+  // Wakes up the worker if it is sleeping in IdleWait().
+  // Called by the master thread.
+  void InterruptIdle();
+
+  // (Re)collects the wakeup fds of all tasks in the tree. Called by the worker
+  // whenever it resumes, since the tree only changes while paused.
+  void RefreshIdleSources();
+
+  // Fraction of cycles spent on tasks that did some work during the last
+  // period, out of kLoadScale. Maintained only with opts().work_stealing.
+  uint32_t load() const { return load_.load(std::memory_order_relaxed); }
+
+  // (Re)collects the leaves that peers may steal, and the peers to steal from.
+  // Called by the worker whenever it resumes.
+  void RefreshStealSources();
+
+  // Withdraws all leaves from stealing, waiting for peers to finish running
+  // them. Called by the worker before it pauses.
+  void RevokeStealSources();
+
   // Wakes up any TrafficClasses whose wakeup time has passed.
   void WakeTCs(uint64_t tsc) {
-    while (!wakeup_queue_.q_.empty()) {
-      TrafficClass *c = wakeup_queue_.q_.top();
-      uint64_t wakeup_time = c->wakeup_time();
-      if (wakeup_time < tsc) {
-        wakeup_queue_.q_.pop();
-        c->wakeup_time_ = 0;
-
-        // Traverse upward toward root to unblock any blocked parents.
-        c->UnblockTowardsRoot(wakeup_time);
-      } else {
-        break;
-      }
-    }
+    wakeup_queue_.Expire(tsc, [](TrafficClass *c) {
+      uint64_t wakeup_time = c->wakeup_time_;
+      c->wakeup_time_ = 0;
+
+      // Traverse upward toward root to unblock any blocked parents.
+      c->UnblockTowardsRoot(wakeup_time);
+    });
   }
 
   TrafficClass *root() { return root_; }
@@ -186,6 +318,47 @@ class Scheduler {
       return nullptr;
     }
 
+    if (flat_version_ != TrafficClass::tree_version() || flat_root_ != root_) {
+      RebuildFlatTree();
+    }
+
+    const TcFlatNode *nodes = flat_tree_->data();
+    const int num_nodes = flat_tree_->size();
+    int i = 0;
+    while (nodes[i].policy != POLICY_LEAF) {
+      int pick = nodes[i].pick;
+      // Children always come after their parent. Anything else is a pick left
+      // stale by a change of children, so recompile and take the slow path.
+      if (unlikely(pick <= i || pick >= num_nodes)) {
+        RebuildFlatTree();
+        return PickLeaf();
+      }
+      i = pick;
+    }
+
+    return static_cast<LeafTrafficClass *>(nodes[i].tc);
+  }
+
+  // Same as Next(), but walks the TrafficClass objects with virtual calls,
+  // rather than the flattened tree. For testing and benchmarking.
+  LeafTrafficClass *NextUnflattened(uint64_t tsc) {
+    WakeTCs(tsc);
+
+    if (!root_ || root_->blocked()) {
+      return nullptr;
+    }
+
+    return PickLeaf();
+  }
+
+  // Compiles the tree into flat_tree_. Next() calls this whenever the tree has
+  // changed (e.g., by AddTc or UpdateTcParent), so it should not be needed
+  // elsewhere.
+  void RebuildFlatTree();
+
+ protected:
+  // Walks down from the (unblocked) root with PickNextChild().
+  LeafTrafficClass *PickLeaf() const {
     TrafficClass *c = root_;
     while (c->policy_ != POLICY_LEAF) {
       c = c->PickNextChild();
@@ -194,15 +367,107 @@ class Scheduler {
     return static_cast<LeafTrafficClass *>(c);
   }
 
- protected:
+  static constexpr uint32_t kLoadScale = 1024;
+
+  // Peers are stolen from only if they are busier than this...
+  static constexpr uint32_t kStealMinPeerLoad = kLoadScale * 3 / 4;
+
+  // ...and only by workers less busy than this.
+  static constexpr uint32_t kStealMaxLoad = kLoadScale / 4;
+
   // Starts at the given class and attempts to unblock classes on the path
   // towards the root.
   void UnblockTowardsRoot(TrafficClass *c, uint64_t tsc);
 
+  // Takes the right to run the task of 'leaf', which may be held by a peer
+  // if the leaf is stealable.
+  bool AcquireLeaf(LeafTrafficClass *leaf) {
+    return !leaf->stealable_ || leaf->TryAcquire();
+  }
+
+  void ReleaseLeaf(LeafTrafficClass *leaf) {
+    if (leaf->stealable_) {
+      leaf->Release();
+    }
+  }
+
+  // Runs the task of 'leaf' (already acquired) at checkpoint_. If the leaf has
+  // a run budget, keeps running the task until the budget is spent or a run
+  // finds nothing to do. Fills 'usage' with the sum of all runs, which are
+  // accounted for as one, and returns the time they ended. The result has the
+  // total packets and bits, and 'block' of the last run.
+  uint64_t RunLeaf(Context *ctx, LeafTrafficClass *leaf, resource_arr_t usage,
+                   struct task_result *result) {
+    const uint64_t budget_cycles = leaf->run_budget_cycles_;
+    const uint64_t budget_packets = leaf->run_budget_packets_;
+    const bool budgeted = leaf->has_run_budget();
+    uint64_t now = checkpoint_;
+
+    ctx->task = leaf->task();
+    ctx->batch_limit = leaf->batch_limit();
+    ctx->silent_drops = 0;
+
+    *result = {.block = false, .packets = 0, .bits = 0};
+    usage[RESOURCE_COUNT] = 0;
+
+    for (;;) {
+      ctx->current_tsc = now;  // Tasks see updated tsc.
+      ctx->current_ns = now * ns_per_cycle_;
+      current_worker.set_current_tsc(ctx->current_tsc);
+      current_worker.set_current_ns(ctx->current_ns);
+
+      auto ret = (*ctx->task)(ctx);
+      now = rdtsc();
+
+      ++usage[RESOURCE_COUNT];
+      result->block = ret.block;
+      result->packets += ret.packets;
+      result->bits += ret.bits;
+
+      if (!budgeted || !ret.packets ||
+          (budget_cycles && now - checkpoint_ >= budget_cycles) ||
+          (budget_packets && result->packets >= budget_packets)) {
+        break;
+      }
+      ++stats_.cnt_budget_rerun;
+    }
+
+    usage[RESOURCE_CYCLE] = now - checkpoint_;
+    usage[RESOURCE_PACKET] = result->packets;
+    usage[RESOURCE_BIT] = result->bits;
+    return now;
+  }
+
+  // Accounts a task run to the scheduler-wide statistics.
+  void AccountRun(const resource_arr_t usage) {
+    for (int i = 0; i < NUM_RESOURCES; i++) {
+      stats_.usage[i] += usage[i];
+    }
+
+    uint64_t cycles = usage[RESOURCE_CYCLE];
+    int bucket = cycles ? 64 - __builtin_clzll(cycles) : 0;
+    if (bucket >= sched_stats::kNumRunLengthBuckets) {
+      bucket = sched_stats::kNumRunLengthBuckets - 1;
+    }
+    ++stats_.run_length_hist[bucket];
+  }
+
+  // Updates load() at the end of each period. Called periodically.
+  void UpdateLoad(uint64_t now);
+
+  // Runs a stealable task of a peer whose load() is high. Returns true if one
+  // has been run.
+  bool TrySteal(Context *ctx);
+
   TrafficClass *root_;
 
   RoundRobinTrafficClass *default_rr_class_;
 
+  // The tree of root_ in depth-first order, as of flat_version_.
+  std::shared_ptr<TcFlatTree> flat_tree_;
+  TrafficClass *flat_root_;
+  uint64_t flat_version_;
+
   SchedWakeupQueue wakeup_queue_;
 
   struct sched_stats stats_;
@@ -211,7 +476,46 @@ class Scheduler {
 
   double ns_per_cycle_;
 
+  SchedulerOpts opts_;
+
+  // Cycles spent on tasks that did some work, during the current load period.
+  uint64_t busy_cycles_;
+
  private:
+  friend class FlatTreeTest;
+  friend class WorkStealingTest;
+
+  struct IdleSource {
+    int fd;
+    LeafTrafficClass *leaf;
+    bool armed;  // Registered with EPOLLONESHOT and not fired yet?
+  };
+
+  void CloseIdle();
+
+  // Unblocks a leaf that has been waiting in the wakeup queue.
+  void WakeLeaf(LeafTrafficClass *leaf, uint64_t tsc);
+
+  int idle_epoll_fd_;
+  int idle_timer_fd_;  // timerfd for the earliest wakeup deadline
+  int idle_event_fd_;  // eventfd for InterruptIdle()
+
+  std::vector<IdleSource> idle_sources_;
+
+  static constexpr int kMaxStealLeaves = 64;
+
+  std::atomic<uint32_t> load_;
+  uint64_t load_checkpoint_;
+
+  // Leaves that peers may steal, published with num_steal_leaves_.
+  std::atomic<int> num_steal_leaves_;
+  std::atomic<LeafTrafficClass *> steal_leaves_[kMaxStealLeaves];
+
+  std::vector<Scheduler *> steal_peers_;
+  int wid_;  // worker running this scheduler, for the runs stolen by peers
+  size_t steal_next_peer_;
+  size_t steal_next_leaf_;
+
   DISALLOW_COPY_AND_ASSIGN(Scheduler);
 };
 
@@ -235,15 +539,26 @@ class DefaultScheduler : public Scheduler {
 
     Context ctx = {};
     ctx.wid = current_worker.wid();
+    ctx.owner_wid = ctx.wid;
 
     // The main scheduling, running, accounting loop.
     for (uint64_t round = 0;; ++round) {
+      bool pause_now = current_worker.Quiesce();
+
       // Periodic check, to mitigate expensive operations.
-      if ((round & accounting_mask) == 0) {
+      if ((round & accounting_mask) == 0 || pause_now) {
         if (current_worker.is_pause_requested()) {
+          this->RevokeStealSources();
           if (current_worker.BlockWorker()) {
             break;
           }
+          this->RefreshIdleSources();
+          this->RefreshStealSources();
+          // Quiesce again, in case we were paused while held.
+          continue;
+        }
+        if (this->opts_.work_stealing) {
+          this->UpdateLoad(this->checkpoint_);
         }
       }
 
@@ -260,38 +575,45 @@ class DefaultScheduler : public Scheduler {
 
     uint64_t now;
     if (leaf) {
-      ctx->current_tsc = this->checkpoint_;  // Tasks see updated tsc.
-      ctx->current_ns = this->checkpoint_ * this->ns_per_cycle_;
-      current_worker.set_current_tsc(ctx->current_tsc);
-      current_worker.set_current_ns(ctx->current_ns);
-
-      ctx->task = leaf->task();
-      ctx->silent_drops = 0;
+      if (!this->AcquireLeaf(leaf)) {
+        // A peer is running the task at the moment. Try again later.
+        this->checkpoint_ = rdtsc();
+        return;
+      }
 
       // Run.
-      auto ret = (*ctx->task)(ctx);
-
-      now = rdtsc();
+      struct task_result ret;
+      now = this->RunLeaf(ctx, leaf, usage, &ret);
+      this->ReleaseLeaf(leaf);
 
       // Account.
-      usage[RESOURCE_COUNT] = 1;
-      usage[RESOURCE_CYCLE] = now - this->checkpoint_;
-      usage[RESOURCE_PACKET] = ret.packets;
-      usage[RESOURCE_BIT] = ret.bits;
-
       current_worker.incr_silent_drops(ctx->silent_drops);
-      // TODO(barath): Re-enable scheduler-wide stats accumulation.
-      // accumulate(stats_.usage, usage);
 
       leaf->FinishAndAccountTowardsRoot(&this->wakeup_queue_, nullptr, usage,
                                         now);
+
+      if (ret.packets) {
+        this->AccountRun(usage);
+        this->busy_cycles_ += usage[RESOURCE_CYCLE];
+      } else {
+        // An empty run is no better than spinning.
+        ++this->stats_.cnt_idle;
+        this->stats_.cycles_idle += usage[RESOURCE_CYCLE];
+
+        if (this->opts_.work_stealing && this->load() < this->kStealMaxLoad &&
+            this->TrySteal(ctx)) {
+          now = rdtsc();
+        }
+      }
+    } else if (this->opts_.work_stealing && this->TrySteal(ctx)) {
+      // Everything is blocked, but a peer had something for us to do.
+      now = rdtsc();
     } else {
-      // TODO(barath): Ideally, we wouldn't spin in this case but rather take
-      // the fact that Next() returned nullptr as an indication that everything
-      // is blocked, so we could wait until something is added that unblocks us.
-      // We currently have no functionality to support such whole-scheduler
-      // blocking/unblocking.
+      // Everything is blocked. Unless idle mode is enabled, we just spin.
       ++this->stats_.cnt_idle;
+      if (this->opts_.idle_sleep) {
+        this->IdleWait(this->checkpoint_);
+      }
 
       now = rdtsc();
       this->stats_.cycles_idle += (now - this->checkpoint_);
@@ -322,15 +644,26 @@ class ExperimentalScheduler : public Scheduler {
 
     Context ctx = {};
     ctx.wid = current_worker.wid();
+    ctx.owner_wid = ctx.wid;
 
     // The main scheduling, running, accounting loop.
     for (uint64_t round = 0;; ++round) {
+      bool pause_now = current_worker.Quiesce();
+
       // Periodic check, to mitigate expensive operations.
-      if ((round & accounting_mask) == 0) {
+      if ((round & accounting_mask) == 0 || pause_now) {
         if (current_worker.is_pause_requested()) {
+          this->RevokeStealSources();
           if (current_worker.BlockWorker()) {
             break;
           }
+          this->RefreshIdleSources();
+          this->RefreshStealSources();
+          // Quiesce again, in case we were paused while held.
+          continue;
+        }
+        if (this->opts_.work_stealing) {
+          this->UpdateLoad(this->checkpoint_);
         }
       }
 
@@ -347,16 +680,16 @@ class ExperimentalScheduler : public Scheduler {
 
     uint64_t now;
     if (leaf) {
-      ctx->current_tsc = this->checkpoint_;  // Tasks see updated tsc.
-      ctx->current_ns = this->checkpoint_ * this->ns_per_cycle_;
-      current_worker.set_current_tsc(ctx->current_tsc);
-      current_worker.set_current_ns(ctx->current_ns);
-
-      ctx->task = leaf->task();
+      if (!this->AcquireLeaf(leaf)) {
+        // A peer is running the task at the moment. Try again later.
+        this->checkpoint_ = rdtsc();
+        return;
+      }
 
       // Run.
-      auto ret = (*ctx->task)(ctx);
-      now = rdtsc();
+      struct task_result ret;
+      now = this->RunLeaf(ctx, leaf, usage, &ret);
+      this->ReleaseLeaf(leaf);
 
       if (ret.packets == 0 && ret.block) {
         constexpr uint64_t kMaxWait = 1ull << 20;
@@ -373,18 +706,28 @@ class ExperimentalScheduler : public Scheduler {
         usage[RESOURCE_BIT] = 0;
       } else {
         leaf->set_wait_cycles((leaf->wait_cycles() + 1) >> 1);
-
-        usage[RESOURCE_COUNT] = 1;
-        usage[RESOURCE_CYCLE] = now - this->checkpoint_;
-        usage[RESOURCE_PACKET] = ret.packets;
-        usage[RESOURCE_BIT] = ret.bits;
       }
 
       // Account.
+      if (ret.packets) {
+        this->AccountRun(usage);
+        this->busy_cycles_ += usage[RESOURCE_CYCLE];
+      } else {
+        // An empty run is no better than spinning.
+        ++this->stats_.cnt_idle;
+        this->stats_.cycles_idle += now - this->checkpoint_;
+      }
+
       leaf->FinishAndAccountTowardsRoot(&this->wakeup_queue_, nullptr, usage,
                                         now);
+    } else if (this->opts_.work_stealing && this->TrySteal(ctx)) {
+      // Everything is blocked, but a peer had something for us to do.
+      now = rdtsc();
     } else {
       ++this->stats_.cnt_idle;
+      if (this->opts_.idle_sleep) {
+        this->IdleWait(this->checkpoint_);
+      }
 
       now = rdtsc();
       this->stats_.cycles_idle += (now - this->checkpoint_);
@@ -34,6 +34,7 @@
 
 #include "gate.h"
 #include "module.h"
+#include "module_graph.h"
 
 // Called when the leaf that owns this task is destroyed.
 void Task::Detach() {
@@ -43,14 +44,27 @@ void Task::Detach() {
 // Called when the leaf that owns this task is created.
 void Task::Attach(bess::LeafTrafficClass *c) {
   c_ = c;
+  UpdatePerGateBatch(ModuleGraph::task_gate_cnt());
 }
 
 struct task_result Task::operator()(Context *ctx) const {
   bess::PacketBatch init_batch;
   ClearPacketBatch();
 
+  // ModuleGraph::ConfigureTasks() has made room for all gates, including the
+  // ones connected with workers running.
+  DCHECK_LE(ModuleGraph::gate_cnt(), gate_batch_.size());
+
   // Start from the first module (task module)
-  struct task_result result = module_->RunTask(ctx, &init_batch, arg_);
+  struct task_result result;
+  if (likely(!Module::profiling_enabled())) {
+    result = module_->RunTask(ctx, &init_batch, arg_);
+  } else {
+    module_->Profile(ctx, 0, [&]() {
+      result = module_->RunTask(ctx, &init_batch, arg_);
+    });
+  }
+
   // next_gate_: Continuously run if modules are chained
   // igates_to_run_ : If next module connection is not chained (merged),
   // check priority to choose which module run next
@@ -81,8 +95,7 @@ struct task_result Task::operator()(Context *ctx) const {
     }
 
     Module *m = igate->module();
-    m->ProcessBatch(ctx, batch);  // process module
-    m->ProcessOGates(ctx);        // process ogates
+    m->RunProcessBatch(ctx, batch);  // process module, then ogates
   }
 
   deadend(ctx, &dead_batch_);
@@ -106,3 +119,27 @@ void Task::AddActiveWorker(int wid) const {
     module_->AddActiveWorker(wid, c_->task());
   }
 }
+
+void Task::AddStealingWorker(int wid, int owner_wid) const {
+  if (module_) {
+    std::unordered_set<const Module *> visited;
+    module_->AddStealingWorker(wid, owner_wid, c_->task(), &visited);
+  }
+}
+
+int Task::GetWakeupFd() const {
+  return module_ ? module_->GetTaskWakeupFd(arg_) : -1;
+}
+
+uint64_t Task::GetHeadTsc() const {
+  return module_ ? module_->GetTaskHeadTsc(arg_) : 0;
+}
+
+bool Task::IsMigratable() const {
+  if (!module_ || !module_->IsTaskMigratable(arg_)) {
+    return false;
+  }
+
+  std::unordered_set<const Module *> visited;
+  return module_->IsPipelineMigratable(this, true, &visited);
+}
@@ -50,6 +50,11 @@ typedef uint64_t placement_constraint;
 
 #define MAX_PBATCH_CNT 256
 
+// A batch split by one module over its output gates needs up to kMaxBurst new
+// batches at once.
+static_assert(MAX_PBATCH_CNT >= bess::PacketBatch::kMaxBurst,
+              "MAX_PBATCH_CNT is too small for BESS_MAX_BURST");
+
 class Module;
 struct Context;
 
@@ -174,6 +179,20 @@ class Task {
 
   // Add a worker to the set of workers that call this task.
   void AddActiveWorker(int wid) const;
+
+  // Add a worker that may run this task by stealing it from its owner.
+  void AddStealingWorker(int wid, int owner_wid) const;
+
+  // Returns a file descriptor that becomes readable when this task has new
+  // work to do, or -1 if unknown. See Module::GetTaskWakeupFd().
+  int GetWakeupFd() const;
+
+  // Returns true if this task can be run by workers other than its owner.
+  bool IsMigratable() const;
+
+  // Returns the TSC at which the oldest pending work of this task was queued,
+  // or 0 if none or unknown. See Module::GetTaskHeadTsc().
+  uint64_t GetHeadTsc() const;
 };
 
 #endif  // BESS_TASK_H_
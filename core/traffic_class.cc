@@ -63,6 +63,41 @@ int TrafficClass::WorkerId() const {
   return Worker::kAnyWorker;
 }
 
+void TrafficClass::UpdateFlatPick() {
+  if (!flat_tree_) {
+    return;
+  }
+
+  // PickNextChild() is valid only if unblocked. The classes are final, so
+  // these calls are not virtual.
+  TrafficClass *next = nullptr;
+  if (!blocked_) {
+    switch (policy_) {
+      case POLICY_PRIORITY:
+        next = static_cast<PriorityTrafficClass *>(this)->PickNextChild();
+        break;
+      case POLICY_WEIGHTED_FAIR:
+        next = static_cast<WeightedFairTrafficClass *>(this)->PickNextChild();
+        break;
+      case POLICY_ROUND_ROBIN:
+        next = static_cast<RoundRobinTrafficClass *>(this)->PickNextChild();
+        break;
+      case POLICY_RATE_LIMIT:
+        next = static_cast<RateLimitTrafficClass *>(this)->PickNextChild();
+        break;
+      case POLICY_DEADLINE:
+        next = static_cast<DeadlineTrafficClass *>(this)->PickNextChild();
+        break;
+      default:
+        break;
+    }
+  }
+
+  // A child added since the tree was compiled has no index there (yet).
+  (*flat_tree_)[flat_idx_].pick =
+      (next && next->flat_tree_ == flat_tree_) ? next->flat_idx_ : -1;
+}
+
 PriorityTrafficClass::~PriorityTrafficClass() {
   for (auto &c : children_) {
     delete c.c_;
@@ -95,6 +130,7 @@ bool PriorityTrafficClass::AddChild(TrafficClass *child, priority_t priority) {
   ChildData d{priority, child};
   InsertSorted(children_, d);
   child->parent_ = this;
+  TreeChanged();
 
   UnblockTowardsRoot(rdtsc());
 
@@ -110,6 +146,7 @@ bool PriorityTrafficClass::RemoveChild(TrafficClass *child) {
     if (children_[i].c_ == child) {
       children_.erase(children_.begin() + i);
       child->parent_ = nullptr;
+      TreeChanged();
       if (first_runnable_ > i) {
         first_runnable_--;
       }
@@ -160,6 +197,8 @@ void PriorityTrafficClass::FinishAndAccountTowardsRoot(
     }
     blocked_ = (first_runnable_ == num_children);
   }
+  UpdateFlatPick();
+
   if (!parent_) {
     return;
   }
@@ -192,6 +231,8 @@ bool WeightedFairTrafficClass::AddChild(TrafficClass *child,
   }
 
   child->parent_ = this;
+  TreeChanged();
+
   ChildData child_data{STRIDE1 / (double)share, {NextPass()}, child};
   if (child->blocked_) {
     blocked_children_.push_back(child_data);
@@ -222,6 +263,7 @@ bool WeightedFairTrafficClass::RemoveChild(TrafficClass *child) {
     if (it->c == child) {
       blocked_children_.erase(it);
       child->parent_ = nullptr;
+      TreeChanged();
       return true;
     }
   }
@@ -230,6 +272,7 @@ bool WeightedFairTrafficClass::RemoveChild(TrafficClass *child) {
       [=](const ChildData &x) { return x.c == child; });
   if (ret) {
     child->parent_ = nullptr;
+    TreeChanged();
     BlockTowardsRoot();
     return true;
   }
@@ -291,6 +334,8 @@ void WeightedFairTrafficClass::FinishAndAccountTowardsRoot(
     runnable_children_.decrease_key_top();
   }
 
+  UpdateFlatPick();
+
   if (!parent_) {
     return;
   }
@@ -312,6 +357,7 @@ bool RoundRobinTrafficClass::AddChild(TrafficClass *child) {
     return false;
   }
   child->parent_ = this;
+  TreeChanged();
 
   if (child->blocked_) {
     blocked_children_.push_back(child);
@@ -343,6 +389,7 @@ bool RoundRobinTrafficClass::RemoveChild(TrafficClass *child) {
     if (*it == child) {
       blocked_children_.erase(it);
       child->parent_ = nullptr;
+      TreeChanged();
       return true;
     }
   }
@@ -351,6 +398,7 @@ bool RoundRobinTrafficClass::RemoveChild(TrafficClass *child) {
     if (runnable_children_[i] == child) {
       runnable_children_.erase(runnable_children_.begin() + i);
       child->parent_ = nullptr;
+      TreeChanged();
       if (next_child_ > i) {
         next_child_--;
       }
@@ -421,6 +469,8 @@ void RoundRobinTrafficClass::FinishAndAccountTowardsRoot(
     next_child_ = 0;
   }
 
+  UpdateFlatPick();
+
   if (!parent_) {
     return;
   }
@@ -450,6 +500,7 @@ bool RateLimitTrafficClass::AddChild(TrafficClass *child) {
 
   child_ = child;
   child->parent_ = this;
+  TreeChanged();
 
   UnblockTowardsRoot(rdtsc());
 
@@ -463,12 +514,25 @@ bool RateLimitTrafficClass::RemoveChild(TrafficClass *child) {
 
   child_->parent_ = nullptr;
   child_ = nullptr;
+  TreeChanged();
 
   BlockTowardsRoot();
 
   return true;
 }
 
+uint32_t RateLimitTrafficClass::batch_limit() const {
+  if (!pacing_gap_ns_ || resource_ != RESOURCE_PACKET || !limit_arg_) {
+    return bess::PacketBatch::kMaxBurst;
+  }
+
+  // Packets allowed per gap
+  uint64_t packets =
+      static_cast<uint64_t>(limit_arg_ * (pacing_gap_ns_ / 1e9));
+  return std::max<uint64_t>(
+      1, std::min<uint64_t>(packets, bess::PacketBatch::kMaxBurst));
+}
+
 TrafficClass *RateLimitTrafficClass::PickNextChild() {
   return child_;
 }
@@ -489,12 +553,45 @@ void RateLimitTrafficClass::FinishAndAccountTowardsRoot(
     SchedWakeupQueue *wakeup_queue, TrafficClass *child, resource_arr_t usage,
     uint64_t tsc) {
   ACCUMULATE(stats_.usage, usage);
+  uint64_t prev_tsc = last_tsc_;
   uint64_t elapsed_cycles = tsc - last_tsc_;
   last_tsc_ = tsc;
 
+  if (usage[resource_]) {
+    if (last_run_tsc_) {
+      uint64_t gap = tsc - last_run_tsc_;
+      if (!pacing_stats_.cnt_gaps || gap < pacing_stats_.gap_cycles_min) {
+        pacing_stats_.gap_cycles_min = gap;
+      }
+      pacing_stats_.gap_cycles_max =
+          std::max(pacing_stats_.gap_cycles_max, gap);
+      pacing_stats_.gap_cycles += gap;
+      pacing_stats_.cnt_gaps++;
+    }
+    last_run_tsc_ = tsc;
+  } else {
+    // Do not count idle periods as gaps.
+    last_run_tsc_ = 0;
+  }
+
   uint64_t tokens = tokens_ + limit_ * elapsed_cycles;
   uint64_t consumed = to_work_units(usage[resource_]);
-  if (tokens < consumed) {
+  if (pacing_gap_ns_) {
+    // Pacing. No tokens are saved: the next run is due when this one has been
+    // paid for, counting from when this one became eligible to run. Since
+    // that is the wakeup time if we were throttled, runs are evenly spaced.
+    tokens_ = 0;
+
+    if (limit_) {
+      uint64_t due = prev_tsc + consumed / limit_;
+      if (due > tsc) {
+        blocked_ = true;
+        ++stats_.cnt_throttled;
+        wakeup_time_ = due;
+        wakeup_queue->Add(this);
+      }
+    }
+  } else if (tokens < consumed) {
     // Exceeded limit, throttled.
     tokens_ = 0;
     blocked_ = true;
@@ -514,18 +611,175 @@ void RateLimitTrafficClass::FinishAndAccountTowardsRoot(
   // the rate limit.
   blocked_ |= child->blocked_;
 
+  UpdateFlatPick();
+
   if (!parent_) {
     return;
   }
   parent_->FinishAndAccountTowardsRoot(wakeup_queue, this, usage, tsc);
 }
 
+DeadlineTrafficClass::~DeadlineTrafficClass() {
+  while (!runnable_children_.empty()) {
+    delete runnable_children_.top().c;
+    runnable_children_.pop();
+  }
+  for (auto &c : blocked_children_) {
+    delete c.c;
+  }
+  TrafficClassBuilder::Clear(this);
+}
+
+std::vector<TrafficClass *> DeadlineTrafficClass::Children() const {
+  std::vector<TrafficClass *> ret;
+  for (const auto &child : all_children_) {
+    ret.push_back(child.first);
+  }
+  return ret;
+}
+
+bool DeadlineTrafficClass::AddChild(TrafficClass *child,
+                                    uint64_t deadline_ns) {
+  if (child->parent_ || deadline_ns == 0) {
+    return false;
+  }
+
+  child->parent_ = this;
+  TreeChanged();
+
+  uint64_t now = rdtsc();
+  uint64_t rel_deadline = static_cast<uint64_t>(deadline_ns * (tsc_hz / 1e9));
+  ChildData child_data{Deadline(child, rel_deadline, now), rel_deadline, child};
+  if (child->blocked_) {
+    blocked_children_.push_back(child_data);
+  } else {
+    runnable_children_.push(child_data);
+    UnblockTowardsRoot(now);
+  }
+
+  all_children_.emplace_back(child, deadline_ns);
+
+  return true;
+}
+
+bool DeadlineTrafficClass::RemoveChild(TrafficClass *child) {
+  if (child->parent_ != this) {
+    return false;
+  }
+
+  for (auto it = all_children_.begin(); it != all_children_.end(); it++) {
+    if (it->first == child) {
+      all_children_.erase(it);
+      break;
+    }
+  }
+
+  for (auto it = blocked_children_.begin(); it != blocked_children_.end();
+       it++) {
+    if (it->c == child) {
+      blocked_children_.erase(it);
+      child->parent_ = nullptr;
+      TreeChanged();
+      return true;
+    }
+  }
+
+  bool ret = runnable_children_.delete_single_element(
+      [=](const ChildData &x) { return x.c == child; });
+  if (ret) {
+    child->parent_ = nullptr;
+    TreeChanged();
+    BlockTowardsRoot();
+    return true;
+  }
+
+  return false;
+}
+
+TrafficClass *DeadlineTrafficClass::PickNextChild() {
+  return runnable_children_.top().c;
+}
+
+void DeadlineTrafficClass::UnblockTowardsRoot(uint64_t tsc) {
+  for (auto it = blocked_children_.begin(); it != blocked_children_.end();) {
+    if (!it->c->blocked_) {
+      it->deadline = Deadline(it->c, it->rel_deadline, tsc);
+      runnable_children_.push(*it);
+      blocked_children_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+
+  TrafficClass::UnblockTowardsRootSetBlocked(tsc, runnable_children_.empty());
+}
+
+void DeadlineTrafficClass::BlockTowardsRoot() {
+  runnable_children_.delete_single_element([&](const ChildData &x) {
+    if (x.c->blocked_) {
+      blocked_children_.push_back(x);
+      return true;
+    }
+    return false;
+  });
+
+  TrafficClass::BlockTowardsRootSetBlocked(runnable_children_.empty());
+}
+
+void DeadlineTrafficClass::FinishAndAccountTowardsRoot(
+    SchedWakeupQueue *wakeup_queue, TrafficClass *child, resource_arr_t usage,
+    uint64_t tsc) {
+  ACCUMULATE(stats_.usage, usage);
+
+  auto &item = runnable_children_.mutable_top();
+
+  // Runs that found nothing to do (e.g., polling an empty queue) never count
+  // as misses.
+  uint64_t start_tsc = tsc - usage[RESOURCE_CYCLE];
+  if (usage[RESOURCE_PACKET] && start_tsc > item.deadline) {
+    child->stats_.cnt_deadline_missed++;
+  }
+
+  if (child->blocked_) {
+    blocked_children_.emplace_back(std::move(item));
+    runnable_children_.pop();
+    blocked_ = runnable_children_.empty();
+  } else {
+    // Never moves backwards, so that the child only sinks in the heap.
+    item.deadline =
+        std::max(item.deadline, Deadline(child, item.rel_deadline, tsc));
+    runnable_children_.decrease_key_top();
+  }
+
+  UpdateFlatPick();
+
+  if (!parent_) {
+    return;
+  }
+  parent_->FinishAndAccountTowardsRoot(wakeup_queue, this, usage, tsc);
+}
+
+uint64_t DeadlineTrafficClass::Deadline(const TrafficClass *c,
+                                        uint64_t rel_deadline, uint64_t tsc) {
+  if (c->policy() == POLICY_LEAF) {
+    uint64_t head_tsc =
+        static_cast<const LeafTrafficClass *>(c)->task()->GetHeadTsc();
+    if (head_tsc && head_tsc < tsc) {
+      return head_tsc + rel_deadline;
+    }
+  }
+
+  return tsc + rel_deadline;
+}
+
 LeafTrafficClass::~LeafTrafficClass() {
   TrafficClassBuilder::Clear(this);
   task_->Detach();
   delete task_;
 }
 
+uint64_t TrafficClass::tree_version_;
+
 std::unordered_map<std::string, TrafficClass *> TrafficClassBuilder::all_tcs_;
 
 bool TrafficClassBuilder::ClearAll() {
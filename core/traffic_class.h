@@ -30,10 +30,12 @@
 #ifndef BESS_TRAFFIC_CLASS_H_
 #define BESS_TRAFFIC_CLASS_H_
 
+#include <atomic>
 #include <cstdint>
 #include <deque>
 #include <functional>
 #include <list>
+#include <memory>
 #include <queue>
 #include <string>
 #include <unordered_map>
@@ -46,6 +48,7 @@
 #include "utils/extended_priority_queue.h"
 #include "utils/simd.h"
 #include "utils/time.h"
+#include "utils/timing_wheel.h"
 
 using bess::utils::extended_priority_queue;
 
@@ -81,6 +84,15 @@ typedef int32_t resource_share_t;
 struct tc_stats {
   resource_arr_t usage;
   uint64_t cnt_throttled;
+  uint64_t cnt_deadline_missed;  // Runs that started past the deadline.
+};
+
+// Gaps between consecutive runs of a pacing rate limiter that did some work.
+struct pacing_stats {
+  uint64_t cnt_gaps;
+  uint64_t gap_cycles;  // Sum of all gaps.
+  uint64_t gap_cycles_min;
+  uint64_t gap_cycles_max;
 };
 
 class Scheduler;
@@ -90,6 +102,7 @@ class PriorityTrafficClass;
 class WeightedFairTrafficClass;
 class RoundRobinTrafficClass;
 class RateLimitTrafficClass;
+class DeadlineTrafficClass;
 class LeafTrafficClass;
 class TrafficClass;
 
@@ -98,6 +111,7 @@ enum TrafficPolicy {
   POLICY_WEIGHTED_FAIR,
   POLICY_ROUND_ROBIN,
   POLICY_RATE_LIMIT,
+  POLICY_DEADLINE,
   POLICY_LEAF,
   NUM_POLICIES,  // sentinel
 };
@@ -115,6 +129,9 @@ enum RoundRobinFakeType {
 enum RateLimitFakeType {
   RATE_LIMIT = 0,
 };
+enum DeadlineFakeType {
+  DEADLINE = 0,
+};
 enum LeafFakeType {
   LEAF = 0,
 };
@@ -124,7 +141,8 @@ enum LeafFakeType {
 using namespace traffic_class_initializer_types;
 
 const std::string TrafficPolicyName[NUM_POLICIES] = {
-    "priority", "weighted_fair", "round_robin", "rate_limit", "leaf"};
+    "priority", "weighted_fair", "round_robin", "rate_limit", "deadline",
+    "leaf"};
 
 const std::unordered_map<std::string, enum resource_t> ResourceMap = {
     {"count", RESOURCE_COUNT},
@@ -148,6 +166,18 @@ const std::unordered_map<int, std::string> ResourceName = {
     }                                                     \
   }
 
+// A node of the flattened copy of a scheduler's TC tree. The nodes are laid
+// out in an array in depth-first order, and each non-leaf node mirrors the
+// result of its PickNextChild(), so that Scheduler::Next() can walk down the
+// tree within a few cache lines, without any virtual calls.
+struct TcFlatNode {
+  TrafficClass *tc;
+  TrafficPolicy policy;
+  int pick;  // Index of the child to be scheduled next, -1 if blocked.
+};
+
+typedef std::vector<TcFlatNode> TcFlatTree;
+
 class TCChildArgs {
  public:
   TCChildArgs(TrafficClass *child)
@@ -168,7 +198,7 @@ class TCChildArgs {
 // schedulable task units.
 class TrafficClass {
  public:
-  virtual ~TrafficClass() {}
+  virtual ~TrafficClass() { tree_version_++; }
 
   // Returns the number of TCs in the TC subtree rooted at this, including
   // this TC.
@@ -210,11 +240,16 @@ class TrafficClass {
 
   TrafficPolicy policy() const { return policy_; }
 
+  // Incremented whenever any TC tree changes its shape. Schedulers rebuild
+  // their flattened trees when this changes.
+  static uint64_t tree_version() { return tree_version_; }
+
  protected:
   friend PriorityTrafficClass;
   friend WeightedFairTrafficClass;
   friend RoundRobinTrafficClass;
   friend RateLimitTrafficClass;
+  friend DeadlineTrafficClass;
   friend class LeafTrafficClass;
 
   TrafficClass(const std::string &name, const TrafficPolicy &policy,
@@ -224,13 +259,24 @@ class TrafficClass {
         stats_(),
         wakeup_time_(),
         blocked_(blocked),
-        policy_(policy) {}
+        policy_(policy),
+        wheel_link_(),
+        flat_tree_(),
+        flat_idx_(-1) {}
+
+  // Must be called by subclasses whenever they add or remove a child.
+  static void TreeChanged() { tree_version_++; }
+
+  // Updates the pick of the node in the flattened tree, if any. Must be called
+  // whenever the result of PickNextChild() may have changed.
+  void UpdateFlatPick();
 
   // Sets blocked status to nowblocked and recurses towards root by signaling
   // the parent if status became unblocked.
   void UnblockTowardsRootSetBlocked(uint64_t tsc, bool nowblocked) {
     bool became_unblocked = !nowblocked && blocked_;
     blocked_ = nowblocked;
+    UpdateFlatPick();
 
     if (!parent_ || !became_unblocked) {
       return;
@@ -244,6 +290,7 @@ class TrafficClass {
   void BlockTowardsRootSetBlocked(bool nowblocked) {
     bool became_blocked = nowblocked && !blocked_;
     blocked_ = nowblocked;
+    UpdateFlatPick();
 
     if (!parent_ || !became_blocked) {
       return;
@@ -278,11 +325,23 @@ class TrafficClass {
   friend class Scheduler;
   friend class DefaultScheduler;
   friend class ExperimentalScheduler;
+  friend class SchedWakeupQueue;
 
   bool blocked_;
 
   const TrafficPolicy policy_;
 
+  // Hook for SchedWakeupQueue, if it is backed by a timing wheel.
+  utils::TimingWheelLink<TrafficClass> wheel_link_;
+
+  // The flattened tree that this class was last compiled into by its
+  // scheduler, and its index there. Shared, so that a class moved to another
+  // tree never writes to freed memory before the scheduler catches up.
+  std::shared_ptr<TcFlatTree> flat_tree_;
+  int flat_idx_;
+
+  static uint64_t tree_version_;
+
   DISALLOW_COPY_AND_ASSIGN(TrafficClass);
 };
 
@@ -466,10 +525,17 @@ class RoundRobinTrafficClass final : public TrafficClass {
 // Performs rate limiting on a single child class (which could implement some
 // other policy with many children).  Rate limit policy is special, because it
 // can block and because there is a one-to-one parent-child relationship.
+//
+// With a nonzero pacing gap, the class does not let tokens pile up (max_burst
+// is ignored): after each run it blocks until the work done has been paid
+// for, so that runs are evenly spaced. If the resource is packets, the leaves
+// below are also asked to produce no more packets per run than the limit
+// allows in one gap (see LeafTrafficClass::batch_limit()).
 class RateLimitTrafficClass final : public TrafficClass {
  public:
   RateLimitTrafficClass(const std::string &name, resource_t resource,
-                        uint64_t limit, uint64_t max_burst)
+                        uint64_t limit, uint64_t max_burst,
+                        uint64_t pacing_gap_ns = 0)
       : TrafficClass(name, POLICY_RATE_LIMIT),
         resource_(resource),
         limit_(),
@@ -478,6 +544,9 @@ class RateLimitTrafficClass final : public TrafficClass {
         max_burst_arg_(),
         tokens_(),
         last_tsc_(),
+        pacing_gap_ns_(pacing_gap_ns),
+        last_run_tsc_(),
+        pacing_stats_(),
         child_() {
     set_limit(limit);
     set_max_burst(max_burst);
@@ -516,12 +585,30 @@ class RateLimitTrafficClass final : public TrafficClass {
   // Return the configured max burst, in resource units
   uint64_t max_burst_arg() const { return max_burst_arg_; }
 
-  void set_resource(resource_t res) { resource_ = res; }
+  // Return the configured pacing gap in ns, 0 if not pacing
+  uint64_t pacing_gap_ns() const { return pacing_gap_ns_; }
+
+  const struct pacing_stats &pacing_stats() const { return pacing_stats_; }
+
+  // Return the number of packets that the leaves below may produce per run.
+  uint32_t batch_limit() const;
+
+  void set_resource(resource_t res) {
+    resource_ = res;
+    TreeChanged();  // batch_limit() may have changed
+  }
 
   // Set the limit to `limit`, which is in units of the resource type
   void set_limit(uint64_t limit) {
     limit_arg_ = limit;
     limit_ = to_work_units_per_cycle(limit);
+    TreeChanged();
+  }
+
+  // Set the pacing gap to `gap_ns`. 0 disables pacing.
+  void set_pacing_gap_ns(uint64_t gap_ns) {
+    pacing_gap_ns_ = gap_ns;
+    TreeChanged();
   }
 
   // Set the max burst to `burst`, which is in units of the resource type
@@ -568,9 +655,86 @@ class RateLimitTrafficClass final : public TrafficClass {
   // Last time this TC was scheduled.
   uint64_t last_tsc_;
 
+  uint64_t pacing_gap_ns_;
+
+  // Last time this TC finished a run that did some work, for pacing_stats_.
+  uint64_t last_run_tsc_;
+
+  struct pacing_stats pacing_stats_;
+
   TrafficClass *child_;
 };
 
+// Earliest deadline first. Each child has a relative deadline, and the child
+// whose oldest pending work is due the soonest runs first. The age of the
+// pending work is known only for leaves whose tasks report it (see
+// Task::GetHeadTsc()); otherwise it is assumed to be the time of the last run
+// or unblocking of the child.
+class DeadlineTrafficClass final : public TrafficClass {
+ public:
+  struct ChildData {
+    bool operator<(const ChildData &right) const {
+      // Reversed so that priority_queue is a min priority queue.
+      return right.deadline < deadline;
+    }
+
+    uint64_t deadline;      // Absolute, in TSC.
+    uint64_t rel_deadline;  // In cycles.
+    TrafficClass *c;
+  };
+
+  explicit DeadlineTrafficClass(const std::string &name)
+      : TrafficClass(name, POLICY_DEADLINE),
+        runnable_children_(),
+        blocked_children_(),
+        all_children_() {}
+
+  ~DeadlineTrafficClass();
+
+  std::vector<TrafficClass *> Children() const override;
+
+  // Returns true if child was added successfully.
+  bool AddChild(TrafficClass *child, uint64_t deadline_ns);
+
+  // Returns true if child was removed successfully.
+  bool RemoveChild(TrafficClass *child) override;
+
+  TrafficClass *PickNextChild() override;
+
+  void UnblockTowardsRoot(uint64_t tsc) override;
+  void BlockTowardsRoot() override;
+
+  void FinishAndAccountTowardsRoot(SchedWakeupQueue *wakeup_queue,
+                                   TrafficClass *child, resource_arr_t usage,
+                                   uint64_t tsc) override;
+
+  const extended_priority_queue<ChildData> &runnable_children() const {
+    return runnable_children_;
+  }
+
+  const std::list<ChildData> &blocked_children() const {
+    return blocked_children_;
+  }
+
+  // Children with their relative deadlines in ns.
+  const std::vector<std::pair<TrafficClass *, uint64_t>> &children() const {
+    return all_children_;
+  }
+
+ private:
+  // Returns the absolute deadline of the oldest pending work of child 'c', as
+  // of 'tsc'.
+  static uint64_t Deadline(const TrafficClass *c, uint64_t rel_deadline,
+                           uint64_t tsc);
+
+  extended_priority_queue<ChildData> runnable_children_;
+  std::list<ChildData> blocked_children_;
+
+  // This is a copy of the pointers to (and deadlines of) all children. It can
+  // be safely accessed from the master thread while the workers are running.
+  std::vector<std::pair<TrafficClass *, uint64_t>> all_children_;
+};
+
 class LeafTrafficClass final : public TrafficClass {
  public:
   static const uint64_t kInitialWaitCycles = (1ull << 14);
@@ -578,7 +742,16 @@ class LeafTrafficClass final : public TrafficClass {
   explicit LeafTrafficClass(const std::string &name, Task *task)
       : TrafficClass(name, POLICY_LEAF, false),
         task_(task),
-        wait_cycles_(kInitialWaitCycles) {
+        wait_cycles_(kInitialWaitCycles),
+        batch_limit_(bess::PacketBatch::kMaxBurst),
+        run_budget_cycles_(),
+        run_budget_packets_(),
+        paced_(),
+        stealable_(),
+        running_(),
+        cnt_stolen_(),
+        cycles_stolen_(),
+        packets_stolen_() {
     task_->Attach(this);
   }
 
@@ -595,6 +768,27 @@ class LeafTrafficClass final : public TrafficClass {
 
   void set_wait_cycles(uint64_t wait_cycles) { wait_cycles_ = wait_cycles; }
 
+  // The number of packets the task should produce at most per run, as imposed
+  // by pacing rate limiters above. Passed to the task in Context.
+  uint32_t batch_limit() const { return batch_limit_; }
+
+  // The run budget. Once picked, the task is run over and over, without going
+  // through the scheduler, until it has run for this many cycles or produced
+  // this many packets (0 for no limit on either), or finds nothing to do. All
+  // those runs are accounted for as one. With neither limit (the default),
+  // the task is run once per pick. Not applied under pacing rate limiters.
+  uint64_t run_budget_cycles() const { return run_budget_cycles_; }
+  uint64_t run_budget_packets() const { return run_budget_packets_; }
+
+  void set_run_budget(uint64_t cycles, uint64_t packets) {
+    run_budget_cycles_ = cycles;
+    run_budget_packets_ = packets;
+  }
+
+  bool has_run_budget() const {
+    return !paced_ && (run_budget_cycles_ || run_budget_packets_);
+  }
+
   void BlockTowardsRoot() override {
     TrafficClass::BlockTowardsRootSetBlocked(false);
   }
@@ -616,10 +810,61 @@ class LeafTrafficClass final : public TrafficClass {
     parent_->FinishAndAccountTowardsRoot(wakeup_queue, this, usage, tsc);
   }
 
+  // Can the task be run by other workers? See Scheduler::TrySteal().
+  bool stealable() const { return stealable_; }
+
+  // Statistics of runs by workers other than the owner. Not included in
+  // stats().
+  uint64_t cnt_stolen() const {
+    return cnt_stolen_.load(std::memory_order_relaxed);
+  }
+  uint64_t cycles_stolen() const {
+    return cycles_stolen_.load(std::memory_order_relaxed);
+  }
+  uint64_t packets_stolen() const {
+    return packets_stolen_.load(std::memory_order_relaxed);
+  }
+
  private:
+  friend class Scheduler;
+  friend class WorkStealingTest;
+
+  // Takes the exclusive right to run the task, for stealable leaves.
+  bool TryAcquire() {
+    return !running_.load(std::memory_order_relaxed) &&
+           !running_.exchange(true, std::memory_order_acquire);
+  }
+
+  void Release() { running_.store(false, std::memory_order_release); }
+
+  void AccountStolen(uint64_t cycles, uint64_t packets) {
+    cnt_stolen_.fetch_add(1, std::memory_order_relaxed);
+    cycles_stolen_.fetch_add(cycles, std::memory_order_relaxed);
+    packets_stolen_.fetch_add(packets, std::memory_order_relaxed);
+  }
+
   Task *task_;
 
   uint64_t wait_cycles_;
+
+  // Set by the scheduler when it rebuilds its flattened tree.
+  uint32_t batch_limit_;
+
+  uint64_t run_budget_cycles_;
+  uint64_t run_budget_packets_;
+
+  // Under a pacing rate limiter? Set along with batch_limit_.
+  bool paced_;
+
+  // Set by the owner scheduler on resume.
+  bool stealable_;
+
+  // True while some worker is running the task. Only used if stealable_.
+  std::atomic<bool> running_;
+
+  std::atomic<uint64_t> cnt_stolen_;
+  std::atomic<uint64_t> cycles_stolen_;
+  std::atomic<uint64_t> packets_stolen_;
 };
 
 class PriorityChildArgs : public TCChildArgs {
@@ -652,6 +897,16 @@ class RateLimitChildArgs : public TCChildArgs {
   RateLimitChildArgs(TrafficClass *c) : TCChildArgs(POLICY_RATE_LIMIT, c) {}
 };
 
+class DeadlineChildArgs : public TCChildArgs {
+ public:
+  DeadlineChildArgs(uint64_t deadline_ns, TrafficClass *c)
+      : TCChildArgs(POLICY_DEADLINE, c), deadline_ns_(deadline_ns) {}
+  uint64_t deadline_ns() { return deadline_ns_; }
+
+ private:
+  uint64_t deadline_ns_;
+};
+
 // Responsible for creating and destroying all traffic classes.
 class TrafficClassBuilder {
  public:
@@ -681,6 +936,10 @@ class TrafficClassBuilder {
     resource_t resource;
     uint64_t limit;
     uint64_t max_burst;
+    uint64_t pacing_gap_ns = 0;  // 0 if not pacing
+  };
+  struct DeadlineArgs {
+    DeadlineFakeType dummy;
   };
 
   struct LeafArgs {
@@ -744,11 +1003,21 @@ class TrafficClassBuilder {
   static TrafficClass *CreateTree(const std::string &name, RateLimitArgs args,
                                   RateLimitChildArgs child) {
     RateLimitTrafficClass *p = CreateTrafficClass<RateLimitTrafficClass>(
-        name, args.resource, args.limit, args.max_burst);
+        name, args.resource, args.limit, args.max_burst, args.pacing_gap_ns);
     p->AddChild(child.child());
     return p;
   }
 
+  static TrafficClass *CreateTree(const std::string &name,
+                                  [[maybe_unused]] DeadlineArgs args,
+                                  std::vector<DeadlineChildArgs> children) {
+    DeadlineTrafficClass *p = CreateTrafficClass<DeadlineTrafficClass>(name);
+    for (auto &c : children) {
+      p->AddChild(c.child(), c.deadline_ns());
+    }
+    return p;
+  }
+
   static TrafficClass *CreateTree(const std::string &name, LeafArgs args) {
     return CreateTrafficClass<LeafTrafficClass>(name, args.task);
   }
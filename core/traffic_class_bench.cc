@@ -32,6 +32,8 @@
 #include <benchmark/benchmark.h>
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <string>
 #include <vector>
 
 #include "module.h"
@@ -232,6 +234,180 @@ BENCHMARK_REGISTER_F(TCRoundRobin, TCScheduleOnce)
     ->Args({4 << 14})
     ->Complexity();
 
+// Performs TC Scheduler init/deinit before/after each test.
+// Sets up a round robin of many rate-limited leaves, so that most of them are
+// blocked in the wakeup queue at any given moment.
+class TCRateLimit : public benchmark::Fixture {
+ public:
+  // Aggregate rate of all classes, in times per second. Set lower than what
+  // a core can schedule, so that the limiters kick in.
+  static const uint64_t kTotalLimit = 10000000;
+
+  TCRateLimit() : s_(), dummy_() {}
+
+  void SetUp(benchmark::State &state) override {
+    int num_classes = state.range(0);
+    SchedWakeupQueue::Type type = (SchedWakeupQueue::Type)state.range(1);
+
+    dummy_ = new DummyModule;
+
+    TrafficClass *root = CT("rr", {ROUND_ROBIN}, {});
+    s_ = new DefaultScheduler(root);
+    s_->wakeup_queue().set_type(type);
+    RoundRobinTrafficClass *rr =
+        static_cast<RoundRobinTrafficClass *>(TrafficClassBuilder::Find("rr"));
+
+    uint64_t limit = std::max<uint64_t>(kTotalLimit / num_classes, 1);
+    for (int i = 0; i < num_classes; i++) {
+      std::string name("class_" + std::to_string(i));
+      TrafficClass *c =
+          CT("limit_" + std::to_string(i),
+             {RATE_LIMIT, RESOURCE_COUNT, limit, 0},
+             {CT(name, {LEAF, new Task(dummy_, nullptr)})});
+
+      CHECK(rr->AddChild(c));
+    }
+    CHECK(!rr->blocked());
+  }
+
+  void TearDown(benchmark::State &) override {
+    delete s_;
+    s_ = nullptr;
+
+    delete dummy_;
+    dummy_ = nullptr;
+
+    TrafficClassBuilder::ClearAll();
+  }
+
+ protected:
+  DefaultScheduler *s_;
+  Module *dummy_;
+};
+
+BENCHMARK_DEFINE_F(TCRateLimit, TCScheduleOnce)(benchmark::State &state) {
+  while (state.KeepRunning()) {
+    Context ctx = {};
+    s_->ScheduleOnce(&ctx);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetComplexityN(state.range(0));
+}
+
+BENCHMARK_REGISTER_F(TCRateLimit, TCScheduleOnce)
+    ->Args({1 << 8, SchedWakeupQueue::kHeap})
+    ->Args({1 << 10, SchedWakeupQueue::kHeap})
+    ->Args({1 << 12, SchedWakeupQueue::kHeap})
+    ->Args({10000, SchedWakeupQueue::kHeap})
+    ->Args({1 << 14, SchedWakeupQueue::kHeap})
+    ->Args({1 << 16, SchedWakeupQueue::kHeap})
+    ->Args({1 << 8, SchedWakeupQueue::kTimingWheel})
+    ->Args({1 << 10, SchedWakeupQueue::kTimingWheel})
+    ->Args({1 << 12, SchedWakeupQueue::kTimingWheel})
+    ->Args({10000, SchedWakeupQueue::kTimingWheel})
+    ->Args({1 << 14, SchedWakeupQueue::kTimingWheel})
+    ->Args({1 << 16, SchedWakeupQueue::kTimingWheel});
+
+// Performs TC Scheduler init/deinit before/after each test.
+// Sets up a deep tree (priority -> weighted fair -> rate limit -> leaf), so
+// that a scheduling decision has to walk down several levels.
+class TCDeepTree : public benchmark::Fixture {
+ public:
+  TCDeepTree() : s_(), dummy_() {}
+
+  void SetUp(benchmark::State &state) override {
+    int num_classes = state.range(0);
+
+    dummy_ = new DummyModule;
+
+    TrafficClass *root =
+        CT("root", {PRIORITY},
+           {{0, CT("weighted", {WEIGHTED_FAIR, RESOURCE_COUNT}, {})}});
+    s_ = new DefaultScheduler(root);
+    WeightedFairTrafficClass *weighted =
+        static_cast<WeightedFairTrafficClass *>(
+            TrafficClassBuilder::Find("weighted"));
+
+    for (int i = 0; i < num_classes; i++) {
+      std::string name("class_" + std::to_string(i));
+      // High enough that the limiters never kick in.
+      TrafficClass *c =
+          CT("limit_" + std::to_string(i),
+             {RATE_LIMIT, RESOURCE_COUNT, 1000000000, 0},
+             {CT(name, {LEAF, new Task(dummy_, nullptr)})});
+
+      resource_share_t share = 1;
+      CHECK(weighted->AddChild(c, share));
+    }
+    CHECK(!root->blocked());
+  }
+
+  void TearDown(benchmark::State &) override {
+    delete s_;
+    s_ = nullptr;
+
+    delete dummy_;
+    dummy_ = nullptr;
+
+    TrafficClassBuilder::ClearAll();
+  }
+
+ protected:
+  // Picks a leaf and accounts a single unit of work to it, as ScheduleOnce()
+  // does, but without running the task.
+  template <bool flattened>
+  void Decide() {
+    uint64_t now = rdtsc();
+    LeafTrafficClass *leaf =
+        flattened ? s_->Next(now) : s_->NextUnflattened(now);
+    resource_arr_t usage = {};
+    usage[RESOURCE_COUNT] = 1;
+    leaf->FinishAndAccountTowardsRoot(&s_->wakeup_queue(), nullptr, usage,
+                                      now);
+  }
+
+  DefaultScheduler *s_;
+  Module *dummy_;
+};
+
+// Benchmarks scheduling decisions, walking the TrafficClass objects.
+BENCHMARK_DEFINE_F(TCDeepTree, TCNextUnflattened)(benchmark::State &state) {
+  while (state.KeepRunning()) {
+    Decide<false>();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetComplexityN(state.range(0));
+}
+
+// Benchmarks scheduling decisions, walking the flattened tree.
+BENCHMARK_DEFINE_F(TCDeepTree, TCNext)(benchmark::State &state) {
+  while (state.KeepRunning()) {
+    Decide<true>();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetComplexityN(state.range(0));
+}
+
+BENCHMARK_REGISTER_F(TCDeepTree, TCNextUnflattened)
+    ->Args({4 << 0})
+    ->Args({4 << 2})
+    ->Args({4 << 4})
+    ->Args({4 << 6})
+    ->Args({4 << 8})
+    ->Args({4 << 10})
+    ->Args({4 << 12})
+    ->Complexity();
+
+BENCHMARK_REGISTER_F(TCDeepTree, TCNext)
+    ->Args({4 << 0})
+    ->Args({4 << 2})
+    ->Args({4 << 4})
+    ->Args({4 << 6})
+    ->Args({4 << 8})
+    ->Args({4 << 10})
+    ->Args({4 << 12})
+    ->Complexity();
+
 }  // namespace
 
 BENCHMARK_MAIN();
@@ -30,10 +30,14 @@
 // Unit tests traffic class and scheduler routines.
 
 #include <gtest/gtest.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
+#include <thread>
 
 #include "module.h"
 #include "scheduler.h"
@@ -203,6 +207,73 @@ TEST(CreateTree, RateLimitRootAndLeaf) {
   TrafficClassBuilder::ClearAll();
 }
 
+// Tests that we can create and fetch a deadline root node with a leaf under
+// it.
+TEST(CreateTree, DeadlineRootAndLeaf) {
+  std::unique_ptr<TrafficClass> tree(
+      CT("root", {DEADLINE},
+         {{1000, CT("leaf", {LEAF, new Task(nullptr, nullptr)})}}));
+  ASSERT_EQ(2, TrafficClassBuilder::Find("root")->Size());
+
+  ASSERT_NE(nullptr, tree);
+  EXPECT_EQ(POLICY_DEADLINE, tree->policy());
+
+  DeadlineTrafficClass *c = static_cast<DeadlineTrafficClass *>(tree.get());
+  ASSERT_NE(nullptr, c);
+  ASSERT_EQ(1, c->runnable_children().size());
+  ASSERT_EQ(0, c->blocked_children().size());
+  ASSERT_EQ(1, c->children().size());
+  EXPECT_EQ(1000, c->children()[0].second);
+
+  LeafTrafficClass *leaf = static_cast<LeafTrafficClass *>(
+      c->runnable_children().container().front().c);
+  ASSERT_NE(nullptr, leaf);
+  EXPECT_EQ(leaf->parent(), c);
+
+  TrafficClass *leaf2 = CT("leaf_2", {LEAF, new Task(nullptr, nullptr)});
+  ASSERT_FALSE(c->AddChild(leaf2, 0));
+  ASSERT_TRUE(c->AddChild(leaf2, 2000));
+  ASSERT_EQ(3, TrafficClassBuilder::Find("root")->Size());
+
+  ASSERT_TRUE(c->RemoveChild(leaf2));
+  ASSERT_EQ(2, TrafficClassBuilder::Find("root")->Size());
+  delete leaf2;
+
+  TrafficClassBuilder::ClearAll();
+}
+
+class FlatTreeTest : public ::testing::Test {
+ protected:
+  void TearDown() override { TrafficClassBuilder::ClearAll(); }
+
+  static void SetPick(Scheduler *s, int idx, int pick) {
+    (*s->flat_tree_)[idx].pick = pick;
+  }
+};
+
+// Tests that Next() does not follow a pick that has gone out of the tree,
+// but recompiles it and picks the same leaf as the slow path.
+TEST_F(FlatTreeTest, StalePick) {
+  DummyModule dm;
+  DefaultScheduler s(
+      CT("root", {ROUND_ROBIN},
+         {{CT("leaf_1", {LEAF, new Task(&dm, nullptr)})},
+          {CT("leaf_2", {LEAF, new Task(&dm, nullptr)})}}));
+
+  uint64_t now = rdtsc();
+  ASSERT_NE(nullptr, s.Next(now));
+
+  for (int pick : {-1, 0, 3}) {
+    SetPick(&s, 0, pick);
+    LeafTrafficClass *leaf = s.Next(now);
+    ASSERT_NE(nullptr, leaf);
+    EXPECT_EQ(s.NextUnflattened(now), leaf);
+
+    // Recompiled
+    EXPECT_EQ(leaf, s.Next(now));
+  }
+}
+
 // Tess that we can create a simple tree and have the scheduler pick the leaf
 // repeatedly.
 TEST(DefaultSchedulerNext, BasicTreePriority) {
@@ -359,6 +430,62 @@ TEST(DefaultSchedulerNext, TwoLeavesWeightedFairOneBlocked) {
   TrafficClassBuilder::ClearAll();
 }
 
+// Tests that the flattened tree picks the same leaves as the TrafficClass
+// objects do, including after the tree has changed.
+TEST(DefaultSchedulerNext, FlatTreeMatchesUnflattened) {
+  DummyModule dm;
+  DefaultScheduler s(CT(
+      "root", {PRIORITY},
+      {{0, CT("weighted", {WEIGHTED_FAIR, RESOURCE_COUNT},
+              {{1, CT("rr", {ROUND_ROBIN},
+                      {{CT("leaf_1", {LEAF, new Task(&dm, nullptr)})},
+                       {CT("leaf_2", {LEAF, new Task(&dm, nullptr)})}})},
+               {2, CT("limit", {RATE_LIMIT, RESOURCE_COUNT, 1000000, 0},
+                      {CT("leaf_3", {LEAF, new Task(&dm, nullptr)})})}})},
+       {1, CT("leaf_4", {LEAF, new Task(&dm, nullptr)})}}));
+
+  auto run = [&](int n) {
+    std::set<std::string> picked;
+    for (int i = 0; i < n; i++) {
+      uint64_t now = rdtsc();
+      LeafTrafficClass *leaf = s.Next(now);
+      EXPECT_EQ(s.NextUnflattened(now), leaf);
+      if (!leaf) {
+        continue;
+      }
+
+      picked.insert(leaf->name());
+      resource_arr_t usage = {};
+      usage[RESOURCE_COUNT] = 1;
+      leaf->FinishAndAccountTowardsRoot(&s.wakeup_queue(), nullptr, usage,
+                                        now);
+    }
+    return picked;
+  };
+
+  std::set<std::string> picked = run(1000);
+  EXPECT_EQ(1, picked.count("leaf_1"));
+  EXPECT_EQ(1, picked.count("leaf_2"));
+  EXPECT_EQ(0, picked.count("leaf_4"));
+
+  RoundRobinTrafficClass *rr =
+      static_cast<RoundRobinTrafficClass *>(TrafficClassBuilder::Find("rr"));
+  ASSERT_TRUE(rr->AddChild(CT("leaf_5", {LEAF, new Task(&dm, nullptr)})));
+  picked = run(1000);
+  EXPECT_EQ(1, picked.count("leaf_5"));
+
+  PriorityTrafficClass *root =
+      static_cast<PriorityTrafficClass *>(TrafficClassBuilder::Find("root"));
+  TrafficClass *weighted = TrafficClassBuilder::Find("weighted");
+  ASSERT_TRUE(root->RemoveChild(weighted));
+  s.wakeup_queue().Remove(TrafficClassBuilder::Find("limit"));
+  delete weighted;
+  picked = run(10);
+  EXPECT_EQ(std::set<std::string>({"leaf_4"}), picked);
+
+  TrafficClassBuilder::ClearAll();
+}
+
 // Tess that we can create a simple tree and have the scheduler pick the
 // leaves in proportion to their weights.
 TEST(DefaultScheduleOnce, TwoLeavesWeightedFair) {
@@ -403,6 +530,136 @@ TEST(DefaultScheduleOnce, TwoLeavesWeightedFair) {
   TrafficClassBuilder::ClearAll();
 }
 
+// Produces a full batch for a given number of runs, and then nothing.
+class CountdownModule : public Module {
+ public:
+  struct task_result RunTask(Context *, bess::PacketBatch *, void *) override {
+    if (runs_left == 0) {
+      return {.block = false, .packets = 0, .bits = 0};
+    }
+    runs_left--;
+    return {.block = false, .packets = 32, .bits = 0};
+  }
+
+  int runs_left = 0;
+};
+
+// Tests that the scheduler accumulates the usage of task runs that did some
+// work, and accounts empty runs as idle.
+TEST(DefaultScheduleOnce, SchedulerStats) {
+  CountdownModule cm;
+  DefaultScheduler s(CT("leaf", {LEAF, new Task(&cm, nullptr)}));
+  Context ctx = {};
+
+  cm.runs_left = 6;
+  for (int i = 0; i < 10; i++) {
+    s.ScheduleOnce(&ctx);
+  }
+
+  const sched_stats &stats = s.stats();
+  EXPECT_EQ(6, stats.usage[RESOURCE_COUNT]);
+  EXPECT_EQ(6 * 32, stats.usage[RESOURCE_PACKET]);
+  EXPECT_EQ(4, stats.cnt_idle);
+  EXPECT_LT(0, stats.cycles_idle);
+
+  uint64_t runs = 0;
+  for (int i = 0; i < sched_stats::kNumRunLengthBuckets; i++) {
+    runs += stats.run_length_hist[i];
+  }
+  EXPECT_EQ(6, runs);
+
+  TrafficClassBuilder::ClearAll();
+}
+
+// Same as above, for the experimental scheduler.
+TEST(ExperimentalScheduleOnce, SchedulerStats) {
+  CountdownModule cm;
+  ExperimentalScheduler s(CT("leaf", {LEAF, new Task(&cm, nullptr)}));
+  Context ctx = {};
+
+  cm.runs_left = 6;
+  for (int i = 0; i < 10; i++) {
+    s.ScheduleOnce(&ctx);
+  }
+
+  const sched_stats &stats = s.stats();
+  EXPECT_EQ(6, stats.usage[RESOURCE_COUNT]);
+  EXPECT_EQ(6 * 32, stats.usage[RESOURCE_PACKET]);
+  EXPECT_EQ(4, stats.cnt_idle);
+  EXPECT_LT(0, stats.cycles_idle);
+
+  TrafficClassBuilder::ClearAll();
+}
+
+// Tests that a leaf with a run budget is run until the budget is spent or it
+// has nothing to do, and accounted for once.
+TEST(DefaultScheduleOnce, RunBudget) {
+  CountdownModule cm;
+  DefaultScheduler s(CT("leaf", {LEAF, new Task(&cm, nullptr)}));
+  LeafTrafficClass *leaf = static_cast<LeafTrafficClass *>(s.root());
+  const tc_stats &stats = leaf->stats();
+  Context ctx = {};
+
+  // No budget: one run per round.
+  cm.runs_left = 10;
+  s.ScheduleOnce(&ctx);
+  EXPECT_EQ(9, cm.runs_left);
+  EXPECT_EQ(1, stats.usage[RESOURCE_COUNT]);
+
+  // 100 packets take 4 runs.
+  leaf->set_run_budget(0, 100);
+  s.ScheduleOnce(&ctx);
+  EXPECT_EQ(5, cm.runs_left);
+  EXPECT_EQ(5, stats.usage[RESOURCE_COUNT]);
+  EXPECT_EQ(5 * 32, stats.usage[RESOURCE_PACKET]);
+  EXPECT_EQ(3, s.stats().cnt_budget_rerun);
+
+  // Stops at the first run that finds nothing to do.
+  leaf->set_run_budget(0, 1000);
+  s.ScheduleOnce(&ctx);
+  EXPECT_EQ(0, cm.runs_left);
+  EXPECT_EQ(11, stats.usage[RESOURCE_COUNT]);
+  EXPECT_EQ(10 * 32, stats.usage[RESOURCE_PACKET]);
+  EXPECT_EQ(8, s.stats().cnt_budget_rerun);
+
+  // A single run already takes more than a cycle.
+  cm.runs_left = 10;
+  leaf->set_run_budget(1, 0);
+  s.ScheduleOnce(&ctx);
+  EXPECT_EQ(9, cm.runs_left);
+
+  uint64_t rounds = 0;
+  for (int i = 0; i < sched_stats::kNumRunLengthBuckets; i++) {
+    rounds += s.stats().run_length_hist[i];
+  }
+  EXPECT_EQ(4, rounds);
+  EXPECT_EQ(12, s.stats().usage[RESOURCE_COUNT]);
+
+  TrafficClassBuilder::ClearAll();
+}
+
+// Tests that run budgets do not apply under pacing rate limiters.
+TEST(DefaultScheduleOnce, RunBudgetPaced) {
+  DummyModule dm;
+  DefaultScheduler s(
+      CT("limit", {RATE_LIMIT, RESOURCE_PACKET, 10000, 0, 1000000},
+         {CT("leaf", {LEAF, new Task(&dm, nullptr)})}));
+  LeafTrafficClass *leaf =
+      static_cast<LeafTrafficClass *>(TrafficClassBuilder::Find("leaf"));
+  RateLimitTrafficClass *limit =
+      static_cast<RateLimitTrafficClass *>(TrafficClassBuilder::Find("limit"));
+
+  leaf->set_run_budget(0, 100);
+  ASSERT_EQ(leaf, s.Next(rdtsc()));
+  EXPECT_FALSE(leaf->has_run_budget());
+
+  limit->set_pacing_gap_ns(0);
+  ASSERT_EQ(leaf, s.Next(rdtsc()));
+  EXPECT_TRUE(leaf->has_run_budget());
+
+  TrafficClassBuilder::ClearAll();
+}
+
 // Tess that we can create a simple tree and have the scheduler pick the best
 // (lowest) priority leaf that is unblocked at that time.
 TEST(DefaultScheduleOnce, TwoLeavesPriority) {
@@ -624,4 +881,342 @@ TEST(RateLimit, BasicBlockUnblock) {
   TrafficClassBuilder::ClearAll();
 }
 
+// Tests that rate limit nodes get unblocked with the timing wheel as well.
+TEST(RateLimit, TimingWheelBlockUnblock) {
+  DefaultScheduler s(CT("limit", {RATE_LIMIT, RESOURCE_COUNT, 1, 0},
+                        {CT("leaf", {LEAF, new Task(nullptr, nullptr)})}));
+  s.wakeup_queue().set_type(SchedWakeupQueue::kTimingWheel);
+
+  RateLimitTrafficClass *limit =
+      static_cast<RateLimitTrafficClass *>(TrafficClassBuilder::Find("limit"));
+  LeafTrafficClass *leaf =
+      static_cast<LeafTrafficClass *>(TrafficClassBuilder::Find("leaf"));
+
+  uint64_t now = rdtsc();
+  TrafficClass *c = s.Next(now);
+  ASSERT_EQ(c, leaf);
+  resource_arr_t usage = {};
+  usage[RESOURCE_COUNT] = 1;
+  c->FinishAndAccountTowardsRoot(&s.wakeup_queue(), nullptr, usage, now);
+  ASSERT_TRUE(limit->blocked());
+  ASSERT_FALSE(s.wakeup_queue().empty());
+  EXPECT_EQ(limit->wakeup_time(), s.wakeup_queue().NextWakeupTime());
+
+  // Fake a quarter second delay; still blocked.
+  now += tsc_hz / 4;
+  ASSERT_EQ(nullptr, s.Next(now));
+
+  // Fake two seconds delay and expect unblocking.
+  now += tsc_hz * 2;
+  ASSERT_EQ(leaf, s.Next(now));
+  ASSERT_FALSE(limit->blocked());
+  ASSERT_TRUE(s.wakeup_queue().empty());
+
+  // Removal from the queue. The limiter has earned more than a token since
+  // it woke up, so use more than that.
+  usage[RESOURCE_COUNT] = 3;
+  c->FinishAndAccountTowardsRoot(&s.wakeup_queue(), nullptr, usage, now);
+  ASSERT_TRUE(limit->blocked());
+  s.wakeup_queue().Remove(limit);
+  ASSERT_TRUE(s.wakeup_queue().empty());
+
+  TrafficClassBuilder::ClearAll();
+}
+
+// Tests that a pacing rate limiter spaces the runs of its child evenly and
+// limits their batch sizes.
+TEST(RateLimit, Pacing) {
+  // 10 packets per 1ms. max_burst would allow for more, but is ignored.
+  DefaultScheduler s(
+      CT("limit", {RATE_LIMIT, RESOURCE_PACKET, 10000, 1000, 1000000},
+         {CT("leaf", {LEAF, new Task(nullptr, nullptr)})}));
+  const uint64_t gap = tsc_hz / 1000;
+
+  RateLimitTrafficClass *limit =
+      static_cast<RateLimitTrafficClass *>(TrafficClassBuilder::Find("limit"));
+  LeafTrafficClass *leaf =
+      static_cast<LeafTrafficClass *>(TrafficClassBuilder::Find("leaf"));
+
+  uint64_t now = rdtsc();
+  ASSERT_EQ(leaf, s.Next(now));
+  EXPECT_EQ(10, leaf->batch_limit());
+
+  resource_arr_t usage = {};
+  usage[RESOURCE_COUNT] = 1;
+  usage[RESOURCE_PACKET] = 10;
+  leaf->FinishAndAccountTowardsRoot(&s.wakeup_queue(), nullptr, usage, now);
+  ASSERT_TRUE(limit->blocked());
+
+  for (int i = 0; i < 3; i++) {
+    uint64_t wakeup = limit->wakeup_time();
+    ASSERT_EQ(nullptr, s.Next(wakeup));
+    ASSERT_EQ(leaf, s.Next(wakeup + 1));
+
+    // The next run is due a gap after the previous one became eligible, no
+    // matter how long it took.
+    now = wakeup + gap / 10;
+    leaf->FinishAndAccountTowardsRoot(&s.wakeup_queue(), nullptr, usage, now);
+    ASSERT_TRUE(limit->blocked());
+    EXPECT_NEAR(wakeup + gap, limit->wakeup_time(), gap / 100);
+  }
+
+  const struct pacing_stats &stats = limit->pacing_stats();
+  EXPECT_EQ(3, stats.cnt_gaps);
+  EXPECT_NEAR(gap, stats.gap_cycles / stats.cnt_gaps, gap / 10);
+  EXPECT_NEAR(gap, stats.gap_cycles_min, gap / 100);
+
+  // Without pacing, the same limiter lets the leaf burst.
+  limit->set_pacing_gap_ns(0);
+  ASSERT_EQ(leaf, s.Next(limit->wakeup_time() + 1));
+  EXPECT_EQ(bess::PacketBatch::kMaxBurst, leaf->batch_limit());
+
+  TrafficClassBuilder::ClearAll();
+}
+
+// Tests that the child due the soonest runs first, and that runs that start
+// past their deadlines are counted.
+TEST(Deadline, EarliestDeadlineFirst) {
+  DefaultScheduler s(
+      CT("root", {DEADLINE},
+         {{10000, CT("fast", {LEAF, new Task(nullptr, nullptr)})},
+          {1000000, CT("slow", {LEAF, new Task(nullptr, nullptr)})}}));
+  const uint64_t us = tsc_hz / 1000000;
+
+  LeafTrafficClass *fast =
+      static_cast<LeafTrafficClass *>(TrafficClassBuilder::Find("fast"));
+  LeafTrafficClass *slow =
+      static_cast<LeafTrafficClass *>(TrafficClassBuilder::Find("slow"));
+
+  resource_arr_t usage = {};
+  usage[RESOURCE_COUNT] = 1;
+  usage[RESOURCE_CYCLE] = us;
+  usage[RESOURCE_PACKET] = 1;
+
+  // The tasks don't report the age of their work, so each child is due its
+  // relative deadline after it was added or last run.
+  uint64_t t0 = rdtsc();
+  ASSERT_EQ(fast, s.Next(t0));
+  fast->FinishAndAccountTowardsRoot(&s.wakeup_queue(), nullptr, usage, t0 + us);
+  EXPECT_EQ(0, fast->stats().cnt_deadline_missed);
+
+  // Started 88us late.
+  ASSERT_EQ(fast, s.Next(t0 + 100 * us));
+  fast->FinishAndAccountTowardsRoot(&s.wakeup_queue(), nullptr, usage,
+                                    t0 + 100 * us);
+  EXPECT_EQ(1, fast->stats().cnt_deadline_missed);
+
+  // Still sooner than the slow one, even if it is late again.
+  ASSERT_EQ(fast, s.Next(t0 + 2000 * us));
+  fast->FinishAndAccountTowardsRoot(&s.wakeup_queue(), nullptr, usage,
+                                    t0 + 2000 * us);
+  EXPECT_EQ(2, fast->stats().cnt_deadline_missed);
+
+  // Now the slow one is due first, and it is 1ms late.
+  ASSERT_EQ(slow, s.Next(t0 + 2000 * us));
+  slow->FinishAndAccountTowardsRoot(&s.wakeup_queue(), nullptr, usage,
+                                    t0 + 2001 * us);
+  EXPECT_EQ(1, slow->stats().cnt_deadline_missed);
+
+  // Runs without any packets are not misses.
+  usage[RESOURCE_PACKET] = 0;
+  ASSERT_EQ(fast, s.Next(t0 + 5000 * us));
+  fast->FinishAndAccountTowardsRoot(&s.wakeup_queue(), nullptr, usage,
+                                    t0 + 5000 * us);
+  EXPECT_EQ(2, fast->stats().cnt_deadline_missed);
+  EXPECT_EQ(0, s.root()->stats().cnt_deadline_missed);
+
+  TrafficClassBuilder::ClearAll();
+}
+
+// Tests that an idle worker sleeps until the rate limiter wakes up.
+TEST(IdleSleep, SleepUntilRateLimitWakeup) {
+  DefaultScheduler s(CT("limit", {RATE_LIMIT, RESOURCE_COUNT, 1000, 0},
+                        {CT("leaf", {LEAF, new Task(nullptr, nullptr)})}));
+  SchedulerOpts opts;
+  opts.idle_sleep = true;
+  opts.idle_max_sleep_us = 100000;
+  opts.idle_wakeup_margin_us = 20;
+  s.set_opts(opts);
+  current_worker.set_status(WORKER_RUNNING);
+
+  RateLimitTrafficClass *limit =
+      static_cast<RateLimitTrafficClass *>(TrafficClassBuilder::Find("limit"));
+
+  uint64_t now = rdtsc();
+  TrafficClass *c = s.Next(now);
+  ASSERT_NE(nullptr, c);
+  resource_arr_t usage = {};
+  usage[RESOURCE_COUNT] = 1;
+  c->FinishAndAccountTowardsRoot(&s.wakeup_queue(), nullptr, usage, now);
+  ASSERT_TRUE(limit->blocked());
+
+  // 1000 times/s, so the limiter should be blocked for about 1ms.
+  now = rdtsc();
+  ASSERT_EQ(nullptr, s.Next(now));
+  s.IdleWait(now);
+
+  EXPECT_EQ(1, s.stats().cnt_sleep);
+  EXPECT_EQ(1, s.stats().cnt_timer_wakeup);
+  EXPECT_GE(rdtsc(), limit->wakeup_time());
+  EXPECT_EQ(limit->child(), s.Next(rdtsc()));
+
+  // An interruption ends the sleep early.
+  s.InterruptIdle();
+  now = rdtsc();
+  s.IdleWait(now);
+  EXPECT_EQ(2, s.stats().cnt_sleep);
+  EXPECT_EQ(1, s.stats().cnt_timer_wakeup);
+  EXPECT_LT(rdtsc() - now, tsc_hz / 100);
+
+  current_worker.set_status(WORKER_PAUSING);
+  TrafficClassBuilder::ClearAll();
+}
+
+// A task that may be run by any worker.
+class StealableModule : public CountdownModule {
+ public:
+  StealableModule() { max_allowed_workers_ = Worker::kMaxWorkers; }
+
+  bool IsTaskMigratable(void *) const override { return true; }
+};
+
+// Sets up an owner scheduler whose leaves a thief scheduler may steal,
+// without running any workers.
+class WorkStealingTest : public ::testing::Test {
+ protected:
+  void SetUp() override { opts_.work_stealing = true; }
+
+  void TearDown() override { TrafficClassBuilder::ClearAll(); }
+
+  // Makes 'thief' steal from 'owner', which looks busy.
+  void Pair(Scheduler *thief, Scheduler *owner) {
+    thief->set_opts(opts_);
+    owner->set_opts(opts_);
+    owner->RefreshStealSources();
+    thief->RefreshStealSources();
+    thief->steal_peers_ = {owner};
+    SetBusy(owner, true);
+  }
+
+  static void SetBusy(Scheduler *s, bool busy) {
+    s->load_ = busy ? Scheduler::kLoadScale : 0;
+  }
+
+  static bool TrySteal(Scheduler *s, Context *ctx) { return s->TrySteal(ctx); }
+
+  static int num_steal_leaves(const Scheduler *s) {
+    return s->num_steal_leaves_.load();
+  }
+
+  static bool TryAcquire(LeafTrafficClass *leaf) { return leaf->TryAcquire(); }
+
+  static void Release(LeafTrafficClass *leaf) { leaf->Release(); }
+
+  SchedulerOpts opts_;
+};
+
+// Tests that a thief runs the task of a busy owner, accounted for the leaf
+// and not in the tree of the owner, and releases it afterwards.
+TEST_F(WorkStealingTest, StealAndRelease) {
+  StealableModule sm;
+  DefaultScheduler owner(CT("leaf", {LEAF, new Task(&sm, nullptr)}));
+  DefaultScheduler thief(nullptr);
+  LeafTrafficClass *leaf = static_cast<LeafTrafficClass *>(owner.root());
+  Context ctx = {};
+
+  Pair(&thief, &owner);
+  ASSERT_TRUE(leaf->stealable());
+  ASSERT_EQ(1, num_steal_leaves(&owner));
+
+  sm.runs_left = 2;
+  EXPECT_TRUE(TrySteal(&thief, &ctx));
+  EXPECT_EQ(1, sm.runs_left);
+  EXPECT_EQ(1, leaf->cnt_stolen());
+  EXPECT_EQ(32, leaf->packets_stolen());
+  EXPECT_EQ(1, thief.stats().cnt_steal);
+  EXPECT_EQ(0, leaf->stats().usage[RESOURCE_COUNT]);
+
+  // Released, so that the owner and the thief can run it again.
+  ASSERT_TRUE(TryAcquire(leaf));
+  Release(leaf);
+  EXPECT_TRUE(TrySteal(&thief, &ctx));
+  EXPECT_EQ(0, sm.runs_left);
+  EXPECT_EQ(2, leaf->cnt_stolen());
+
+  // Not while someone else runs it.
+  ASSERT_TRUE(TryAcquire(leaf));
+  EXPECT_FALSE(TrySteal(&thief, &ctx));
+  Release(leaf);
+
+  // Nor if the owner is not busy.
+  SetBusy(&owner, false);
+  EXPECT_FALSE(TrySteal(&thief, &ctx));
+  EXPECT_EQ(2, leaf->cnt_stolen());
+}
+
+// Tests that revoking waits for a running thief, and holds the leaves until
+// they are published again.
+TEST_F(WorkStealingTest, Revoke) {
+  StealableModule sm;
+  DefaultScheduler owner(CT("leaf", {LEAF, new Task(&sm, nullptr)}));
+  DefaultScheduler thief(nullptr);
+  LeafTrafficClass *leaf = static_cast<LeafTrafficClass *>(owner.root());
+  Context ctx = {};
+
+  Pair(&thief, &owner);
+
+  // A thief in the middle of a run.
+  ASSERT_TRUE(TryAcquire(leaf));
+  std::atomic<bool> revoked(false);
+  std::thread t([&]() {
+    owner.RevokeStealSources();
+    revoked = true;
+  });
+  usleep(10000);
+  EXPECT_FALSE(revoked);
+  Release(leaf);
+  t.join();
+  EXPECT_TRUE(revoked);
+
+  EXPECT_EQ(0, num_steal_leaves(&owner));
+  EXPECT_FALSE(TryAcquire(leaf));
+  sm.runs_left = 1;
+  EXPECT_FALSE(TrySteal(&thief, &ctx));
+  EXPECT_EQ(1, sm.runs_left);
+
+  owner.RefreshStealSources();
+  SetBusy(&owner, true);
+  EXPECT_TRUE(TrySteal(&thief, &ctx));
+  EXPECT_EQ(0, sm.runs_left);
+}
+
+// Tests that tasks are not published for stealing if their pipeline may not
+// be run by more workers, or if they are under a rate limiter.
+TEST_F(WorkStealingTest, NotStealable) {
+  CountdownModule cm;  // max_allowed_workers_ is 1
+  StealableModule sm;
+  DefaultScheduler owner(CT(
+      "root", {ROUND_ROBIN},
+      {CT("leaf_1", {LEAF, new Task(&cm, nullptr)}),
+       CT("limit", {RATE_LIMIT, RESOURCE_COUNT, 1000000, 0},
+          {CT("leaf_2", {LEAF, new Task(&sm, nullptr)})})}));
+  DefaultScheduler thief(nullptr);
+  Context ctx = {};
+
+  Pair(&thief, &owner);
+  EXPECT_FALSE(
+      static_cast<LeafTrafficClass *>(TrafficClassBuilder::Find("leaf_1"))
+          ->stealable());
+  EXPECT_FALSE(
+      static_cast<LeafTrafficClass *>(TrafficClassBuilder::Find("leaf_2"))
+          ->stealable());
+  EXPECT_EQ(0, num_steal_leaves(&owner));
+
+  cm.runs_left = 1;
+  sm.runs_left = 1;
+  EXPECT_FALSE(TrySteal(&thief, &ctx));
+  EXPECT_EQ(1, cm.runs_left);
+  EXPECT_EQ(1, sm.runs_left);
+}
+
 }  // namespace bess
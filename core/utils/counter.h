@@ -0,0 +1,79 @@
+// Copyright (c) 2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_COUNTER_H_
+#define BESS_UTILS_COUNTER_H_
+
+#include <atomic>
+#include <cstdint>
+
+namespace bess {
+namespace utils {
+
+// A 64-bit counter that is updated by a single thread (e.g., a worker), but
+// may be read by any other thread at any time. Unlike std::atomic's
+// read-modify-write operations, updates do not need locked instructions;
+// on x86 they are as cheap as those of a plain uint64_t.
+class SingleWriterCounter {
+ public:
+  SingleWriterCounter() : v_(0) {}
+
+  // Must be called only by the writer thread.
+  SingleWriterCounter &operator+=(uint64_t x) {
+    v_.store(v_.load(std::memory_order_relaxed) + x,
+             std::memory_order_relaxed);
+    return *this;
+  }
+
+  // Must be called only by the writer thread.
+  SingleWriterCounter &operator++() { return *this += 1; }
+
+  // Raises the value to 'x' if it is smaller. Must be called only by the
+  // writer thread.
+  void UpdateMax(uint64_t x) {
+    if (x > v_.load(std::memory_order_relaxed)) {
+      v_.store(x, std::memory_order_relaxed);
+    }
+  }
+
+  // Must be called only by the writer thread, or while it is not running.
+  void Reset() { v_.store(0, std::memory_order_relaxed); }
+
+  uint64_t value() const { return v_.load(std::memory_order_relaxed); }
+
+  operator uint64_t() const { return value(); }
+
+ private:
+  std::atomic<uint64_t> v_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_COUNTER_H_
@@ -0,0 +1,254 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "io_uring.h"
+
+#ifdef BESS_HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace bess {
+namespace utils {
+
+int IoUring::Init(unsigned entries, bool sqpoll, unsigned sqpoll_idle_ms) {
+  io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  if (sqpoll) {
+    p.flags |= IORING_SETUP_SQPOLL;
+    p.sq_thread_idle = sqpoll_idle_ms;
+  }
+
+  fd_ = syscall(__NR_io_uring_setup, entries, &p);
+  if (fd_ < 0) {
+    fd_ = -1;
+    return -errno;
+  }
+  sqpoll_ = sqpoll;
+
+  sq_map_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_map_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    sq_map_size_ = cq_map_size_ = std::max(sq_map_size_, cq_map_size_);
+  }
+
+  sq_map_ = mmap(nullptr, sq_map_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sq_map_ == MAP_FAILED) {
+    sq_map_ = nullptr;
+    int ret = -errno;
+    Close();
+    return ret;
+  }
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_map_ = sq_map_;
+  } else {
+    cq_map_ = mmap(nullptr, cq_map_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_map_ == MAP_FAILED) {
+      cq_map_ = nullptr;
+      int ret = -errno;
+      Close();
+      return ret;
+    }
+  }
+
+  sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+  void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    int ret = -errno;
+    Close();
+    return ret;
+  }
+  sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+  char *sq = static_cast<char *>(sq_map_);
+  sq_head_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+  sq_flags_ = reinterpret_cast<unsigned *>(sq + p.sq_off.flags);
+  sq_mask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+  sq_entries_ = p.sq_entries;
+  sqe_tail_ = *sq_tail_;
+
+  // SQ slot i always holds SQE i
+  unsigned *array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+  for (unsigned i = 0; i < sq_entries_; i++) {
+    array[i] = i;
+  }
+
+  char *cq = static_cast<char *>(cq_map_);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+  cq_head_local_ = *cq_head_;
+  cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+
+  return 0;
+}
+
+void IoUring::Close() {
+  // Closing the ring cancels its pending requests
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+
+  if (buf_ring_) {
+    munmap(buf_ring_, buf_ring_size_);
+    buf_ring_ = nullptr;
+  }
+
+  if (sqes_) {
+    munmap(sqes_, sqes_size_);
+    sqes_ = nullptr;
+  }
+
+  if (cq_map_ && cq_map_ != sq_map_) {
+    munmap(cq_map_, cq_map_size_);
+  }
+  cq_map_ = nullptr;
+
+  if (sq_map_) {
+    munmap(sq_map_, sq_map_size_);
+    sq_map_ = nullptr;
+  }
+}
+
+int IoUring::Enter(unsigned to_submit, unsigned min_complete,
+                   unsigned flags) {
+  int ret = syscall(__NR_io_uring_enter, fd_, to_submit, min_complete, flags,
+                    nullptr, 0);
+  return ret < 0 ? -errno : ret;
+}
+
+io_uring_sqe *IoUring::GetSqe() {
+  // With SQPOLL, the kernel consumes SQEs asynchronously
+  unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  if (sqe_tail_ - head >= sq_entries_) {
+    return nullptr;
+  }
+
+  io_uring_sqe *sqe = &sqes_[sqe_tail_++ & sq_mask_];
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int IoUring::Submit() {
+  unsigned to_submit = sqe_tail_ - *sq_tail_;
+  __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+
+  if (!sqpoll_) {
+    // Including SQEs left over by an earlier submission that failed
+    to_submit = sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    return to_submit ? Enter(to_submit, 0, 0) : 0;
+  }
+
+  if (to_submit == 0) {
+    return 0;
+  }
+
+  // The SQ thread may have gone to sleep before it saw the new tail
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+    int ret = Enter(0, 0, IORING_ENTER_SQ_WAKEUP);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  return to_submit;
+}
+
+unsigned IoUring::PeekCqes(io_uring_cqe **cqes, unsigned max) {
+  unsigned avail =
+      __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) - cq_head_local_;
+
+  // CQEs that did not fit in the CQ are kept by the kernel, which flushes
+  // them on the next io_uring_enter().
+  if (avail == 0 &&
+      (__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)) {
+    Enter(0, 0, IORING_ENTER_GETEVENTS);
+    avail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) - cq_head_local_;
+  }
+
+  unsigned n = std::min(avail, max);
+  for (unsigned i = 0; i < n; i++) {
+    cqes[i] = &cqes_[(cq_head_local_ + i) & cq_mask_];
+  }
+  return n;
+}
+
+int IoUring::WaitCqe() {
+  while (__atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) == cq_head_local_) {
+    int ret = Enter(0, 1, IORING_ENTER_GETEVENTS);
+    if (ret < 0 && ret != -EINTR) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+int IoUring::SetUpBufRing(unsigned entries, uint16_t bgid) {
+  buf_ring_size_ = entries * sizeof(io_uring_buf);
+  void *ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (ring == MAP_FAILED) {
+    return -errno;
+  }
+
+  io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uintptr_t>(ring);
+  reg.ring_entries = entries;
+  reg.bgid = bgid;
+
+  if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PBUF_RING, &reg,
+              1) < 0) {
+    int ret = -errno;
+    munmap(ring, buf_ring_size_);
+    return ret;
+  }
+
+  buf_ring_ = static_cast<io_uring_buf *>(ring);
+  buf_mask_ = entries - 1;
+  buf_tail_ = 0;
+  return 0;
+}
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_HAVE_IO_URING
@@ -0,0 +1,173 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef BESS_UTILS_IO_URING_H_
+#define BESS_UTILS_IO_URING_H_
+
+// Multishot receive and provided buffer rings need Linux 6.0+ headers. The
+// class is left out of older builds; check BESS_HAVE_IO_URING.
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+#ifdef IORING_RECV_MULTISHOT
+#define BESS_HAVE_IO_URING 1
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bess {
+namespace utils {
+
+// A minimal io_uring instance, driven by raw system calls (no liburing).
+// Not thread-safe: only one thread may submit, and one thread may reap
+// completions at a time.
+//
+// The ring may have a ring of provided buffers, which requests with
+// IOSQE_BUFFER_SELECT pick their buffer from, e.g., multishot receives.
+class IoUring {
+ public:
+  IoUring()
+      : fd_(-1),
+        sqpoll_(),
+        sq_map_(),
+        sq_map_size_(),
+        cq_map_(),
+        cq_map_size_(),
+        sqes_(),
+        sqes_size_(),
+        sq_head_(),
+        sq_tail_(),
+        sq_flags_(),
+        sq_mask_(),
+        sq_entries_(),
+        sqe_tail_(),
+        cq_head_(),
+        cq_tail_(),
+        cq_mask_(),
+        cq_head_local_(),
+        cqes_(),
+        buf_ring_(),
+        buf_ring_size_(),
+        buf_mask_(),
+        buf_tail_() {}
+
+  ~IoUring() { Close(); }
+
+  // IoUring is neither copyable nor movable.
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  // Sets up a ring with at least 'entries' SQ entries (twice as many CQ
+  // entries). With 'sqpoll', a kernel thread polls the SQ, so that
+  // submissions need no system call while it is awake. Returns 0 or -errno.
+  int Init(unsigned entries, bool sqpoll, unsigned sqpoll_idle_ms = 0);
+
+  void Close();
+
+  int fd() const { return fd_; }
+
+  // Returns a zeroed SQE to fill in, or nullptr if the SQ is full
+  io_uring_sqe *GetSqe();
+
+  // Submits the SQEs gotten so far. Returns the number of SQEs submitted,
+  // or -errno. SQEs that failed to submit are retried by the next call.
+  int Submit();
+
+  // Stores pointers to up to 'max' completed CQEs in 'cqes', and returns
+  // their number. Never blocks. The CQEs stay valid until AdvanceCq().
+  unsigned PeekCqes(io_uring_cqe **cqes, unsigned max);
+
+  // Marks the 'n' oldest CQEs seen
+  void AdvanceCq(unsigned n) {
+    cq_head_local_ += n;
+    __atomic_store_n(cq_head_, cq_head_local_, __ATOMIC_RELEASE);
+  }
+
+  // Blocks until a CQE is available. Returns 0 or -errno.
+  int WaitCqe();
+
+  // Sets up a ring of 'entries' (a power of two) provided buffers, of group
+  // 'bgid'. Returns 0 or -errno.
+  int SetUpBufRing(unsigned entries, uint16_t bgid);
+
+  // Queues a buffer to the buffer ring. It is given to the kernel, along
+  // with the others queued before, by CommitBufs().
+  void AddBuf(void *addr, uint32_t len, uint16_t bid) {
+    io_uring_buf *buf = &buf_ring_[buf_tail_++ & buf_mask_];
+    buf->addr = reinterpret_cast<uintptr_t>(addr);
+    buf->len = len;
+    buf->bid = bid;
+  }
+
+  void CommitBufs() {
+    // The ring tail overlays the reserved field of the first entry
+    __atomic_store_n(&buf_ring_[0].resv, buf_tail_, __ATOMIC_RELEASE);
+  }
+
+ private:
+  int Enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+
+  int fd_;
+  bool sqpoll_;
+
+  void *sq_map_;
+  size_t sq_map_size_;
+  void *cq_map_;  // may be the same as sq_map_
+  size_t cq_map_size_;
+  io_uring_sqe *sqes_;
+  size_t sqes_size_;
+
+  unsigned *sq_head_;
+  unsigned *sq_tail_;
+  unsigned *sq_flags_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  unsigned sqe_tail_;  // SQEs gotten, not necessarily submitted yet
+
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned cq_mask_;
+  unsigned cq_head_local_;
+  io_uring_cqe *cqes_;
+
+  // Not io_uring_buf_ring, whose 'bufs' is misplaced when compiled as C++
+  io_uring_buf *buf_ring_;
+  size_t buf_ring_size_;
+  uint16_t buf_mask_;
+  uint16_t buf_tail_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // IORING_RECV_MULTISHOT
+
+#endif  // BESS_UTILS_IO_URING_H_
@@ -0,0 +1,183 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "io_uring.h"
+
+#include <gtest/gtest.h>
+
+#ifdef BESS_HAVE_IO_URING
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace bess {
+namespace utils {
+namespace {
+
+// io_uring may be unavailable (old kernels, or disabled by seccomp or
+// sysctl). The tests pass vacuously then.
+#define INIT_OR_RETURN(ring, ...)                          \
+  do {                                                     \
+    int ret = (ring).Init(__VA_ARGS__);                    \
+    if (ret == -ENOSYS || ret == -EPERM) {                 \
+      std::cerr << "io_uring unavailable, skipping test\n"; \
+      return;                                              \
+    }                                                      \
+    ASSERT_EQ(0, ret) << strerror(-ret);                   \
+  } while (0)
+
+void PrepNop(io_uring_sqe *sqe, uint64_t user_data) {
+  sqe->opcode = IORING_OP_NOP;
+  sqe->user_data = user_data;
+}
+
+TEST(IoUringTest, Nop) {
+  IoUring ring;
+  INIT_OR_RETURN(ring, 8, false);
+
+  for (int i = 0; i < 4; i++) {
+    io_uring_sqe *sqe = ring.GetSqe();
+    ASSERT_NE(nullptr, sqe);
+    PrepNop(sqe, 100 + i);
+  }
+  ASSERT_EQ(4, ring.Submit());
+
+  io_uring_cqe *cqes[8];
+  ASSERT_EQ(4, ring.PeekCqes(cqes, 8));
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(100 + i, cqes[i]->user_data);
+    EXPECT_EQ(0, cqes[i]->res);
+  }
+  ring.AdvanceCq(4);
+  EXPECT_EQ(0, ring.PeekCqes(cqes, 8));
+}
+
+TEST(IoUringTest, FullSq) {
+  IoUring ring;
+  INIT_OR_RETURN(ring, 4, false);
+
+  for (int i = 0; i < 4; i++) {
+    ASSERT_NE(nullptr, ring.GetSqe());
+  }
+  EXPECT_EQ(nullptr, ring.GetSqe());
+}
+
+TEST(IoUringTest, SqPoll) {
+  IoUring ring;
+  INIT_OR_RETURN(ring, 8, true, 10);
+
+  PrepNop(ring.GetSqe(), 42);
+  ASSERT_EQ(1, ring.Submit());
+  ASSERT_EQ(0, ring.WaitCqe());
+
+  io_uring_cqe *cqe;
+  ASSERT_EQ(1, ring.PeekCqes(&cqe, 1));
+  EXPECT_EQ(42, cqe->user_data);
+  ring.AdvanceCq(1);
+}
+
+TEST(IoUringTest, MultishotRecv) {
+  const int kNumBufs = 4;
+  const size_t kBufSize = 64;
+  const uint16_t kGroup = 7;
+
+  IoUring ring;
+  INIT_OR_RETURN(ring, 8, false);
+
+  int ret = ring.SetUpBufRing(kNumBufs, kGroup);
+  if (ret == -EINVAL) {
+    std::cerr << "Provided buffer rings unsupported, skipping test\n";
+    return;
+  }
+  ASSERT_EQ(0, ret) << strerror(-ret);
+
+  char bufs[kNumBufs][kBufSize];
+  for (int i = 0; i < kNumBufs; i++) {
+    ring.AddBuf(bufs[i], kBufSize, i);
+  }
+  ring.CommitBufs();
+
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds));
+
+  io_uring_sqe *sqe = ring.GetSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fds[0];
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kGroup;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->user_data = 1;
+  ASSERT_EQ(1, ring.Submit());
+
+  const char *msgs[] = {"hello", "io_uring", "world"};
+  for (const char *msg : msgs) {
+    ASSERT_EQ(strlen(msg), send(fds[1], msg, strlen(msg), 0));
+  }
+
+  // One CQE per message, each in a buffer of its own
+  int seen = 0;
+  while (seen < 3) {
+    ASSERT_EQ(0, ring.WaitCqe());
+
+    io_uring_cqe *cqes[8];
+    unsigned n = ring.PeekCqes(cqes, 8);
+    for (unsigned i = 0; i < n; i++, seen++) {
+      io_uring_cqe *cqe = cqes[i];
+      ASSERT_EQ(strlen(msgs[seen]), cqe->res);
+      ASSERT_TRUE(cqe->flags & IORING_CQE_F_BUFFER);
+      EXPECT_TRUE(cqe->flags & IORING_CQE_F_MORE);
+
+      int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      ASSERT_LT(bid, kNumBufs);
+      EXPECT_EQ(0, memcmp(msgs[seen], bufs[bid], cqe->res));
+    }
+    ring.AdvanceCq(n);
+  }
+
+  // The receive ends with the connection
+  close(fds[1]);
+  ASSERT_EQ(0, ring.WaitCqe());
+
+  io_uring_cqe *cqe;
+  ASSERT_EQ(1, ring.PeekCqes(&cqe, 1));
+  EXPECT_EQ(0, cqe->res);
+  EXPECT_FALSE(cqe->flags & IORING_CQE_F_MORE);
+  ring.AdvanceCq(1);
+
+  close(fds[0]);
+}
+
+}  // namespace
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_HAVE_IO_URING
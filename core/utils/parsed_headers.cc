@@ -0,0 +1,149 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "parsed_headers.h"
+
+#include "ether.h"
+#include "icmp.h"
+#include "ip.h"
+#include "tcp.h"
+#include "udp.h"
+
+namespace bess {
+namespace utils {
+
+// Fragment offset bits of Ipv4::fragment_offset, below the flags
+static const uint16_t kFragmentOffsetMask = 0x1fff;
+
+void ParseHeaders(const void *data, size_t len, ParsedHeaders *hdrs) {
+  const uint8_t *head = static_cast<const uint8_t *>(data);
+  size_t offset = sizeof(Ethernet);
+
+  *hdrs = {};
+  if (len < offset) {
+    hdrs->flags = ParsedHeaders::kTruncated;
+    return;
+  }
+
+  uint16_t ether_type =
+      reinterpret_cast<const Ethernet *>(head)->ether_type.value();
+
+  if (ether_type == Ethernet::Type::kQinQ) {
+    hdrs->flags |= ParsedHeaders::kVlan;
+    if (len < offset + sizeof(Vlan)) {
+      hdrs->flags |= ParsedHeaders::kTruncated;
+      return;
+    }
+    ether_type =
+        reinterpret_cast<const Vlan *>(head + offset)->ether_type.value();
+    offset += sizeof(Vlan);
+  }
+
+  if (ether_type == Ethernet::Type::kVlan) {
+    hdrs->flags |= ParsedHeaders::kVlan;
+    if (len < offset + sizeof(Vlan)) {
+      hdrs->flags |= ParsedHeaders::kTruncated;
+      return;
+    }
+    ether_type =
+        reinterpret_cast<const Vlan *>(head + offset)->ether_type.value();
+    offset += sizeof(Vlan);
+  }
+
+  hdrs->ether_type = ether_type;
+  hdrs->l3_offset = offset;
+  if (ether_type != Ethernet::Type::kIpv4) {
+    return;
+  }
+
+  if (len < offset + sizeof(Ipv4)) {
+    hdrs->flags |= ParsedHeaders::kTruncated;
+    return;
+  }
+
+  const Ipv4 *ip = reinterpret_cast<const Ipv4 *>(head + offset);
+  size_t ip_bytes = ip->header_length << 2;
+  if (len < offset + ip_bytes) {
+    hdrs->flags |= ParsedHeaders::kTruncated;
+    return;
+  }
+  if (ip_bytes < sizeof(Ipv4)) {
+    return;  // bogus header length
+  }
+
+  hdrs->flags |= ParsedHeaders::kIpv4;
+  hdrs->ip_proto = ip->protocol;
+  if (ip_bytes > sizeof(Ipv4)) {
+    hdrs->flags |= ParsedHeaders::kIpOptions;
+  }
+
+  uint16_t frag = ip->fragment_offset.value();
+  if (frag & (Ipv4::Flag::kMF | kFragmentOffsetMask)) {
+    hdrs->flags |= ParsedHeaders::kFragment;
+    if (frag & kFragmentOffsetMask) {
+      return;  // no L4 header in this fragment
+    }
+  }
+
+  offset += ip_bytes;
+  hdrs->l4_offset = offset;
+
+  size_t l4_bytes;
+  switch (ip->protocol) {
+    case Ipv4::Proto::kTcp:
+      l4_bytes = sizeof(Tcp);
+      if (len >= offset + l4_bytes) {
+        l4_bytes = reinterpret_cast<const Tcp *>(head + offset)->offset << 2;
+        if (l4_bytes < sizeof(Tcp)) {
+          return;  // bogus data offset
+        }
+      }
+      break;
+    case Ipv4::Proto::kUdp:
+      l4_bytes = sizeof(Udp);
+      break;
+    case Ipv4::Proto::kIcmp:
+      l4_bytes = sizeof(Icmp);
+      break;
+    default:
+      return;
+  }
+
+  if (len < offset + l4_bytes) {
+    hdrs->flags |= ParsedHeaders::kTruncated;
+    return;
+  }
+
+  hdrs->flags |= ParsedHeaders::kL4;
+  hdrs->payload_offset = offset + l4_bytes;
+}
+
+}  // namespace utils
+}  // namespace bess
@@ -0,0 +1,87 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef BESS_UTILS_PARSED_HEADERS_H_
+#define BESS_UTILS_PARSED_HEADERS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace bess {
+namespace utils {
+
+// Where the headers of a packet are, relative to its head_data(), as found by
+// ParseHeaders() in a single pass. Small enough to be carried along as the
+// "parsed_headers" metadata attribute (see the ParseHeaders module), so that
+// each downstream module does not have to walk the same headers again.
+struct ParsedHeaders {
+  enum Flag : uint8_t {
+    kIpv4 = 1 << 0,       // l3_offset points to an IPv4 header
+    kL4 = 1 << 1,         // l4_offset points to a header of type 'ip_proto'
+    kVlan = 1 << 2,       // 802.1Q tagged, possibly in an 802.1ad outer tag
+    kIpOptions = 1 << 3,  // IPv4 header is longer than 20 bytes
+    kFragment = 1 << 4,   // IPv4 fragment. kL4 only for the first one
+    kTruncated = 1 << 5,  // a header is cut short by the end of the data
+  };
+
+  bool has(Flag flag) const { return flags & flag; }
+
+  template <typename T>
+  T *l3(void *head) const {
+    return reinterpret_cast<T *>(static_cast<uint8_t *>(head) + l3_offset);
+  }
+
+  template <typename T>
+  T *l4(void *head) const {
+    return reinterpret_cast<T *>(static_cast<uint8_t *>(head) + l4_offset);
+  }
+
+  uint16_t ether_type;     // Innermost EtherType, in host order
+  uint8_t l3_offset;       // Past the Ethernet header and VLAN tags
+  uint8_t l4_offset;       // Past the IPv4 header. Valid with kL4
+  uint8_t payload_offset;  // Past the TCP/UDP header. Valid with kL4
+  uint8_t ip_proto;        // IPv4 protocol. Valid with kIpv4
+  uint8_t flags;           // Flag bits
+  uint8_t reserved;
+};
+
+static_assert(std::is_pod<ParsedHeaders>::value, "not a POD type");
+static_assert(sizeof(ParsedHeaders) == 8, "struct ParsedHeaders is incorrect");
+
+// Parses the Ethernet (with up to two VLAN tags), IPv4, and TCP/UDP/ICMP
+// headers of the 'len' bytes at 'data'. Other protocols are left unparsed,
+// with only the offsets found so far.
+void ParseHeaders(const void *data, size_t len, ParsedHeaders *hdrs);
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_PARSED_HEADERS_H_
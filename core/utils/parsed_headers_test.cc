@@ -0,0 +1,170 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "parsed_headers.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "ether.h"
+#include "ip.h"
+#include "tcp.h"
+#include "udp.h"
+
+namespace {
+
+using bess::utils::be16_t;
+using bess::utils::Ethernet;
+using bess::utils::Ipv4;
+using bess::utils::ParsedHeaders;
+using bess::utils::Tcp;
+using bess::utils::Udp;
+using bess::utils::Vlan;
+
+// Builds an Ethernet frame with 'num_tags' VLAN tags (an 802.1ad one first if
+// there are two), an IPv4 header with 'ip_opt_words' words of options, and an
+// L4 header of 'proto' followed by 'payload' bytes.
+std::vector<uint8_t> MakeFrame(int num_tags, int ip_opt_words, uint8_t proto,
+                               size_t payload = 10) {
+  std::vector<uint8_t> frame(sizeof(Ethernet) + num_tags * sizeof(Vlan) +
+                             sizeof(Ipv4) + ip_opt_words * 4 + sizeof(Tcp) +
+                             payload);
+  uint8_t *p = frame.data();
+
+  Ethernet *eth = reinterpret_cast<Ethernet *>(p);
+  if (num_tags == 2) {
+    eth->ether_type = be16_t(Ethernet::Type::kQinQ);
+  } else if (num_tags == 1) {
+    eth->ether_type = be16_t(Ethernet::Type::kVlan);
+  } else {
+    eth->ether_type = be16_t(Ethernet::Type::kIpv4);
+  }
+  p += sizeof(Ethernet);
+  for (int i = 0; i < num_tags; i++) {
+    Vlan *vlan = reinterpret_cast<Vlan *>(p);
+    vlan->ether_type = be16_t(i + 1 < num_tags ? Ethernet::Type::kVlan
+                                               : Ethernet::Type::kIpv4);
+    p += sizeof(Vlan);
+  }
+
+  Ipv4 *ip = reinterpret_cast<Ipv4 *>(p);
+  ip->version = 4;
+  ip->header_length = 5 + ip_opt_words;
+  ip->protocol = proto;
+  p += ip->header_length << 2;
+
+  if (proto == Ipv4::Proto::kTcp) {
+    reinterpret_cast<Tcp *>(p)->offset = 5;
+  }
+  return frame;
+}
+
+TEST(ParsedHeadersTest, Untagged) {
+  std::vector<uint8_t> frame = MakeFrame(0, 0, Ipv4::Proto::kUdp);
+  ParsedHeaders hdrs;
+  bess::utils::ParseHeaders(frame.data(), frame.size(), &hdrs);
+
+  EXPECT_EQ(Ethernet::Type::kIpv4, hdrs.ether_type);
+  EXPECT_EQ(ParsedHeaders::kIpv4 | ParsedHeaders::kL4, hdrs.flags);
+  EXPECT_EQ(Ipv4::Proto::kUdp, hdrs.ip_proto);
+  EXPECT_EQ(14, hdrs.l3_offset);
+  EXPECT_EQ(34, hdrs.l4_offset);
+  EXPECT_EQ(34 + sizeof(Udp), hdrs.payload_offset);
+}
+
+TEST(ParsedHeadersTest, VlanAndOptions) {
+  std::vector<uint8_t> frame = MakeFrame(2, 3, Ipv4::Proto::kTcp);
+  ParsedHeaders hdrs;
+  bess::utils::ParseHeaders(frame.data(), frame.size(), &hdrs);
+
+  EXPECT_TRUE(hdrs.has(ParsedHeaders::kVlan));
+  EXPECT_TRUE(hdrs.has(ParsedHeaders::kIpOptions));
+  EXPECT_TRUE(hdrs.has(ParsedHeaders::kL4));
+  EXPECT_FALSE(hdrs.has(ParsedHeaders::kTruncated));
+  EXPECT_EQ(22, hdrs.l3_offset);
+  EXPECT_EQ(22 + 32, hdrs.l4_offset);
+  EXPECT_EQ(22 + 32 + sizeof(Tcp), hdrs.payload_offset);
+  EXPECT_EQ(Ipv4::Proto::kTcp, hdrs.l3<Ipv4>(frame.data())->protocol);
+}
+
+TEST(ParsedHeadersTest, Fragment) {
+  std::vector<uint8_t> frame = MakeFrame(1, 0, Ipv4::Proto::kUdp);
+  Ipv4 *ip = reinterpret_cast<Ipv4 *>(frame.data() + 18);
+  ParsedHeaders hdrs;
+
+  ip->fragment_offset = be16_t(Ipv4::Flag::kMF);
+  bess::utils::ParseHeaders(frame.data(), frame.size(), &hdrs);
+  EXPECT_TRUE(hdrs.has(ParsedHeaders::kFragment));
+  EXPECT_TRUE(hdrs.has(ParsedHeaders::kL4));
+
+  ip->fragment_offset = be16_t(100);
+  bess::utils::ParseHeaders(frame.data(), frame.size(), &hdrs);
+  EXPECT_TRUE(hdrs.has(ParsedHeaders::kFragment));
+  EXPECT_FALSE(hdrs.has(ParsedHeaders::kL4));
+}
+
+TEST(ParsedHeadersTest, NonIp) {
+  std::vector<uint8_t> frame = MakeFrame(1, 0, Ipv4::Proto::kUdp);
+  reinterpret_cast<Vlan *>(frame.data() + 14)->ether_type =
+      be16_t(Ethernet::Type::kArp);
+  ParsedHeaders hdrs;
+  bess::utils::ParseHeaders(frame.data(), frame.size(), &hdrs);
+
+  EXPECT_EQ(Ethernet::Type::kArp, hdrs.ether_type);
+  EXPECT_EQ(ParsedHeaders::kVlan, hdrs.flags);
+  EXPECT_EQ(18, hdrs.l3_offset);
+}
+
+TEST(ParsedHeadersTest, Truncated) {
+  std::vector<uint8_t> frame = MakeFrame(0, 0, Ipv4::Proto::kTcp);
+  ParsedHeaders hdrs;
+
+  bess::utils::ParseHeaders(frame.data(), 40, &hdrs);
+  EXPECT_TRUE(hdrs.has(ParsedHeaders::kIpv4));
+  EXPECT_FALSE(hdrs.has(ParsedHeaders::kL4));
+  EXPECT_TRUE(hdrs.has(ParsedHeaders::kTruncated));
+
+  bess::utils::ParseHeaders(frame.data(), 20, &hdrs);
+  EXPECT_FALSE(hdrs.has(ParsedHeaders::kIpv4));
+  EXPECT_TRUE(hdrs.has(ParsedHeaders::kTruncated));
+
+  bess::utils::ParseHeaders(frame.data(), 10, &hdrs);
+  EXPECT_EQ(ParsedHeaders::kTruncated, hdrs.flags);
+
+  // Nothing past the end is read, not even the IPv4 header length.
+  std::vector<uint8_t> eth_only(frame.begin(),
+                                frame.begin() + sizeof(Ethernet));
+  bess::utils::ParseHeaders(eth_only.data(), eth_only.size(), &hdrs);
+  EXPECT_EQ(ParsedHeaders::kTruncated, hdrs.flags);
+  EXPECT_EQ(Ethernet::Type::kIpv4, hdrs.ether_type);
+}
+
+}  // namespace
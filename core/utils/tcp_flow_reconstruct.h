@@ -75,10 +75,10 @@ class TcpFlowReconstruct {
   // Returns true upon success.  Returns false if the given packet is not a SYN
   // but if we have not been given a SYN previously.
   //
-  // Behavior is undefined the packet is not a TCP packet.
-  bool InsertPacket(Packet *p) {
-    const Ethernet *eth = p->head_data<const Ethernet *>();
-    const Ipv4 *ip = (const Ipv4 *)(eth + 1);
+  // Behavior is undefined the packet is not a TCP packet. 'ip_offset' is
+  // where the IPv4 header starts, e.g., past VLAN tags.
+  bool InsertPacket(Packet *p, size_t ip_offset = sizeof(Ethernet)) {
+    const Ipv4 *ip = p->head_data<const Ipv4 *>(ip_offset);
     const Tcp *tcp =
         (const Tcp *)(((const char *)ip) + (ip->header_length * 4));
 
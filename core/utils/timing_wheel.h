@@ -0,0 +1,261 @@
+// Copyright (c) 2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_TIMING_WHEEL_H_
+#define BESS_UTILS_TIMING_WHEEL_H_
+
+#include <algorithm>
+#include <cstdint>
+
+#include <glog/logging.h>
+
+namespace bess {
+namespace utils {
+
+// Intrusive hook for elements of TimingWheel. Embed one in the element type.
+template <typename T>
+struct TimingWheelLink {
+  T *prev = nullptr;
+  T *next = nullptr;
+  uint64_t expiry = 0;
+  int slot = -1;  // Index into TimingWheel::heads_, -1 if not in a wheel.
+
+  bool linked() const { return slot >= 0; }
+};
+
+// Hierarchical timing wheel (a la Varghese & Lauck), keyed on 64-bit
+// timestamps such as TSC. Add(), Remove() and the expiration of each element
+// are O(1); advancing time over empty slots is skipped with per-level bitmaps.
+//
+// Time is quantized into ticks of 2^tick_shift units. Level 0 has one slot per
+// tick for the next 64 ticks, level 1 one slot per 64 ticks for the next 64^2
+// ticks, and so forth. Elements in upper levels cascade down as time passes.
+// Elements further than 64^kLevels ticks away are parked in the last slot and
+// cascaded again when it comes around.
+//
+// Expiration is exact: Expire(now) hands out precisely the elements whose
+// expiry is less than 'now', albeit not sorted within a tick.
+template <typename T, TimingWheelLink<T> T::*Link>
+class TimingWheel {
+ public:
+  static const int kSlotBits = 6;
+  static const int kSlots = 1 << kSlotBits;
+  static const uint64_t kSlotMask = kSlots - 1;
+  static const int kLevels = 6;
+
+  // 2^10 TSC cycles is ~0.4us at 2.5GHz, fine enough for rate limiting.
+  static const int kDefaultTickShift = 10;
+
+  explicit TimingWheel(int tick_shift = kDefaultTickShift)
+      : tick_shift_(tick_shift), now_tick_(), size_(), bitmaps_(), heads_() {}
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  // Adds 'item' to expire at 'expiry'. 'item' must not be in the wheel.
+  void Add(T *item, uint64_t expiry) {
+    DCHECK(!(item->*Link).linked());
+    (item->*Link).expiry = expiry;
+
+    if (size_ == 0) {
+      // Nothing to cascade, so we are free to fast forward.
+      now_tick_ = std::max(now_tick_, expiry >> tick_shift_);
+    }
+    Place(item);
+    size_++;
+  }
+
+  // Removes 'item' from the wheel. No-op if it is not in the wheel.
+  void Remove(T *item) {
+    if (!(item->*Link).linked()) {
+      return;
+    }
+    Unlink(item);
+    size_--;
+  }
+
+  // Returns the earliest expiry among the elements. The wheel must not be
+  // empty. Not O(1), but does not scan more than one slot per level.
+  uint64_t NextExpiry() const {
+    DCHECK(size_ > 0);
+
+    uint64_t ret = UINT64_MAX;
+    for (int level = 0; level < kLevels; level++) {
+      // Level 0 starts from the current slot, upper levels from the next one.
+      uint64_t pos = (now_tick_ >> (level * kSlotBits)) + (level ? 1 : 0);
+      uint64_t bits = RotateRight(bitmaps_[level], pos & kSlotMask);
+      if (!bits) {
+        continue;
+      }
+
+      int slot = level * kSlots + ((pos + __builtin_ctzll(bits)) & kSlotMask);
+      for (T *t = heads_[slot]; t; t = (t->*Link).next) {
+        ret = std::min(ret, (t->*Link).expiry);
+      }
+    }
+    return ret;
+  }
+
+  // Removes all elements whose expiry is less than 'now', calling func(item)
+  // for each. 'func' may Add() the expired item back, but must not Remove()
+  // other elements.
+  template <typename F>
+  void Expire(uint64_t now, F func) {
+    const uint64_t target_tick = now >> tick_shift_;
+
+    if (size_ == 0) {
+      now_tick_ = std::max(now_tick_, target_tick);
+      return;
+    }
+
+    while (now_tick_ < target_tick) {
+      // All elements in the current slot have expired.
+      int cur = now_tick_ & kSlotMask;
+      while (T *t = heads_[cur]) {
+        Unlink(t);
+        size_--;
+        func(t);
+      }
+
+      uint64_t next = std::min(target_tick, NextEventTick());
+      DCHECK(next > now_tick_);
+      now_tick_ = next;
+      Cascade();
+    }
+
+    // Some of the elements in the current tick may not have expired yet.
+    T *t = heads_[now_tick_ & kSlotMask];
+    while (t) {
+      T *next = (t->*Link).next;
+      if ((t->*Link).expiry < now) {
+        Unlink(t);
+        size_--;
+        func(t);
+      }
+      t = next;
+    }
+  }
+
+ private:
+  static uint64_t RotateRight(uint64_t bits, int n) {
+    return n ? (bits >> n) | (bits << (64 - n)) : bits;
+  }
+
+  // Returns the earliest tick after now_tick_ at which either a level 0 slot
+  // needs to be run or an upper level slot needs to be cascaded.
+  uint64_t NextEventTick() const {
+    uint64_t ret = UINT64_MAX;
+    for (int level = 0; level < kLevels; level++) {
+      const int shift = level * kSlotBits;
+      uint64_t pos = (now_tick_ >> shift) + 1;
+      uint64_t bits = RotateRight(bitmaps_[level], pos & kSlotMask);
+      if (bits) {
+        ret = std::min(ret, (pos + __builtin_ctzll(bits)) << shift);
+      }
+    }
+    return ret;
+  }
+
+  // Moves the elements of upper level slots that now_tick_ has just entered
+  // to lower levels.
+  void Cascade() {
+    for (int level = 1; level < kLevels; level++) {
+      const int shift = level * kSlotBits;
+      if (now_tick_ & ((1ull << shift) - 1)) {
+        break;
+      }
+
+      int slot = level * kSlots + ((now_tick_ >> shift) & kSlotMask);
+      while (T *t = heads_[slot]) {
+        Unlink(t);
+        Place(t);
+      }
+    }
+  }
+
+  void Place(T *item) {
+    TimingWheelLink<T> &link = item->*Link;
+    uint64_t tick = std::max(link.expiry >> tick_shift_, now_tick_);
+    uint64_t delta = tick - now_tick_;
+
+    int level = 0;
+    while (level < kLevels - 1 && delta >= (1ull << ((level + 1) * kSlotBits))) {
+      level++;
+    }
+    if (level == kLevels - 1) {
+      // Park too distant elements in the farthest slot.
+      const uint64_t max_delta = (1ull << (kLevels * kSlotBits)) - 1;
+      tick = now_tick_ + std::min(delta, max_delta);
+    }
+
+    int slot = level * kSlots + ((tick >> (level * kSlotBits)) & kSlotMask);
+
+    link.slot = slot;
+    link.prev = nullptr;
+    link.next = heads_[slot];
+    if (link.next) {
+      (link.next->*Link).prev = item;
+    }
+    heads_[slot] = item;
+    bitmaps_[level] |= 1ull << (slot & kSlotMask);
+  }
+
+  void Unlink(T *item) {
+    TimingWheelLink<T> &link = item->*Link;
+    int slot = link.slot;
+
+    if (link.prev) {
+      (link.prev->*Link).next = link.next;
+    } else {
+      heads_[slot] = link.next;
+      if (!link.next) {
+        bitmaps_[slot / kSlots] &= ~(1ull << (slot & kSlotMask));
+      }
+    }
+    if (link.next) {
+      (link.next->*Link).prev = link.prev;
+    }
+
+    link.prev = link.next = nullptr;
+    link.slot = -1;
+  }
+
+  const int tick_shift_;
+
+  uint64_t now_tick_;  // All ticks before this one have been expired.
+  size_t size_;
+
+  uint64_t bitmaps_[kLevels];  // Non-empty slots of each level
+  T *heads_[kLevels * kSlots];
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_TIMING_WHEEL_H_
@@ -0,0 +1,146 @@
+// Copyright (c) 2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "timing_wheel.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <vector>
+
+#include "random.h"
+
+namespace {
+
+struct Timer {
+  int id;
+  bess::utils::TimingWheelLink<Timer> link;
+};
+
+using Wheel = bess::utils::TimingWheel<Timer, &Timer::link>;
+
+// Tests that elements expire exactly when their time has passed.
+TEST(TimingWheelTest, ExpireExact) {
+  Wheel wheel(4);
+  Timer a = {1, {}}, b = {2, {}};
+  std::vector<int> expired;
+  auto f = [&](Timer *t) { expired.push_back(t->id); };
+
+  wheel.Expire(1000, f);
+  wheel.Add(&a, 1005);
+  wheel.Add(&b, 1003);
+  EXPECT_EQ(2, wheel.size());
+  EXPECT_EQ(1003, wheel.NextExpiry());
+
+  wheel.Expire(1003, f);
+  EXPECT_TRUE(expired.empty());
+
+  wheel.Expire(1004, f);
+  ASSERT_EQ(1, expired.size());
+  EXPECT_EQ(2, expired[0]);
+  EXPECT_FALSE(b.link.linked());
+  EXPECT_EQ(1005, wheel.NextExpiry());
+
+  wheel.Expire(100000, f);
+  ASSERT_EQ(2, expired.size());
+  EXPECT_EQ(1, expired[1]);
+  EXPECT_TRUE(wheel.empty());
+}
+
+// Tests that removed elements never expire.
+TEST(TimingWheelTest, Remove) {
+  Wheel wheel(4);
+  Timer a = {1, {}}, b = {2, {}};
+  int cnt = 0;
+
+  wheel.Expire(0, [](Timer *) {});
+  wheel.Add(&a, 10);
+  wheel.Add(&b, 1000000);
+  wheel.Remove(&a);
+  wheel.Remove(&a);
+  EXPECT_EQ(1, wheel.size());
+  EXPECT_EQ(1000000, wheel.NextExpiry());
+
+  wheel.Remove(&b);
+  wheel.Expire(UINT64_MAX, [&](Timer *) { cnt++; });
+  EXPECT_EQ(0, cnt);
+  EXPECT_TRUE(wheel.empty());
+}
+
+// Compares against std::multimap with random operations across all levels.
+TEST(TimingWheelTest, Random) {
+  const int kTimers = 2000;
+  Wheel wheel(2);
+  Random rd(1);
+  std::vector<Timer> timers(kTimers);
+  std::multimap<uint64_t, int> ref;
+  uint64_t now = 12345;
+
+  for (int i = 0; i < kTimers; i++) {
+    timers[i].id = i;
+  }
+  wheel.Expire(now, [](Timer *) {});
+
+  for (int round = 0; round < 20000; round++) {
+    Timer *t = &timers[rd.GetRange(kTimers)];
+    if (t->link.linked()) {
+      for (auto it = ref.begin(); it != ref.end(); ++it) {
+        if (it->second == t->id) {
+          ref.erase(it);
+          break;
+        }
+      }
+      wheel.Remove(t);
+    } else {
+      // Mostly short timeouts, some beyond the range of the wheel.
+      uint64_t delay = uint64_t{rd.GetRange(64)} << (rd.GetRange(8) * 6);
+      wheel.Add(t, now + delay);
+      ref.emplace(now + delay, t->id);
+    }
+    ASSERT_EQ(ref.size(), wheel.size());
+    if (!ref.empty()) {
+      ASSERT_EQ(ref.begin()->first, wheel.NextExpiry());
+    }
+
+    now += uint64_t{rd.GetRange(16)} << (rd.GetRange(6) * 5);
+    std::vector<int> expired;
+    wheel.Expire(now, [&](Timer *x) {
+      EXPECT_LT(x->link.expiry, now);
+      expired.push_back(x->id);
+    });
+    size_t num_expired = 0;
+    while (!ref.empty() && ref.begin()->first < now) {
+      ref.erase(ref.begin());
+      num_expired++;
+    }
+    ASSERT_EQ(num_expired, expired.size());
+  }
+}
+
+}  // namespace
@@ -58,6 +58,9 @@ using bess::DefaultScheduler;
 using bess::ExperimentalScheduler;
 using bess::Scheduler;
 
+static_assert(Worker::kMaxWorkers <= bess::PacketPool::kMaxWorkers,
+              "Not enough packet caches for all workers");
+
 int num_workers = 0;
 std::thread worker_threads[Worker::kMaxWorkers];
 Worker *volatile workers[Worker::kMaxWorkers];
@@ -71,6 +74,9 @@ std::list<std::pair<int, bess::TrafficClass *>> orphan_tcs;
 // See worker.h
 __thread Worker current_worker;
 
+volatile uint64_t Worker::global_epoch_;
+volatile bool Worker::hold_requested_;
+
 struct thread_arg {
   int wid;
   int core;
@@ -111,6 +117,9 @@ void pause_worker(int wid) {
 
     FULL_BARRIER();
 
+    // The worker may be sleeping in idle mode; make sure it notices.
+    workers[wid]->scheduler()->InterruptIdle();
+
     while (workers[wid]->status() == WORKER_PAUSING) {
     } /* spin */
   }
@@ -229,6 +238,46 @@ bool is_any_worker_running() {
   return false;
 }
 
+void synchronize_workers() {
+  uint64_t epoch = ++Worker::global_epoch_;
+
+  FULL_BARRIER();
+
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    Worker *w = workers[wid];
+    if (!w || w->quiescent_epoch() >= epoch) {
+      continue;
+    }
+
+    // The worker may be sleeping in idle mode; make sure it notices.
+    w->scheduler()->InterruptIdle();
+
+    // A paused worker is quiescent until it is resumed (by this thread).
+    while (w->status() != WORKER_PAUSED && w->quiescent_epoch() < epoch) {
+    } /* spin */
+  }
+}
+
+bool Worker::Hold() {
+  bool pause = false;
+
+  held_ = true;
+  while (hold_requested_) {
+    // pause_worker() waits for us to block, even while holding us.
+    if (is_pause_requested()) {
+      pause = true;
+      break;
+    }
+    // Grace periods may pass while we are held.
+    quiescent_epoch_ = global_epoch_;
+    __builtin_ia32_pause();
+  }
+  held_ = false;
+  INST_BARRIER();
+
+  return pause;
+}
+
 void Worker::SetNonWorker() {
   // These TLS variables should not be accessed by non-worker threads.
   // Assign INT_MIN to the variables so that the program can crash
@@ -254,6 +303,9 @@ int Worker::BlockWorker() {
   worker_signal t;
   int ret;
 
+  // Let others have the packets cached by this worker while it sleeps.
+  bess::PacketPool::FlushDefaultPoolCaches();
+
   status_ = WORKER_PAUSED;
 
   ret = read(fd_event_, &t, sizeof(t));
@@ -308,6 +360,7 @@ void *Worker::Run(void *_arg) {
 
   packet_pool_ = bess::PacketPool::GetDefaultPool(socket_);
   CHECK_NOTNULL(packet_pool_);
+  bess::PacketPool::SetCurrentWorker(wid_, socket_);
 
   status_ = WORKER_PAUSING;
 
@@ -322,6 +375,9 @@ void *Worker::Run(void *_arg) {
   CPU_ZERO(&set);
   scheduler_->ScheduleLoop();
 
+  bess::PacketPool::FlushDefaultPoolCaches();
+  bess::PacketPool::SetCurrentWorker(-1, -1);
+
   LOG(INFO) << "Worker " << wid_ << "(" << this << ") "
             << "is quitting... (core " << core_ << ", socket " << socket_
             << ")";
@@ -338,7 +394,8 @@ void *run_worker(void *_arg) {
 }
 
 void launch_worker(int wid, int core,
-                   [[maybe_unused]] const std::string &scheduler) {
+                   [[maybe_unused]] const std::string &scheduler,
+                   const bess::SchedulerOpts &opts) {
   struct thread_arg arg = {.wid = wid, .core = core, .scheduler = nullptr};
   if (scheduler == "") {
     arg.scheduler = new DefaultScheduler();
@@ -347,6 +404,7 @@ void launch_worker(int wid, int core,
   } else {
     CHECK(false) << "Scheduler " << scheduler << " is invalid.";
   }
+  arg.scheduler->set_opts(opts);
 
   worker_threads[wid] = std::thread(run_worker, &arg);
   worker_threads[wid].detach();
@@ -458,3 +516,38 @@ WorkerPauser::~WorkerPauser() {
     VLOG(1) << "*** Worker " << wid << " Resumed ***";
   }
 }
+
+int WorkerHolder::depth_;
+
+WorkerHolder::WorkerHolder() {
+  if (depth_++) {
+    return;
+  }
+
+  Worker::hold_requested_ = true;
+
+  FULL_BARRIER();
+
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    Worker *w = workers[wid];
+    if (!w) {
+      continue;
+    }
+
+    // The worker may be sleeping in idle mode; make sure it notices.
+    w->scheduler()->InterruptIdle();
+
+    while (w->status() != WORKER_PAUSED && !w->held()) {
+    } /* spin */
+  }
+}
+
+WorkerHolder::~WorkerHolder() {
+  if (--depth_) {
+    return;
+  }
+
+  // Workers must see everything done while they were held.
+  FULL_BARRIER();
+  Worker::hold_requested_ = false;
+}
@@ -68,6 +68,29 @@ typedef enum {
 namespace bess {
 class Scheduler;
 class PacketPool;
+
+// Per-worker scheduler options, given when the worker is launched.
+struct SchedulerOpts {
+  // If true, the worker sleeps instead of busy-polling while every traffic
+  // class of its scheduler is blocked. See Scheduler::IdleWait().
+  bool idle_sleep = false;
+
+  // Upper bound of a single idle sleep, in microseconds.
+  uint64_t idle_max_sleep_us = 1000;
+
+  // How long before a traffic class deadline the worker wakes up, busy-waiting
+  // the rest, to hide the OS wakeup latency. In microseconds.
+  uint64_t idle_wakeup_margin_us = 20;
+
+  // If true, blocked traffic classes are kept in a hierarchical timing wheel
+  // rather than a binary heap. Worth it with thousands of rate limiters.
+  bool wakeup_timing_wheel = false;
+
+  // If true, the worker runs migratable tasks of busy peers (that also have
+  // this option set) while it has little to do itself, and vice versa.
+  // See Scheduler::TrySteal().
+  bool work_stealing = false;
+};
 }  // namespace bess
 
 class Task;
@@ -93,6 +116,22 @@ class Worker {
   /* The entry point of worker threads */
   void *Run(void *_arg);
 
+  /* Called between task runs, where the worker holds no pointers to gates or
+   * other pipeline state. Reports that it has seen the current epoch.
+   * Returns true if the worker must pause right away (see Hold()). */
+  inline bool Quiesce() {
+    INST_BARRIER();
+    quiescent_epoch_ = global_epoch_;
+    if (unlikely(hold_requested_)) {
+      return Hold();
+    }
+    return false;
+  }
+
+  /* Spins in a quiescent state until no WorkerHolder is alive, or until a
+   * pause is requested, in which case it returns true. */
+  bool Hold();
+
   worker_status_t status() { return status_; }
   void set_status(worker_status_t status) { status_ = status; }
 
@@ -117,9 +156,24 @@ class Worker {
 
   Random *rand() const { return rand_; }
 
+  uint64_t quiescent_epoch() const { return quiescent_epoch_; }
+
+  // True while the worker is held in Quiesce().
+  bool held() const { return held_; }
+
+  // Advanced by synchronize_workers().
+  static volatile uint64_t global_epoch_;
+
+  // Set by WorkerHolder.
+  static volatile bool hold_requested_;
+
  private:
   volatile worker_status_t status_;
 
+  volatile uint64_t quiescent_epoch_;
+
+  volatile bool held_;
+
   int wid_;   // always [0, kMaxWorkers - 1]
   int core_;  // TODO: should be cpuset_t
   int socket_;
@@ -175,6 +229,12 @@ void destroy_all_workers();
 
 bool is_any_worker_running();
 
+// Waits until every running worker has finished the task runs that it was in
+// when this was called (a "grace period"). Pipeline state that was unlinked
+// before the call, e.g., a disconnected gate, can be freed afterwards. This
+// takes about one task run, without stopping the workers.
+void synchronize_workers();
+
 int is_cpu_present(unsigned int core_id);
 
 static inline int is_worker_active(int wid) {
@@ -186,8 +246,9 @@ inline bool is_worker_running(int wid) {
 }
 
 // arg (int) is the core id the worker should run on, and optionally the
-// scheduler to use.
-void launch_worker(int wid, int core, const std::string &scheduler = "");
+// scheduler to use and its options.
+void launch_worker(int wid, int core, const std::string &scheduler = "",
+                   const bess::SchedulerOpts &opts = bess::SchedulerOpts());
 
 Worker *get_next_active_worker();
 
@@ -224,4 +285,17 @@ class WorkerPauser {
   std::list<int> workers_paused_;
 };
 
+// Holds running workers between task runs for as long as it is alive, e.g.,
+// to change module state that workers read without synchronization. Unlike
+// WorkerPauser, workers keep their state and spin rather than block, and no
+// resume hooks are run, so it only takes about one task run. Can be nested.
+class WorkerHolder {
+ public:
+  explicit WorkerHolder();
+  ~WorkerHolder();
+
+ private:
+  static int depth_;
+};
+
 #endif  // BESS_WORKER_H_
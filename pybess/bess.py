@@ -478,6 +478,11 @@ class BESS(object):
         request.name = name
         return self._request('GetModuleInfo', request)
 
+    def get_drop_stats(self, reason=''):
+        request = bess_msg.GetDropStatsRequest()
+        request.reason = reason
+        return self._request('GetDropStats', request)
+
     def connect_modules(self, m1, m2, ogate=0, igate=0):
         request = bess_msg.ConnectModulesRequest()
         request.m1 = m1
@@ -492,6 +497,26 @@ class BESS(object):
         request.ogate = ogate
         return self._request('DisconnectModules', request)
 
+    def configure_module_profiling(self, enable, reset=False):
+        request = bess_msg.ConfigureModuleProfilingRequest()
+        request.enable = enable
+        request.reset = reset
+        return self._request('ConfigureModuleProfiling', request)
+
+    def get_pipeline_profile(self):
+        return self._request('GetPipelineProfile')
+
+    def propose_pipeline_partition(self, task, wids):
+        request = bess_msg.ProposePipelinePartitionRequest()
+        request.task = task
+        request.wids.extend(wids)
+        return self._request('ProposePipelinePartition', request)
+
+    def apply_pipeline_partition(self, cuts):
+        request = bess_msg.ApplyPipelinePartitionRequest()
+        request.cuts.extend(cuts)
+        return self._request('ApplyPipelinePartition', request)
+
     def run_module_command(self, name, cmd, arg_type, arg):
         request = bess_msg.CommandRequest()
         request.name = name
@@ -624,11 +649,18 @@ class BESS(object):
     def list_workers(self):
         return self._request('ListWorkers')
 
-    def add_worker(self, wid, core, scheduler=None):
+    def add_worker(self, wid, core, scheduler=None, idle_sleep=False,
+                   idle_max_sleep_us=0, idle_wakeup_margin_us=0,
+                   wakeup_timing_wheel=False, work_stealing=False):
         request = bess_msg.AddWorkerRequest()
         request.wid = wid
         request.core = core
         request.scheduler = scheduler or ''
+        request.idle_sleep = idle_sleep
+        request.idle_max_sleep_us = idle_max_sleep_us
+        request.idle_wakeup_margin_us = idle_wakeup_margin_us
+        request.wakeup_timing_wheel = wakeup_timing_wheel
+        request.work_stealing = work_stealing
         return self._request('AddWorker', request)
 
     def destroy_worker(self, wid):
@@ -636,6 +668,12 @@ class BESS(object):
         request.wid = wid
         return self._request('DestroyWorker', request)
 
+    def get_worker_stats(self, wids=None):
+        request = bess_msg.GetWorkerStatsRequest()
+        if wids is not None:
+            request.wids.extend(wids)
+        return self._request('GetWorkerStats', request)
+
     def list_tcs(self, wid=-1):
         request = bess_msg.ListTcsRequest()
         request.wid = wid
@@ -644,7 +682,8 @@ class BESS(object):
 
     def add_tc(self, name, policy, wid=-1, parent='', resource=None,
                priority=None, share=None, limit=None, max_burst=None,
-               leaf_module_name=None, leaf_module_taskid=None):
+               pacing_gap_ns=None, leaf_module_name=None,
+               leaf_module_taskid=None, deadline_ns=None):
         request = bess_msg.AddTcRequest()
         class_ = getattr(request, 'class')
         class_.parent = parent
@@ -658,6 +697,9 @@ class BESS(object):
         if share is not None:
             class_.share = share
 
+        if deadline_ns is not None:
+            class_.deadline_ns = deadline_ns
+
         if resource is not None:
             class_.resource = resource
 
@@ -668,6 +710,10 @@ class BESS(object):
         if max_burst:
             for k in max_burst:
                 class_.max_burst[k] = max_burst[k]
+
+        if pacing_gap_ns is not None:
+            class_.pacing_gap_ns = pacing_gap_ns
+
         if leaf_module_name is not None:
             class_.leaf_module_name = leaf_module_name
         if leaf_module_taskid is not None:
@@ -676,7 +722,9 @@ class BESS(object):
         return self._request('AddTc', request)
 
     def update_tc_params(self, name, resource=None, limit=None, max_burst=None,
-                         leaf_module_name=None, leaf_module_taskid=0):
+                         pacing_gap_ns=None, leaf_module_name=None,
+                         leaf_module_taskid=0, run_budget_cycles=None,
+                         run_budget_packets=None):
         request = bess_msg.UpdateTcParamsRequest()
         class_ = getattr(request, 'class')
         class_.name = name
@@ -691,6 +739,14 @@ class BESS(object):
             for k in max_burst:
                 class_.max_burst[k] = max_burst[k]
 
+        if pacing_gap_ns is not None:
+            class_.pacing_gap_ns = pacing_gap_ns
+
+        if run_budget_cycles is not None:
+            class_.run_budget_cycles = run_budget_cycles
+        if run_budget_packets is not None:
+            class_.run_budget_packets = run_budget_packets
+
         if leaf_module_name is not None:
             class_.leaf_module_name = leaf_module_name
         if leaf_module_taskid is not None:
@@ -711,7 +767,8 @@ class BESS(object):
     #   can be used to customize the child parameter.
     #
     def attach_task(self, module_name, parent='', wid=-1,
-                    module_taskid=0, priority=None, share=None):
+                    module_taskid=0, priority=None, share=None,
+                    deadline_ns=None):
         request = bess_msg.UpdateTcParentRequest()
         class_ = getattr(request, 'class')
         class_.leaf_module_name = module_name
@@ -725,6 +782,9 @@ class BESS(object):
         if share is not None:
             class_.share = share
 
+        if deadline_ns is not None:
+            class_.deadline_ns = deadline_ns
+
         return self._request('UpdateTcParent', request)
 
     # Deprecated alias for attach_task
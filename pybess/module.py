@@ -135,10 +135,10 @@ class Module(object):
     #   `wid`.  If `wid` has multiple roots they will be under a default
     #   round-robin policy.
     # * If `parent` is specified, the task is attached as a child of `parent`.
-    #   If `parent` is a priority or weighted_fair TC, `priority` or `share`
-    #   can be used to customize the child parameter.
+    #   If `parent` is a priority, weighted_fair or deadline TC, `priority`,
+    #   `share` or `deadline_ns` can be used to customize the child parameter.
     #
     def attach_task(self, parent='', wid=-1, module_taskid=0,
-                    priority=None, share=None):
+                    priority=None, share=None, deadline_ns=None):
         return self.bess.attach_task(self.name, parent, wid, module_taskid,
-                                     priority, share)
+                                     priority, share, deadline_ns)